@@ -68,7 +68,7 @@ void ConversationProxyModel::setContactGroup(QObject *o)
         return;
 
     if (m_contactGroup)
-        disconnect(m_contactGroup, SIGNAL(groupsChanged()), this, SLOT(reload()));
+        disconnect(m_contactGroup, SIGNAL(groupsChanged()), this, SLOT(contactGroupsChanged()));
 
     m_contactGroup = g;
     emit contactGroupChanged();
@@ -79,7 +79,7 @@ void ConversationProxyModel::setContactGroup(QObject *o)
     }
 
     if (m_contactGroup)
-        connect(m_contactGroup, SIGNAL(groupsChanged()), SLOT(reload()));
+        connect(m_contactGroup, SIGNAL(groupsChanged()), SLOT(contactGroupsChanged()));
 
     QTimer::singleShot(0, this, SLOT(reload()));
 }
@@ -114,21 +114,33 @@ void ConversationProxyModel::setResolveContacts(bool enabled)
     emit resolveContactsChanged();
 }
 
+QList<int> ConversationProxyModel::contactGroupIds() const
+{
+    QList<GroupObject*> groups = m_contactGroup->groups();
+    QList<int> groupIds;
+    groupIds.reserve(groups.size());
+
+    foreach (GroupObject *group, groups)
+        groupIds.append(group->id());
+
+    return groupIds;
+}
+
 void ConversationProxyModel::reload()
 {
     if (m_groupId >= 0) {
         getEvents(m_groupId);
     } else if (m_contactGroup) {
-        QList<GroupObject*> groups = m_contactGroup->groups();
-        QList<int> groupIds;
-        groupIds.reserve(groups.size());
-
-        foreach (GroupObject *group, groups)
-            groupIds.append(group->id());
-
-        getEvents(groupIds);
+        getEvents(contactGroupIds());
     } else {
         getEvents(QList<int>());
     }
 }
 
+void ConversationProxyModel::contactGroupsChanged()
+{
+    // Merge in or drop only the events of the groups that changed
+    if (m_contactGroup)
+        setGroups(contactGroupIds());
+}
+
@@ -65,6 +65,9 @@ public:
 public slots:
     void reload();
 
+private slots:
+    void contactGroupsChanged();
+
 signals:
     void contactGroupChanged();
     void groupIdChanged();
@@ -72,6 +75,8 @@ signals:
     void resolveContactsChanged();
 
 private:
+    QList<int> contactGroupIds() const;
+
     CommHistory::ContactGroup *m_contactGroup;
     int m_groupId;
     QSharedPointer<QThread> threadInstance;
@@ -14,6 +14,7 @@ BuildRequires:  pkgconfig(Qt5Test)
 BuildRequires:  pkgconfig(qtcontacts-sqlite-qt5-extensions) >= 0.3.0
 BuildRequires:  pkgconfig(contactcache-qt5) >= 0.3.0
 BuildRequires:  libphonenumber-devel
+BuildRequires:  pkgconfig(sqlite3)
 
 %{!?qtc_qmake5:%define qtc_qmake5 %qmake5}
 %{!?qtc_make:%define qtc_make make}
@@ -62,7 +63,7 @@ Documentation for libcommhistory
 
 %build
 unset LD_AS_NEEDED
-%qtc_qmake5 "PROJECT_VERSION=%{version}" "PKGCONFIG_LIB=%{_lib}"
+%qtc_qmake5 "PROJECT_VERSION=%{version}" "PKGCONFIG_LIB=%{_lib}" "CONFIG+=native_sqlite"
 %qtc_make %{?_smp_mflags}
 
 %install
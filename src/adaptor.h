@@ -53,6 +53,8 @@ Q_SIGNALS:
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
 
     void groupsDeleted(const QList<int> &groupIds);
+
+    void upgradeProgress(int percent);
 };
 
 }
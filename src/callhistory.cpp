@@ -20,70 +20,7 @@
 ******************************************************************************/
 
 #include "callhistory_p.h"
-#include "databaseio_p.h"
-#include "event.h"
-
-#include <QtDebug>
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QSqlDatabase>
-
-namespace {
-
-const QDateTime epoch(QDate(1970, 1, 1), QTime(0, 0), Qt::UTC);
-
-QString buildEventsQuery(CommHistory::CallEvent::CallType callType,
-                         const QDateTime &startTime,
-                         const QDateTime &endTime)
-{
-    qint64 startTimeSecs = (startTime.isValid() ? startTime : QDateTime::fromMSecsSinceEpoch(0)).toMSecsSinceEpoch() / 1000;
-    qint64 endTimeSecs = (endTime.isValid() ? endTime : QDateTime::currentDateTimeUtc()).toMSecsSinceEpoch() / 1000;
-
-    QStringList conditions;
-
-    conditions.append(QStringLiteral("startTime >= %1").arg(startTimeSecs));
-    conditions.append(QStringLiteral("startTime <= %1").arg(endTimeSecs));
-    conditions.append(QStringLiteral("type=%1").arg(CommHistory::Event::EventType::CallEvent));
-
-    switch (callType) {
-    case CommHistory::CallEvent::UnknownCallType:
-        break;
-    case CommHistory::CallEvent::ReceivedCallType:
-        conditions.append(QString::fromLatin1("direction=%1 AND isMissedCall=0").arg(CommHistory::Event::Inbound));
-        break;
-    case CommHistory::CallEvent::MissedCallType:
-        conditions.append(QString::fromLatin1("direction=%1 AND isMissedCall=1").arg(CommHistory::Event::Inbound));
-        break;
-    case CommHistory::CallEvent::DialedCallType:
-        conditions.append(QString::fromLatin1("direction=%1").arg(CommHistory::Event::Outbound));
-        break;
-    }
-
-    QString group;
-    static const QString groupTemplate = QStringLiteral(" GROUP BY strftime('%1', datetime(startTime, 'unixepoch'))");
-
-    QString q = "SELECT startTime, endTime, remoteUid from Events";
-    if (!conditions.isEmpty()) {
-        q += " WHERE " + conditions.join(" AND ");
-    }
-
-    return q + group;
-}
-
-QList<CommHistory::CallHistory::Result> readQueryResult(QSqlQuery *query)
-{
-    QList<CommHistory::CallHistory::Result> results;
-    while (query->next()) {
-        CommHistory::CallHistory::Result result;
-        result.when = QDateTime::fromMSecsSinceEpoch(query->value(0).toLongLong() * 1000).toUTC();
-        result.finish = QDateTime::fromMSecsSinceEpoch(query->value(1).toLongLong() * 1000).toUTC();
-        result.phoneNumber = query->value(2).toString();
-        results.append(result);
-    }
-    return results;
-}
-
-}
+#include "historyquery_p.h"
 
 namespace CommHistory {
 
@@ -148,22 +85,25 @@ bool CallHistory::reload()
 {
     d->results.clear();
 
-    if (d->startTime.isValid() && d->endTime.isValid() && d->endTime <= d->startTime) {
-        qWarning() << "Error: end time" << d->endTime.toString()
-                   << "is not after start time" << d->startTime.toString();
-        return false;
-    }
-
-    QString queryString = buildEventsQuery(d->callType, d->startTime, d->endTime);
+    HistoryQuery::Filter filter;
+    filter.startTime = d->startTime;
+    filter.endTime = d->endTime;
+    filter.eventType = Event::CallEvent;
+    filter.callType = d->callType;
 
-    QSqlQuery query = DatabaseIOPrivate::prepareQuery(queryString);
-    if (!query.exec()) {
-        qWarning() << "Failed to execute query:" << query.lastQuery();
-        qWarning() << "Error was:" << query.lastError();
+    HistoryQuery history(filter);
+    QVector<HistoryQuery::Row> rows;
+    if (!history.isValid() || !history.events(rows))
         return false;
-    }
 
-    d->results = readQueryResult(&query);
+    d->results.reserve(rows.size());
+    foreach (const HistoryQuery::Row &row, rows) {
+        Result result;
+        result.when = QDateTime::fromMSecsSinceEpoch(row.startTime * 1000, Qt::UTC);
+        result.finish = QDateTime::fromMSecsSinceEpoch(row.endTime * 1000, Qt::UTC);
+        result.phoneNumber = row.remoteUid;
+        d->results.append(result);
+    }
     return true;
 }
 
@@ -32,6 +32,7 @@
 #include "callmodel.h"
 #include "event.h"
 #include "commonutils.h"
+#include "updatesemitter.h"
 #include "debug.h"
 
 namespace {
@@ -81,6 +82,10 @@ public:
     void eventsUpdatedSlot(const QList<Event> &events);
     QModelIndex findEvent(int id) const;
     void deleteFromModel(int id);
+    bool reload();
+    QString shareKey() const;
+    void adoptState(EventModelPrivate &source);
+    QStringList eventPaths() const;
 
     virtual void recipientsUpdated(const QSet<Recipient> &recipients, bool resolved = false);
 
@@ -94,7 +99,7 @@ public:
     QString filterLocalUid;
     bool hasBeenFetched;
     QSet<QString> countedUids;
-    QSet<QString> updatedGroups;
+    QSet<CallGroupKey> updatedGroups;
 };
 
 CallModelPrivate::CallModelPrivate(EventModel *model)
@@ -105,6 +110,41 @@ CallModelPrivate::CallModelPrivate(EventModel *model)
         , hasBeenFetched(false)
 {
     propertyMask -= unusedProperties;
+    // The base class followed the signals for all events
+    updateEventSubscription();
+}
+
+bool CallModelPrivate::reload()
+{
+    Q_Q(CallModel);
+
+    return !hasBeenFetched || q->getEvents();
+}
+
+QString CallModelPrivate::shareKey() const
+{
+    QStringList key;
+    key << baseShareKey()
+        << QString::number(sortBy)
+        << QString::number(eventType)
+        << QString::number(referenceTime)
+        << filterLocalUid;
+    return key.join(QLatin1Char(':'));
+}
+
+void CallModelPrivate::adoptState(EventModelPrivate &source)
+{
+    EventModelPrivate::adoptState(source);
+
+    // Groups being refreshed in the primary are refreshed for all models
+    CallModelPrivate &callSource = static_cast<CallModelPrivate &>(source);
+    countedUids = callSource.countedUids;
+    updatedGroups = callSource.updatedGroups;
+}
+
+QStringList CallModelPrivate::eventPaths() const
+{
+    return QStringList() << UpdatesEmitter::typeEventsPath(Event::CallEvent);
 }
 
 bool CallModelPrivate::eventMatchesFilter(const Event &event) const
@@ -157,7 +197,7 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
 
     if ((sortBy != CallModel::SortByContact && sortBy != CallModel::SortByContactAndType)
             || updatedGroups.isEmpty())
-        return EventModelPrivate::eventsReceivedSlot(start, end, events);
+        return EventModelPrivate::eventsReceivedSlot(start, end, std::move(events));
 
     // reimp from EventModelPrivate, for video calls
 
@@ -177,7 +217,7 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
                 replaced = true;
                 eventRootItem->child(row)->setEvent(event);
                 emitDataChanged(row, eventRootItem->child(row));
-                updatedGroups.remove(DatabaseIOPrivate::makeCallGroupURI(event));
+                updatedGroups.remove(CallGroupKey(event));
 
                 // if we had an audio and video call group for the same
                 // contact and the latest audio call gets upgraded (or
@@ -205,19 +245,19 @@ void CallModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory:
             }
 
             q->beginInsertRows(QModelIndex(), row, row);
-            eventRootItem->insertChildAt(row, new EventTreeItem(event, eventRootItem));
+            eventRootItem->insertChildAt(row, newItem(event, eventRootItem));
             q->endInsertRows();
 
-            updatedGroups.remove(DatabaseIOPrivate::makeCallGroupURI(event));
+            updatedGroups.remove(CallGroupKey(event));
         }
     }
 
     if (!updatedGroups.isEmpty()) {
         DEBUG() << Q_FUNC_INFO << "remaining call groups:" << updatedGroups;
         // no results for call group means it has been emptied, remove from list
-        foreach (QString group, updatedGroups.values()) {
+        foreach (const CallGroupKey &group, updatedGroups) {
             for (int row = 0; row < eventRootItem->childCount(); row++) {
-                if (DatabaseIOPrivate::makeCallGroupURI(eventRootItem->eventAt(row)) == group) {
+                if (CallGroupKey(eventRootItem->eventAt(row)) == group) {
                     DEBUG() << Q_FUNC_INFO << "remove" << row << eventRootItem->eventAt(row).toString();
                     emit q->beginRemoveRows(QModelIndex(), row, row);
                     eventRootItem->removeAt(row);
@@ -303,7 +343,7 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
 
     //for flat mode EventModelPrivate::fillModel is sufficient as all the events will be stored at the top level
     if (!isInTreeMode) {
-        return EventModelPrivate::fillModel(start, end, events, resolved);
+        return EventModelPrivate::fillModel(start, end, std::move(events), resolved);
     }
 
     if (events.count() > 0) {
@@ -356,13 +396,12 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
             {
                 QList<EventTreeItem *> topLevelItems;
                 // get the first event and save it as top level item
-                Event event = events.first();
-                EventTreeItem *parent = new EventTreeItem(event);
+                EventTreeItem *parent = newItem(events.first());
                 topLevelItems.append(parent);
-                parent->appendChild(new EventTreeItem(event, parent));
+                parent->appendChild(newItem(std::move(events.first()), parent));
 
                 for (int i = 1; i < events.count(); i++) {
-                    const Event &event = events.at(i);
+                    Event &event(events[i]);
 
                     int j = 0;
                     for (; j < topLevelItems.count(); ++j) {
@@ -371,14 +410,14 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                         // ignore matching events because the already existing
                         // entry has to be more recent
                         if (belongToSameGroup(topLevelItem->event(), event)) {
-                            topLevelItem->appendChild(new EventTreeItem(event, topLevelItem));
+                            topLevelItem->appendChild(newItem(std::move(event), topLevelItem));
                             break;
                         }
                     }
                     if (j == topLevelItems.count()) {
-                        parent = new EventTreeItem(event);
+                        parent = newItem(event);
                         topLevelItems.append(parent);
-                        parent->appendChild(new EventTreeItem(event, parent));
+                        parent->appendChild(newItem(std::move(event), parent));
                     }
                 }
 
@@ -416,11 +455,12 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
 
                 QList<EventTreeItem *> newItems;
 
-                foreach (Event event, events) {
+                for (int i = 0; i < events.size(); i++) {
+                    Event &event(events[i]);
                     if (last && last->event().eventCount() == -1
                         && belongToSameGroup(event, last->event())) {
                         // still filling last row with matching events
-                        last->appendChild(new EventTreeItem(event, last));
+                        last->appendChild(newItem(std::move(event), last));
                     } else {
                         // no match to previous event -> update count
                         // for last row and add a new row if event is
@@ -435,14 +475,15 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                             if (last != previousLastItem && eventMatchesFilter(last->event())) {
                                 newItems.append(last);
                             } else if (last != previousLastItem) {
-                                delete last;
+                                EventTreeItem::destroy(last);
                                 last = 0;
                             }
                         }
 
+                        // The event is not shared yet, so this does not detach
                         event.setEventCount(-1);
-                        last = new EventTreeItem(event);
-                        last->appendChild(new EventTreeItem(event, last));
+                        last = newItem(event);
+                        last->appendChild(newItem(std::move(event), last));
                     }
                 }
 
@@ -454,7 +495,7 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                     }
                     newItems.append(last);
                 } else if (last != previousLastItem) {
-                    delete last;
+                    EventTreeItem::destroy(last);
                 }
 
                 // update count for last item in the previous batch
@@ -484,12 +525,13 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
 void CallModelPrivate::prependEvents(QList<Event> events, bool resolved)
 {
     if (!isInTreeMode) {
-        EventModelPrivate::prependEvents(events, resolved);
+        EventModelPrivate::prependEvents(std::move(events), resolved);
         return;
     }
 
-    foreach (const Event &event, events)
-        insertEvent(event);
+    // Events are in row order, each one inserted goes to the top
+    for (int i = events.size() - 1; i >= 0; i--)
+        insertEvent(events.at(i));
 }
 
 void CallModelPrivate::insertEvent(Event event)
@@ -517,7 +559,7 @@ void CallModelPrivate::insertEvent(Event event)
                 const bool increaseEventCount(matchingItem->event().direction() == event.direction() &&
                                               matchingItem->event().isMissedCall() == event.isMissedCall());
 
-                matchingItem->prependChild(new EventTreeItem(event, matchingItem));
+                matchingItem->prependChild(newItem(event, matchingItem));
                 matchingItem->setEvent(event);
                 matchingItem->event().setEventCount(increaseEventCount ? groupEventCount + 1 : 1);
 
@@ -535,8 +577,8 @@ void CallModelPrivate::insertEvent(Event event)
                 emit q->beginInsertRows(QModelIndex(), 0, 0);
                 event.setEventCount(1);
 
-                EventTreeItem *newParent = new EventTreeItem(event);
-                newParent->appendChild(new EventTreeItem(event, newParent));
+                EventTreeItem *newParent = newItem(event);
+                newParent->appendChild(newItem(event, newParent));
                 eventRootItem->prependChild(newParent);
 
                 emit q->endInsertRows();
@@ -549,7 +591,7 @@ void CallModelPrivate::insertEvent(Event event)
             if (!eventMatchesFilter(event) && eventRootItem->childCount()) {
                 EventTreeItem *topItem = eventRootItem->child(0);
                 if (event.recipients().matches(topItem->event().recipients())) {
-                    EventTreeItem *newTopItem = new EventTreeItem(topItem->event());
+                    EventTreeItem *newTopItem = newItem(topItem->event());
                     newTopItem->event().setEventCount(1);
 
                     eventRootItem->removeAt(0);
@@ -571,7 +613,7 @@ void CallModelPrivate::insertEvent(Event event)
                 // alias
                 EventTreeItem *firstTopLevelItem = eventRootItem->child(0);
                 // add event to the group, set it as top level item and refresh event count
-                firstTopLevelItem->prependChild(new EventTreeItem(event, firstTopLevelItem));
+                firstTopLevelItem->prependChild(newItem(event, firstTopLevelItem));
                 firstTopLevelItem->setEvent(event);
                 firstTopLevelItem->event().setEventCount(calculateEventCount(firstTopLevelItem));
                 // only counter and timestamp of first must be updated
@@ -580,11 +622,11 @@ void CallModelPrivate::insertEvent(Event event)
                 // a new row must be inserted
                 q->beginInsertRows(QModelIndex(), 0, 0);
                 // add new item as first on the list
-                eventRootItem->prependChild(new EventTreeItem(event));
+                eventRootItem->prependChild(newItem(event));
                 // alias
                 EventTreeItem *firstTopLevelItem = eventRootItem->child(0);
                 // add the copy of the event to its local list and refresh event count
-                firstTopLevelItem->prependChild(new EventTreeItem(event, firstTopLevelItem));
+                firstTopLevelItem->prependChild(newItem(event, firstTopLevelItem));
                 firstTopLevelItem->event().setEventCount(calculateEventCount(firstTopLevelItem));
                 q->endInsertRows();
             }
@@ -620,7 +662,7 @@ void CallModelPrivate::eventsUpdatedSlot(const QList<Event> &events)
 
         if (!index.isValid()) {
             if (acceptsEvent(e))
-                additions.append(e);
+                additions.prepend(e);
 
             continue;
         }
@@ -632,8 +674,8 @@ void CallModelPrivate::eventsUpdatedSlot(const QList<Event> &events)
                 // Video call status up/downgraded; refetch both video-
                 // and non-video-versions for the call group and process
                 // the results in eventsReceived
-                updatedGroups.insert(DatabaseIOPrivate::makeCallGroupURI(oldEvent));
-                updatedGroups.insert(DatabaseIOPrivate::makeCallGroupURI(event));
+                updatedGroups.insert(CallGroupKey(oldEvent));
+                updatedGroups.insert(CallGroupKey(event));
             } else {
                 modifyInModel(e);
             }
@@ -718,7 +760,7 @@ void CallModelPrivate::deleteFromModel(int id)
 
             if (belongToSameGroup(prev->event(), next->event())) {
                 for (int i = 0; i < next->childCount(); i++) {
-                    prev->appendChild(new EventTreeItem(next->child(i)->event()));
+                    prev->appendChild(newItem(next->child(i)->event()));
                 }
                 prev->event().setEventCount(calculateEventCount(prev));
                 isRegroupingNeeded = true;
@@ -878,8 +920,8 @@ void CallModelPrivate::recipientsUpdated(const QSet<Recipient> &recipients, bool
                 // No match found
                 emit q->beginInsertRows(QModelIndex(), positionRow, positionRow);
 
-                EventTreeItem *newParent = new EventTreeItem(event);
-                newParent->appendChild(new EventTreeItem(event, newParent));
+                EventTreeItem *newParent = newItem(event);
+                newParent->appendChild(newItem(event, newParent));
                 newParent->event().setEventCount(1);
                 eventRootItem->insertChildAt(positionRow, newParent);
 
@@ -897,7 +939,7 @@ void CallModelPrivate::recipientsUpdated(const QSet<Recipient> &recipients, bool
                         break;
                 }
 
-                matchingItem->insertChildAt(newChildIndex, new EventTreeItem(event, matchingItem));
+                matchingItem->insertChildAt(newChildIndex, newItem(event, matchingItem));
                 if (newChildIndex == 0)
                     matchingItem->setEvent(event);
                 matchingItem->event().setEventCount(increaseEventCount ? groupEventCount + 1 : 1);
@@ -1017,6 +1059,9 @@ bool CallModel::getEvents()
     d->countedUids.clear();
     d->updatedGroups.clear();
 
+    if (d->attachShared())
+        return true;
+
     QString q = DatabaseIOPrivate::eventQueryBase();
     q += QString::fromLatin1("WHERE type=%1 ").arg(Event::CallEvent);
 
@@ -1174,7 +1219,7 @@ bool CallModel::deleteEvent(int id)
             d->deleteFromModel(id);
             // signal delete in case someone else needs to know it
             foreach (const Event &e, deletedEvents)
-                emit d->eventDeleted(e.id());
+                d->emitEventDeleted(e);
             emit d->eventsCommitted(deletedEvents, true);
 
             return true;
@@ -22,6 +22,7 @@
 
 #include "commhistorydatabase.h"
 #include "commhistorydatabasepath.h"
+#include "event.h"
 #include <QDir>
 #include <QFile>
 #include <QSqlError>
@@ -44,6 +45,141 @@ static const char *db_setup[] = {
 };
 static int db_setup_count = sizeof(db_setup) / sizeof(*db_setup);
 
+// Event::CallEvent, for the statements below
+#define CALL_EVENT_TYPE "3"
+Q_STATIC_ASSERT_X(CommHistory::Event::CallEvent == 3, "CALL_EVENT_TYPE must match Event::CallEvent");
+
+// Per recipient, day, type and direction activity, kept up to date by
+// triggers for ContactStatistics. Drafts are not counted. Events not yet
+// covered by the contact_activity backfill are left to it.
+#define CONTACT_ACTIVITY_KEY(row) \
+    "localUid = IFNULL(" row ".localUid, '') AND remoteUid = IFNULL(" row ".remoteUid, '') " \
+    "AND day = IFNULL(" row ".startTime, 0) / 86400 AND type = " row ".type AND direction = " row ".direction"
+#define CONTACT_ACTIVITY_DURATION(row) \
+    "(CASE WHEN " row ".type = " CALL_EVENT_TYPE " THEN MAX(IFNULL(" row ".endTime, 0) - IFNULL(" row ".startTime, 0), 0) ELSE 0 END)"
+#define CONTACT_ACTIVITY_COUNTED(row) \
+    "(SELECT " row ".id <= watermark OR " row ".id > target FROM Migrations WHERE name = 'contact_activity')"
+#define CONTACT_ACTIVITY_ADD(row) \
+    "INSERT OR IGNORE INTO ContactActivity (localUid, remoteUid, day, type, direction) " \
+    "  SELECT IFNULL(" row ".localUid, ''), IFNULL(" row ".remoteUid, ''), IFNULL(" row ".startTime, 0) / 86400, " \
+    "    " row ".type, " row ".direction WHERE IFNULL(" row ".isDraft, 0) = 0; " \
+    "UPDATE ContactActivity SET eventCount = eventCount + 1, " \
+    "  missedCount = missedCount + (IFNULL(" row ".isMissedCall, 0) != 0), " \
+    "  duration = duration + " CONTACT_ACTIVITY_DURATION(row) " " \
+    "  WHERE IFNULL(" row ".isDraft, 0) = 0 AND " CONTACT_ACTIVITY_KEY(row) "; "
+#define CONTACT_ACTIVITY_REMOVE(row) \
+    "UPDATE ContactActivity SET eventCount = eventCount - 1, " \
+    "  missedCount = missedCount - (IFNULL(" row ".isMissedCall, 0) != 0), " \
+    "  duration = duration - " CONTACT_ACTIVITY_DURATION(row) " " \
+    "  WHERE IFNULL(" row ".isDraft, 0) = 0 AND " CONTACT_ACTIVITY_KEY(row) "; " \
+    "DELETE FROM ContactActivity WHERE eventCount <= 0 AND " CONTACT_ACTIVITY_KEY(row) "; "
+
+#define CONTACT_ACTIVITY_TABLE \
+    "CREATE TABLE ContactActivity ( " \
+    "  localUid TEXT, " \
+    "  remoteUid TEXT, " \
+    "  day INTEGER, " \
+    "  type INTEGER, " \
+    "  direction INTEGER, " \
+    "  eventCount INTEGER DEFAULT 0, " \
+    "  missedCount INTEGER DEFAULT 0, " \
+    "  duration INTEGER DEFAULT 0, " \
+    "  PRIMARY KEY (localUid, remoteUid, day, type, direction) " \
+    ")"
+// Modified properties are written even when their value is unchanged, the
+// update trigger skips those
+#define CONTACT_ACTIVITY_TRIGGERS \
+    "CREATE TRIGGER contact_activity_insert AFTER INSERT ON Events " \
+    "  WHEN " CONTACT_ACTIVITY_COUNTED("NEW") " " \
+    "  BEGIN " CONTACT_ACTIVITY_ADD("NEW") " END", \
+    "CREATE TRIGGER contact_activity_update AFTER UPDATE OF type, startTime, endTime, direction, " \
+    "    isDraft, isMissedCall, localUid, remoteUid ON Events " \
+    "  WHEN " CONTACT_ACTIVITY_COUNTED("NEW") " AND (OLD.type IS NOT NEW.type " \
+    "    OR OLD.startTime IS NOT NEW.startTime OR OLD.endTime IS NOT NEW.endTime " \
+    "    OR OLD.direction IS NOT NEW.direction OR OLD.isDraft IS NOT NEW.isDraft " \
+    "    OR OLD.isMissedCall IS NOT NEW.isMissedCall OR OLD.localUid IS NOT NEW.localUid " \
+    "    OR OLD.remoteUid IS NOT NEW.remoteUid) " \
+    "  BEGIN " CONTACT_ACTIVITY_REMOVE("OLD") CONTACT_ACTIVITY_ADD("NEW") " END", \
+    "CREATE TRIGGER contact_activity_delete AFTER DELETE ON Events " \
+    "  WHEN " CONTACT_ACTIVITY_COUNTED("OLD") " " \
+    "  BEGIN " CONTACT_ACTIVITY_REMOVE("OLD") " END"
+
+// Journal of changed event and group ids for clients catching up on
+// missed signals, see DatabaseIO::changesSince(). Target is 0 for events
+// and 1 for groups, operation 0 for inserts, 1 for updates and 2 for
+// deletes. Only the last 9000 to 10000 entries are kept.
+#define CHANGE_JOURNAL_ADD(target, row, groupId, operation) \
+    "INSERT INTO ChangeJournal (target, id, groupId, operation) " \
+    "  VALUES (" target ", " row ".id, " row "." groupId ", " operation "); "
+
+#define CHANGE_JOURNAL_TABLE \
+    "CREATE TABLE ChangeJournal ( " \
+    "  seq INTEGER PRIMARY KEY AUTOINCREMENT, " \
+    "  target INTEGER, " \
+    "  id INTEGER, " \
+    "  groupId INTEGER, " \
+    "  operation INTEGER " \
+    ")"
+// Updates that leave every column as it was are not journaled. Unused
+// columns are not compared.
+#define CHANGE_JOURNAL_TRIGGERS \
+    "CREATE TRIGGER change_journal_events_insert AFTER INSERT ON Events " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("0", "NEW", "groupId", "0") " END", \
+    "CREATE TRIGGER change_journal_events_update AFTER UPDATE ON Events " \
+    "  WHEN OLD.type IS NOT NEW.type OR OLD.startTime IS NOT NEW.startTime " \
+    "    OR OLD.endTime IS NOT NEW.endTime OR OLD.direction IS NOT NEW.direction " \
+    "    OR OLD.isDraft IS NOT NEW.isDraft OR OLD.isRead IS NOT NEW.isRead " \
+    "    OR OLD.isMissedCall IS NOT NEW.isMissedCall OR OLD.isEmergencyCall IS NOT NEW.isEmergencyCall " \
+    "    OR OLD.status IS NOT NEW.status OR OLD.bytesReceived IS NOT NEW.bytesReceived " \
+    "    OR OLD.localUid IS NOT NEW.localUid OR OLD.remoteUid IS NOT NEW.remoteUid " \
+    "    OR OLD.subject IS NOT NEW.subject OR OLD.freeText IS NOT NEW.freeText " \
+    "    OR OLD.groupId IS NOT NEW.groupId OR OLD.messageToken IS NOT NEW.messageToken " \
+    "    OR OLD.lastModified IS NOT NEW.lastModified OR OLD.vCardFileName IS NOT NEW.vCardFileName " \
+    "    OR OLD.vCardLabel IS NOT NEW.vCardLabel OR OLD.reportDelivery IS NOT NEW.reportDelivery " \
+    "    OR OLD.validityPeriod IS NOT NEW.validityPeriod OR OLD.contentLocation IS NOT NEW.contentLocation " \
+    "    OR OLD.headers IS NOT NEW.headers OR OLD.readStatus IS NOT NEW.readStatus " \
+    "    OR OLD.reportRead IS NOT NEW.reportRead OR OLD.reportedReadRequested IS NOT NEW.reportedReadRequested " \
+    "    OR OLD.mmsId IS NOT NEW.mmsId OR OLD.isAction IS NOT NEW.isAction " \
+    "    OR OLD.hasExtraProperties IS NOT NEW.hasExtraProperties " \
+    "    OR OLD.hasMessageParts IS NOT NEW.hasMessageParts " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("0", "NEW", "groupId", "1") " END", \
+    "CREATE TRIGGER change_journal_events_delete AFTER DELETE ON Events " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("0", "OLD", "groupId", "2") " END", \
+    "CREATE TRIGGER change_journal_groups_insert AFTER INSERT ON Groups " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("1", "NEW", "id", "0") " END", \
+    "CREATE TRIGGER change_journal_groups_update AFTER UPDATE ON Groups " \
+    "  WHEN OLD.localUid IS NOT NEW.localUid OR OLD.remoteUids IS NOT NEW.remoteUids " \
+    "    OR OLD.type IS NOT NEW.type OR OLD.chatName IS NOT NEW.chatName " \
+    "    OR OLD.lastModified IS NOT NEW.lastModified OR OLD.lastEventTime IS NOT NEW.lastEventTime " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("1", "NEW", "id", "1") " END", \
+    "CREATE TRIGGER change_journal_groups_delete AFTER DELETE ON Groups " \
+    "  BEGIN " CHANGE_JOURNAL_ADD("1", "OLD", "id", "2") " END", \
+    "CREATE TRIGGER change_journal_retention AFTER INSERT ON ChangeJournal " \
+    "  WHEN NEW.seq % 1000 = 0 " \
+    "  BEGIN " \
+    "    DELETE FROM ChangeJournal WHERE seq <= NEW.seq - 10000; " \
+    "  END"
+
+// Modified properties are written even when their value is unchanged
+#define GROUPS_ACTIVITY_UPDATE_TRIGGER \
+    "CREATE TRIGGER groups_activity_update AFTER UPDATE OF groupId, endTime ON Events " \
+    "  WHEN OLD.groupId IS NOT NEW.groupId OR OLD.endTime IS NOT NEW.endTime " \
+    "  BEGIN " \
+    "    UPDATE Groups SET lastEventTime=IFNULL((SELECT endTime FROM Events WHERE groupId=Groups.id " \
+    "      ORDER BY endTime DESC, id DESC LIMIT 1), 0) WHERE id IN (OLD.groupId, NEW.groupId); " \
+    "  END"
+
+// Lookup of the events of a group by message token, see
+// DatabaseIO::upsertEventByToken(). Not unique: other writers may store
+// the same token more than once.
+#define EVENTS_GROUP_TOKEN_INDEX \
+    "CREATE INDEX events_groupToken ON Events (groupId, messageToken) " \
+    "  WHERE messageToken != ''"
+
+// Unread count of a group, without going through its read events
+#define EVENTS_GROUP_UNREAD_INDEX \
+    "CREATE INDEX events_groupUnread ON Events (groupId) WHERE isRead = 0"
+
 static const char *db_schema[] = {
     "PRAGMA encoding = \"UTF-16\"",
 
@@ -53,8 +189,10 @@ static const char *db_schema[] = {
     "  remoteUids TEXT, "
     "  type INTEGER, "
     "  chatName TEXT, "
-    "  lastModified INTEGER UNSIGNED "
+    "  lastModified INTEGER UNSIGNED, "
+    "  lastEventTime INTEGER DEFAULT 0 "
     ")",
+    "CREATE INDEX groups_activity ON Groups (lastEventTime DESC, id DESC)",
 
     "CREATE TABLE Events ( "
     "  id INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -98,6 +236,8 @@ static const char *db_schema[] = {
     "CREATE INDEX events_messageToken ON Events (messageToken)",
     "CREATE INDEX events_sorting ON Events (groupId, endTime DESC, id DESC)",
     "CREATE INDEX events_unread ON Events (isRead)",
+    EVENTS_GROUP_TOKEN_INDEX,
+    EVENTS_GROUP_UNREAD_INDEX,
 
     "CREATE TABLE EventProperties ( "
     "  eventId INTEGER, "
@@ -137,7 +277,36 @@ static const char *db_schema[] = {
     "    UPDATE Events SET hasMessageParts=0 WHERE id=OLD.eventId; "
     "  END",
 
-    "PRAGMA user_version=4"
+    "CREATE TRIGGER groups_activity_insert AFTER INSERT ON Events "
+    "  WHEN NEW.groupId IS NOT NULL "
+    "  BEGIN "
+    "    UPDATE Groups SET lastEventTime=NEW.endTime WHERE id=NEW.groupId AND lastEventTime < NEW.endTime; "
+    "  END",
+    GROUPS_ACTIVITY_UPDATE_TRIGGER,
+    "CREATE TRIGGER groups_activity_delete AFTER DELETE ON Events "
+    "  WHEN OLD.groupId IS NOT NULL "
+    "  BEGIN "
+    "    UPDATE Groups SET lastEventTime=IFNULL((SELECT endTime FROM Events WHERE groupId=Groups.id "
+    "      ORDER BY endTime DESC, id DESC LIMIT 1), 0) WHERE id=OLD.groupId; "
+    "  END",
+
+    "CREATE TABLE Migrations ( "
+    "  name TEXT PRIMARY KEY, "
+    "  watermark INTEGER, "
+    "  target INTEGER, "
+    "  finished INTEGER "
+    ")",
+    // Nothing to migrate in a new database
+    "INSERT INTO Migrations VALUES ('groups_lastEventTime', 0, 0, 1)",
+
+    CONTACT_ACTIVITY_TABLE,
+    CONTACT_ACTIVITY_TRIGGERS,
+    "INSERT INTO Migrations VALUES ('contact_activity', 0, 0, 1)",
+
+    CHANGE_JOURNAL_TABLE,
+    CHANGE_JOURNAL_TRIGGERS,
+
+    "PRAGMA user_version=8"
 };
 static int db_schema_count = sizeof(db_schema) / sizeof(*db_schema);
 
@@ -203,15 +372,100 @@ static const char *db_upgrade_3[] = {
     0
 };
 
+// Only cheap schema changes belong here, as upgrades block all clients.
+// Backfills of existing data are registered in Migrations and run later
+// in batches, see db_migrations.
+static const char *db_upgrade_4[] = {
+    "ALTER TABLE Groups ADD COLUMN lastEventTime INTEGER DEFAULT 0",
+    "CREATE INDEX groups_activity ON Groups (lastEventTime DESC, id DESC)",
+    "CREATE TRIGGER groups_activity_insert AFTER INSERT ON Events "
+    "  WHEN NEW.groupId IS NOT NULL "
+    "  BEGIN "
+    "    UPDATE Groups SET lastEventTime=NEW.endTime WHERE id=NEW.groupId AND lastEventTime < NEW.endTime; "
+    "  END",
+    GROUPS_ACTIVITY_UPDATE_TRIGGER,
+    "CREATE TRIGGER groups_activity_delete AFTER DELETE ON Events "
+    "  WHEN OLD.groupId IS NOT NULL "
+    "  BEGIN "
+    "    UPDATE Groups SET lastEventTime=IFNULL((SELECT endTime FROM Events WHERE groupId=Groups.id "
+    "      ORDER BY endTime DESC, id DESC LIMIT 1), 0) WHERE id=OLD.groupId; "
+    "  END",
+    "CREATE TABLE Migrations ( "
+    "  name TEXT PRIMARY KEY, "
+    "  watermark INTEGER, "
+    "  target INTEGER, "
+    "  finished INTEGER "
+    ")",
+    "INSERT INTO Migrations SELECT 'groups_lastEventTime', 0, IFNULL(MAX(id), 0), 0 FROM Groups",
+    "PRAGMA user_version=5",
+    0
+};
+
+static const char *db_upgrade_5[] = {
+    CONTACT_ACTIVITY_TABLE,
+    // Register the backfill first, the triggers skip events it covers
+    "INSERT INTO Migrations SELECT 'contact_activity', 0, IFNULL(MAX(id), 0), 0 FROM Events",
+    CONTACT_ACTIVITY_TRIGGERS,
+    "PRAGMA user_version=6",
+    0
+};
+
+static const char *db_upgrade_6[] = {
+    CHANGE_JOURNAL_TABLE,
+    CHANGE_JOURNAL_TRIGGERS,
+    "PRAGMA user_version=7",
+    0
+};
+
+static const char *db_upgrade_7[] = {
+    EVENTS_GROUP_TOKEN_INDEX,
+    EVENTS_GROUP_UNREAD_INDEX,
+    "PRAGMA user_version=8",
+    0
+};
+
 // REMEMBER TO UPDATE THE SCHEMA AND USER_VERSION!
 static const char **db_upgrade[] = {
     db_upgrade_0,
     db_upgrade_1,
     db_upgrade_2,
-    db_upgrade_3
+    db_upgrade_3,
+    db_upgrade_4,
+    db_upgrade_5,
+    db_upgrade_6,
+    db_upgrade_7
 };
 static int db_upgrade_count = sizeof(db_upgrade) / sizeof(*db_upgrade);
 
+struct Migration {
+    const char *name;
+    // Processes rows with :first < id <= :last
+    const char *batch;
+};
+
+// Backfills registered in the Migrations table by upgrades. Rows are
+// processed in id order up to the target recorded at upgrade time; newer
+// rows are kept up to date by triggers.
+static const Migration db_migrations[] = {
+    { "groups_lastEventTime",
+      "UPDATE Groups SET lastEventTime=IFNULL((SELECT endTime FROM Events WHERE groupId=Groups.id "
+      "  ORDER BY endTime DESC, id DESC LIMIT 1), 0) WHERE id > :first AND id <= :last" },
+    { "contact_activity",
+      "INSERT OR REPLACE INTO ContactActivity "
+      "  (localUid, remoteUid, day, type, direction, eventCount, missedCount, duration) "
+      "SELECT IFNULL(Events.localUid, ''), IFNULL(Events.remoteUid, ''), IFNULL(Events.startTime, 0) / 86400, "
+      "  Events.type, Events.direction, "
+      "  COUNT(*) + IFNULL(MAX(A.eventCount), 0), "
+      "  SUM(IFNULL(Events.isMissedCall, 0) != 0) + IFNULL(MAX(A.missedCount), 0), "
+      "  SUM(" CONTACT_ACTIVITY_DURATION("Events") ") + IFNULL(MAX(A.duration), 0) "
+      "FROM Events LEFT JOIN ContactActivity AS A ON (A.localUid = IFNULL(Events.localUid, '') "
+      "  AND A.remoteUid = IFNULL(Events.remoteUid, '') AND A.day = IFNULL(Events.startTime, 0) / 86400 "
+      "  AND A.type = Events.type AND A.direction = Events.direction) "
+      "WHERE Events.id > :first AND Events.id <= :last AND IFNULL(Events.isDraft, 0) = 0 "
+      "GROUP BY 1, 2, 3, 4, 5" }
+};
+static int db_migrations_count = sizeof(db_migrations) / sizeof(*db_migrations);
+
 static bool execute(QSqlDatabase &database, const QString &statement)
 {
     QSqlQuery query(database);
@@ -348,6 +602,124 @@ QSqlQuery CommHistoryDatabase::prepare(const char *statement, const QSqlDatabase
     return query;
 }
 
+bool CommHistoryDatabase::migrationFinished(const QSqlDatabase &database, const char *name)
+{
+    QSqlQuery query = prepare("SELECT finished FROM Migrations WHERE name = :name", database);
+    query.bindValue(":name", QLatin1String(name));
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    // Unknown migrations have nothing to do
+    bool finished = !query.next() || query.value(0).toBool();
+    query.finish();
+    return finished;
+}
+
+bool CommHistoryDatabase::migrationProgress(const QSqlDatabase &database, int *done, int *total)
+{
+    QSqlQuery query = prepare("SELECT TOTAL(MIN(watermark, target)), TOTAL(target) FROM Migrations", database);
+    if (!query.exec() || !query.next()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    *done = query.value(0).toInt();
+    *total = query.value(1).toInt();
+    query.finish();
+    return true;
+}
+
+bool CommHistoryDatabase::runMigrationBatch(QSqlDatabase &database, int batchSize, bool *finished)
+{
+    *finished = false;
+
+    // A savepoint works both inside and outside of a transaction. Other
+    // processes may run the same batch; whoever commits first wins and the
+    // other one fails and retries from the new watermark.
+    if (!execute(database, QLatin1String("SAVEPOINT migration")))
+        return false;
+
+    // Migrations registered by a newer version are left for it to finish
+    QByteArray names;
+    for (int i = 0; i < db_migrations_count; i++) {
+        if (i)
+            names += ", ";
+        names += QByteArray("'") + db_migrations[i].name + "'";
+    }
+
+    QByteArray q = "SELECT name, watermark, target FROM Migrations "
+                   "WHERE finished = 0 AND name IN (" + names + ") ORDER BY rowid LIMIT 1";
+
+    QSqlQuery query = prepare(q.constData(), database);
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        execute(database, QLatin1String("ROLLBACK TO migration"));
+        execute(database, QLatin1String("RELEASE migration"));
+        return false;
+    }
+
+    if (!query.next()) {
+        query.finish();
+        *finished = true;
+        return execute(database, QLatin1String("RELEASE migration"));
+    }
+
+    QString name = query.value(0).toString();
+    qint64 watermark = query.value(1).toLongLong();
+    qint64 target = query.value(2).toLongLong();
+    query.finish();
+
+    const Migration *migration = 0;
+    for (int i = 0; i < db_migrations_count; i++) {
+        if (name == QLatin1String(db_migrations[i].name)) {
+            migration = &db_migrations[i];
+            break;
+        }
+    }
+
+    qint64 last = qMin(watermark + batchSize, target);
+
+    QSqlQuery batch = prepare(migration->batch, database);
+    batch.bindValue(":first", watermark);
+    batch.bindValue(":last", last);
+    bool ok = batch.exec();
+    if (!ok) {
+        qWarning() << "Failed to execute query";
+        qWarning() << batch.lastError();
+        qWarning() << batch.lastQuery();
+    }
+
+    if (ok) {
+        QSqlQuery update = prepare("UPDATE Migrations SET watermark = :watermark, finished = :finished "
+                                   "WHERE name = :name", database);
+        update.bindValue(":watermark", last);
+        update.bindValue(":finished", last >= target ? 1 : 0);
+        update.bindValue(":name", name);
+        if (!update.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << update.lastError();
+            qWarning() << update.lastQuery();
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        execute(database, QLatin1String("ROLLBACK TO migration"));
+        execute(database, QLatin1String("RELEASE migration"));
+        return false;
+    }
+
+    return execute(database, QLatin1String("RELEASE migration"));
+}
+
 void CommHistoryDatabasePath::setRootDir(const QString &rootDir)
 {
     db_root_dir = rootDir;
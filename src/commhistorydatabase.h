@@ -30,6 +30,14 @@ class CommHistoryDatabase
 public:
     static QSqlDatabase open(const QString &databaseName);
     static QSqlQuery prepare(const char *statement, const QSqlDatabase &database);
+
+    /* open() only applies cheap schema changes. Backfills of existing data
+     * are run afterwards in small batches with runMigrationBatch(), resuming
+     * from a watermark stored in the database. Until migrationFinished(),
+     * queries must not rely on the migrated data. */
+    static bool migrationFinished(const QSqlDatabase &database, const char *name);
+    static bool migrationProgress(const QSqlDatabase &database, int *done, int *total);
+    static bool runMigrationBatch(QSqlDatabase &database, int batchSize, bool *finished);
 };
 
 #endif
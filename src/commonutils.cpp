@@ -28,9 +28,42 @@
 
 #include <QString>
 #include <QSettings>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QThreadStorage>
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace {
 
+// A local day as [start, end) in seconds since the epoch
+struct LocalDay {
+    LocalDay() : start(0), end(0) {}
+
+    qint64 start;
+    qint64 end;
+    QDate date;
+};
+
+// Entries expire so that time zone changes are picked up
+const qint64 localDayLifetime = 60 * 1000;
+
+struct LocalDayCache {
+    LocalDayCache() : next(0) { age.start(); }
+
+    LocalDay days[4];
+    int next;
+    QElapsedTimer age;
+};
+
+QThreadStorage<LocalDayCache> localDayCaches;
+
 int phoneNumberMatchLength()
 {
     // TODO: use a configuration variable to make this configurable
@@ -38,6 +71,69 @@ int phoneNumberMatchLength()
     return numberMatchLength;
 }
 
+// Whether all length UTF-16 units at data are ASCII digits
+bool allAsciiDigits(const ushort *data, int length)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero256 = _mm256_set1_epi16('0');
+    const __m256i nine256 = _mm256_set1_epi16(9);
+    for ( ; i + 16 <= length; i += 16) {
+        // c - '0' wraps around for c < '0', so a saturated c - '0' - 9 is
+        // zero exactly for the digits
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i over = _mm256_subs_epu16(_mm256_sub_epi16(v, zero256), nine256);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(over, _mm256_setzero_si256())) != -1)
+            return false;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i zero128 = _mm_set1_epi16('0');
+    const __m128i nine128 = _mm_set1_epi16(9);
+    for ( ; i + 8 <= length; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i over = _mm_subs_epu16(_mm_sub_epi16(v, zero128), nine128);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(over, _mm_setzero_si128())) != 0xffff)
+            return false;
+    }
+#endif
+
+    for ( ; i < length; i++) {
+        if (ushort(data[i] - '0') > 9)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Fast path for the common case of minimizing a number which is only ASCII
+ * digits, optionally after a leading '+'. Sets offset and length to the part
+ * of number that minimizePhoneNumber() returns, and returns false for any
+ * other input, which must go through the full normalizer.
+ */
+bool minimizePlainNumber(const QString &number, int maxDigits, int *offset, int *length)
+{
+    const ushort *data = number.utf16();
+    const int size = number.size();
+    const int start = (size > 0 && data[0] == '+') ? 1 : 0;
+    const int digits = size - start;
+
+    if (digits < 1 || !allAsciiDigits(data + start, digits))
+        return false;
+
+    // Numbers with fewer digits than the match length are kept as they are,
+    // including the '+'
+    if (digits < maxDigits) {
+        *offset = 0;
+        *length = size;
+    } else {
+        *offset = size - maxDigits;
+        *length = maxDigits;
+    }
+    return true;
+}
+
 }
 
 namespace CommHistory {
@@ -54,12 +150,26 @@ LIBCOMMHISTORY_EXPORT QString normalizePhoneNumber(const QString &number, bool v
 
 LIBCOMMHISTORY_EXPORT QString minimizePhoneNumber(const QString &number)
 {
+    int offset, length;
+    if (minimizePlainNumber(number, phoneNumberMatchLength(), &offset, &length))
+        return length == number.size() ? number : number.mid(offset, length);
+
     return QtContactsSqliteExtensions::minimizePhoneNumber(number, phoneNumberMatchLength());
 }
 
 LIBCOMMHISTORY_EXPORT bool remoteAddressMatch(const QString &localUid, const QString &uid, const QString &match, bool minimizedComparison)
 {
     if (localUidComparesPhoneNumbers(localUid)) {
+        if (minimizedComparison) {
+            // Compare the digits in place when both are plain numbers
+            int offset, length, matchOffset, matchLength;
+            if (minimizePlainNumber(uid, phoneNumberMatchLength(), &offset, &length)
+                && minimizePlainNumber(match, phoneNumberMatchLength(), &matchOffset, &matchLength)) {
+                return length == matchLength
+                    && memcmp(uid.constData() + offset, match.constData() + matchOffset, length * sizeof(QChar)) == 0;
+            }
+        }
+
         QString phone, phoneMatch;
         if (minimizedComparison) {
             phone = minimizePhoneNumber(uid);
@@ -119,4 +229,32 @@ LIBCOMMHISTORY_EXPORT bool remoteAddressMatch(const QString &localUid, const QSt
     return true;
 }
 
+LIBCOMMHISTORY_EXPORT QDate localDate(quint32 secs)
+{
+    LocalDayCache &cache = localDayCaches.localData();
+    if (cache.age.hasExpired(localDayLifetime)) {
+        for (LocalDay &day : cache.days)
+            day = LocalDay();
+        cache.age.restart();
+    }
+
+    for (const LocalDay &day : cache.days) {
+        if (secs >= day.start && secs < day.end)
+            return day.date;
+    }
+
+    const QDate date = QDateTime::fromTime_t(secs).date();
+
+    LocalDay &day = cache.days[cache.next];
+    cache.next = (cache.next + 1) % 4;
+    day.date = date;
+    day.start = QDateTime(date, QTime(0, 0)).toMSecsSinceEpoch() / 1000;
+    day.end = QDateTime(date.addDays(1), QTime(0, 0)).toMSecsSinceEpoch() / 1000;
+    if (secs < day.start || secs >= day.end) {
+        // Midnight does not exist on some DST transitions, don't cache those
+        day = LocalDay();
+    }
+    return date;
+}
+
 }
@@ -24,6 +24,7 @@
 #define COMMHISTORY_COMMONUTILS_H
 
 #include <QString>
+#include <QDate>
 
 namespace CommHistory {
 
@@ -74,6 +75,16 @@ QString minimizePhoneNumber(const QString &number);
 bool remoteAddressMatch(const QString &localUid, const QString &uid, const QString &match, bool minimizedComparison = false);
 bool remoteAddressMatch(const QString &localUid, const QStringList &uids, const QStringList &match, bool minimizedComparison = false);
 
+/*!
+ * Date in the local time zone of a time in seconds since the epoch.
+ * Boundaries of recently used days are cached, so that only the first
+ * lookup within a day needs a time zone conversion.
+ *
+ * \param secs Seconds since the epoch.
+ * \return Local date.
+ */
+QDate localDate(quint32 secs);
+
 }
 
 #endif /* COMMONUTILS_H */
@@ -30,6 +30,12 @@ namespace CommHistory {
 #define COMM_HISTORY_INTERFACE     QLatin1String("com.nokia.commhistory")
 #define COMM_HISTORY_OBJECT_PATH   QLatin1String("/CommHistoryModel")
 
+// Event signals are also emitted with this interface on the paths of the
+// group and of the type of the events, see UpdatesEmitter
+#define COMM_HISTORY_EVENTS_INTERFACE   QLatin1String("com.nokia.commhistory.events")
+#define COMM_HISTORY_GROUP_EVENTS_PATH  QLatin1String("/CommHistoryModel/groups/")
+#define COMM_HISTORY_TYPE_EVENTS_PATH   QLatin1String("/CommHistoryModel/types/")
+
 #define EVENTS_ADDED_SIGNAL        QLatin1String("eventsAdded")
 #define EVENTS_UPDATED_SIGNAL      QLatin1String("eventsUpdated")
 #define EVENT_DELETED_SIGNAL       QLatin1String("eventDeleted")
@@ -39,6 +45,8 @@ namespace CommHistory {
 #define GROUPS_UPDATED_FULL_SIGNAL QLatin1String("groupsUpdatedFull")
 #define GROUPS_DELETED_SIGNAL      QLatin1String("groupsDeleted")
 
+#define UPGRADE_PROGRESS_SIGNAL    QLatin1String("upgradeProgress")
+
 #define EVENT_PROPERTY_SUBSCRIBER_ID    QLatin1String("subscriberIdentity")
 
 } /* namespace CommHistory */
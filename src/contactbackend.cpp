@@ -0,0 +1,193 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jollamobile.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "contactbackend.h"
+
+#include <QCoreApplication>
+#include <QMetaMethod>
+#include <QSet>
+
+#include "debug.h"
+
+namespace CommHistory {
+
+class SeasideContactBackend
+    : public ContactBackend,
+      public SeasideCache::ResolveListener,
+      public SeasideCache::ChangeListener
+{
+    Q_OBJECT
+
+public:
+    explicit SeasideContactBackend(QObject *parent);
+    ~SeasideContactBackend();
+
+    bool resolve(const Recipient &recipient);
+    SeasideCache::CacheItem *itemById(int contactId);
+
+protected:
+    void connectNotify(const QMetaMethod &signal);
+
+    void addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item);
+    void itemUpdated(SeasideCache::CacheItem *item);
+    void itemAboutToBeRemoved(SeasideCache::CacheItem *item);
+
+private:
+    QSet<Recipient> pending;
+    bool listeningForChanges;
+};
+
+}
+
+using namespace CommHistory;
+
+namespace {
+
+ContactBackend *installedBackend = 0;
+ContactBackend *defaultBackend = 0;
+
+}
+
+ContactBackend::ContactBackend(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ContactBackend::~ContactBackend()
+{
+    if (installedBackend == this)
+        installedBackend = 0;
+    if (defaultBackend == this)
+        defaultBackend = 0;
+}
+
+ContactBackend *ContactBackend::instance()
+{
+    if (installedBackend)
+        return installedBackend;
+
+    if (!defaultBackend)
+        defaultBackend = new SeasideContactBackend(QCoreApplication::instance());
+    return defaultBackend;
+}
+
+void ContactBackend::setInstance(ContactBackend *backend)
+{
+    installedBackend = backend;
+}
+
+SeasideContactBackend::SeasideContactBackend(QObject *parent)
+    : ContactBackend(parent)
+    , listeningForChanges(false)
+{
+}
+
+SeasideContactBackend::~SeasideContactBackend()
+{
+    SeasideCache::unregisterResolveListener(this);
+    if (listeningForChanges)
+        SeasideCache::unregisterChangeListener(this);
+}
+
+void SeasideContactBackend::connectNotify(const QMetaMethod &signal)
+{
+    // Only follow contact changes when someone is interested
+    if (!listeningForChanges
+        && (signal == QMetaMethod::fromSignal(&ContactBackend::contactUpdated)
+            || signal == QMetaMethod::fromSignal(&ContactBackend::contactAboutToBeRemoved))) {
+        listeningForChanges = true;
+        SeasideCache::registerChangeListener(this, SeasideCache::FetchAvatar);
+    }
+}
+
+bool SeasideContactBackend::resolve(const Recipient &recipient)
+{
+    // Already requested, possibly by another resolver
+    if (pending.contains(recipient))
+        return false;
+
+    SeasideCache::CacheItem *item = 0;
+    if (recipient.isPhoneNumber()) {
+        item = SeasideCache::resolvePhoneNumber(this, recipient.remoteUid(), false);
+    } else {
+        item = SeasideCache::resolveOnlineAccount(this, recipient.localUid(), recipient.remoteUid(), false);
+    }
+
+    if (item) {
+        recipient.setResolved(item);
+        return true;
+    }
+
+    pending.insert(recipient);
+    return false;
+}
+
+SeasideCache::CacheItem *SeasideContactBackend::itemById(int contactId)
+{
+    return SeasideCache::itemById(contactId, false);
+}
+
+void SeasideContactBackend::addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item)
+{
+    QList<Recipient> recipients;
+
+    if (second.isEmpty()) {
+        qWarning() << "Got addressResolved with empty UIDs" << first << second << item;
+        return;
+    } else if (first.isEmpty()) {
+        // This resolution is for a phone number - we need to call back to libcontacts
+        // to select the best match from multiple possible resolutions
+        const Recipient::PhoneNumberMatchDetails phoneNumber(Recipient::phoneNumberMatchDetails(second));
+        for (QSet<Recipient>::iterator it = pending.begin(); it != pending.end(); ) {
+            if (it->matchesPhoneNumber(phoneNumber)) {
+                // Look up the best match for the full number
+                it->setResolved(SeasideCache::itemByPhoneNumber(it->remoteUid(), false));
+                recipients.append(*it);
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    } else {
+        QSet<Recipient>::iterator it = pending.find(Recipient(first, second));
+        if (it != pending.end()) {
+            it->setResolved(item);
+            recipients.append(*it);
+            pending.erase(it);
+        }
+    }
+
+    if (!recipients.isEmpty())
+        emit resolved(recipients);
+}
+
+void SeasideContactBackend::itemUpdated(SeasideCache::CacheItem *item)
+{
+    emit contactUpdated(item);
+}
+
+void SeasideContactBackend::itemAboutToBeRemoved(SeasideCache::CacheItem *item)
+{
+    emit contactAboutToBeRemoved(item);
+}
+
+#include "contactbackend.moc"
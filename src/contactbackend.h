@@ -0,0 +1,81 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jollamobile.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_CONTACTBACKEND_H
+#define COMMHISTORY_CONTACTBACKEND_H
+
+#include <QObject>
+#include "recipient.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+/* ContactBackend finds the contacts matching recipients, for ContactResolver,
+ * ContactListener and RecipientList::fromContact().
+ *
+ * Contacts are represented by SeasideCache::CacheItem, which is what
+ * Recipient::setResolved() takes. The default backend uses SeasideCache and
+ * the contacts database. Another backend, such as the StubContactBackend of
+ * the tests, can be installed with setInstance() before any contacts are
+ * resolved.
+ */
+class LIBCOMMHISTORY_EXPORT ContactBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ContactBackend(QObject *parent = 0);
+    virtual ~ContactBackend();
+
+    /* The installed backend, or the SeasideCache backend if none is */
+    static ContactBackend *instance();
+
+    /* Install a backend, which is not owned. Passing 0 restores the default.
+     * Resolvers and listeners keep the backend they were created with, so
+     * it has to outlive them. */
+    static void setInstance(ContactBackend *backend);
+
+    /* Start resolving the contact of a recipient
+     *
+     * Returns true if the recipient was resolved immediately, with
+     * Recipient::setResolved(). Otherwise, resolved() is emitted later.
+     */
+    virtual bool resolve(const Recipient &recipient) = 0;
+
+    /* The contact with this id, or 0 if it is not known yet */
+    virtual SeasideCache::CacheItem *itemById(int contactId) = 0;
+
+signals:
+    /* Emitted after setResolved() was called for recipients that were not
+     * resolved immediately by resolve() */
+    void resolved(const QList<CommHistory::Recipient> &recipients);
+
+    /* Emitted after a contact was added or modified */
+    void contactUpdated(SeasideCache::CacheItem *item);
+
+    /* Emitted before a contact is removed */
+    void contactAboutToBeRemoved(SeasideCache::CacheItem *item);
+};
+
+}
+
+#endif
@@ -382,7 +382,7 @@ QVariant ContactGroupModel::data(const QModelIndex &index, int role) const
     case ContactGroupRole:
         return QVariant::fromValue<QObject*>(g);
     case TimeSectionRole:
-        return g->endTime().toLocalTime().date();
+        return localDate(g->endTimeT());
     case ContactIdsRole:
         return QVariant::fromValue(g->contactIds());
     case ContactNamesRole:
@@ -443,6 +443,16 @@ QList<QObject*> ContactGroupModel::contactGroups() const
     return re;
 }
 
+void ContactGroupModel::prefetch(int row)
+{
+    ContactGroup *item = d->items.value(row);
+    if (!item || !d->manager)
+        return;
+
+    foreach (GroupObject *group, item->groups())
+        d->manager->prefetchConversation(group->id());
+}
+
 bool ContactGroupModel::canFetchMore(const QModelIndex &parent) const
 {
     if (!parent.isValid())
@@ -106,6 +106,15 @@ public:
 
     int count() const;
 
+    /*!
+     * Request prefetching of the conversations of the contact at row,
+     * typically when its delegate becomes visible.
+     * See GroupManager::prefetchConversation().
+     *
+     * \param row Model row.
+     */
+    Q_INVOKABLE void prefetch(int row);
+
     /*!
      * List of contact groups in the model
      */
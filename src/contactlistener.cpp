@@ -33,14 +33,13 @@
 #include <QContactEmailAddress>
 
 #include "commonutils.h"
+#include "contactbackend.h"
 #include "contactresolver.h"
 #include "debug.h"
 
 namespace CommHistory {
 
-class ContactListenerPrivate
-    : public QObject,
-      public SeasideCache::ChangeListener
+class ContactListenerPrivate : public QObject
 {
     Q_OBJECT
     Q_DECLARE_PUBLIC(ContactListener)
@@ -57,8 +56,6 @@ private slots:
     void retryFinished();
     void resolveAgain(const CommHistory::Recipient &recipient);
     void retryUnresolved();
-
-protected:
     void itemUpdated(SeasideCache::CacheItem *item);
     void itemAboutToBeRemoved(SeasideCache::CacheItem *item);
 
@@ -100,12 +97,15 @@ ContactListenerPrivate::ContactListenerPrivate(ContactListener *q)
     , retryResolver(0)
     , q_ptr(q)
 {
-    SeasideCache::registerChangeListener(this, SeasideCache::FetchAvatar);
+    ContactBackend *backend = ContactBackend::instance();
+    connect(backend, SIGNAL(contactUpdated(SeasideCache::CacheItem*)),
+            SLOT(itemUpdated(SeasideCache::CacheItem*)));
+    connect(backend, SIGNAL(contactAboutToBeRemoved(SeasideCache::CacheItem*)),
+            SLOT(itemAboutToBeRemoved(SeasideCache::CacheItem*)));
 }
 
 ContactListenerPrivate::~ContactListenerPrivate()
 {
-    SeasideCache::unregisterChangeListener(this);
 }
 
 ContactResolver *ContactListenerPrivate::resolver()
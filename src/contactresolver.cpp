@@ -24,6 +24,7 @@
 
 #include <QElapsedTimer>
 
+#include "contactbackend.h"
 #include "commonutils.h"
 #include "debug.h"
 
@@ -31,13 +32,14 @@ using namespace CommHistory;
 
 namespace CommHistory {
 
-class ContactResolverPrivate : public QObject, public SeasideCache::ResolveListener
+class ContactResolverPrivate : public QObject
 {
     Q_OBJECT
     Q_DECLARE_PUBLIC(ContactResolver)
 
 public:
     ContactResolver *q_ptr;
+    ContactBackend *backend;
     QSet<Recipient> pending;
     bool resolving;
     bool forceResolving;
@@ -47,10 +49,10 @@ public:
 
     void resolve(Recipient recipient);
     void checkIfFinishedAsynchronously();
-    virtual void addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item);
 
 public slots:
     bool checkIfFinished();
+    void recipientsResolved(const QList<CommHistory::Recipient> &recipients);
 };
 
 } // namespace CommHistory
@@ -61,13 +63,15 @@ ContactResolver::ContactResolver(QObject *parent)
 }
 
 ContactResolverPrivate::ContactResolverPrivate(ContactResolver *parent)
-    : QObject(parent), q_ptr(parent), resolving(false), forceResolving(false)
+    : QObject(parent), q_ptr(parent), backend(ContactBackend::instance())
+    , resolving(false), forceResolving(false)
 {
+    connect(backend, SIGNAL(resolved(QList<CommHistory::Recipient>)),
+            SLOT(recipientsResolved(QList<CommHistory::Recipient>)));
 }
 
 ContactResolverPrivate::~ContactResolverPrivate()
 {
-    SeasideCache::unregisterResolveListener(this);
 }
 
 bool ContactResolver::isResolving() const
@@ -130,18 +134,8 @@ void ContactResolverPrivate::resolve(Recipient recipient)
     if (pending.contains(recipient))
         return;
 
-    SeasideCache::CacheItem *item = 0;
-    if (recipient.isPhoneNumber()) {
-        item = SeasideCache::resolvePhoneNumber(this, recipient.remoteUid(), false);
-    } else {
-        item = SeasideCache::resolveOnlineAccount(this, recipient.localUid(), recipient.remoteUid(), false);
-    }
-
-    if (item) {
-        recipient.setResolved(item);
-    } else {
+    if (!backend->resolve(recipient))
         pending.insert(recipient);
-    }
 }
 
 void ContactResolverPrivate::checkIfFinishedAsynchronously()
@@ -168,33 +162,15 @@ bool ContactResolverPrivate::checkIfFinished()
     return false;
 }
 
-void ContactResolverPrivate::addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item)
+void ContactResolverPrivate::recipientsResolved(const QList<Recipient> &recipients)
 {
-    if (second.isEmpty()) {
-        qWarning() << "Got addressResolved with empty UIDs" << first << second << item;
-        return;
-    } else if (first.isEmpty()) {
-        // This resolution is for a phone number - we need to call back to libcontacts
-        // to select the best match from multiple possible resolutions
-        const Recipient::PhoneNumberMatchDetails phoneNumber(Recipient::phoneNumberMatchDetails(second));
-        for (QSet<Recipient>::iterator it = pending.begin(); it != pending.end(); ) {
-            if (it->matchesPhoneNumber(phoneNumber)) {
-                // Look up the best match for the full number
-                it->setResolved(SeasideCache::itemByPhoneNumber(it->remoteUid(), false));
-                it = pending.erase(it);
-            } else {
-                ++it;
-            }
-        }
-    } else {
-        QSet<Recipient>::iterator it = pending.find(Recipient(first, second));
-        if (it != pending.end()) {
-            it->setResolved(item);
-            pending.erase(it);
-        }
-    }
+    // The backend reports the recipients of all resolvers
+    bool changed = false;
+    foreach (const Recipient &recipient, recipients)
+        changed |= pending.remove(recipient);
 
-    checkIfFinished();
+    if (changed)
+        checkIfFinished();
 }
 
 #include "contactresolver.moc"
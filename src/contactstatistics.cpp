@@ -0,0 +1,399 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "contactstatistics_p.h"
+#include "databaseio_p.h"
+#include "commonutils.h"
+
+#include <QtDebug>
+#include <QSqlError>
+#include <QSqlDatabase>
+
+namespace {
+
+const qint64 secondsPerDay = 24 * 60 * 60;
+
+// First UTC day starting at or after secs
+qint64 dayAtOrAfter(qint64 secs)
+{
+    const qint64 day = secs / secondsPerDay;
+    return (secs > day * secondsPerDay) ? day + 1 : day;
+}
+
+// Last UTC day starting at or before secs
+qint64 dayAtOrBefore(qint64 secs)
+{
+    const qint64 day = secs / secondsPerDay;
+    return (secs < day * secondsPerDay) ? day - 1 : day;
+}
+
+QByteArray bucketExpression(CommHistory::ContactStatistics::TimeInterval timeInterval)
+{
+    switch (timeInterval) {
+    case CommHistory::ContactStatistics::NoTimeInterval:
+        break;
+    case CommHistory::ContactStatistics::Yearly:
+        return "CAST(strftime('%s', time, 'unixepoch', 'start of year') AS INTEGER)";
+    case CommHistory::ContactStatistics::Monthly:
+        return "CAST(strftime('%s', time, 'unixepoch', 'start of month') AS INTEGER)";
+    case CommHistory::ContactStatistics::Weekly:
+        // Monday on or before the day
+        return "CAST(strftime('%s', time, 'unixepoch', 'start of day', '-6 days', 'weekday 1') AS INTEGER)";
+    case CommHistory::ContactStatistics::Daily:
+        return "(time / 86400) * 86400";
+    }
+    return "0";
+}
+
+QByteArray eventsSource()
+{
+    using CommHistory::Event;
+    return "SELECT IFNULL(localUid, '') AS localUid, IFNULL(remoteUid, '') AS remoteUid, "
+           "IFNULL(startTime, 0) AS time, type, 1 AS eventCount, "
+           "IFNULL(isMissedCall, 0) != 0 AS missedCount, "
+           "(CASE WHEN type = " + QByteArray::number(Event::CallEvent)
+           + " THEN MAX(IFNULL(endTime, 0) - IFNULL(startTime, 0), 0) ELSE 0 END) AS duration "
+           "FROM Events WHERE IFNULL(isDraft, 0) = 0";
+}
+
+QByteArray messageTypes()
+{
+    using CommHistory::Event;
+    return QByteArray::number(Event::IMEvent) + ", " + QByteArray::number(Event::SMSEvent) + ", "
+        + QByteArray::number(Event::MMSEvent) + ", " + QByteArray::number(Event::ClassZeroSMSEvent);
+}
+
+}
+
+namespace CommHistory {
+
+ContactStatisticsPrivate::ContactStatisticsPrivate(ContactStatistics *parent)
+    : QObject(parent)
+    , q(parent)
+    , eventType(Event::UnknownType)
+    , timeInterval(ContactStatistics::NoTimeInterval)
+    , sortOrder(ContactStatistics::SortByRecipient)
+    , limit(0)
+    , filterRecipient(false)
+    , rowCount(0)
+{
+}
+
+ContactStatistics::ContactStatistics(QObject *parent)
+    : QObject(parent)
+    , d(new ContactStatisticsPrivate(this))
+{
+}
+
+ContactStatistics::~ContactStatistics()
+{
+    close();
+}
+
+void ContactStatistics::setStartTime(const QDateTime &dt)
+{
+    if (dt != d->startTime) {
+        d->startTime = dt;
+        emit startTimeChanged();
+    }
+}
+
+QDateTime ContactStatistics::startTime() const
+{
+    return d->startTime;
+}
+
+void ContactStatistics::setEndTime(const QDateTime &dt)
+{
+    if (dt != d->endTime) {
+        d->endTime = dt;
+        emit endTimeChanged();
+    }
+}
+
+QDateTime ContactStatistics::endTime() const
+{
+    return d->endTime;
+}
+
+void ContactStatistics::setEventType(Event::EventType type)
+{
+    if (type != d->eventType) {
+        d->eventType = type;
+        emit eventTypeChanged();
+    }
+}
+
+Event::EventType ContactStatistics::eventType() const
+{
+    return d->eventType;
+}
+
+void ContactStatistics::setRecipient(const Recipient &recipient)
+{
+    if (recipient != d->recipient) {
+        d->recipient = recipient;
+        emit recipientChanged();
+    }
+}
+
+Recipient ContactStatistics::recipient() const
+{
+    return d->recipient;
+}
+
+void ContactStatistics::setTimeInterval(TimeInterval timeInterval)
+{
+    if (timeInterval != d->timeInterval) {
+        d->timeInterval = timeInterval;
+        emit timeIntervalChanged();
+    }
+}
+
+ContactStatistics::TimeInterval ContactStatistics::timeInterval() const
+{
+    return d->timeInterval;
+}
+
+void ContactStatistics::setSortOrder(SortOrder sortOrder)
+{
+    if (sortOrder != d->sortOrder) {
+        d->sortOrder = sortOrder;
+        emit sortOrderChanged();
+    }
+}
+
+ContactStatistics::SortOrder ContactStatistics::sortOrder() const
+{
+    return d->sortOrder;
+}
+
+void ContactStatistics::setLimit(int limit)
+{
+    if (limit != d->limit) {
+        d->limit = limit;
+        emit limitChanged();
+    }
+}
+
+int ContactStatistics::limit() const
+{
+    return d->limit;
+}
+
+QList<CommHistory::ContactStatistics::Result> ContactStatistics::results() const
+{
+    return d->results;
+}
+
+bool ContactStatistics::reload()
+{
+    d->results.clear();
+
+    if (!open())
+        return false;
+
+    Result result;
+    while (next(result))
+        d->results.append(result);
+    return true;
+}
+
+bool ContactStatistics::open()
+{
+    close();
+
+    if (d->startTime.isValid() && d->endTime.isValid() && d->endTime <= d->startTime) {
+        qWarning() << "Error: end time" << d->endTime.toString()
+                   << "is not after start time" << d->startTime.toString();
+        return false;
+    }
+
+    const bool hasStart = d->startTime.isValid();
+    const bool hasEnd = d->endTime.isValid();
+    const qint64 startSecs = d->startTime.toMSecsSinceEpoch() / 1000;
+    const qint64 endSecs = d->endTime.toMSecsSinceEpoch() / 1000;
+
+    // ContactActivity has UTC day granularity and is only complete once
+    // backfilled. Whole days of the range are read from it, the partial
+    // days at its ends, e.g. for ranges between local midnights, from
+    // Events.
+    const qint64 firstDay = hasStart ? dayAtOrAfter(startSecs) : 0;
+    const qint64 endDay = hasEnd ? dayAtOrBefore(endSecs) : 0;
+    const bool rollup = (!hasStart || !hasEnd || firstDay < endDay)
+        && DatabaseIOPrivate::instance()->contactActivityAvailable();
+
+    QByteArray filter;
+    QVariantList filterValues;
+    if (d->eventType != Event::UnknownType) {
+        filter += " AND type = ?";
+        filterValues << int(d->eventType);
+    }
+
+    // Phone numbers are matched with LIKE on the minimized number, like
+    // RecipientEventModel does, and the exact match is checked in next()
+    d->filterRecipient = false;
+    if (!d->recipient.isNull()) {
+        if (localUidComparesPhoneNumbers(d->recipient.localUid())) {
+            filter += " AND remoteUid LIKE ? AND localUid LIKE ?";
+            filterValues << QString(QLatin1String("%%1%")).arg(minimizePhoneNumber(d->recipient.remoteUid()))
+                         << QString(RING_ACCOUNT + QLatin1Char('%'));
+            d->filterRecipient = true;
+        } else {
+            filter += " AND remoteUid = ? AND localUid = ?";
+            filterValues << d->recipient.remoteUid() << d->recipient.localUid();
+        }
+    }
+
+    // Both sources provide the same columns, one row per day or per event
+    QByteArray source;
+    QVariantList values;
+    if (rollup) {
+        source = "SELECT localUid, remoteUid, day * 86400 AS time, type, "
+                 "eventCount, missedCount, duration "
+                 "FROM ContactActivity WHERE 1";
+        if (hasStart) {
+            source += " AND day >= ?";
+            values << firstDay;
+        }
+        if (hasEnd) {
+            source += " AND day < ?";
+            values << endDay;
+        }
+        source += filter;
+        values += filterValues;
+
+        QByteArray edges;
+        if (hasStart && startSecs < firstDay * secondsPerDay) {
+            edges += "(startTime >= ? AND startTime < ?)";
+            values << startSecs << firstDay * secondsPerDay;
+        }
+        if (hasEnd && endDay * secondsPerDay < endSecs) {
+            if (!edges.isEmpty())
+                edges += " OR ";
+            edges += "(startTime >= ? AND startTime < ?)";
+            values << endDay * secondsPerDay << endSecs;
+        }
+        if (!edges.isEmpty()) {
+            source += " UNION ALL " + eventsSource() + " AND (" + edges + ")" + filter;
+            values += filterValues;
+        }
+    } else {
+        source = eventsSource();
+        if (hasStart) {
+            source += " AND startTime >= ?";
+            values << startSecs;
+        }
+        if (hasEnd) {
+            source += " AND startTime < ?";
+            values << endSecs;
+        }
+        source += filter;
+        values += filterValues;
+    }
+
+    const QByteArray callType = QByteArray::number(Event::CallEvent);
+    const QByteArray bucket = bucketExpression(d->timeInterval);
+    QByteArray q = "SELECT localUid, remoteUid, " + bucket + ", "
+                   "SUM(eventCount), "
+                   "SUM(CASE WHEN type IN (" + messageTypes() + ") THEN eventCount ELSE 0 END), "
+                   "SUM(CASE WHEN type = " + callType + " THEN eventCount ELSE 0 END), "
+                   "SUM(CASE WHEN type = " + callType + " THEN missedCount ELSE 0 END), "
+                   "SUM(duration) "
+                   "FROM (" + source + ") GROUP BY localUid, remoteUid, 3";
+
+    switch (d->sortOrder) {
+    case SortByRecipient:
+        q += " ORDER BY localUid, remoteUid, 3";
+        break;
+    case SortByEventCount:
+        q += " ORDER BY 4 DESC, localUid, remoteUid, 3";
+        break;
+    case SortByCallDuration:
+        q += " ORDER BY 8 DESC, 4 DESC, localUid, remoteUid, 3";
+        break;
+    }
+
+    // Rows dropped by the recipient check must not count towards the limit
+    if (d->limit > 0 && !d->filterRecipient)
+        q += " LIMIT ?";
+
+    d->query = DatabaseIOPrivate::prepareQuery(QString::fromLatin1(q));
+    foreach (const QVariant &value, values)
+        d->query.addBindValue(value);
+    if (d->limit > 0 && !d->filterRecipient)
+        d->query.addBindValue(d->limit);
+
+    if (!d->query.exec()) {
+        qWarning() << "Failed to execute query:" << d->query.lastQuery();
+        qWarning() << "Error was:" << d->query.lastError();
+        d->query = QSqlQuery();
+        return false;
+    }
+
+    d->rowCount = 0;
+    return true;
+}
+
+bool ContactStatistics::next(Result &result)
+{
+    if (!d->query.isActive())
+        return false;
+
+    if (d->limit > 0 && d->rowCount >= d->limit) {
+        close();
+        return false;
+    }
+
+    while (d->query.next()) {
+        QString localUid = d->query.value(0).toString();
+        QString remoteUid = d->query.value(1).toString();
+        if (d->filterRecipient && !d->recipient.matches(Recipient(localUid, remoteUid)))
+            continue;
+
+        result.localUid = localUid;
+        result.remoteUid = remoteUid;
+        if (d->timeInterval == NoTimeInterval)
+            result.when = d->startTime.toUTC();
+        else
+            result.when = QDateTime::fromMSecsSinceEpoch(d->query.value(2).toLongLong() * 1000, Qt::UTC);
+        result.eventCount = d->query.value(3).toInt();
+        result.messageCount = d->query.value(4).toInt();
+        result.callCount = d->query.value(5).toInt();
+        result.missedCallCount = d->query.value(6).toInt();
+        result.callDuration = d->query.value(7).toLongLong();
+        d->rowCount++;
+        return true;
+    }
+
+    close();
+    return false;
+}
+
+void ContactStatistics::close()
+{
+    if (d->query.isActive())
+        d->query.finish();
+    d->query = QSqlQuery();
+}
+
+}
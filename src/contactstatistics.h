@@ -0,0 +1,137 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_CONTACTSTATISTICS_H
+#define COMMHISTORY_CONTACTSTATISTICS_H
+
+#include <QObject>
+#include <QDateTime>
+
+#include "libcommhistoryexport.h"
+#include "event.h"
+#include "recipient.h"
+
+namespace CommHistory {
+
+class ContactStatisticsPrivate;
+
+/*!
+ * \class ContactStatistics
+ *
+ * Per recipient event counts and call durations, optionally split into
+ * time buckets. Aggregation is done by the database, from the
+ * ContactActivity rollup for the whole days of the requested range.
+ *
+ * Buckets and rollup days are in UTC. Partial days at the ends of the
+ * range, as with ranges between local midnights, are counted from the
+ * events themselves, but buckets still start at UTC boundaries.
+ *
+ * Results can be read as a list with reload() and results(), or one row
+ * at a time with open() and next() when all contacts are wanted. Sorting
+ * by count or duration together with a limit gives top-K queries.
+ */
+class LIBCOMMHISTORY_EXPORT ContactStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum TimeInterval {
+        NoTimeInterval,
+        Yearly,
+        Monthly,
+        Weekly,
+        Daily
+    };
+    Q_ENUM(TimeInterval)
+
+    enum SortOrder {
+        SortByRecipient,
+        SortByEventCount,
+        SortByCallDuration
+    };
+    Q_ENUM(SortOrder)
+
+    struct Result {
+        QString localUid;
+        QString remoteUid;
+        // Start of the time bucket in UTC, or the start time without interval
+        QDateTime when;
+        int eventCount;
+        int messageCount;
+        int callCount;
+        int missedCallCount;
+        // Total call duration in seconds
+        qint64 callDuration;
+        Result() : eventCount(0), messageCount(0), callCount(0), missedCallCount(0), callDuration(0) {}
+    };
+
+    explicit ContactStatistics(QObject *parent = 0);
+    ~ContactStatistics();
+
+    // Events starting at or after startTime and before endTime are counted
+    void setStartTime(const QDateTime &dt);
+    QDateTime startTime() const;
+
+    void setEndTime(const QDateTime &dt);
+    QDateTime endTime() const;
+
+    void setEventType(Event::EventType type);
+    Event::EventType eventType() const;
+
+    // Restrict results to one recipient, phone numbers are matched loosely
+    void setRecipient(const Recipient &recipient);
+    Recipient recipient() const;
+
+    void setTimeInterval(TimeInterval timeInterval);
+    TimeInterval timeInterval() const;
+
+    void setSortOrder(SortOrder sortOrder);
+    SortOrder sortOrder() const;
+
+    // Maximum number of result rows, 0 for no limit
+    void setLimit(int limit);
+    int limit() const;
+
+    QList<CommHistory::ContactStatistics::Result> results() const;
+
+    bool reload();
+
+    bool open();
+    bool next(Result &result);
+    void close();
+
+Q_SIGNALS:
+    void startTimeChanged();
+    void endTimeChanged();
+    void eventTypeChanged();
+    void recipientChanged();
+    void timeIntervalChanged();
+    void sortOrderChanged();
+    void limitChanged();
+
+private:
+    ContactStatisticsPrivate *d;
+};
+
+}
+
+#endif // COMMHISTORY_CONTACTSTATISTICS_H
@@ -0,0 +1,464 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtDBus/QtDBus>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QThread>
+#include <QDir>
+
+#include <algorithm>
+
+#include "conversationcache_p.h"
+#include "databaseio_p.h"
+#include "commhistorydatabase.h"
+#include "commhistorydatabasepath.h"
+#include "updatesemitter.h"
+#include "constants.h"
+#include "debug.h"
+
+namespace {
+
+const int defaultMaxEntries = 16;
+
+inline bool eventSort(const CommHistory::Event &a, const CommHistory::Event &b)
+{
+    if (a.endTimeT() != b.endTimeT())
+        return a.endTimeT() > b.endTimeT();
+    return a.id() > b.id();
+}
+
+}
+
+namespace CommHistory {
+
+/* Reads conversations on a background thread, over a read-only connection
+ * of its own. Rows are handed back as plain values, because events and
+ * recipients must only be created on the thread of the cache. */
+class ConversationPrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConversationPrefetcher();
+    ~ConversationPrefetcher();
+
+public Q_SLOTS:
+    void fetch(int serial, int groupId, int limit);
+
+Q_SIGNALS:
+    void fetched(int serial, int groupId, int limit, bool ok,
+                 const QVariantList &events, const QVariantMap &extraProperties,
+                 const QVariantMap &messageParts);
+
+private:
+    bool open();
+    bool read(int groupId, int limit, QVariantList &events, QVariantMap &extraProperties,
+              QVariantMap &messageParts);
+
+    QString connectionName;
+    QSqlDatabase database;
+};
+
+ConversationPrefetcher::ConversationPrefetcher()
+{
+}
+
+ConversationPrefetcher::~ConversationPrefetcher()
+{
+    if (!connectionName.isEmpty()) {
+        database.close();
+        database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
+
+bool ConversationPrefetcher::open()
+{
+    if (database.isOpen())
+        return true;
+
+    // The database has been opened and upgraded by DatabaseIO already
+    if (connectionName.isEmpty()) {
+        connectionName = QString::fromLatin1("commhistory-prefetch-%1").arg(quintptr(this), 0, 16);
+        database = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), connectionName);
+        database.setDatabaseName(QDir(CommHistoryDatabasePath::databaseDir())
+                                 .absoluteFilePath(CommHistoryDatabasePath::databaseFile()));
+        database.setConnectOptions(QLatin1String("QSQLITE_OPEN_READONLY"));
+    }
+
+    if (!database.open()) {
+        qWarning() << "Failed to open commhistory database for prefetching";
+        qWarning() << database.lastError();
+        return false;
+    }
+    return true;
+}
+
+void ConversationPrefetcher::fetch(int serial, int groupId, int limit)
+{
+    QVariantList events;
+    QVariantMap extraProperties, messageParts;
+    bool ok = open() && read(groupId, limit, events, extraProperties, messageParts);
+    emit fetched(serial, groupId, limit, ok, events, extraProperties, messageParts);
+}
+
+bool ConversationPrefetcher::read(int groupId, int limit, QVariantList &events,
+                                  QVariantMap &extraProperties, QVariantMap &messageParts)
+{
+    QString q = DatabaseIOPrivate::eventQueryBase();
+    q += "WHERE Events.isDraft = 0 AND Events.groupId = :groupId "
+         "ORDER BY Events.endTime DESC, Events.id DESC ";
+    q += "LIMIT " + QString::number(limit);
+
+    QSqlQuery query = CommHistoryDatabase::prepare(q.toUtf8().constData(), database);
+    query.bindValue(":groupId", groupId);
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    // hasExtraProperties and hasMessageParts are the last columns
+    QList<int> extraIds, partIds;
+    while (query.next()) {
+        const int columns = query.record().count();
+        QVariantList values;
+        values.reserve(columns);
+        for (int i = 0; i < columns; i++)
+            values.append(query.value(i));
+
+        if (values.at(columns - 2).toBool())
+            extraIds.append(values.at(0).toInt());
+        if (values.at(columns - 1).toBool())
+            partIds.append(values.at(0).toInt());
+        events.append(QVariant(values));
+    }
+    query.finish();
+
+    foreach (int eventId, extraIds) {
+        QSqlQuery propertyQuery = CommHistoryDatabase::prepare(
+                "SELECT key, value FROM EventProperties WHERE eventId=:eventId", database);
+        propertyQuery.bindValue(":eventId", eventId);
+        if (!propertyQuery.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << propertyQuery.lastError();
+            return false;
+        }
+
+        QVariantMap properties;
+        while (propertyQuery.next())
+            properties.insert(propertyQuery.value(0).toString(), propertyQuery.value(1).toString());
+        extraProperties.insert(QString::number(eventId), properties);
+    }
+
+    foreach (int eventId, partIds) {
+        QSqlQuery partQuery = CommHistoryDatabase::prepare(
+                "SELECT id, contentId, contentType, path FROM MessageParts WHERE eventId=:eventId", database);
+        partQuery.bindValue(":eventId", eventId);
+        if (!partQuery.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << partQuery.lastError();
+            return false;
+        }
+
+        QVariantList parts;
+        while (partQuery.next()) {
+            parts.append(QVariant(QVariantList() << partQuery.value(0) << partQuery.value(1)
+                                                 << partQuery.value(2) << partQuery.value(3)));
+        }
+        messageParts.insert(QString::number(eventId), parts);
+    }
+
+    return true;
+}
+
+QWeakPointer<ConversationCache> ConversationCache::m_Instance;
+
+ConversationCache::ConversationCache()
+    : maxEntries(defaultMaxEntries)
+    , lastSerial(0)
+{
+    // Writes made in this process invalidate entries before they return,
+    // the D-Bus signals cover other processes
+    emitter = UpdatesEmitter::instance();
+    connect(emitter.data(), SIGNAL(eventsAdded(const QList<CommHistory::Event>&)),
+            this, SLOT(eventsChangedSlot(const QList<CommHistory::Event>&)));
+    connect(emitter.data(), SIGNAL(eventsUpdated(const QList<CommHistory::Event>&)),
+            this, SLOT(eventsChangedSlot(const QList<CommHistory::Event>&)));
+    connect(emitter.data(), SIGNAL(eventDeleted(int)),
+            this, SLOT(eventDeletedSlot(int)));
+    connect(emitter.data(), SIGNAL(groupsUpdated(const QList<int>&)),
+            this, SLOT(groupsChangedSlot(const QList<int>&)));
+    connect(emitter.data(), SIGNAL(groupsUpdatedFull(const QList<CommHistory::Group>&)),
+            this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group>&)));
+    connect(emitter.data(), SIGNAL(groupsDeleted(const QList<int>&)),
+            this, SLOT(groupsChangedSlot(const QList<int>&)));
+
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+        this, SLOT(eventsChangedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+        this, SLOT(eventsChangedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+        this, SLOT(eventDeletedSlot(int)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_SIGNAL,
+        this, SLOT(groupsChangedSlot(const QList<int> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+        this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+        this, SLOT(groupsChangedSlot(const QList<int> &)));
+}
+
+ConversationCache::~ConversationCache()
+{
+    foreach (const QPointer<ConversationPrefetcher> &prefetcher, prefetchers) {
+        if (prefetcher)
+            prefetcher->deleteLater();
+    }
+}
+
+QSharedPointer<ConversationCache> ConversationCache::instance()
+{
+    QSharedPointer<ConversationCache> result;
+    if (!m_Instance) {
+        result = QSharedPointer<ConversationCache>(new ConversationCache());
+        m_Instance = result.toWeakRef();
+    } else {
+        result = m_Instance.toStrongRef();
+    }
+
+    return result;
+}
+
+QSharedPointer<ConversationCache> ConversationCache::existingInstance()
+{
+    return m_Instance.toStrongRef();
+}
+
+int ConversationCache::capacity() const
+{
+    return maxEntries;
+}
+
+void ConversationCache::setCapacity(int capacity)
+{
+    maxEntries = qMax(capacity, 1);
+    while (usage.size() > maxEntries)
+        entries.remove(usage.takeFirst());
+}
+
+bool ConversationCache::contains(int groupId, int limit) const
+{
+    QHash<int, Entry>::const_iterator it = entries.constFind(groupId);
+    return it != entries.constEnd() && it->limit >= limit;
+}
+
+bool ConversationCache::fetch(int groupId, int limit)
+{
+    DEBUG() << Q_FUNC_INFO << groupId << limit;
+
+    QString q = DatabaseIOPrivate::eventQueryBase();
+    q += "WHERE Events.isDraft = 0 AND Events.groupId = :groupId "
+         "ORDER BY Events.endTime DESC, Events.id DESC ";
+    q += "LIMIT " + QString::number(limit);
+
+    QSqlQuery query = DatabaseIOPrivate::prepareQuery(q);
+    query.bindValue(":groupId", groupId);
+
+    Entry entry;
+    entry.limit = limit;
+    if (!DatabaseIOPrivate::readEvents(query, entry.events))
+        return false;
+
+    insert(groupId, entry);
+    return true;
+}
+
+void ConversationCache::fetchInBackground(int groupId, int limit, QThread *thread)
+{
+    DEBUG() << Q_FUNC_INFO << groupId << limit;
+
+    QPointer<ConversationPrefetcher> &prefetcher = prefetchers[thread];
+    if (!prefetcher) {
+        prefetcher = new ConversationPrefetcher;
+        prefetcher->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), prefetcher.data(), SLOT(deleteLater()));
+        connect(prefetcher.data(),
+                SIGNAL(fetched(int, int, int, bool, const QVariantList&, const QVariantMap&, const QVariantMap&)),
+                this,
+                SLOT(backgroundFetched(int, int, int, bool, const QVariantList&, const QVariantMap&, const QVariantMap&)),
+                Qt::QueuedConnection);
+    }
+
+    const int serial = ++lastSerial;
+    pending.insert(groupId, serial);
+    QMetaObject::invokeMethod(prefetcher.data(), "fetch", Qt::QueuedConnection,
+                              Q_ARG(int, serial), Q_ARG(int, groupId), Q_ARG(int, limit));
+}
+
+bool ConversationCache::isFetching(int groupId) const
+{
+    return pending.contains(groupId);
+}
+
+void ConversationCache::backgroundFetched(int serial, int groupId, int limit, bool ok,
+                                          const QVariantList &events, const QVariantMap &extraProperties,
+                                          const QVariantMap &messageParts)
+{
+    // Dropped if invalidated or requested again while being read
+    if (pending.value(groupId) == serial && pending.remove(groupId) && ok) {
+        Entry entry;
+        entry.limit = limit;
+        entry.events.reserve(events.size());
+        foreach (const QVariant &values, events) {
+            Event event;
+            bool hasExtraProperties, hasMessageParts;
+            DatabaseIOPrivate::readEventValues(values.toList(), event, hasExtraProperties, hasMessageParts);
+
+            const QString id = QString::number(event.id());
+            if (hasExtraProperties) {
+                event.setExtraProperties(extraProperties.value(id).toMap());
+                event.resetModifiedProperty(Event::ExtraProperties);
+            }
+            if (hasMessageParts) {
+                event.setMessageParts(QList<MessagePart>());
+                foreach (const QVariant &part, messageParts.value(id).toList()) {
+                    const QVariantList fields = part.toList();
+                    MessagePart messagePart;
+                    messagePart.setId(fields.value(0).toInt());
+                    messagePart.setContentId(fields.value(1).toString());
+                    messagePart.setContentType(fields.value(2).toString());
+                    messagePart.setPath(fields.value(3).toString());
+                    event.addMessagePart(messagePart);
+                }
+                event.resetModifiedProperty(Event::MessageParts);
+            }
+            entry.events.append(event);
+        }
+        insert(groupId, entry);
+    }
+
+    emit fetchFinished(groupId);
+}
+
+bool ConversationCache::lookup(const QList<int> &groupIds, int limit, QList<Event> &events)
+{
+    if (groupIds.isEmpty())
+        return false;
+
+    foreach (int groupId, groupIds) {
+        if (!contains(groupId, limit))
+            return false;
+    }
+
+    QList<Event> merged;
+    foreach (int groupId, groupIds) {
+        const QList<Event> &cached = entries[groupId].events;
+        merged.reserve(merged.size() + cached.size());
+        merged.append(cached);
+
+        usage.removeOne(groupId);
+        usage.append(groupId);
+    }
+
+    // Same order as the conversation query: endTime DESC, id DESC
+    if (groupIds.size() > 1)
+        std::sort(merged.begin(), merged.end(), eventSort);
+
+    events = merged.mid(0, limit);
+    return true;
+}
+
+void ConversationCache::insert(int groupId, const Entry &entry)
+{
+    usage.removeOne(groupId);
+    usage.append(groupId);
+    entries.insert(groupId, entry);
+
+    while (usage.size() > maxEntries)
+        entries.remove(usage.takeFirst());
+}
+
+void ConversationCache::invalidate(int groupId)
+{
+    pending.remove(groupId);
+    if (entries.remove(groupId))
+        usage.removeOne(groupId);
+}
+
+void ConversationCache::clear()
+{
+    pending.clear();
+    entries.clear();
+    usage.clear();
+}
+
+void ConversationCache::eventsChangedSlot(const QList<CommHistory::Event> &events)
+{
+    foreach (const Event &event, events)
+        invalidate(event.groupId());
+}
+
+void ConversationCache::eventDeletedSlot(int id)
+{
+    // Reads in progress may contain the event
+    pending.clear();
+
+    // The signal does not carry the group, so look for the event
+    QList<int> stale;
+    QHash<int, Entry>::const_iterator it = entries.constBegin();
+    for (; it != entries.constEnd(); ++it) {
+        foreach (const Event &event, it->events) {
+            if (event.id() == id) {
+                stale.append(it.key());
+                break;
+            }
+        }
+    }
+
+    foreach (int groupId, stale)
+        invalidate(groupId);
+}
+
+void ConversationCache::groupsChangedSlot(const QList<int> &groupIds)
+{
+    foreach (int groupId, groupIds)
+        invalidate(groupId);
+}
+
+void ConversationCache::groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups)
+{
+    foreach (const Group &group, groups)
+        invalidate(group.id());
+}
+
+}
+
+#include "conversationcache.moc"
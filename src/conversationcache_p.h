@@ -0,0 +1,134 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_CONVERSATIONCACHE_P_H
+#define COMMHISTORY_CONVERSATIONCACHE_P_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QWeakPointer>
+#include <QPointer>
+#include <QVariantList>
+
+#include "event.h"
+#include "group.h"
+
+class QThread;
+
+namespace CommHistory {
+
+class ConversationPrefetcher;
+class UpdatesEmitter;
+
+/*!
+ * \class ConversationCache
+ *
+ * Bounded, process-wide cache of the newest events of conversations,
+ * filled speculatively by GroupManager when conversation prefetching is
+ * enabled. A ConversationModel requesting a single group with a matching
+ * first chunk adopts the cached events instead of querying the database.
+ *
+ * Entries are dropped whenever the database reports a change to the group,
+ * and synchronously on writes made through the models of this process.
+ * The cache only exists while at least one prefetching manager holds it.
+ */
+class ConversationCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QSharedPointer<ConversationCache> instance();
+    static QSharedPointer<ConversationCache> existingInstance();
+
+    ~ConversationCache();
+
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    bool contains(int groupId, int limit) const;
+
+    /*!
+     * Read up to limit newest events of a group into the cache.
+     */
+    bool fetch(int groupId, int limit);
+
+    /*!
+     * Like fetch(), but the query runs on thread and fetchFinished() is
+     * emitted once its result has been stored or dropped. A result is
+     * dropped if the group was invalidated while it was being read.
+     */
+    void fetchInBackground(int groupId, int limit, QThread *thread);
+    bool isFetching(int groupId) const;
+
+    /*!
+     * Merge the cached events of the groups, newest first and truncated to
+     * limit, which is what a conversation query over these groups returns.
+     * Returns false unless every group has an entry covering limit events.
+     */
+    bool lookup(const QList<int> &groupIds, int limit, QList<Event> &events);
+
+    void invalidate(int groupId);
+    void clear();
+
+public Q_SLOTS:
+    void eventsChangedSlot(const QList<CommHistory::Event> &events);
+    void eventDeletedSlot(int id);
+    void groupsChangedSlot(const QList<int> &groupIds);
+    void groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups);
+
+Q_SIGNALS:
+    void fetchFinished(int groupId);
+
+private Q_SLOTS:
+    void backgroundFetched(int serial, int groupId, int limit, bool ok,
+                           const QVariantList &events, const QVariantMap &extraProperties,
+                           const QVariantMap &messageParts);
+
+private:
+    ConversationCache();
+
+    struct Entry {
+        int limit;
+        QList<Event> events;
+    };
+
+    void insert(int groupId, const Entry &entry);
+
+    QHash<int, Entry> entries;
+    // Least recently used first
+    QList<int> usage;
+    int maxEntries;
+
+    // Background reads in progress, by group
+    QHash<int, int> pending;
+    int lastSerial;
+    QHash<QThread*, QPointer<ConversationPrefetcher> > prefetchers;
+    QSharedPointer<UpdatesEmitter> emitter;
+
+    static QWeakPointer<ConversationCache> m_Instance;
+};
+
+}
+
+#endif
@@ -25,12 +25,16 @@
 #include <QSqlQuery>
 #include <QSqlError>
 
+#include <algorithm>
+
 #include "eventmodel_p.h"
 #include "conversationmodel.h"
 #include "conversationmodel_p.h"
+#include "conversationcache_p.h"
 #include "constants.h"
 #include "commhistorydatabase.h"
 #include "databaseio_p.h"
+#include "updatesemitter.h"
 #include "debug.h"
 
 namespace {
@@ -43,12 +47,40 @@ static CommHistory::Event::PropertySet unusedProperties = CommHistory::Event::Pr
 }
 namespace CommHistory {
 
+namespace {
+
+// Model order: most recent first, newest id first for equal times
+bool eventSortsBefore(const Event &a, const Event &b)
+{
+    if (a.endTimeT() != b.endTimeT())
+        return a.endTimeT() > b.endTimeT();
+    return a.id() > b.id();
+}
+
+}
+
 ConversationModelPrivate::ConversationModelPrivate(EventModel *model)
             : EventModelPrivate(model)
             , filterType(Event::UnknownType)
             , filterAccount(QString())
             , filterDirection(Event::UnknownDirection)
             , allGroups(false)
+            , mergeResolver(0)
+{
+    // The base class subscribed to event signals only, for all events
+    subscribeGroups();
+    updateEventSubscription();
+    // remove call properties
+    propertyMask -= unusedProperties;
+}
+
+void ConversationModelPrivate::subscribe()
+{
+    EventModelPrivate::subscribe();
+    subscribeGroups();
+}
+
+void ConversationModelPrivate::subscribeGroups()
 {
     QDBusConnection::sessionBus().connect(
         QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_ADDED_SIGNAL,
@@ -56,8 +88,68 @@ ConversationModelPrivate::ConversationModelPrivate(EventModel *model)
     QDBusConnection::sessionBus().connect(
         QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
         this, SLOT(groupsDeletedSlot(const QList<int> &)));
-    // remove call properties
-    propertyMask -= unusedProperties;
+}
+
+void ConversationModelPrivate::unsubscribe()
+{
+    EventModelPrivate::unsubscribe();
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_ADDED_SIGNAL,
+        this, SLOT(groupsAddedSlot(const QList<Group> &)));
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
+        this, SLOT(groupsDeletedSlot(const QList<int> &)));
+}
+
+bool ConversationModelPrivate::reload()
+{
+    Q_Q(ConversationModel);
+
+    if (allGroups)
+        return q->getEvents();
+    if (!filterGroupIds.isEmpty())
+        return q->getEvents(filterGroupIds.values());
+    return true;
+}
+
+QString ConversationModelPrivate::shareKey() const
+{
+    QStringList groups;
+    if (allGroups) {
+        groups.append(QStringLiteral("all"));
+    } else {
+        QList<int> ids = filterGroupIds.values();
+        std::sort(ids.begin(), ids.end());
+        foreach (int id, ids)
+            groups.append(QString::number(id));
+    }
+
+    QStringList key;
+    key << baseShareKey()
+        << groups.join(QLatin1Char(','))
+        << QString::number(filterType)
+        << filterAccount
+        << QString::number(filterDirection);
+    return key.join(QLatin1Char(':'));
+}
+
+QStringList ConversationModelPrivate::eventPaths() const
+{
+    QStringList paths;
+    if (!allGroups && !filterGroupIds.isEmpty()) {
+        QList<int> ids = filterGroupIds.values();
+        std::sort(ids.begin(), ids.end());
+        foreach (int id, ids)
+            paths.append(UpdatesEmitter::groupEventsPath(id));
+    } else if (filterType != Event::UnknownType) {
+        paths.append(UpdatesEmitter::typeEventsPath(filterType));
+    } else {
+        paths << UpdatesEmitter::typeEventsPath(Event::IMEvent)
+              << UpdatesEmitter::typeEventsPath(Event::SMSEvent)
+              << UpdatesEmitter::typeEventsPath(Event::MMSEvent)
+              << UpdatesEmitter::typeEventsPath(Event::StatusMessageEvent);
+    }
+    return paths;
 }
 
 void ConversationModelPrivate::groupsAddedSlot(const QList<Group> &/*groups*/)
@@ -78,23 +170,19 @@ void ConversationModelPrivate::groupsAddedSlot(const QList<Group> &/*groups*/)
 void ConversationModelPrivate::groupsDeletedSlot(const QList<int> &groupIds)
 {
     Q_Q(ConversationModel);
-    bool changed = false;
-
-    foreach (int group, groupIds) {
-        if (allGroups)
-            changed = true;
-        else if (filterGroupIds.remove(group))
-            changed = true;
-    }
 
-    // XXX This could be more efficient by removing events from this group without
-    // refreshing others
-    if (changed) {
-        if (allGroups)
+    if (allGroups) {
+        if (!groupIds.isEmpty())
             q->getEvents();
-        else
-            q->getEvents(filterGroupIds.values());
+        return;
     }
+
+    QSet<int> remaining = filterGroupIds;
+    foreach (int group, groupIds)
+        remaining.remove(group);
+
+    if (remaining.size() != filterGroupIds.size())
+        q->setGroups(remaining.toList());
 }
 
 bool ConversationModelPrivate::acceptsEvent(const Event &event) const
@@ -124,20 +212,8 @@ bool ConversationModelPrivate::acceptsEvent(const Event &event) const
     return true;
 }
 
-QSqlQuery ConversationModelPrivate::buildQuery() const
+QString ConversationModelPrivate::filterClause() const
 {
-    QList<int> groups = filterGroupIds.values();
-    QString q;
-    int unionCount = 0;
-
-    qint64 firstTimestamp = 0;
-    int firstId = -1;
-    if (eventRootItem->childCount() > 0) {
-        Event firstEvent = eventRootItem->eventAt(eventRootItem->childCount() - 1);
-        firstTimestamp = firstEvent.endTimeT();
-        firstId = firstEvent.id();
-    }
-
     QString filters;
     if (!filterAccount.isEmpty())
         filters += "AND Events.localUid = :filterAccount ";
@@ -145,10 +221,23 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
         filters += "AND Events.type = :filterType ";
     if (filterDirection != Event::UnknownDirection)
         filters += "AND Events.direction = :filterDirection ";
-    if (firstId >= 0) {
-        filters += "AND (Events.endTime < :firstTimestamp OR (Events.endTime = :firstTimestamp "
-                    "AND Events.id < :firstId)) ";
-    }
+    return filters;
+}
+
+void ConversationModelPrivate::bindFilters(QSqlQuery &query) const
+{
+    if (!filterAccount.isEmpty())
+        query.bindValue(":filterAccount", filterAccount);
+    if (filterType != Event::UnknownType)
+        query.bindValue(":filterType", filterType);
+    if (filterDirection != Event::UnknownDirection)
+        query.bindValue(":filterDirection", filterDirection);
+}
+
+QString ConversationModelPrivate::groupsQuery(const QList<int> &groups, const QString &filters) const
+{
+    QString q;
+    int unionCount = 0;
 
     if (!groups.isEmpty()) {
         /* Rather than the intuitive solution of groupId IN (1,2),
@@ -182,18 +271,33 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
     }
 
     q += "ORDER BY Events.endTime DESC, Events.id DESC ";
+    return q;
+}
+
+QSqlQuery ConversationModelPrivate::buildQuery() const
+{
+    qint64 firstTimestamp = 0;
+    int firstId = -1;
+    if (eventRootItem->childCount() > 0) {
+        Event firstEvent = eventRootItem->eventAt(eventRootItem->childCount() - 1);
+        firstTimestamp = firstEvent.endTimeT();
+        firstId = firstEvent.id();
+    }
+
+    QString filters = filterClause();
+    if (firstId >= 0) {
+        filters += "AND (Events.endTime < :firstTimestamp OR (Events.endTime = :firstTimestamp "
+                    "AND Events.id < :firstId)) ";
+    }
+
+    QString q = groupsQuery(filterGroupIds.values(), filters);
 
     if (!queryLimit && queryMode == EventModel::StreamedAsyncQuery && chunkSize > 0)
         q += "LIMIT " + QString::number((firstId < 0 && firstChunkSize > 0) ? firstChunkSize : chunkSize);
 
     QSqlQuery query = prepareQuery(q);
 
-    if (!filterAccount.isEmpty())
-        query.bindValue(":filterAccount", filterAccount);
-    if (filterType != Event::UnknownType)
-        query.bindValue(":filterType", filterType);
-    if (filterDirection != Event::UnknownDirection)
-        query.bindValue(":filterDirection", filterDirection);
+    bindFilters(query);
     if (firstId >= 0) {
         query.bindValue(":firstTimestamp", firstTimestamp);
         query.bindValue(":firstId", firstId);
@@ -202,13 +306,64 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
     return query;
 }
 
+QSqlQuery ConversationModelPrivate::buildMergeQuery(const QList<int> &groups) const
+{
+    // Only the events of the groups that fall within the rows already loaded;
+    // older events are fetched with the next chunk as usual.
+    QString filters = filterClause();
+    bool windowed = !isFullyLoaded() && eventRootItem->childCount() > 0;
+    if (windowed) {
+        filters += "AND (Events.endTime > :lastTimestamp OR (Events.endTime = :lastTimestamp "
+                   "AND Events.id > :lastId)) ";
+    }
+
+    QSqlQuery query = prepareQuery(groupsQuery(groups, filters));
+
+    bindFilters(query);
+    if (windowed) {
+        Event lastEvent = eventRootItem->eventAt(eventRootItem->childCount() - 1);
+        query.bindValue(":lastTimestamp", lastEvent.endTimeT());
+        query.bindValue(":lastId", lastEvent.id());
+    }
+
+    return query;
+}
+
+bool ConversationModelPrivate::adoptCachedEvents()
+{
+    // Only the plain first chunk of a streamed query is prefetched
+    if (queryMode != EventModel::StreamedAsyncQuery || queryLimit || chunkSize <= 0
+        || filterType != Event::UnknownType || !filterAccount.isEmpty()
+        || filterDirection != Event::UnknownDirection) {
+        return false;
+    }
+
+    QSharedPointer<ConversationCache> cache = ConversationCache::existingInstance();
+    if (!cache)
+        return false;
+
+    QList<Event> events;
+    int limit = firstChunkSize > 0 ? firstChunkSize : chunkSize;
+    if (!cache->lookup(filterGroupIds.values(), limit, events))
+        return false;
+
+    DEBUG() << Q_FUNC_INFO << "adopted" << events.size() << "prefetched events";
+
+    // The cache follows the same signals as the model
+    changeSequence = database()->changeSequence();
+    isReady = false;
+    const int count = events.size();
+    eventsReceivedSlot(0, count, std::move(events));
+    return true;
+}
+
 void ConversationModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events)
 {
     // There is no more data when a query returns no rows
     if (queryMode == EventModel::StreamedAsyncQuery && events.size() == 0)
         isReady = true;
 
-    EventModelPrivate::eventsReceivedSlot(start, end, events);
+    EventModelPrivate::eventsReceivedSlot(start, end, std::move(events));
 }
 
 void ConversationModelPrivate::modelUpdatedSlot(bool successful)
@@ -227,6 +382,131 @@ bool ConversationModelPrivate::isModelReady() const
     return isReady;
 }
 
+bool ConversationModelPrivate::isFullyLoaded() const
+{
+    // Streamed models are complete once a chunk comes back empty; others
+    // load all events with the first query
+    if (queryMode == EventModel::StreamedAsyncQuery && chunkSize > 0)
+        return isReady;
+    return true;
+}
+
+void ConversationModelPrivate::removeGroupEvents(const QSet<int> &groupIds)
+{
+    Q_Q(ConversationModel);
+
+    // Remove contiguous runs of rows, from the end so that rows before the
+    // current run keep their position
+    int row = eventRootItem->childCount() - 1;
+    while (row >= 0) {
+        if (!groupIds.contains(eventRootItem->eventAt(row).groupId())) {
+            row--;
+            continue;
+        }
+
+        int last = row;
+        while (row > 0 && groupIds.contains(eventRootItem->eventAt(row - 1).groupId()))
+            row--;
+
+        q->beginRemoveRows(QModelIndex(), row, last);
+        for (int i = last; i >= row; i--)
+            eventRootItem->removeAt(i);
+        q->endRemoveRows();
+        row--;
+    }
+
+    QMutableListIterator<Event> i(pendingMerged);
+    while (i.hasNext()) {
+        if (groupIds.contains(i.next().groupId()))
+            i.remove();
+    }
+}
+
+bool ConversationModelPrivate::mergeGroupEvents(const QList<int> &groupIds)
+{
+    QSqlQuery query = buildMergeQuery(groupIds);
+
+    QList<Event> events;
+    if (!DatabaseIOPrivate::readEvents(query, events))
+        return false;
+
+    DEBUG() << Q_FUNC_INFO << "merging" << events.size() << "events from groups" << groupIds;
+
+    if (events.isEmpty())
+        return true;
+
+    if (resolveContacts == EventModel::ResolveImmediately) {
+        if (!mergeResolver) {
+            mergeResolver = new ContactResolver(this);
+            connect(mergeResolver, SIGNAL(finished()), SLOT(mergeResolverFinished()));
+        }
+
+        pendingMerged.append(events);
+        mergeResolver->add(events);
+    } else {
+        mergeEvents(events);
+    }
+
+    return true;
+}
+
+void ConversationModelPrivate::mergeResolverFinished()
+{
+    QList<Event> resolved(pendingMerged);
+    pendingMerged.clear();
+
+    QList<Event>::iterator it = resolved.begin(), end = resolved.end();
+    for ( ; it != end; ++it) {
+        Event &event(*it);
+        if (!event.isResolved() && event.recipients().allContactsResolved())
+            event.setIsResolved(true);
+    }
+
+    std::sort(resolved.begin(), resolved.end(), eventSortsBefore);
+    mergeEvents(resolved);
+}
+
+void ConversationModelPrivate::mergeEvents(const QList<Event> &events)
+{
+    Q_Q(ConversationModel);
+
+    // events are in model order; walk both lists once, inserting each run
+    // of new events in front of the first loaded row that sorts after them
+    bool complete = isFullyLoaded();
+    int row = 0;
+    int i = 0;
+    while (i < events.size()) {
+        const Event &event = events.at(i);
+        if (!acceptsEvent(event) || findEvent(event.id()).isValid()) {
+            i++;
+            continue;
+        }
+
+        while (row < eventRootItem->childCount() && eventSortsBefore(eventRootItem->eventAt(row), event))
+            row++;
+
+        // Past the loaded rows of an incomplete model, fetchMore() has them
+        if (row == eventRootItem->childCount() && !complete)
+            break;
+
+        QList<Event> run;
+        run.append(event);
+        i++;
+        while (i < events.size()
+               && (row == eventRootItem->childCount() || eventSortsBefore(events.at(i), eventRootItem->eventAt(row)))) {
+            if (acceptsEvent(events.at(i)) && !findEvent(events.at(i).id()).isValid())
+                run.append(events.at(i));
+            i++;
+        }
+
+        q->beginInsertRows(QModelIndex(), row, row + run.size() - 1);
+        for (int j = 0; j < run.size(); j++)
+            eventRootItem->insertChildAt(row + j, newItem(run.at(j), eventRootItem));
+        q->endInsertRows();
+        row += run.size();
+    }
+}
+
 ConversationModel::ConversationModel(QObject *parent)
         : EventModel(*new ConversationModelPrivate(this), parent)
 {
@@ -274,10 +554,56 @@ bool ConversationModel::getEvents(QList<int> groupIds)
     if (d->filterGroupIds.isEmpty())
         return true;
 
+    if (d->attachShared() || d->adoptCachedEvents())
+        return true;
+
     QSqlQuery query = d->buildQuery();
     return d->executeQuery(query);
 }
 
+bool ConversationModel::setGroups(QList<int> groupIds)
+{
+    Q_D(ConversationModel);
+
+    // Only a loaded flat model can be patched in place
+    if (d->allGroups || d->filterGroupIds.isEmpty() || d->isInTreeMode || d->queryLimit
+        || d->eventRootItem->childCount() == 0 || !d->pendingReceived.isEmpty()) {
+        return getEvents(groupIds);
+    }
+
+    QSet<int> groups = QSet<int>::fromList(groupIds);
+    QSet<int> removed = d->filterGroupIds - groups;
+    QList<int> added = (groups - d->filterGroupIds).toList();
+
+    DEBUG() << Q_FUNC_INFO << "added" << added << "removed" << removed.toList();
+
+    // Patched rows are no longer those of other models with the old groups
+    if (d->detachShared())
+        d->connectEventSignals();
+    d->filterGroupIds = groups;
+    d->updateEventSubscription();
+
+    if (groups.isEmpty()) {
+        beginResetModel();
+        d->clearEvents();
+        endResetModel();
+        return true;
+    }
+
+    if (!removed.isEmpty()) {
+        d->removeGroupEvents(removed);
+
+        // Nothing left to continue fetching from
+        if (d->eventRootItem->childCount() == 0)
+            return getEvents(groupIds);
+    }
+
+    if (!added.isEmpty())
+        return d->mergeGroupEvents(added);
+
+    return true;
+}
+
 bool ConversationModel::getEvents()
 {
     Q_D(ConversationModel);
@@ -289,6 +615,9 @@ bool ConversationModel::getEvents()
     d->clearEvents();
     endResetModel();
 
+    if (d->attachShared())
+        return true;
+
     QSqlQuery query = d->buildQuery();
     return d->executeQuery(query);
 }
@@ -91,6 +91,16 @@ public:
      * \return true if successful, otherwise false
      */
     bool getEvents(QList<int> groupIds);
+    /*!
+     * Change the groups of the conversation without resetting the model.
+     * Events of removed groups are removed, and events of added groups
+     * are merged into the rows already loaded; rows that remain are kept
+     * as they are. Falls back to getEvents() if nothing is loaded yet.
+     *
+     * \param groupIds List of valid group IDs
+     * \return true if successful, otherwise false
+     */
+    bool setGroups(QList<int> groupIds);
     /*!
      * Reset model to all events.
      *
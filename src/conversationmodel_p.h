@@ -41,14 +41,31 @@ public:
     ConversationModelPrivate(EventModel *model);
 
     bool acceptsEvent(const Event &event) const;
+    QString filterClause() const;
+    void bindFilters(QSqlQuery &query) const;
+    QString groupsQuery(const QList<int> &groups, const QString &filters) const;
     QSqlQuery buildQuery() const;
+    QSqlQuery buildMergeQuery(const QList<int> &groups) const;
+    bool adoptCachedEvents();
+    bool reload();
+    QString shareKey() const;
+    QStringList eventPaths() const;
+    void subscribe();
+    void subscribeGroups();
+    void unsubscribe();
     bool isModelReady() const;
+    bool isFullyLoaded() const;
+
+    void removeGroupEvents(const QSet<int> &groupIds);
+    bool mergeGroupEvents(const QList<int> &groupIds);
+    void mergeEvents(const QList<Event> &events);
 
 public Q_SLOTS:
     virtual void eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events);
     virtual void modelUpdatedSlot(bool successful);
     void groupsAddedSlot(const QList<Group> &groups);
     void groupsDeletedSlot(const QList<int> &groupIds);
+    void mergeResolverFinished();
 
 public:
     QSet<int> filterGroupIds;
@@ -56,6 +73,9 @@ public:
     QString filterAccount;
     Event::EventDirection filterDirection;
     bool allGroups;
+
+    ContactResolver *mergeResolver;
+    QList<Event> pendingMerged;
 };
 
 }
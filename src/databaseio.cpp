@@ -24,15 +24,34 @@
 #include "databaseio.h"
 #include "commhistorydatabase.h"
 #include "contactlistener.h"
+#include "updatesemitter.h"
 #include "group.h"
+#include "sqliterows_p.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QTimer>
+#include <QMutex>
 #include "debug.h"
 
 using namespace CommHistory;
 
 Q_GLOBAL_STATIC(DatabaseIO, databaseIO)
 
+namespace {
+
+const int migrationBatchSize = 200;
+// Leave room for other queries and processes between batches
+const int migrationBatchInterval = 50;
+const int migrationRetryInterval = 5000;
+
+// Cached query results are bounded by entries and by total rows, larger
+// results are not cached at all
+const int maxCachedQueries = 32;
+const int maxCachedRows = 2000;
+const int maxCachedResultRows = 500;
+
+}
+
 class QueryHelper {
 public:
     typedef QPair<QByteArray,QVariant> Field;
@@ -295,6 +314,7 @@ public:
     {
         if (!active)
             return false;
+        DatabaseIOPrivate::instance()->clearQueryCache();
         QSqlQuery query(db);
         bool re = query.exec("ROLLBACK TO " + name);
         if (!re)
@@ -331,6 +351,15 @@ DatabaseIOPrivate *DatabaseIOPrivate::instance()
 
 DatabaseIOPrivate::DatabaseIOPrivate(DatabaseIO *p)
     : q(p)
+    , migrationTimer(0)
+    , upgradeProgress(100)
+    , groupActivityMigrated(false)
+    , contactActivityMigrated(false)
+    , queryCacheRows(0)
+    , queryCacheDataVersion(-1)
+    , queryCacheChanges(-1)
+    , queryCacheHits(0)
+    , queryCacheMisses(0)
 {
 }
 
@@ -351,12 +380,159 @@ QSqlQuery DatabaseIOPrivate::prepareQuery(const QString &s, int limit, int offse
 
 QSqlDatabase &DatabaseIOPrivate::connection()
 {
-    if (!m_pConnection.isValid())
+    if (!m_pConnection.isValid()) {
         m_pConnection = CommHistoryDatabase::open("commhistory");
+        if (m_pConnection.isOpen())
+            startMigrations();
+    }
 
     return m_pConnection;
 }
 
+void DatabaseIOPrivate::startMigrations()
+{
+    upgradeProgress = migrationProgress();
+    if (upgradeProgress >= 100)
+        return;
+
+    qWarning() << "Migrating commhistory database in the background," << upgradeProgress << "% done";
+
+    if (!migrationTimer) {
+        migrationTimer = new QTimer(this);
+        migrationTimer->setSingleShot(true);
+        connect(migrationTimer, SIGNAL(timeout()), SLOT(runMigrationBatch()));
+    }
+    migrationTimer->start(migrationBatchInterval);
+}
+
+int DatabaseIOPrivate::migrationProgress()
+{
+    int done = 0, total = 0;
+    if (!CommHistoryDatabase::migrationProgress(m_pConnection, &done, &total) || total <= 0)
+        return 100;
+
+    return qMin(100, int((qint64(done) * 100) / total));
+}
+
+void DatabaseIOPrivate::runMigrationBatch()
+{
+    bool finished = false;
+    if (!CommHistoryDatabase::runMigrationBatch(m_pConnection, migrationBatchSize, &finished)) {
+        // Most likely another process is writing, try again later
+        migrationTimer->start(migrationRetryInterval);
+        return;
+    }
+
+    int progress = finished ? 100 : qMin(99, migrationProgress());
+    if (progress != upgradeProgress) {
+        upgradeProgress = progress;
+        DEBUG() << Q_FUNC_INFO << "migration progress" << progress;
+
+        if (!emitter)
+            emitter = UpdatesEmitter::instance();
+        emit emitter->upgradeProgress(progress);
+        emit q->upgradeProgressChanged(progress);
+    }
+
+    if (finished) {
+        qWarning() << "Finished migrating commhistory database";
+        emitter.clear();
+    } else {
+        migrationTimer->start(migrationBatchInterval);
+    }
+}
+
+bool DatabaseIOPrivate::groupActivityAvailable()
+{
+    // Groups.lastEventTime is only reliable once it has been backfilled
+    if (!groupActivityMigrated)
+        groupActivityMigrated = CommHistoryDatabase::migrationFinished(connection(), "groups_lastEventTime");
+    return groupActivityMigrated;
+}
+
+bool DatabaseIOPrivate::contactActivityAvailable()
+{
+    // ContactActivity is missing older events until it has been backfilled
+    if (!contactActivityMigrated)
+        contactActivityMigrated = CommHistoryDatabase::migrationFinished(connection(), "contact_activity");
+    return contactActivityMigrated;
+}
+
+QString DatabaseIOPrivate::queryCacheKey(const QSqlQuery &query)
+{
+    QString key = query.lastQuery();
+    const QMap<QString, QVariant> values = query.boundValues();
+    for (QMap<QString, QVariant>::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+        key += QLatin1Char('\n') + it.key() + QLatin1Char('=') + QLatin1String(it.value().typeName())
+             + QLatin1Char(':') + it.value().toString();
+    }
+    return key;
+}
+
+bool DatabaseIOPrivate::findCachedResult(const QString &key, QVariant &result)
+{
+    // PRAGMA data_version changes when another connection commits, and
+    // total_changes() counts the rows changed through this one
+    if (!dataVersionQuery.isValid()) {
+        dataVersionQuery = CommHistoryDatabase::prepare("PRAGMA data_version", connection());
+        totalChangesQuery = CommHistoryDatabase::prepare("SELECT total_changes()", connection());
+    }
+
+    qint64 dataVersion = -1, changes = -1;
+    if (dataVersionQuery.exec() && dataVersionQuery.next())
+        dataVersion = dataVersionQuery.value(0).toLongLong();
+    dataVersionQuery.finish();
+    if (totalChangesQuery.exec() && totalChangesQuery.next())
+        changes = totalChangesQuery.value(0).toLongLong();
+    totalChangesQuery.finish();
+
+    if (dataVersion < 0 || changes < 0 || dataVersion != queryCacheDataVersion
+            || changes != queryCacheChanges) {
+        clearQueryCache();
+        queryCacheDataVersion = dataVersion;
+        queryCacheChanges = changes;
+    }
+
+    QHash<QString, QVariant>::const_iterator it = queryCache.constFind(key);
+    if (it == queryCache.constEnd()) {
+        queryCacheMisses++;
+        return false;
+    }
+
+    queryCacheHits++;
+    result = *it;
+    return true;
+}
+
+void DatabaseIOPrivate::cacheResult(const QString &key, const QVariant &result, int rows)
+{
+    // Nothing is cached when the database version could not be read
+    if (queryCacheDataVersion < 0 || queryCacheChanges < 0 || rows > maxCachedResultRows
+            || queryCache.contains(key))
+        return;
+
+    while (!queryCacheOrder.isEmpty()
+           && (queryCacheOrder.size() >= maxCachedQueries || queryCacheRows + rows > maxCachedRows)) {
+        const QPair<QString, int> oldest = queryCacheOrder.dequeue();
+        queryCache.remove(oldest.first);
+        queryCacheRows -= oldest.second;
+    }
+
+    queryCache.insert(key, result);
+    queryCacheOrder.enqueue(qMakePair(key, rows));
+    queryCacheRows += rows;
+}
+
+void DatabaseIOPrivate::clearQueryCache()
+{
+    queryCache.clear();
+    queryCacheOrder.clear();
+    queryCacheRows = 0;
+    // Changes that are rolled back leave the version counters as they are
+    queryCacheDataVersion = -1;
+    queryCacheChanges = -1;
+}
+
 QSqlQuery DatabaseIOPrivate::createQuery()
 {
     return QSqlQuery(connection());
@@ -409,6 +585,115 @@ bool DatabaseIO::addEvent(Event &event)
     return savepoint.release();
 }
 
+bool DatabaseIO::upsertEventByToken(Event &event, MergePolicy policy, bool *inserted)
+{
+    if (event.type() == Event::UnknownType) {
+        qWarning() << Q_FUNC_INFO << "Event type not set";
+        return false;
+    }
+
+    if (event.direction() == Event::UnknownDirection) {
+        qWarning() << Q_FUNC_INFO << "Event direction not set";
+        return false;
+    }
+
+    if (event.groupId() == -1) {
+        qWarning() << Q_FUNC_INFO << "Group id not set";
+        return false;
+    }
+
+    if (event.messageToken().isEmpty()) {
+        qWarning() << Q_FUNC_INFO << "Message token not set";
+        return false;
+    }
+
+    AutoSavepoint savepoint(d->connection());
+    if (!savepoint.begin())
+        return false;
+
+    // Inserted only if the group has no event with the token. The
+    // statement takes the write lock before it reads, so other processes
+    // cannot add the token in between.
+    QueryHelper::FieldList fields = QueryHelper::eventFields(event, event.allProperties());
+    QSqlQuery query = QueryHelper::insertQuery(
+        "INSERT INTO Events (:fields) SELECT :values WHERE NOT EXISTS ("
+        "SELECT 1 FROM Events WHERE groupId=:keyGroupId AND messageToken=:keyToken"
+        " AND messageToken != '')", fields);
+    query.bindValue(":keyGroupId", event.groupId());
+    query.bindValue(":keyToken", event.messageToken());
+
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    const bool added = query.numRowsAffected() > 0;
+    const int insertId = added ? query.lastInsertId().toInt() : -1;
+    query.finish();
+
+    if (added) {
+        event.setId(insertId);
+
+        QVariantMap extraProperties = event.extraProperties();
+        if (!extraProperties.isEmpty() && !d->insertEventProperties(event.id(), extraProperties))
+            return false;
+
+        if (!event.messageParts().isEmpty() && !d->insertMessageParts(event))
+            return false;
+    } else {
+        // The insert started the write transaction, so the event cannot
+        // change until the savepoint is released. Events stored more than
+        // once by other writers resolve to the most recent one.
+        query = CommHistoryDatabase::prepare(
+            "SELECT id FROM Events WHERE groupId=:groupId AND messageToken=:messageToken"
+            " AND messageToken != '' ORDER BY id DESC LIMIT 1", d->connection());
+        query.bindValue(":groupId", event.groupId());
+        query.bindValue(":messageToken", event.messageToken());
+        if (!query.exec() || !query.next()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << query.lastError();
+            qWarning() << query.lastQuery();
+            return false;
+        }
+        event.setId(query.value(0).toInt());
+        query.finish();
+
+        Event::PropertySet updated;
+        if (policy == ReplaceExisting)
+            updated = event.allProperties();
+        else if (policy == MergeModified)
+            updated = event.modifiedProperties();
+        // The key of the event stays the same
+        updated.remove(Event::GroupId);
+        updated.remove(Event::MessageToken);
+
+        QueryHelper::FieldList updatedFields = QueryHelper::eventFields(event, updated);
+        if (!updatedFields.isEmpty()) {
+            query = QueryHelper::updateQuery("UPDATE Events SET :fields WHERE id=:eventId", updatedFields);
+            query.bindValue(":eventId", event.id());
+            if (!query.exec()) {
+                qWarning() << "Failed to execute query";
+                qWarning() << query.lastError();
+                qWarning() << query.lastQuery();
+                return false;
+            }
+            query.finish();
+        }
+
+        if (!d->updateEventDetails(event, updated))
+            return false;
+    }
+
+    if (!savepoint.release())
+        return false;
+
+    if (inserted)
+        *inserted = added;
+    return true;
+}
+
 bool DatabaseIOPrivate::insertEventProperties(int eventId, const QVariantMap &properties)
 {
     QSqlQuery query = CommHistoryDatabase::prepare(
@@ -467,6 +752,57 @@ bool DatabaseIOPrivate::insertMessageParts(Event &event)
     return true;
 }
 
+bool DatabaseIOPrivate::updateEventDetails(Event &event, const Event::PropertySet &properties)
+{
+    QSqlQuery query;
+
+    if (properties.contains(Event::ExtraProperties)) {
+        const char *q = "DELETE FROM EventProperties WHERE eventId=:eventId";
+        query = CommHistoryDatabase::prepare(q, connection());
+        query.bindValue(":eventId", event.id());
+        if (!query.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << query.lastError();
+            qWarning() << query.lastQuery();
+            return false;
+        }
+        query.finish();
+
+        QVariantMap extraProperties = event.extraProperties();
+        if (!extraProperties.isEmpty() && !insertEventProperties(event.id(), extraProperties))
+            return false;
+    }
+
+    if (properties.contains(Event::MessageParts)) {
+        QList<MessagePart> parts = event.messageParts();
+        QByteArray idList;
+        foreach (const MessagePart &part, parts) {
+            if (part.id() >= 0) {
+                if (!idList.isEmpty())
+                    idList.append(',');
+                idList.append(QString::number(part.id()));
+            }
+        }
+
+        // Parts with no associated event are cleaned up asynchronously
+        QByteArray q = "UPDATE MessageParts SET eventId=NULL WHERE eventId=:eventId AND id NOT IN (" + idList + ")";
+        query = CommHistoryDatabase::prepare(q, connection());
+        query.bindValue(":eventId", event.id());
+        if (!query.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << query.lastError();
+            qWarning() << query.lastQuery();
+            return false;
+        }
+        query.finish();
+
+        if (!event.messageParts().isEmpty() && !insertMessageParts(event))
+            return false;
+    }
+
+    return true;
+}
+
 // See http://www.sqlite.org/fileformat2.html#seqtab
 bool DatabaseIO::reserveEventIds(int count, int *firstReservedId)
 {
@@ -606,53 +942,160 @@ QString DatabaseIOPrivate::categoryClause(int categoryMask)
     return rv;
 }
 
-void DatabaseIOPrivate::readEventResult(QSqlQuery &query, Event &event, bool &hasExtraProperties,
-        bool &hasMessageParts)
+// Column access on the current row of a QSqlQuery, with the same
+// interface as SqliteRows
+class QueryRow
+{
+public:
+    explicit QueryRow(QSqlQuery &query) : m_query(query) {}
+
+    bool isNull(int column) const { return m_query.value(column).isNull(); }
+    int intValue(int column) const { return m_query.value(column).toInt(); }
+    quint32 uintValue(int column) const { return m_query.value(column).toUInt(); }
+    bool boolValue(int column) const { return m_query.value(column).toBool(); }
+    QString stringValue(int column) const { return m_query.value(column).toString(); }
+    QString sharedStringValue(int column) const { return stringValue(column); }
+
+private:
+    QSqlQuery &m_query;
+};
+
+// Column access on the values of a row, with the same interface as
+// SqliteRows
+class ValueRow
+{
+public:
+    explicit ValueRow(const QVariantList &values) : m_values(values) {}
+
+    bool isNull(int column) const { return m_values.value(column).isNull(); }
+    int intValue(int column) const { return m_values.value(column).toInt(); }
+    quint32 uintValue(int column) const { return m_values.value(column).toUInt(); }
+    bool boolValue(int column) const { return m_values.value(column).toBool(); }
+    QString stringValue(int column) const { return m_values.value(column).toString(); }
+    QString sharedStringValue(int column) const { return stringValue(column); }
+
+private:
+    const QVariantList &m_values;
+};
+
+template <typename Row>
+static void decodeEvent(Row &row, Event &event, bool &hasExtraProperties, bool &hasMessageParts)
 {
     int field = 0;
-    event.setId(query.value(field).toInt());
-    event.setType(static_cast<Event::EventType>(query.value(++field).toInt()));
-    event.setStartTimeT(query.value(++field).toUInt());
-    event.setEndTimeT(query.value(++field).toUInt());
-    event.setDirection(static_cast<Event::EventDirection>(query.value(++field).toInt()));
-    event.setIsDraft(query.value(++field).toBool());
-    event.setIsRead(query.value(++field).toBool());
-    event.setIsMissedCall(query.value(++field).toBool());
-    event.setIsEmergencyCall(query.value(++field).toBool());
-    event.setStatus(static_cast<Event::EventStatus>(query.value(++field).toInt()));
-    event.setBytesReceived(query.value(++field).toInt());
-    event.setLocalUid(query.value(++field).toString());
-    event.setRecipients(Recipient(event.localUid(), query.value(++field).toString()));
-    event.setSubject(query.value(++field).toString());
-    event.setFreeText(query.value(++field).toString());
-    if (query.value(++field).isNull())
+    event.setId(row.intValue(field));
+    event.setType(static_cast<Event::EventType>(row.intValue(++field)));
+    event.setStartTimeT(row.uintValue(++field));
+    event.setEndTimeT(row.uintValue(++field));
+    event.setDirection(static_cast<Event::EventDirection>(row.intValue(++field)));
+    event.setIsDraft(row.boolValue(++field));
+    event.setIsRead(row.boolValue(++field));
+    event.setIsMissedCall(row.boolValue(++field));
+    event.setIsEmergencyCall(row.boolValue(++field));
+    event.setStatus(static_cast<Event::EventStatus>(row.intValue(++field)));
+    event.setBytesReceived(row.intValue(++field));
+    event.setLocalUid(row.sharedStringValue(++field));
+    event.setRecipients(Recipient(event.localUid(), row.sharedStringValue(++field)));
+    event.setSubject(row.stringValue(++field));
+    event.setFreeText(row.stringValue(++field));
+    if (row.isNull(++field))
         event.setGroupId(-1);
     else
-        event.setGroupId(query.value(field).toInt());
-    event.setMessageToken(query.value(++field).toString());
-    event.setLastModifiedT(query.value(++field).toUInt());
-    QString vCardFileName = query.value(++field).toString();
-    QString vCardLabel = query.value(++field).toString();
+        event.setGroupId(row.intValue(field));
+    event.setMessageToken(row.stringValue(++field));
+    event.setLastModifiedT(row.uintValue(++field));
+    QString vCardFileName = row.stringValue(++field);
+    QString vCardLabel = row.stringValue(++field);
     event.setFromVCard(vCardFileName, vCardLabel);
-    event.setReportDelivery(query.value(++field).toBool());
-    event.setValidityPeriod(query.value(++field).toInt());
-    event.setContentLocation(query.value(++field).toString());
+    event.setReportDelivery(row.boolValue(++field));
+    event.setValidityPeriod(row.intValue(++field));
+    event.setContentLocation(row.stringValue(++field));
 
     QHash<QString,QString> headers;
-    QStringList hf = query.value(++field).toString().split('\x1c');
+    QStringList hf = row.stringValue(++field).split('\x1c');
     foreach (QString h, hf) {
         QStringList fields = h.split('\x1d');
         if (fields.size() == 2)
             headers.insert(fields.value(0), fields.value(1));
     }
     event.setHeaders(headers);
-    event.setReadStatus(static_cast<Event::EventReadStatus>(query.value(++field).toInt()));
-    event.setReportRead(query.value(++field).toBool());
-    event.setReportReadRequested(query.value(++field).toBool());
-    event.setMmsId(query.value(++field).toString());
-    event.setIsAction(query.value(++field).toBool());
-    hasExtraProperties = query.value(++field).toBool();
-    hasMessageParts = query.value(++field).toBool();
+    event.setReadStatus(static_cast<Event::EventReadStatus>(row.intValue(++field)));
+    event.setReportRead(row.boolValue(++field));
+    event.setReportReadRequested(row.boolValue(++field));
+    event.setMmsId(row.stringValue(++field));
+    event.setIsAction(row.boolValue(++field));
+    hasExtraProperties = row.boolValue(++field);
+    hasMessageParts = row.boolValue(++field);
+}
+
+void DatabaseIOPrivate::readEventResult(QSqlQuery &query, Event &event, bool &hasExtraProperties,
+        bool &hasMessageParts)
+{
+    QueryRow row(query);
+    decodeEvent(row, event, hasExtraProperties, hasMessageParts);
+}
+
+void DatabaseIOPrivate::readEventValues(const QVariantList &values, Event &event, bool &hasExtraProperties,
+        bool &hasMessageParts)
+{
+    ValueRow row(values);
+    decodeEvent(row, event, hasExtraProperties, hasMessageParts);
+}
+
+template <typename Row>
+static void appendEvent(Row &row, QList<Event> &events, QList<int> &extraPropertyIndices,
+        QList<int> &hasPartsIndices)
+{
+    Event e;
+    bool extra = false, parts = false;
+    decodeEvent(row, e, extra, parts);
+    if (extra)
+        extraPropertyIndices.append(events.size());
+    if (parts)
+        hasPartsIndices.append(events.size());
+    events.append(e);
+}
+
+bool DatabaseIOPrivate::readEvents(QSqlQuery &query, QList<Event> &events)
+{
+    DatabaseIOPrivate *d = instance();
+    const QString key = queryCacheKey(query);
+    QVariant cached;
+    if (d->findCachedResult(key, cached)) {
+        events.append(cached.value<QList<Event> >());
+        return true;
+    }
+    const int firstRow = events.size();
+
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    QList<int> extraPropertyIndices;
+    QList<int> hasPartsIndices;
+    SqliteRows rows(query);
+    if (rows.isValid()) {
+        while (rows.next())
+            appendEvent(rows, events, extraPropertyIndices, hasPartsIndices);
+    } else {
+        QueryRow row(query);
+        while (query.next())
+            appendEvent(row, events, extraPropertyIndices, hasPartsIndices);
+    }
+    query.finish();
+
+    if (rows.hasError())
+        return false;
+
+    foreach (int i, extraPropertyIndices)
+        DatabaseIO::instance()->getEventExtraProperties(events[i]);
+    foreach (int i, hasPartsIndices)
+        DatabaseIO::instance()->getMessageParts(events[i]);
+
+    d->cacheResult(key, QVariant::fromValue(events.mid(firstRow)), events.size() - firstRow);
+    return true;
 }
 
 bool DatabaseIO::getEvent(int id, Event &event)
@@ -688,6 +1131,31 @@ bool DatabaseIO::getEvent(int id, Event &event)
     return re;
 }
 
+bool DatabaseIO::getEventsByIds(const QList<int> &ids, QList<Event> &events)
+{
+    // Stay well below SQLITE_MAX_VARIABLE_NUMBER
+    static const int maxBatch = 500;
+
+    for (int first = 0; first < ids.size(); first += maxBatch) {
+        QList<int> batch = ids.mid(first, maxBatch);
+
+        QByteArray q = baseEventQuery;
+        q += "\n WHERE Events.id IN (?";
+        for (int i = 1; i < batch.size(); i++)
+            q += ",?";
+        q += ")";
+
+        QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+        foreach (int id, batch)
+            query.addBindValue(id);
+
+        if (!DatabaseIOPrivate::readEvents(query, events))
+            return false;
+    }
+
+    return true;
+}
+
 bool DatabaseIO::getEventExtraProperties(Event &event)
 {
     const char *q = "SELECT key, value FROM EventProperties WHERE eventId=:eventId";
@@ -735,13 +1203,138 @@ bool DatabaseIO::getMessageParts(Event &event)
     return true;
 }
 
-bool DatabaseIO::getEventByMessageToken(const QString &token, Event &event)
+namespace CommHistory {
+
+class EventCursorPrivate
+{
+public:
+    QSqlQuery query;
+    RecipientList recipients;
+};
+
+}
+
+EventCursor::EventCursor()
+    : d(new EventCursorPrivate)
+{
+}
+
+EventCursor::~EventCursor()
+{
+    close();
+    delete d;
+}
+
+bool EventCursor::next(Event &event)
+{
+    while (d->query.isActive() && d->query.next()) {
+        Event e;
+        bool extra = false, parts = false;
+        DatabaseIOPrivate::readEventResult(d->query, e, extra, parts);
+
+        // The phone number clauses only prefilter, same as in RecipientEventModel
+        if (!d->recipients.isEmpty() && !d->recipients.intersectsMatch(e.recipients()))
+            continue;
+
+        if (extra)
+            DatabaseIO::instance()->getEventExtraProperties(e);
+        if (parts)
+            DatabaseIO::instance()->getMessageParts(e);
+
+        event = e;
+        return true;
+    }
+
+    close();
+    return false;
+}
+
+bool EventCursor::isActive() const
+{
+    return d->query.isActive();
+}
+
+void EventCursor::close()
+{
+    if (d->query.isActive())
+        d->query.finish();
+    d->query = QSqlQuery();
+    d->recipients = RecipientList();
+}
+
+QByteArray DatabaseIOStatements::eventsQuery(int groupId, Event::EventType type,
+                                             const RecipientList &recipients, QVariantList &values)
 {
     QByteArray q = baseEventQuery;
-    q += "\n WHERE Events.messageToken = :messageToken LIMIT 1";
+    q += "\n WHERE 1";
+    if (groupId >= 0) {
+        q += " AND Events.groupId = ?";
+        values.append(groupId);
+    }
+    if (type != Event::UnknownType) {
+        q += " AND Events.type = ?";
+        values.append(int(type));
+    }
 
-    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
-    query.bindValue(":messageToken", token);
+    if (!recipients.isEmpty()) {
+        QList<QByteArray> clauses;
+        for (RecipientList::const_iterator it = recipients.constBegin(); it != recipients.constEnd(); ++it) {
+            if (localUidComparesPhoneNumbers(it->localUid())) {
+                clauses.append("(Events.remoteUid LIKE ? AND Events.localUid LIKE ?)");
+                values.append(QString(QLatin1String("%%1%")).arg(minimizePhoneNumber(it->remoteUid())));
+                values.append(RING_ACCOUNT + QLatin1Char('%'));
+            } else {
+                clauses.append("(Events.remoteUid = ? AND Events.localUid = ?)");
+                values.append(it->remoteUid());
+                values.append(it->localUid());
+            }
+        }
+
+        q += " AND (";
+        for (int i = 0; i < clauses.size(); i++) {
+            if (i > 0)
+                q += " OR ";
+            q += clauses.at(i);
+        }
+        q += ")";
+    }
+    q += "\n ORDER BY Events.endTime DESC, Events.id DESC";
+    return q;
+}
+
+QByteArray DatabaseIOStatements::eventByMessageTokenQuery()
+{
+    return QByteArray(baseEventQuery) + "\n WHERE Events.messageToken = ? LIMIT 1";
+}
+
+bool DatabaseIO::openEvents(EventCursor &cursor, int groupId, Event::EventType type,
+                            const RecipientList &recipients)
+{
+    cursor.close();
+
+    QVariantList values;
+    const QByteArray q = DatabaseIOStatements::eventsQuery(groupId, type, recipients, values);
+    QSqlQuery query = CommHistoryDatabase::prepare(q.constData(), d->connection());
+    foreach (const QVariant &value, values)
+        query.addBindValue(value);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    cursor.d->query = query;
+    cursor.d->recipients = recipients;
+    return true;
+}
+
+bool DatabaseIO::getEventByMessageToken(const QString &token, Event &event)
+{
+    const QByteArray q = DatabaseIOStatements::eventByMessageTokenQuery();
+    QSqlQuery query = CommHistoryDatabase::prepare(q.constData(), d->connection());
+    query.addBindValue(token);
 
     if (!query.exec()) {
         qWarning() << "Failed to execute query";
@@ -840,49 +1433,8 @@ bool DatabaseIO::modifyEvent(Event &event)
     }
     query.finish();
 
-    if (event.modifiedProperties().contains(Event::ExtraProperties)) {
-        const char *q = "DELETE FROM EventProperties WHERE eventId=:eventId";
-        query = CommHistoryDatabase::prepare(q, d->connection());
-        query.bindValue(":eventId", event.id());
-        if (!query.exec()) {
-            qWarning() << "Failed to execute query";
-            qWarning() << query.lastError();
-            qWarning() << query.lastQuery();
-            return false;
-        }
-        query.finish();
-
-        QVariantMap properties = event.extraProperties();
-        if (!properties.isEmpty() && !d->insertEventProperties(event.id(), properties))
-            return false;
-    }
-
-    if (event.modifiedProperties().contains(Event::MessageParts)) {
-        QList<MessagePart> parts = event.messageParts();
-        QByteArray idList;
-        foreach (const MessagePart &part, parts) {
-            if (part.id() >= 0) {
-                if (!idList.isEmpty())
-                    idList.append(',');
-                idList.append(QString::number(part.id()));
-            }
-        }
-
-        // Parts with no associated event are cleaned up asynchronously
-        QByteArray q = "UPDATE MessageParts SET eventId=NULL WHERE eventId=:eventId AND id NOT IN (" + idList + ")";
-        query = CommHistoryDatabase::prepare(q, d->connection());
-        query.bindValue(":eventId", event.id());
-        if (!query.exec()) {
-            qWarning() << "Failed to execute query";
-            qWarning() << query.lastError();
-            qWarning() << query.lastQuery();
-            return false;
-        }
-        query.finish();
-
-        if (!event.messageParts().isEmpty() && !d->insertMessageParts(event))
-            return false;
-    }
+    if (!d->updateEventDetails(event, event.modifiedProperties()))
+        return false;
 
     return savepoint.release();
 }
@@ -945,40 +1497,69 @@ bool DatabaseIO::addGroup(Group &group)
 /* Read the result from a groups query into a Group.
  * The order of fields must match those queries.
  */
-void DatabaseIOPrivate::readGroupResult(QSqlQuery &query, Group &group)
+template <typename Row>
+static void decodeGroup(Row &row, Group &group)
 {
-    group.setId(query.value(0).toInt());
-    group.setLocalUid(query.value(1).toString());
-    group.setRecipients(RecipientList::fromUids(group.localUid(), query.value(2).toString().split('\n')));
+    group.setId(row.intValue(0));
+    group.setLocalUid(row.sharedStringValue(1));
+    group.setRecipients(RecipientList::fromUids(group.localUid(), row.stringValue(2).split('\n')));
 
-    group.setChatType(static_cast<Group::ChatType>(query.value(3).toInt()));
-    group.setChatName(query.value(4).toString());
-    group.setLastModifiedT(query.value(5).toUInt());
+    group.setChatType(static_cast<Group::ChatType>(row.intValue(3)));
+    group.setChatName(row.stringValue(4));
+    group.setLastModifiedT(row.uintValue(5));
     // startTime and endTime are below
-    group.setUnreadMessages(query.value(8).toInt());
+    group.setUnreadMessages(row.intValue(8));
 
-    if (query.value(6).isNull())
+    if (row.isNull(6))
         group.setStartTimeT(0);
     else
-        group.setStartTimeT(query.value(6).toUInt());
+        group.setStartTimeT(row.uintValue(6));
 
-    if (query.value(7).isNull())
+    if (row.isNull(7))
         group.setEndTimeT(0);
     else
-        group.setEndTimeT(query.value(7).toUInt());
+        group.setEndTimeT(row.uintValue(7));
 
-    if (query.value(9).isNull())
+    if (row.isNull(9))
         group.setLastEventId(-1);
     else
-        group.setLastEventId(query.value(9).toInt());
+        group.setLastEventId(row.intValue(9));
+
+    group.setLastMessageText(row.stringValue(10));
+    group.setLastVCardFileName(row.stringValue(11));
+    group.setLastVCardLabel(row.stringValue(12));
+    group.setLastEventType(static_cast<Event::EventType>(row.intValue(13)));
+    group.setLastEventStatus(static_cast<Event::EventStatus>(row.intValue(14)));
+    group.setLastEventIsDraft(row.boolValue(15));
+    group.setSubscriberIdentity(row.sharedStringValue(16));
+}
 
-    group.setLastMessageText(query.value(10).toString());
-    group.setLastVCardFileName(query.value(11).toString());
-    group.setLastVCardLabel(query.value(12).toString());
-    group.setLastEventType(static_cast<Event::EventType>(query.value(13).toInt()));
-    group.setLastEventStatus(static_cast<Event::EventStatus>(query.value(14).toInt()));
-    group.setLastEventIsDraft(query.value(15).toBool());
-    group.setSubscriberIdentity(query.value(16).toString());
+void DatabaseIOPrivate::readGroupResult(QSqlQuery &query, Group &group)
+{
+    QueryRow row(query);
+    decodeGroup(row, group);
+}
+
+bool DatabaseIOPrivate::readGroups(QSqlQuery &query, QList<Group> &groups)
+{
+    SqliteRows rows(query);
+    if (rows.isValid()) {
+        while (rows.next()) {
+            Group g;
+            decodeGroup(rows, g);
+            groups.append(g);
+        }
+    } else {
+        QueryRow row(query);
+        while (query.next()) {
+            Group g;
+            decodeGroup(row, g);
+            groups.append(g);
+        }
+    }
+    query.finish();
+
+    return !rows.hasError();
 }
 
 static const char *baseGroupQuery =
@@ -991,7 +1572,7 @@ static const char *baseGroupQuery =
     "\n Groups.lastModified, "
     "\n LastEvent.startTime, "
     "\n LastEvent.endTime, "
-    "\n EventCount.unread, "
+    "\n (SELECT COUNT(*) FROM Events WHERE groupId = Groups.id AND isRead = 0), "
     "\n LastEvent.id, "
     "\n LastEvent.freeText, "
     "\n LastEvent.vCardFileName, "
@@ -1001,12 +1582,6 @@ static const char *baseGroupQuery =
     "\n LastEvent.isDraft, "
     "\n LastSubscriberIdentity.value "
     "\n FROM Groups "
-    "\n LEFT JOIN ("
-    "\n  SELECT groupId, COUNT(*) as unread "
-    "\n  FROM Events "
-    "\n  WHERE isRead = 0 "
-    "\n  GROUP BY groupId "
-    "\n ) AS EventCount ON (EventCount.groupId = Groups.id) "
     "\n LEFT JOIN Events AS LastEvent ON ("
     "\n  LastEvent.id = ("
     "\n   SELECT id FROM Events "
@@ -1019,6 +1594,38 @@ static const char *baseGroupQuery =
     "\n  LastSubscriberIdentity.eventId = LastEvent.id AND LastSubscriberIdentity.key = 'subscriberIdentity'"
     "\n ) ";
 
+bool DatabaseIO::getGroupsByIds(const QList<int> &ids, QList<Group> &groups)
+{
+    // Stay well below SQLITE_MAX_VARIABLE_NUMBER
+    static const int maxBatch = 500;
+
+    for (int first = 0; first < ids.size(); first += maxBatch) {
+        QList<int> batch = ids.mid(first, maxBatch);
+
+        QByteArray q = baseGroupQuery;
+        q += "\n WHERE Groups.id IN (?";
+        for (int i = 1; i < batch.size(); i++)
+            q += ",?";
+        q += ")";
+
+        QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+        foreach (int id, batch)
+            query.addBindValue(id);
+
+        if (!query.exec()) {
+            qWarning() << "Failed to execute query";
+            qWarning() << query.lastError();
+            qWarning() << query.lastQuery();
+            return false;
+        }
+
+        if (!d->readGroups(query, groups))
+            return false;
+    }
+
+    return true;
+}
+
 bool DatabaseIO::getGroup(int id, Group &group)
 {
     QByteArray q = baseGroupQuery;
@@ -1067,6 +1674,13 @@ bool DatabaseIO::getGroups(const QString &localUid, const QString &remoteUid, QL
     if (!remoteUid.isNull())
         query.bindValue(":remoteUid", remoteUid);
 
+    const QString key = d->queryCacheKey(query);
+    QVariant cached;
+    if (d->findCachedResult(key, cached)) {
+        result = cached.value<QList<Group> >();
+        return true;
+    }
+
     if (!query.exec()) {
         qWarning() << "Failed to execute query";
         qWarning() << query.lastError();
@@ -1075,12 +1689,80 @@ bool DatabaseIO::getGroups(const QString &localUid, const QString &remoteUid, QL
     }
 
     result.clear();
-    while (query.next()) {
-        Group g;
-        d->readGroupResult(query, g);
-        result.append(g);
+    if (!d->readGroups(query, result))
+        return false;
+
+    d->cacheResult(key, QVariant::fromValue(result), result.size());
+    return true;
+}
+
+QByteArray DatabaseIOStatements::groupsChunkQuery(bool byActivity, const QString &localUid,
+                                                  const QString &remoteUid, int limit,
+                                                  quint32 lastEndTime, int lastId, QVariantList &values)
+{
+    // Use the indexed Groups.lastEventTime when available, else fall back to
+    // the end time of the last event, looked up by index for each group.
+    // Both have the same value; groups without events sort last.
+    QByteArray activity = byActivity
+        ? "Groups.lastEventTime"
+        : "IFNULL((SELECT endTime FROM Events WHERE groupId = Groups.id ORDER BY endTime DESC, id DESC LIMIT 1), 0)";
+
+    // The page is selected on Groups alone, so that the last events and
+    // unread counts are only read for the groups returned
+    QByteArray page = "SELECT Groups.id FROM Groups WHERE 1 ";
+    if (!localUid.isEmpty()) {
+        page += "AND Groups.localUid = ? ";
+        values.append(localUid);
+    }
+    if (!remoteUid.isEmpty()) {
+        page += "AND Groups.remoteUids = ? ";
+        values.append(remoteUid);
+    }
+    if (lastId >= 0) {
+        page += "AND (" + activity + " < ? "
+                "OR (" + activity + " = ? AND Groups.id < ?)) ";
+        values << lastEndTime << lastEndTime << lastId;
     }
+    page += "ORDER BY " + activity + " DESC, Groups.id DESC ";
+    if (limit > 0)
+        page += "LIMIT " + QByteArray::number(limit);
 
+    // The joins are one-to-one, so there is no need for GROUP BY here
+    QByteArray q = baseGroupQuery;
+    q += " WHERE Groups.id IN (" + page + ") ";
+    q += "ORDER BY " + activity + " DESC, Groups.id DESC";
+    return q;
+}
+
+bool DatabaseIO::getGroupsChunk(const QString &localUid, const QString &remoteUid, QList<Group> &result,
+                                int limit, quint32 lastEndTime, int lastId)
+{
+    QVariantList values;
+    const QByteArray q = DatabaseIOStatements::groupsChunkQuery(d->groupActivityAvailable(), localUid, remoteUid,
+                                                                limit, lastEndTime, lastId, values);
+    QSqlQuery query = CommHistoryDatabase::prepare(q.constData(), d->connection());
+    foreach (const QVariant &value, values)
+        query.addBindValue(value);
+
+    const QString key = d->queryCacheKey(query);
+    QVariant cached;
+    if (d->findCachedResult(key, cached)) {
+        result = cached.value<QList<Group> >();
+        return true;
+    }
+
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    result.clear();
+    if (!d->readGroups(query, result))
+        return false;
+
+    d->cacheResult(key, QVariant::fromValue(result), result.size());
     return true;
 }
 
@@ -1140,6 +1822,13 @@ bool DatabaseIO::totalEventsInGroup(int groupId, int &totalEvents)
     QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
     query.bindValue(":groupId", groupId);
 
+    const QString key = d->queryCacheKey(query);
+    QVariant cached;
+    if (d->findCachedResult(key, cached)) {
+        totalEvents = cached.toInt();
+        return true;
+    }
+
     if (!query.exec()) {
         qWarning() << "Failed to execute query";
         qWarning() << query.lastError();
@@ -1149,6 +1838,7 @@ bool DatabaseIO::totalEventsInGroup(int groupId, int &totalEvents)
 
     if (query.next()) {
         totalEvents = query.value(0).toInt();
+        d->cacheResult(key, totalEvents, 1);
         return true;
     }
 
@@ -1261,8 +1951,94 @@ bool DatabaseIO::commit()
     return re;
 }
 
+int DatabaseIO::upgradeProgress()
+{
+    d->connection();
+    return d->migrationProgress();
+}
+
+void DatabaseIO::queryCacheStatistics(int &hits, int &misses) const
+{
+    hits = d->queryCacheHits;
+    misses = d->queryCacheMisses;
+}
+
+qint64 DatabaseIO::changeSequence()
+{
+    QSqlQuery query = CommHistoryDatabase::prepare("SELECT IFNULL(MAX(seq), 0) FROM ChangeJournal", d->connection());
+    if (!query.exec() || !query.next()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return -1;
+    }
+
+    return query.value(0).toLongLong();
+}
+
+bool DatabaseIO::changesSince(qint64 sequence, QList<Change> &changes, qint64 &lastSequence,
+                              bool *expired)
+{
+    changes.clear();
+    lastSequence = sequence;
+    if (expired)
+        *expired = false;
+
+    if (sequence < 0)
+        return false;
+
+    QSqlQuery query = CommHistoryDatabase::prepare("SELECT seq, target, id, groupId, operation FROM ChangeJournal "
+                                                   "WHERE seq > :sequence ORDER BY seq", d->connection());
+    query.bindValue(":sequence", sequence);
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << query.lastQuery();
+        return false;
+    }
+
+    while (query.next()) {
+        Change change;
+        change.sequence = query.value(0).toLongLong();
+        change.target = static_cast<Change::Target>(query.value(1).toInt());
+        change.id = query.value(2).toInt();
+        change.groupId = query.value(3).toInt();
+        change.operation = static_cast<Change::Operation>(query.value(4).toInt());
+        changes.append(change);
+    }
+    query.finish();
+
+    // Old entries are only ever removed, so if the entry following the
+    // sequence is still there now, none of the changes read were missed.
+    // A sequence beyond the end belongs to a database that was replaced.
+    QSqlQuery bounds = CommHistoryDatabase::prepare("SELECT IFNULL(MIN(seq), 0), IFNULL(MAX(seq), 0) FROM ChangeJournal",
+                                                    d->connection());
+    if (!bounds.exec() || !bounds.next()) {
+        qWarning() << "Failed to execute query";
+        qWarning() << bounds.lastError();
+        qWarning() << bounds.lastQuery();
+        changes.clear();
+        return false;
+    }
+
+    const qint64 first = bounds.value(0).toLongLong();
+    const qint64 last = bounds.value(1).toLongLong();
+    if (sequence > last || (first > sequence + 1 && sequence < last)) {
+        DEBUG() << Q_FUNC_INFO << "changes after" << sequence << "are no longer journaled";
+        changes.clear();
+        if (expired)
+            *expired = true;
+        return false;
+    }
+
+    if (!changes.isEmpty())
+        lastSequence = changes.last().sequence;
+    return true;
+}
+
 bool DatabaseIO::rollback()
 {
+    d->clearQueryCache();
     bool re = d->connection().rollback();
     if (!re) {
         qWarning() << "Failed to rollback transaction";
@@ -1272,6 +2048,57 @@ bool DatabaseIO::rollback()
 }
 
 QString DatabaseIOPrivate::makeCallGroupURI(const CommHistory::Event &event)
+{
+    return CallGroupKey::uri(event);
+}
+
+namespace {
+
+// Local uids are few (one per account), so they are interned for the life
+// of the process
+QMutex localUidMutex;
+QHash<QString, int> localUidIds;
+QStringList localUids;
+
+int internLocalUid(const QString &localUid)
+{
+    QMutexLocker locker(&localUidMutex);
+
+    QHash<QString, int>::const_iterator it = localUidIds.constFind(localUid);
+    if (it != localUidIds.constEnd())
+        return *it;
+
+    int id = localUids.size();
+    localUids.append(localUid);
+    localUidIds.insert(localUid, id);
+    return id;
+}
+
+QString internedLocalUid(int id)
+{
+    QMutexLocker locker(&localUidMutex);
+    return localUids.value(id);
+}
+
+}
+
+CallGroupKey::CallGroupKey(const Event &event)
+    : localUidId(internLocalUid(event.localUid())),
+      remoteUid(event.recipients().value(0).minimizedRemoteUid()),
+      isVideo(event.isVideoCall())
+{
+    remoteUidHash = ::qHash(remoteUid);
+}
+
+QString CallGroupKey::toString() const
+{
+    QString uri = QLatin1String("callgroup:") + internedLocalUid(localUidId) + QLatin1Char('!') + remoteUid;
+    if (isVideo)
+        uri += QLatin1String("!video");
+    return uri;
+}
+
+QString CallGroupKey::uri(const Event &event)
 {
     const QString callGroupRemoteId = event.recipients().value(0).minimizedRemoteUid();
 
@@ -1284,3 +2111,9 @@ QString DatabaseIOPrivate::makeCallGroupURI(const CommHistory::Event &event)
         .arg(callGroupRemoteId)
         .arg(videoSuffix);
 }
+
+QDebug operator<<(QDebug debug, const CallGroupKey &key)
+{
+    debug << key.toString();
+    return debug;
+}
@@ -32,8 +32,46 @@
 namespace CommHistory {
 
 class DatabaseIOPrivate;
+class EventCursorPrivate;
 class Group;
 
+/**
+ * \class EventCursor
+ *
+ * Forward-only cursor over events in the database, opened with
+ * DatabaseIO::openEvents(). Events are read as the cursor advances, so
+ * memory use does not depend on the number of results.
+ */
+class LIBCOMMHISTORY_EXPORT EventCursor
+{
+public:
+    EventCursor();
+    ~EventCursor();
+
+    /*!
+     * Read the next event. The cursor is closed after the last event.
+     *
+     * \param event Return value for event details.
+     * \return true if an event was read, false at the end of the results
+     */
+    bool next(Event &event);
+
+    /*!
+     * Returns true until the cursor is closed or past the last event.
+     */
+    bool isActive() const;
+
+    /*!
+     * Release the underlying query.
+     */
+    void close();
+
+private:
+    Q_DISABLE_COPY(EventCursor)
+    friend class DatabaseIO;
+    EventCursorPrivate *d;
+};
+
 /**
  * \class DatabaseIO
  *
@@ -45,6 +83,41 @@ class LIBCOMMHISTORY_EXPORT DatabaseIO : public QObject
     Q_OBJECT
 
 public:
+    /*!
+     * An entry of the change journal, see changesSince().
+     */
+    struct Change {
+        enum Target {
+            EventTarget,
+            GroupTarget
+        };
+
+        enum Operation {
+            Inserted,
+            Updated,
+            Deleted
+        };
+
+        qint64 sequence;
+        Target target;
+        Operation operation;
+        int id;
+        // Group of the event, or the id of the group itself
+        int groupId;
+    };
+
+    /*!
+     * What upsertEventByToken() does with an event that is already stored.
+     */
+    enum MergePolicy {
+        // Leave the stored event unchanged
+        KeepExisting,
+        // Write the modified properties of the event
+        MergeModified,
+        // Write all properties of the event
+        ReplaceExisting
+    };
+
     DatabaseIO();
     ~DatabaseIO();
     static DatabaseIO* instance();
@@ -58,6 +131,26 @@ public:
      */
     bool addEvent(Event &event);
 
+    /*!
+     * Add an event, or update the event of the same group with the same
+     * message token, atomically. Retransmitted messages are stored only
+     * once, even when several processes receive them.
+     *
+     * Tokens are not unique in the database: addEvent() and moveEvent()
+     * still store events with a token that their group already has. Of
+     * such events, the most recent one is updated.
+     *
+     * The id field of the event is updated in both cases. Other fields of
+     * an updated event are not read from the database.
+     *
+     * \param event New event, with a message token and a group.
+     * \param policy Changes to an existing event.
+     * \param inserted Optional return value, true if the event was added.
+     * \return true if successful, otherwise false
+     */
+    bool upsertEventByToken(Event &event, MergePolicy policy = MergeModified,
+                            bool *inserted = 0);
+
     /*!
      * Reserves a sequence of \a count event id(s) starting from \a firstReservedId. Main use case
      * is reservation of ids for events which are only stored in model and not saved in database.
@@ -86,6 +179,31 @@ public:
      */
     bool getEvent(int id, Event &event);
 
+    /*!
+     * Query several events by id with one query. Ids that do not exist are
+     * skipped; the order of the results is unspecified.
+     *
+     * \param ids Database ids of the events.
+     * \param events Return value for event details.
+     * \return true if successful, otherwise false
+     */
+    bool getEventsByIds(const QList<int> &ids, QList<Event> &events);
+
+    /*!
+     * Open a cursor over events, most recent first. Events can be limited
+     * to a group, a type, and to those matching any of a list of
+     * recipients, as in RecipientEventModel.
+     *
+     * \param cursor Cursor to open. An open cursor is closed first.
+     * \param groupId Group id, or -1 for events in any group
+     * \param type Event type, or Event::UnknownType for all types
+     * \param recipients Optional recipients to match
+     * \return true if successful, otherwise false
+     */
+    bool openEvents(EventCursor &cursor, int groupId = -1,
+                    Event::EventType type = Event::UnknownType,
+                    const RecipientList &recipients = RecipientList());
+
     /*!
      * Query a single event by message token.
      *
@@ -165,6 +283,16 @@ public:
      */
     bool getGroup(int id, Group &group);
 
+    /*!
+     * Query several groups by id with one query. Ids that do not exist are
+     * skipped; the order of the results is unspecified.
+     *
+     * \param ids Database ids of the groups.
+     * \param groups Return value for group details.
+     * \return true if successful, otherwise false
+     */
+    bool getGroupsByIds(const QList<int> &ids, QList<Group> &groups);
+
     /*!
      * Query groups, optionally by local or remote UID
      *
@@ -176,6 +304,23 @@ public:
     bool getGroups(const QString &localUid, const QString &remoteUid, QList<Group> &groups,
                    const QString &queryOrder = QString());
 
+    /*!
+     * Query a chunk of groups ordered by last activity, most recent first,
+     * optionally by local or remote UID. Chunks are continued from the last
+     * group of the previous chunk rather than by offset, so that they stay
+     * consistent while groups change.
+     *
+     * \param localUid Optional local UID to limit results
+     * \param remoteUid Optional remote UID to limit results
+     * \param groups Reference to container for results
+     * \param limit Maximum number of groups to return
+     * \param lastEndTime End time of the last group of the previous chunk
+     * \param lastId Id of the last group of the previous chunk, -1 for the first chunk
+     * \return true if successful, otherwise false
+     */
+    bool getGroupsChunk(const QString &localUid, const QString &remoteUid, QList<Group> &groups,
+                        int limit, quint32 lastEndTime = 0, int lastId = -1);
+
     /*!
      * Modifye a group.
      *
@@ -270,6 +415,64 @@ public:
      */
     bool rollback();
 
+    /*!
+     * Progress of the data migrations following a schema upgrade, in
+     * percent. Migrations run in small batches in the background while the
+     * database stays usable, and resume where they left off when
+     * interrupted. Progress is also reported by the upgradeProgress D-Bus
+     * signal of the process running the migrations.
+     *
+     * \return progress in percent, 100 when there is nothing left to do
+     */
+    int upgradeProgress();
+
+    /*!
+     * Number of read queries answered from the result cache, and of those
+     * that had to be run, since the start of the process. Cached results
+     * are dropped whenever the database changes, in this or another
+     * process.
+     *
+     * \param hits cache hits
+     * \param misses cache misses
+     */
+    void queryCacheStatistics(int &hits, int &misses) const;
+
+    /*!
+     * Sequence number of the latest entry in the change journal. Every
+     * insert, update and delete of an event or group, by any process,
+     * appends an entry with the next sequence number.
+     *
+     * \return sequence number, or -1 if the journal could not be read
+     */
+    qint64 changeSequence();
+
+    /*!
+     * Read the changes journaled after a sequence number previously
+     * returned by changeSequence() or changesSince(), oldest first. This
+     * allows catching up on signals missed while not listening. Only about
+     * the last 10000 changes are kept, and a single bulk update such as
+     * markAsReadAll() can write more than that. When changes after
+     * \a sequence have already been dropped, \a expired is set and
+     * everything must be reloaded.
+     *
+     * \param sequence Sequence number up to which changes are known
+     * \param changes Return value for the changes after sequence
+     * \param lastSequence Return value for the sequence number of the last change
+     * \param expired Set to true if the changes are no longer available
+     * \return true if successful, false if the changes are no longer available
+     *         or could not be read
+     */
+    bool changesSince(qint64 sequence, QList<Change> &changes, qint64 &lastSequence,
+                      bool *expired = 0);
+
+Q_SIGNALS:
+    /*!
+     * Emitted when a batch of migrations has been run in this process.
+     *
+     * \param percent progress in percent
+     */
+    void upgradeProgressChanged(int percent);
+
 private:
     friend class DatabaseIOPrivate;
     DatabaseIOPrivate * const d;
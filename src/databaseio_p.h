@@ -24,6 +24,7 @@
 #define COMMHISTORY_DATABASEIO_P_H
 
 #include <QObject>
+#include <QDebug>
 #include <QUrl>
 #include <QHash>
 #include <QSet>
@@ -32,14 +33,76 @@
 #include <QThreadStorage>
 #include <QStringList>
 #include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSharedPointer>
 
 #include "event.h"
 #include "commonutils.h"
+#include "libcommhistoryexport.h"
+
+class QTimer;
 
 namespace CommHistory {
 
 class Group;
 class DatabaseIO;
+class UpdatesEmitter;
+
+/*!
+ * \class CallGroupKey
+ *
+ * Identity of a call group, cheap to compare and hash: the local uid is
+ * interned to a small integer, the minimized remote uid is hashed, and the
+ * string is kept to tell hash collisions apart. toString() gives the
+ * "callgroup:" URI form.
+ */
+struct LIBCOMMHISTORY_EXPORT CallGroupKey
+{
+    CallGroupKey() : localUidId(-1), remoteUidHash(0), isVideo(false) {}
+    explicit CallGroupKey(const Event &event);
+
+    bool operator==(const CallGroupKey &other) const
+    {
+        return localUidId == other.localUidId
+            && remoteUidHash == other.remoteUidHash
+            && isVideo == other.isVideo
+            && remoteUid == other.remoteUid;
+    }
+    bool operator!=(const CallGroupKey &other) const { return !(*this == other); }
+
+    QString toString() const;
+
+    static QString uri(const Event &event);
+
+    int localUidId;
+    uint remoteUidHash;
+    QString remoteUid;
+    bool isVideo;
+};
+
+inline uint qHash(const CallGroupKey &key, uint seed = 0)
+{
+    return key.remoteUidHash ^ (uint(key.localUidId) * 31u) ^ uint(key.isVideo) ^ seed;
+}
+
+QDebug operator<<(QDebug debug, const CallGroupKey &key);
+
+/*!
+ * \class DatabaseIOStatements
+ *
+ * Statements of the DatabaseIO queries, with their positional values.
+ * Exported so that commhistory-tool can time them.
+ */
+class LIBCOMMHISTORY_EXPORT DatabaseIOStatements
+{
+public:
+    static QByteArray eventsQuery(int groupId, Event::EventType type,
+                                  const RecipientList &recipients, QVariantList &values);
+    static QByteArray eventByMessageTokenQuery();
+    static QByteArray groupsChunkQuery(bool byActivity, const QString &localUid,
+                                       const QString &remoteUid, int limit,
+                                       quint32 lastEndTime, int lastId, QVariantList &values);
+};
 
 /**
  * \class DatabaseIOPrivate
@@ -64,9 +127,15 @@ public:
 
     static void readEventResult(QSqlQuery &query, Event &event, bool &hasExtraProperties,
             bool &hasMessageParts);
+    // Decodes a row of eventQueryBase() copied out of its query
+    static void readEventValues(const QVariantList &values, Event &event, bool &hasExtraProperties,
+            bool &hasMessageParts);
+    static bool readEvents(QSqlQuery &query, QList<Event> &events);
     static void readGroupResult(QSqlQuery &query, Group &group);
+    static bool readGroups(QSqlQuery &query, QList<Group> &groups);
 
     static QString eventQueryBase();
+
     static QString limitClause(int limit, int offset);
     static QString categoryClause(int categoryMask);
 
@@ -76,12 +145,43 @@ public:
 
     bool insertEventProperties(int eventId, const QVariantMap &properties);
     bool insertMessageParts(Event &event);
+    bool updateEventDetails(Event &event, const Event::PropertySet &properties);
 
     QSqlQuery createQuery();
     QSqlDatabase& connection();
 
+    // Results of read queries, valid while the database is unchanged
+    static QString queryCacheKey(const QSqlQuery &query);
+    bool findCachedResult(const QString &key, QVariant &result);
+    void cacheResult(const QString &key, const QVariant &result, int rows);
+    void clearQueryCache();
+
+    void startMigrations();
+    int migrationProgress();
+    bool groupActivityAvailable();
+    bool contactActivityAvailable();
+
+public Q_SLOTS:
+    void runMigrationBatch();
+
 public:
     QSqlDatabase m_pConnection;
+
+    QTimer *migrationTimer;
+    int upgradeProgress;
+    bool groupActivityMigrated;
+    bool contactActivityMigrated;
+
+    QHash<QString, QVariant> queryCache;
+    QQueue<QPair<QString, int> > queryCacheOrder;
+    int queryCacheRows;
+    QSqlQuery dataVersionQuery;
+    QSqlQuery totalChangesQuery;
+    qint64 queryCacheDataVersion;
+    qint64 queryCacheChanges;
+    int queryCacheHits;
+    int queryCacheMisses;
+    QSharedPointer<UpdatesEmitter> emitter;
 };
 
 } // namespace
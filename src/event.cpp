@@ -25,11 +25,15 @@
 #include <QSharedDataPointer>
 #include <QDBusArgument>
 #include <QDataStream>
+#include <QAtomicInt>
 #include "event.h"
+#include "event_p.h"
 #include "messagepart.h"
 #include "constants.h"
+#include "commonutils.h"
 
 #include <QStringBuilder>
+#include <utility>
 
 #define MMS_TO_HEADER QLatin1String("x-mms-to")
 #define MMS_CC_HEADER QLatin1String("x-mms-cc")
@@ -110,6 +114,9 @@ public:
 using namespace CommHistory;
 
 static Event::PropertySet setOfAllProperties;
+// Only counted while enabled by tests, see event_p.h
+static bool countDataCopies = false;
+static QAtomicInt dataCopies;
 
 QDBusArgument &operator<<(QDBusArgument &argument, const Event &event)
 {
@@ -371,6 +378,9 @@ EventPrivate::EventPrivate(const EventPrivate &other)
     flags.direction = other.flags.direction;
     flags.status = other.flags.status;
     flags.readStatus = other.flags.readStatus;
+
+    if (countDataCopies)
+        dataCopies.fetchAndAddRelaxed(1);
 }
 
 EventPrivate::~EventPrivate()
@@ -397,16 +407,37 @@ Event::Event(const Event &other)
 {
 }
 
+Event::Event(Event &&other)
+    : d(std::move(other.d))
+{
+}
+
 Event &Event::operator=(const Event &other)
 {
     d = other.d;
     return *this;
 }
 
+Event &Event::operator=(Event &&other)
+{
+    d = std::move(other.d);
+    return *this;
+}
+
 Event::~Event()
 {
 }
 
+void CommHistory::setEventDataCopyCounting(bool enabled)
+{
+    countDataCopies = enabled;
+}
+
+int CommHistory::eventDataCopyCount()
+{
+    return dataCopies.load();
+}
+
 int Event::urlToId(const QString &url)
 {
     return url.mid(QString(QLatin1String("message:")).length()).toInt();
@@ -552,7 +583,9 @@ QString Event::localUid() const
 
 QString Event::dateAndAccountGrouping() const
 {
-    QString dateString = startTime().date().toString("yyyy-MM-dd");
+    QString dateString;
+    if (d->startTimeT != 0)
+        dateString = localDate(d->startTimeT).toString("yyyy-MM-dd");
     return dateString + QStringLiteral(" ") + localUid();
 }
 
@@ -163,9 +163,16 @@ public:
 public:
     Event();
     Event(const Event &other);
+
+    /*!
+     * Takes over the data of \a other without copying. The moved-from event
+     * may only be assigned to or destroyed.
+     */
+    Event(Event &&other);
     ~Event();
 
     Event &operator=(const Event &other);
+    Event &operator=(Event &&other);
     bool operator==(const Event &other) const;
     bool operator!=(const Event &other) const;
     bool isValid() const;
@@ -159,6 +159,30 @@ bool EventModel::bufferInsertions() const
     return d->bufferInsertions;
 }
 
+bool EventModel::reuseRowStorage() const
+{
+    Q_D(const EventModel);
+    return d->itemArena.retainSlabs();
+}
+
+int EventModel::batchInterval() const
+{
+    Q_D(const EventModel);
+    return d->batchInterval;
+}
+
+int EventModel::batchSize() const
+{
+    Q_D(const EventModel);
+    return d->batchSize;
+}
+
+bool EventModel::isSuspended() const
+{
+    Q_D(const EventModel);
+    return d->isSuspended;
+}
+
 QModelIndex EventModel::parent(const QModelIndex &index) const
 {
     Q_D(const EventModel);
@@ -431,6 +455,36 @@ void EventModel::setBufferInsertions(bool buffer)
     }
 }
 
+void EventModel::suspend()
+{
+    Q_D(EventModel);
+    d->suspend();
+}
+
+bool EventModel::resume()
+{
+    Q_D(EventModel);
+    return d->resume();
+}
+
+void EventModel::setReuseRowStorage(bool reuse)
+{
+    Q_D(EventModel);
+    d->itemArena.setRetainSlabs(reuse);
+}
+
+void EventModel::setBatchInterval(int msecs)
+{
+    Q_D(EventModel);
+    d->setBatchInterval(msecs);
+}
+
+void EventModel::setBatchSize(int size)
+{
+    Q_D(EventModel);
+    d->batchSize = qMax(1, size);
+}
+
 EventModel::ContactResolveType EventModel::resolveContacts() const
 {
     Q_D(const EventModel);
@@ -518,6 +572,12 @@ bool EventModel::modifyEvents(QList<Event> &events)
     if (!d->database()->transaction())
         return false;
 
+    QHash<int, int> oldGroupIds;
+    if (!d->fillRoutingKeys(events, &oldGroupIds)) {
+        d->database()->rollback();
+        return false;
+    }
+
     QList<int> modifiedGroups;
     for (QList<Event>::Iterator it = events.begin(); it != events.end(); it++) {
         Event &event = *it;
@@ -545,6 +605,12 @@ bool EventModel::modifyEvents(QList<Event> &events)
     if (!d->database()->commit())
         return false;
 
+    foreach (int groupId, oldGroupIds) {
+        if (groupId != -1 && !modifiedGroups.contains(groupId))
+            modifiedGroups.append(groupId);
+    }
+
+    d->emitter->routeEventsMovedOut(events, oldGroupIds);
     emit d->eventsUpdated(events);
     if (!modifiedGroups.isEmpty())
         emit d->groupsUpdated(modifiedGroups);
@@ -582,6 +648,14 @@ bool EventModel::deleteEvent(Event &event)
     if (!d->database()->transaction())
         return false;
 
+    QList<Event> keyed;
+    keyed << event;
+    if (!d->fillRoutingKeys(keyed)) {
+        d->database()->rollback();
+        return false;
+    }
+    event = keyed.first();
+
     if (!d->database()->deleteEvent(event, d->bgThread)) {
         d->database()->rollback();
         return false;
@@ -610,7 +684,7 @@ bool EventModel::deleteEvent(Event &event)
     if (!d->database()->commit())
         return false;
 
-    emit d->eventDeleted(event.id());
+    d->emitEventDeleted(event);
 
     if (groupDeleted)
         emit d->groupsDeleted(QList<int>() << event.groupId());
@@ -670,7 +744,10 @@ bool EventModel::moveEvent(Event &event, int groupId)
     if (!d->database()->commit())
         return false;
 
-    emit d->eventDeleted(event.id());
+    // Removed from the old group, added to the new one
+    Event oldEvent(event);
+    oldEvent.setGroupId(oldGroupId);
+    d->emitEventDeleted(oldEvent);
     if (groupDeleted != -1)
         emit d->groupsDeleted(QList<int>() << groupDeleted);
     else if (oldGroupId != -1)
@@ -683,6 +760,43 @@ bool EventModel::moveEvent(Event &event, int groupId)
     return true;
 }
 
+bool EventModel::upsertEventByToken(Event &event, DatabaseIO::MergePolicy policy, bool *inserted)
+{
+    Q_D(EventModel);
+
+    if (event.lastModifiedT() == 0)
+        event.setLastModifiedT(Event::currentTime_t());
+
+    if (!d->database()->transaction())
+        return false;
+
+    bool added = false;
+    if (!d->database()->upsertEventByToken(event, policy, &added)) {
+        d->database()->rollback();
+        return false;
+    }
+
+    if (!d->database()->commit())
+        return false;
+
+    if (inserted)
+        *inserted = added;
+
+    const QList<Event> events = QList<Event>() << event;
+    if (added) {
+        if (d->acceptsEvent(event))
+            d->addToModel(event, true);
+        emit d->eventsAdded(events);
+        emit d->eventsCommitted(events, true);
+    } else if (policy != DatabaseIO::KeepExisting) {
+        emit d->eventsUpdated(events);
+        emit d->groupsUpdated(QList<int>() << event.groupId());
+        emit d->eventsCommitted(events, true);
+    }
+
+    return true;
+}
+
 bool EventModel::modifyEventsInGroup(QList<Event> &events, Group group)
 {
     Q_D(EventModel);
@@ -693,6 +807,12 @@ bool EventModel::modifyEventsInGroup(QList<Event> &events, Group group)
     if (!d->database()->transaction())
         return false;
 
+    QHash<int, int> oldGroupIds;
+    if (!d->fillRoutingKeys(events, &oldGroupIds)) {
+        d->database()->rollback();
+        return false;
+    }
+
     for (QList<Event>::Iterator it = events.begin(); it != events.end(); it++) {
         Event &event = *it;
         if (event.id() == -1) {
@@ -755,6 +875,7 @@ bool EventModel::modifyEventsInGroup(QList<Event> &events, Group group)
     if (!d->database()->commit())
         return false;
 
+    d->emitter->routeEventsMovedOut(events, oldGroupIds);
     emit d->eventsUpdated(events);
     emit d->groupsUpdatedFull(QList<Group>() << group);
     emit d->eventsCommitted(events, true);
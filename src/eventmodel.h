@@ -27,13 +27,13 @@
 #include <QAbstractItemModel>
 
 #include "event.h"
+#include "databaseio.h"
 #include "libcommhistoryexport.h"
 
 namespace CommHistory {
 
 class EventModelPrivate;
 class Group;
-class DatabaseIO;
 
 /*!
  * \class EventModel
@@ -70,6 +70,8 @@ class LIBCOMMHISTORY_EXPORT EventModel: public QAbstractItemModel
     Q_PROPERTY(bool defaultAccept READ defaultAccept WRITE setDefaultAccept)
     Q_PROPERTY(int eventCategoryMask READ eventCategoryMask WRITE setEventCategoryMask)
     Q_PROPERTY(bool bufferInsertions READ bufferInsertions WRITE setBufferInsertions NOTIFY bufferInsertionsChanged)
+    Q_PROPERTY(int batchInterval READ batchInterval WRITE setBatchInterval)
+    Q_PROPERTY(int batchSize READ batchSize WRITE setBatchSize)
 
 public:
     enum QueryMode { AsyncQuery, StreamedAsyncQuery, SyncQuery };
@@ -257,6 +259,48 @@ public:
      */
     void setBufferInsertions(bool buffer);
 
+    /*!
+     * When set to true, the storage for the model's rows is kept when the
+     * model is reset and reused for the next set of events. This avoids
+     * returning memory to the allocator for models that are reloaded often.
+     * Storage is released when the model is destroyed.
+     */
+    void setReuseRowStorage(bool reuse);
+
+    /*!
+     * Collect changes made by other processes for up to \a msecs
+     * milliseconds and apply them together, so that a burst of changes
+     * results in a single insertion of adjacent rows and in dataChanged()
+     * over ranges of rows. An interval of one frame, 16 ms, lets views lay
+     * out once per frame. 0, the default, applies each change as it
+     * arrives.
+     */
+    void setBatchInterval(int msecs);
+
+    /*!
+     * Apply collected changes as soon as there are \a size of them, rather
+     * than waiting for the end of the batch interval. Defaults to 100.
+     */
+    void setBatchSize(int size);
+
+    /*!
+     * Stop following changes to the database, for example while the model
+     * is not shown. The model keeps its events, but drops its subscriptions
+     * to change signals until resume() is called.
+     */
+    void suspend();
+
+    /*!
+     * Follow changes to the database again after suspend(). Changes made
+     * while suspended are read from the database change journal and applied
+     * as row insertions, updates and removals. If they are no longer
+     * available, the model is reloaded.
+     *
+     * \return true if successful. If false, the model could not catch up
+     * and its events have to be queried again.
+     */
+    bool resume();
+
     /*!
      * Add a new event.
      *
@@ -329,6 +373,21 @@ public:
      */
     bool moveEvent(Event &event, int groupId);
 
+    /*!
+     * Add an event, or update the event of its group with the same message
+     * token, atomically. See DatabaseIO::upsertEventByToken().
+     * eventsAdded() or eventsUpdated() is emitted once, nothing is emitted
+     * when an existing event is kept.
+     *
+     * \param event Event with a message token and a group.
+     * \param policy Changes to an existing event.
+     * \param inserted Optional return value, true if the event was added.
+     * \return true if successful
+     */
+    bool upsertEventByToken(Event &event,
+                            DatabaseIO::MergePolicy policy = DatabaseIO::MergeModified,
+                            bool *inserted = 0);
+
     /*!
      * In StreamedAsyncQuery mode, returns true if the tracker query has
      * more data available.
@@ -354,6 +413,10 @@ public:
     bool defaultAccept() const;
     int eventCategoryMask() const;
     bool bufferInsertions() const;
+    bool reuseRowStorage() const;
+    int batchInterval() const;
+    int batchSize() const;
+    bool isSuspended() const;
 
     /*** reimp from QAbstractItemModel ***/
     virtual QModelIndex parent(const QModelIndex &index) const;
@@ -24,6 +24,11 @@
 #include <QtDBus/QtDBus>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QCoreApplication>
+#include <QPointer>
+#include <QTimer>
+
+#include <algorithm>
 
 #include "databaseio.h"
 #include "databaseio_p.h"
@@ -47,6 +52,31 @@ bool initializeTypes()
 }
 
 const int defaultChunkSize = 50;
+const int defaultBatchSize = 100;
+
+int indexOfEvent(const QList<Event> &events, int id)
+{
+    for (int i = 0; i < events.size(); i++) {
+        if (events.at(i).id() == id)
+            return i;
+    }
+    return -1;
+}
+
+bool indexLessThan(const QModelIndex &a, const QModelIndex &b)
+{
+    if (a.parent() != b.parent())
+        return a.parent() < b.parent();
+    return a.row() < b.row();
+}
+
+// Models sharing events by key, the first one follows the change signals
+typedef QHash<QString, QList<EventModelPrivate *> > SharedModels;
+Q_GLOBAL_STATIC(SharedModels, sharedModels)
+
+// Models reloading while a change is forwarded must not copy rows that
+// have not seen the change yet
+int sharedDispatchDepth = 0;
 
 }
 
@@ -67,14 +97,26 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
         , accept(false)
         , threadCanFetchMore(false)
         , bufferInsertions(false)
+        , isSuspended(false)
+        , batchInterval(0)
+        , batchSize(defaultBatchSize)
+        , batchTimer(0)
+        , coalesceDataChanged(false)
+        , changeSequence(-1)
+        , eventSignalsConnected(false)
         , resolveContacts(EventModel::DoNotResolve)
         , propertyMask(Event::allProperties())
         , bgThread(0)
 {
     q_ptr = model;
 
-    // emit dbus signals
+    // emit dbus signals, the copies for the groups and types of the events
+    // going out before the broadcast ones
     emitter = UpdatesEmitter::instance();
+    connect(this, SIGNAL(eventsAdded(const QList<CommHistory::Event>&)),
+            emitter.data(), SLOT(routeEventsAdded(const QList<CommHistory::Event>&)));
+    connect(this, SIGNAL(eventsUpdated(const QList<CommHistory::Event>&)),
+            emitter.data(), SLOT(routeEventsUpdated(const QList<CommHistory::Event>&)));
     connect(this, SIGNAL(eventsAdded(const QList<CommHistory::Event>&)),
             emitter.data(), SIGNAL(eventsAdded(const QList<CommHistory::Event>&)));
     connect(this, SIGNAL(eventsUpdated(const QList<CommHistory::Event>&)),
@@ -89,24 +131,17 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
             emitter.data(), SIGNAL(groupsDeleted(const QList<int>&)));
 
     // listen to dbus signals
-    QDBusConnection::sessionBus().connect(
-        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
-        this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
-        this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
-        this, SLOT(eventDeletedSlot(int)));
+    EventModelPrivate::subscribe();
 
-    eventRootItem = new EventTreeItem(Event());
+    eventRootItem = newItem(Event());
 }
 
 EventModelPrivate::~EventModelPrivate()
 {
     DEBUG() << Q_FUNC_INFO;
 
-    delete eventRootItem;
+    detachShared();
+    EventTreeItem::destroy(eventRootItem);
 }
 
 bool EventModelPrivate::acceptsEvent(const Event &event) const
@@ -158,34 +193,17 @@ bool EventModelPrivate::executeQuery(QSqlQuery &query)
 
     isReady = false;
 
-    if (!query.exec()) {
-        qWarning() << "Failed to execute query";
-        qWarning() << query.lastError();
-        qWarning() << query.lastQuery();
-        return false;
-    }
+    // Changes journaled while reading are applied again on catch up,
+    // which is harmless
+    if (changeSequence < 0)
+        changeSequence = database()->changeSequence();
 
     QList<Event> events;
-    QList<int> extraPropertyIndices;
-    QList<int> hasPartsIndices;
-    while (query.next()) {
-        Event e;
-        bool extra = false, parts = false;
-        DatabaseIOPrivate::readEventResult(query, e, extra, parts);
-        if (extra)
-            extraPropertyIndices.append(events.size());
-        if (parts)
-            hasPartsIndices.append(events.size());
-        events.append(e);
-    }
-    query.finish();
-
-    foreach (int i, extraPropertyIndices)
-        DatabaseIO::instance()->getEventExtraProperties(events[i]);
-    foreach (int i, hasPartsIndices)
-        DatabaseIO::instance()->getMessageParts(events[i]);
-
-    eventsReceivedSlot(0, events.size(), events);
+    if (!DatabaseIOPrivate::readEvents(query, events))
+        return false;
+
+    const int count = events.size();
+    eventsReceivedSlot(0, count, std::move(events));
     return true;
 }
 
@@ -205,8 +223,8 @@ bool EventModelPrivate::fillModel(int start, int end, QList<CommHistory::Event>
     DEBUG() << Q_FUNC_INFO << ": read" << events.count() << "events";
 
     q->beginInsertRows(QModelIndex(), q->rowCount(), q->rowCount() + events.count() - 1);
-    foreach (const Event &event, events) {
-        eventRootItem->appendChild(new EventTreeItem(event, eventRootItem));
+    for (int i = 0; i < events.size(); i++) {
+        eventRootItem->appendChild(newItem(std::move(events[i]), eventRootItem));
     }
     q->endInsertRows();
 
@@ -232,7 +250,9 @@ bool EventModelPrivate::fillModel(QList<CommHistory::Event> events, bool resolve
         modelUpdatedSlot(true);
         return true;
     } else {
-        return fillModel(q->rowCount(), q->rowCount() + events.count() - 1, events, resolved);
+        const int start = q->rowCount();
+        const int end = start + events.count() - 1;
+        return fillModel(start, end, std::move(events), resolved);
     }
 
 
@@ -242,8 +262,412 @@ bool EventModelPrivate::fillModel(QList<CommHistory::Event> events, bool resolve
 void EventModelPrivate::clearEvents()
 {
     DEBUG() << Q_FUNC_INFO;
-    delete eventRootItem;
-    eventRootItem = new EventTreeItem(Event());
+    EventTreeItem::destroy(eventRootItem);
+    itemArena.clear();
+    eventRootItem = newItem(Event());
+    changeSequence = -1;
+
+    // The model is loaded again, possibly with other settings
+    if (detachShared() && !isSuspended)
+        connectEventSignals();
+    else
+        updateEventSubscription();
+}
+
+void EventModelPrivate::subscribe()
+{
+    // Changes are forwarded by the first model sharing the events
+    if (!isSharedSecondary())
+        connectEventSignals();
+}
+
+void EventModelPrivate::unsubscribe()
+{
+    disconnectEventSignals();
+}
+
+QStringList EventModelPrivate::eventPaths() const
+{
+    return QStringList();
+}
+
+void EventModelPrivate::connectEventSignals()
+{
+    if (eventSignalsConnected)
+        disconnectEventSignals();
+
+    // Without paths, the signals for all events are received. Otherwise
+    // only their copies for the groups or types of the model are.
+    subscribedPaths = eventPaths();
+    if (subscribedPaths.isEmpty()) {
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+            this, SLOT(sharedEventsAdded(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+            this, SLOT(sharedEventsUpdated(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+            this, SLOT(sharedEventDeleted(int)));
+    }
+
+    foreach (const QString &path, subscribedPaths) {
+        QDBusConnection::sessionBus().connect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENTS_ADDED_SIGNAL,
+            this, SLOT(sharedEventsAdded(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().connect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENTS_UPDATED_SIGNAL,
+            this, SLOT(sharedEventsUpdated(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().connect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENT_DELETED_SIGNAL,
+            this, SLOT(sharedEventDeleted(int)));
+    }
+
+    eventSignalsConnected = true;
+}
+
+void EventModelPrivate::disconnectEventSignals()
+{
+    if (!eventSignalsConnected)
+        return;
+
+    if (subscribedPaths.isEmpty()) {
+        QDBusConnection::sessionBus().disconnect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+            this, SLOT(sharedEventsAdded(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().disconnect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_UPDATED_SIGNAL,
+            this, SLOT(sharedEventsUpdated(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().disconnect(
+            QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENT_DELETED_SIGNAL,
+            this, SLOT(sharedEventDeleted(int)));
+    }
+
+    foreach (const QString &path, subscribedPaths) {
+        QDBusConnection::sessionBus().disconnect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENTS_ADDED_SIGNAL,
+            this, SLOT(sharedEventsAdded(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().disconnect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENTS_UPDATED_SIGNAL,
+            this, SLOT(sharedEventsUpdated(const QList<CommHistory::Event> &)));
+        QDBusConnection::sessionBus().disconnect(
+            QString(), path, COMM_HISTORY_EVENTS_INTERFACE, EVENT_DELETED_SIGNAL,
+            this, SLOT(sharedEventDeleted(int)));
+    }
+
+    subscribedPaths.clear();
+    eventSignalsConnected = false;
+}
+
+void EventModelPrivate::updateEventSubscription()
+{
+    if (eventSignalsConnected && eventPaths() != subscribedPaths)
+        connectEventSignals();
+}
+
+void EventModelPrivate::emitEventDeleted(const Event &event)
+{
+    emitter->routeEventDeleted(event);
+    emit eventDeleted(event.id());
+}
+
+bool EventModelPrivate::fillRoutingKeys(QList<Event> &events, QHash<int, int> *oldGroupIds)
+{
+    QList<int> ids;
+    foreach (const Event &event, events) {
+        const Event::PropertySet valid = event.validProperties();
+        if (event.id() >= 0
+            && (!valid.contains(Event::GroupId) || !valid.contains(Event::Type)
+                || (oldGroupIds && event.modifiedProperties().contains(Event::GroupId))))
+            ids.append(event.id());
+    }
+    if (ids.isEmpty())
+        return true;
+
+    QList<Event> stored;
+    if (!database()->getEventsByIds(ids, stored))
+        return false;
+
+    QHash<int, Event> storedById;
+    foreach (const Event &event, stored)
+        storedById.insert(event.id(), event);
+
+    // Not flagged as modified, the keys are not written back
+    for (QList<Event>::Iterator it = events.begin(); it != events.end(); it++) {
+        Event &event = *it;
+        QHash<int, Event>::ConstIterator found = storedById.constFind(event.id());
+        if (found == storedById.constEnd())
+            continue;
+
+        const Event::PropertySet valid = event.validProperties();
+        if (!valid.contains(Event::GroupId)) {
+            event.setGroupId(found->groupId());
+            event.resetModifiedProperty(Event::GroupId);
+        } else if (oldGroupIds && found->groupId() != event.groupId()) {
+            oldGroupIds->insert(event.id(), found->groupId());
+        }
+        if (!valid.contains(Event::Type)) {
+            event.setType(found->type());
+            event.resetModifiedProperty(Event::Type);
+        }
+    }
+
+    return true;
+}
+
+QString EventModelPrivate::shareKey() const
+{
+    return QString();
+}
+
+QString EventModelPrivate::baseShareKey() const
+{
+    QStringList properties;
+    foreach (Event::Property property, propertyMask)
+        properties.append(QString::number(property));
+    properties.sort();
+
+    QStringList key;
+    key << QString::fromLatin1(q_ptr->metaObject()->className())
+        << QString::number(queryMode)
+        << QString::number(chunkSize)
+        << QString::number(firstChunkSize)
+        << QString::number(queryLimit)
+        << QString::number(queryOffset)
+        << QString::number(eventCategoryMask)
+        << QString::number(accept)
+        << QString::number(isInTreeMode)
+        << QString::number(resolveContacts)
+        << properties.join(QLatin1Char(','));
+    return key.join(QLatin1Char(':'));
+}
+
+void EventModelPrivate::adoptItems(EventTreeItem *source, EventTreeItem *parent)
+{
+    for (int row = 0; row < source->childCount(); row++) {
+        EventTreeItem *item = newItem(source->eventAt(row), parent);
+        parent->appendChild(item);
+        adoptItems(source->child(row), item);
+    }
+}
+
+void EventModelPrivate::adoptState(EventModelPrivate &source)
+{
+    Q_Q(EventModel);
+
+    q->beginInsertRows(QModelIndex(), 0, source.eventRootItem->childCount() - 1);
+    adoptItems(source.eventRootItem, eventRootItem);
+    q->endInsertRows();
+
+    isReady = source.isReady;
+    threadCanFetchMore = source.threadCanFetchMore;
+    changeSequence = source.changeSequence;
+}
+
+bool EventModelPrivate::attachShared()
+{
+    // Suspended models do not follow changes, and the registry is only
+    // used from the main thread
+    if (isSuspended || !QCoreApplication::instance()
+        || thread() != QCoreApplication::instance()->thread()) {
+        return false;
+    }
+
+    const QString key = shareKey();
+    if (key.isEmpty())
+        return false;
+
+    QList<EventModelPrivate *> &models = (*sharedModels())[key];
+    if (models.isEmpty()) {
+        models.append(this);
+        sharedKey = key;
+        return false;
+    }
+
+    // Only adopt complete results, not those still being read or resolved
+    EventModelPrivate *primary = models.first();
+    if (sharedDispatchDepth > 0 || primary->changeSequence < 0
+        || primary->eventRootItem->childCount() == 0
+        || !primary->pendingReceived.isEmpty() || primary->hasBatchedChanges()) {
+        return false;
+    }
+
+    DEBUG() << Q_FUNC_INFO << "adopting" << primary->eventRootItem->childCount() << "rows";
+
+    adoptState(*primary);
+    models.append(this);
+    sharedKey = key;
+    disconnectEventSignals();
+
+    // The primary's ready and fetch state was adopted as is; a model that
+    // still has rows to fetch becomes ready when it fetches them
+    if (isReady)
+        emit modelReady(true);
+    return true;
+}
+
+bool EventModelPrivate::detachShared()
+{
+    if (sharedKey.isEmpty() || sharedModels.isDestroyed())
+        return false;
+
+    SharedModels::iterator it = sharedModels()->find(sharedKey);
+    sharedKey.clear();
+    if (it == sharedModels()->end())
+        return false;
+
+    const bool primary = it->first() == this;
+    it->removeAll(this);
+    if (it->isEmpty())
+        sharedModels()->erase(it);
+    else if (primary)
+        it->first()->connectEventSignals();
+
+    return !primary;
+}
+
+bool EventModelPrivate::isSharedSecondary() const
+{
+    if (sharedKey.isEmpty())
+        return false;
+
+    const QList<EventModelPrivate *> models = sharedModels()->value(sharedKey);
+    return !models.isEmpty() && models.first() != this;
+}
+
+QList<QPointer<EventModelPrivate> > EventModelPrivate::sharedSecondaries() const
+{
+    QList<QPointer<EventModelPrivate> > models;
+    if (!sharedKey.isEmpty()) {
+        foreach (EventModelPrivate *model, sharedModels()->value(sharedKey).mid(1))
+            models.append(model);
+    }
+    return models;
+}
+
+void EventModelPrivate::sharedEventsAdded(const QList<CommHistory::Event> &events)
+{
+    const QString key = sharedKey;
+    const QList<QPointer<EventModelPrivate> > models = sharedSecondaries();
+
+    sharedDispatchDepth++;
+    batchEventsAdded(events);
+    foreach (const QPointer<EventModelPrivate> &model, models) {
+        if (model && model->sharedKey == key)
+            model->batchEventsAdded(events);
+    }
+    sharedDispatchDepth--;
+}
+
+void EventModelPrivate::sharedEventsUpdated(const QList<CommHistory::Event> &events)
+{
+    const QString key = sharedKey;
+    const QList<QPointer<EventModelPrivate> > models = sharedSecondaries();
+
+    sharedDispatchDepth++;
+    batchEventsUpdated(events);
+    foreach (const QPointer<EventModelPrivate> &model, models) {
+        if (model && model->sharedKey == key)
+            model->batchEventsUpdated(events);
+    }
+    sharedDispatchDepth--;
+}
+
+void EventModelPrivate::sharedEventDeleted(int id)
+{
+    const QString key = sharedKey;
+    const QList<QPointer<EventModelPrivate> > models = sharedSecondaries();
+
+    sharedDispatchDepth++;
+    batchEventDeleted(id);
+    foreach (const QPointer<EventModelPrivate> &model, models) {
+        if (model && model->sharedKey == key)
+            model->batchEventDeleted(id);
+    }
+    sharedDispatchDepth--;
+}
+
+void EventModelPrivate::suspend()
+{
+    if (isSuspended)
+        return;
+
+    DEBUG() << Q_FUNC_INFO;
+    isSuspended = true;
+    flushBatch();
+    // Changes are caught up on individually when resuming
+    detachShared();
+    unsubscribe();
+}
+
+bool EventModelPrivate::resume()
+{
+    if (!isSuspended)
+        return true;
+
+    DEBUG() << Q_FUNC_INFO;
+    isSuspended = false;
+    // Subscribe first, so that nothing is missed between catching up
+    // and the next signal
+    subscribe();
+
+    // Nothing to catch up on before the first query
+    if (changeSequence < 0 && eventRootItem->childCount() == 0)
+        return true;
+
+    if (applyChanges())
+        return true;
+
+    DEBUG() << Q_FUNC_INFO << "reloading";
+    return reload();
+}
+
+bool EventModelPrivate::reload()
+{
+    return false;
+}
+
+bool EventModelPrivate::applyChanges()
+{
+    if (changeSequence < 0)
+        return false;
+
+    QList<DatabaseIO::Change> changes;
+    qint64 lastSequence;
+    bool expired;
+    if (!database()->changesSince(changeSequence, changes, lastSequence, &expired)) {
+        // Reloaded by the caller
+        if (expired)
+            DEBUG() << Q_FUNC_INFO << "missed changes are no longer journaled";
+        return false;
+    }
+
+    QList<int> ids;
+    QSet<int> changed;
+    foreach (const DatabaseIO::Change &change, changes) {
+        // Events of deleted groups have their own entries
+        if (change.target == DatabaseIO::Change::EventTarget && !changed.contains(change.id)) {
+            changed.insert(change.id);
+            ids.append(change.id);
+        }
+    }
+
+    QList<Event> events;
+    if (!ids.isEmpty() && !database()->getEventsByIds(ids, events))
+        return false;
+
+    DEBUG() << Q_FUNC_INFO << changes.size() << "changes," << events.size() << "events";
+
+    // Events that no longer exist were deleted, whatever else happened
+    foreach (const Event &event, events)
+        changed.remove(event.id());
+    foreach (int id, changed)
+        eventDeletedSlot(id);
+    if (!events.isEmpty())
+        eventsUpdatedSlot(events);
+
+    changeSequence = lastSequence;
+    return true;
 }
 
 void EventModelPrivate::setBufferInsertions(bool buffer)
@@ -252,11 +676,132 @@ void EventModelPrivate::setBufferInsertions(bool buffer)
         bufferInsertions = buffer;
 
         if (!bufferInsertions && !bufferedInsertions.isEmpty()) {
-            // Add the events that were previously buffered
-            addToModel(bufferedInsertions, true);
+            // Add the events that were previously buffered, the last
+            // one as the first row
+            QList<Event> events;
+            foreach (const Event &event, bufferedInsertions)
+                events.prepend(event);
             bufferedInsertions.clear();
+            addToModel(events, true);
+        }
+    }
+}
+
+void EventModelPrivate::setBatchInterval(int msecs)
+{
+    batchInterval = qMax(0, msecs);
+    if (batchInterval == 0)
+        flushBatch();
+}
+
+bool EventModelPrivate::hasBatchedChanges() const
+{
+    return !batchedAdded.isEmpty() || !batchedUpdated.isEmpty() || !batchedDeleted.isEmpty();
+}
+
+void EventModelPrivate::batchEventsAdded(const QList<Event> &events)
+{
+    if (batchInterval <= 0) {
+        eventsAddedSlot(events);
+        return;
+    }
+
+    foreach (const Event &event, events) {
+        int i = indexOfEvent(batchedAdded, event.id());
+        if (i >= 0)
+            batchedAdded[i] = event;
+        else
+            batchedAdded.append(event);
+    }
+    scheduleBatch();
+}
+
+void EventModelPrivate::batchEventsUpdated(const QList<Event> &events)
+{
+    if (batchInterval <= 0) {
+        eventsUpdatedSlot(events);
+        return;
+    }
+
+    // Updates may only carry the changed properties
+    foreach (const Event &event, events) {
+        int i = indexOfEvent(batchedAdded, event.id());
+        if (i >= 0) {
+            batchedAdded[i].copyValidProperties(event);
+            continue;
         }
+
+        i = indexOfEvent(batchedUpdated, event.id());
+        if (i >= 0)
+            batchedUpdated[i].copyValidProperties(event);
+        else
+            batchedUpdated.append(event);
+    }
+    scheduleBatch();
+}
+
+void EventModelPrivate::batchEventDeleted(int id)
+{
+    if (batchInterval <= 0) {
+        eventDeletedSlot(id);
+        return;
     }
+
+    int i = indexOfEvent(batchedAdded, id);
+    if (i >= 0)
+        batchedAdded.removeAt(i);
+    i = indexOfEvent(batchedUpdated, id);
+    if (i >= 0)
+        batchedUpdated.removeAt(i);
+    if (!batchedDeleted.contains(id))
+        batchedDeleted.append(id);
+    scheduleBatch();
+}
+
+void EventModelPrivate::scheduleBatch()
+{
+    if (batchedAdded.size() + batchedUpdated.size() + batchedDeleted.size() >= batchSize) {
+        flushBatch();
+        return;
+    }
+
+    if (!batchTimer) {
+        batchTimer = new QTimer(this);
+        batchTimer->setSingleShot(true);
+        connect(batchTimer, SIGNAL(timeout()), SLOT(flushBatch()));
+    }
+    // The first change of a batch waits for at most one interval
+    if (!batchTimer->isActive())
+        batchTimer->start(batchInterval);
+}
+
+void EventModelPrivate::flushBatch()
+{
+    if (batchTimer)
+        batchTimer->stop();
+    if (!hasBatchedChanges())
+        return;
+
+    QList<int> deleted(batchedDeleted);
+    QList<Event> updated(batchedUpdated);
+    QList<Event> added(batchedAdded);
+    batchedDeleted.clear();
+    batchedUpdated.clear();
+    batchedAdded.clear();
+
+    DEBUG() << Q_FUNC_INFO << added.size() << "added" << updated.size() << "updated"
+            << deleted.size() << "deleted";
+
+    coalesceDataChanged = true;
+    foreach (int id, deleted)
+        eventDeletedSlot(id);
+    if (!updated.isEmpty())
+        eventsUpdatedSlot(updated);
+    if (!added.isEmpty())
+        eventsAddedSlot(added);
+    coalesceDataChanged = false;
+
+    emitCoalescedDataChanged();
 }
 
 void EventModelPrivate::addToModel(const QList<Event> &events, bool sync)
@@ -292,7 +837,7 @@ void EventModelPrivate::resolveAddedEvents(const QList<Event> &events)
 
 void EventModelPrivate::addResolverFinished()
 {
-    QList<Event> resolved(pendingAdded);
+    QList<Event> resolved(std::move(pendingAdded));
     pendingAdded.clear();
 
     QList<Event>::iterator it = resolved.begin(), end = resolved.end();
@@ -302,7 +847,7 @@ void EventModelPrivate::addResolverFinished()
             event.setIsResolved(true);
     }
 
-    prependEvents(resolved, true);
+    prependEvents(std::move(resolved), true);
 }
 
 void EventModelPrivate::prependEvents(QList<Event> events, bool resolved)
@@ -329,7 +874,7 @@ void EventModelPrivate::prependEvents(QList<Event> events, bool resolved)
 
     q->beginInsertRows(QModelIndex(), 0, events.size() - 1);
     for (int i = events.size() - 1; i >= 0; i--) {
-        eventRootItem->prependChild(new EventTreeItem(events[i], eventRootItem));
+        eventRootItem->prependChild(newItem(std::move(events[i]), eventRootItem));
     }
     q->endInsertRows();
 }
@@ -432,13 +977,13 @@ void EventModelPrivate::eventsReceivedSlot(int start, int end, QList<Event> even
         pendingReceived.append(events);
         receiveResolver->add(events);
     } else {
-        fillModel(start, end, events, false);
+        fillModel(start, end, std::move(events), false);
     }
 }
 
 void EventModelPrivate::receiveResolverFinished()
 {
-    QList<Event> resolved(pendingReceived);
+    QList<Event> resolved(std::move(pendingReceived));
     pendingReceived.clear();
 
     QList<Event>::iterator it = resolved.begin(), end = resolved.end();
@@ -448,7 +993,7 @@ void EventModelPrivate::receiveResolverFinished()
             event.setIsResolved(true);
     }
 
-    fillModel(resolved, true);
+    fillModel(std::move(resolved), true);
 }
 
 void EventModelPrivate::modelUpdatedSlot(bool successful)
@@ -463,33 +1008,42 @@ void EventModelPrivate::eventsAddedSlot(const QList<Event> &events)
 {
     DEBUG() << Q_FUNC_INFO << ":" << events.count() << "events";
 
+    // Added together, with the last event as the first row
+    QList<Event> added;
     foreach (const Event &event, events) {
         QModelIndex index = findEvent(event.id());
-        if (index.isValid()) return;
+        if (index.isValid())
+            continue;
 
-        Event e = event;
-        if (acceptsEvent(e))
-            addToModel(e);
+        if (acceptsEvent(event))
+            added.prepend(event);
     }
+
+    if (!added.isEmpty())
+        addToModel(added);
 }
 
 void EventModelPrivate::eventsUpdatedSlot(const QList<Event> &events)
 {
     DEBUG() << Q_FUNC_INFO << ":" << events.count();
 
+    QList<Event> added;
     foreach (const Event &event, events) {
         QModelIndex index = findEvent(event.id());
         Event e = event;
 
         if (!index.isValid()) {
             if (acceptsEvent(e))
-                addToModel(e);
+                added.prepend(e);
 
             continue;
         }
 
         modifyInModel(e);
     }
+
+    if (!added.isEmpty())
+        addToModel(added);
 }
 
 void EventModelPrivate::eventDeletedSlot(int id)
@@ -590,7 +1144,38 @@ void EventModelPrivate::emitDataChanged(int row, void *data)
 {
     Q_Q(EventModel);
 
+    // Rows may still move while a batch is applied
+    if (coalesceDataChanged) {
+        changedIds.insert(static_cast<EventTreeItem *>(data)->event().id());
+        return;
+    }
+
     const QModelIndex modelIndex(q->createIndex(row, 0, data));
     emit q->dataChanged(modelIndex, modelIndex);
 }
 
+void EventModelPrivate::emitCoalescedDataChanged()
+{
+    Q_Q(EventModel);
+
+    QList<QModelIndex> indexes;
+    foreach (int id, changedIds) {
+        QModelIndex index = findEvent(id);
+        if (index.isValid())
+            indexes.append(index);
+    }
+    changedIds.clear();
+
+    std::sort(indexes.begin(), indexes.end(), indexLessThan);
+
+    int first = 0;
+    for (int i = 1; i <= indexes.size(); i++) {
+        if (i < indexes.size() && indexes.at(i).parent() == indexes.at(first).parent()
+            && indexes.at(i).row() == indexes.at(i - 1).row() + 1) {
+            continue;
+        }
+        emit q->dataChanged(indexes.at(first), indexes.at(i - 1));
+        first = i;
+    }
+}
+
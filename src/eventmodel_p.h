@@ -25,7 +25,11 @@
 #define COMMHISTORY_EVENTMODEL_P_H
 
 #include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QPointer>
 #include <QGenericArgument>
+#include <utility>
 
 #include "eventmodel.h"
 #include "event.h"
@@ -36,6 +40,7 @@
 #include "contactresolver.h"
 
 class QSqlQuery;
+class QTimer;
 
 namespace CommHistory {
 
@@ -101,6 +106,8 @@ public:
      * \param end End row for new events in the the internal tracker
      * query model.
      * \param events List of new events to be inserted into the model.
+     * Pass an unshared list (e.g. with std::move()) so that the events can
+     * be moved into the model instead of being copied.
      *
      * \return true if successful (return value not used at the moment).
      */
@@ -111,8 +118,110 @@ public:
      */
     virtual void clearEvents();
 
+    /*!
+     * Apply the changes journaled since the events were read, or since the
+     * last call, as if their signals had been received. Returns false if
+     * the changes are no longer available, in which case the model has to
+     * be reloaded.
+     */
+    bool applyChanges();
+
+    /*!
+     * Connect and disconnect the change signals of other processes.
+     * Reimplement to follow additional signals.
+     */
+    virtual void subscribe();
+    virtual void unsubscribe();
+    void connectEventSignals();
+    void disconnectEventSignals();
+
+    /*!
+     * Object paths of the event signals to follow, see
+     * UpdatesEmitter::groupEventsPath() and UpdatesEmitter::typeEventsPath().
+     * Reimplement in submodels showing only some groups or types, so that
+     * other events are not delivered to the process. Empty for all events.
+     */
+    virtual QStringList eventPaths() const;
+
+    /*!
+     * Follow the paths of eventPaths() after the settings changed.
+     */
+    void updateEventSubscription();
+
+    /*!
+     * Emit eventDeleted(), also for the group and type of the event.
+     */
+    void emitEventDeleted(const Event &event);
+
+    /*!
+     * Read the group and type of the events lacking them, as the change
+     * signals are routed on those. Call in the transaction modifying the
+     * events. If \a oldGroupIds is given, it gets the stored group of the
+     * events whose group is being modified, by event id.
+     */
+    bool fillRoutingKeys(QList<Event> &events, QHash<int, int> *oldGroupIds = 0);
+
+    void suspend();
+    bool resume();
+
+    /*!
+     * Reimplement in submodels to run the last query again when changes
+     * missed while suspended are no longer journaled.
+     *
+     * \return false if the model cannot reload itself
+     */
+    virtual bool reload();
+
+    /*!
+     * Models with the same non-empty key show the same events. Loading
+     * such a model copies the rows of one that is already loaded instead
+     * of querying the database, and only that one follows the change
+     * signals, forwarding them to the others. Reimplement in submodels
+     * from everything that selects and orders the events.
+     */
+    virtual QString shareKey() const;
+
+    /*!
+     * Key parts common to all models: class, query and property settings.
+     */
+    QString baseShareKey() const;
+
+    /*!
+     * Copy the rows and load state of \a source, which has the same
+     * share key. Events are implicitly shared, not copied.
+     */
+    virtual void adoptState(EventModelPrivate &source);
+
+    /*!
+     * Called after clearing the model for a new query. Returns true if the
+     * rows were adopted from a loaded model, otherwise the query has to be
+     * executed.
+     */
+    bool attachShared();
+
+    /*!
+     * Stop sharing. Returns true if the change signals were forwarded by
+     * another model.
+     */
+    bool detachShared();
+
+    bool isSharedSecondary() const;
+    QList<QPointer<EventModelPrivate> > sharedSecondaries() const;
+
     void setBufferInsertions(bool buffer);
 
+    /*!
+     * Apply changes of other processes, or collect them until the batch
+     * interval has passed or the batch size is reached. Collected changes
+     * of the same event are merged.
+     */
+    void batchEventsAdded(const QList<Event> &events);
+    void batchEventsUpdated(const QList<Event> &events);
+    void batchEventDeleted(int id);
+    void setBatchInterval(int msecs);
+    void scheduleBatch();
+    bool hasBatchedChanges() const;
+
     void addToModel(const Event &event, bool synchronous = false) { addToModel(QList<Event>() << event, synchronous); }
 
     virtual void addToModel(const QList<Event> &event, bool synchronous = false);
@@ -122,6 +231,21 @@ public:
 
     QModelIndex findEventRecursive(int id, EventTreeItem *parent) const;
 
+    /*!
+     * Create a row item in the model's arena. Items are released with
+     * EventTreeItem::destroy() or by removing them from their parent.
+     */
+    EventTreeItem *newItem(const Event &event, EventTreeItem *parent = 0)
+    {
+        return EventTreeItem::create(&itemArena, event, parent);
+    }
+    EventTreeItem *newItem(Event &&event, EventTreeItem *parent = 0)
+    {
+        return EventTreeItem::create(&itemArena, std::move(event), parent);
+    }
+
+    void adoptItems(EventTreeItem *source, EventTreeItem *parent);
+
     bool canFetchMore() const;
 
     void setResolveContacts(EventModel::ContactResolveType resolveType);
@@ -133,12 +257,15 @@ public:
 
     void recipientsChangedRecursive(const QSet<Recipient> &recipients, EventTreeItem *parent, bool resolved = false);
     void emitDataChanged(int row, void *data);
+    // Emit dataChanged() over runs of adjacent rows collected during a batch
+    void emitCoalescedDataChanged();
 
     // This is the root node for the internal event tree. In a standard
     // flat model, eventRootNode has rowCount() children with events.
     // Use this in fillModel() and other methods if you're implementing
     // a nonstandard model.
     EventTreeItem *eventRootItem;
+    EventTreeItemArena itemArena;
 
     mutable ContactResolver *addResolver, *receiveResolver, *onDemandResolver;
     mutable QList<Event> pendingAdded, pendingReceived, pendingOnDemand, bufferedInsertions;
@@ -154,6 +281,26 @@ public:
     bool accept;
     bool threadCanFetchMore;
     bool bufferInsertions;
+    bool isSuspended;
+
+    int batchInterval;
+    int batchSize;
+    QTimer *batchTimer;
+    QList<Event> batchedAdded, batchedUpdated;
+    QList<int> batchedDeleted;
+    bool coalesceDataChanged;
+    QSet<int> changedIds;
+
+    // Change journal sequence the model contents are known to be up to
+    // date with, or -1 before the first query
+    qint64 changeSequence;
+
+    // Key the model is registered with for sharing, empty if not shared
+    QString sharedKey;
+
+    // Event signals currently followed
+    bool eventSignalsConnected;
+    QStringList subscribedPaths;
 
     // Do not set directly, use setResolveContacts to enable listener
     EventModel::ContactResolveType resolveContacts;
@@ -186,12 +333,19 @@ public Q_SLOTS:
 
     virtual void canFetchMoreChangedSlot(bool canFetch);
 
+    void flushBatch();
+
     virtual void slotContactInfoChanged(const RecipientList &recipients);
 
     virtual void slotContactChanged(const RecipientList &recipients);
 
     virtual void slotContactDetailsChanged(const RecipientList &recipients);
 
+    // Receive the change signals and forward them to sharing models
+    void sharedEventsAdded(const QList<CommHistory::Event> &events);
+    void sharedEventsUpdated(const QList<CommHistory::Event> &events);
+    void sharedEventDeleted(int id);
+
 Q_SIGNALS:
     void eventsAdded(const QList<CommHistory::Event> &events);
 
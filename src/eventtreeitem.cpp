@@ -22,21 +22,136 @@
 
 #include <QDebug>
 #include <QList>
+#include <stdlib.h>
+#include <new>
+#include <utility>
 #include "event.h"
 #include "eventtreeitem.h"
 
 using namespace CommHistory;
 
+namespace {
+
+const int itemsPerSlab = 256;
+
+// Free items hold the link to the next free item in their first bytes
+const size_t itemSize = (sizeof(EventTreeItem) + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+}
+
+EventTreeItemArena::EventTreeItemArena()
+    : m_freeList(0),
+      m_slab(0),
+      m_used(0),
+      m_retainSlabs(false)
+{
+}
+
+EventTreeItemArena::~EventTreeItemArena()
+{
+    m_retainSlabs = false;
+    clear();
+}
+
+void *EventTreeItemArena::allocate()
+{
+    if (m_freeList) {
+        void *item = m_freeList;
+        m_freeList = *static_cast<void **>(item);
+        return item;
+    }
+
+    if (m_slab < m_slabs.size() && m_used == itemsPerSlab) {
+        m_slab++;
+        m_used = 0;
+    }
+
+    if (m_slab == m_slabs.size()) {
+        char *slab = static_cast<char *>(malloc(itemSize * itemsPerSlab));
+        if (!slab)
+            qFatal("Out of memory for model rows");
+        m_slabs.append(slab);
+        m_used = 0;
+    }
+
+    return m_slabs.at(m_slab) + itemSize * m_used++;
+}
+
+void EventTreeItemArena::release(void *item)
+{
+    *static_cast<void **>(item) = m_freeList;
+    m_freeList = item;
+}
+
+void EventTreeItemArena::clear()
+{
+    m_freeList = 0;
+    m_slab = 0;
+    m_used = 0;
+
+    if (!m_retainSlabs) {
+        foreach (char *slab, m_slabs)
+            free(slab);
+        m_slabs.clear();
+    }
+}
+
+void EventTreeItemArena::setRetainSlabs(bool retain)
+{
+    m_retainSlabs = retain;
+}
+
 EventTreeItem::EventTreeItem(const Event &event, EventTreeItem *parent)
+    : eventData(event),
+      parentItem(parent),
+      arena(0)
+{
+}
+
+EventTreeItem::EventTreeItem(Event &&event, EventTreeItem *parent)
+    : eventData(std::move(event)),
+      parentItem(parent),
+      arena(0)
 {
-    parentItem = parent;
-    eventData = new Event(event);
 }
 
 EventTreeItem::~EventTreeItem()
 {
-    delete eventData;
-    qDeleteAll(children);
+    foreach (EventTreeItem *child, children)
+        destroy(child);
+}
+
+EventTreeItem *EventTreeItem::create(EventTreeItemArena *arena, const Event &event, EventTreeItem *parent)
+{
+    if (!arena)
+        return new EventTreeItem(event, parent);
+
+    EventTreeItem *item = new (arena->allocate()) EventTreeItem(event, parent);
+    item->arena = arena;
+    return item;
+}
+
+EventTreeItem *EventTreeItem::create(EventTreeItemArena *arena, Event &&event, EventTreeItem *parent)
+{
+    if (!arena)
+        return new EventTreeItem(std::move(event), parent);
+
+    EventTreeItem *item = new (arena->allocate()) EventTreeItem(std::move(event), parent);
+    item->arena = arena;
+    return item;
+}
+
+void EventTreeItem::destroy(EventTreeItem *item)
+{
+    if (!item)
+        return;
+
+    if (EventTreeItemArena *arena = item->arena) {
+        item->~EventTreeItem();
+        arena->release(item);
+    } else {
+        delete item;
+    }
 }
 
 void EventTreeItem::appendChild(EventTreeItem *child)
@@ -68,7 +183,7 @@ void EventTreeItem::insertChildAt(int row, EventTreeItem *child)
 
 void EventTreeItem::removeAt(int row)
 {
-    delete children.takeAt(row);
+    destroy(children.takeAt(row));
 }
 
 EventTreeItem *EventTreeItem::child(int row)
@@ -89,13 +204,12 @@ int EventTreeItem::childCount() const
 
 Event &EventTreeItem::event()
 {
-    return *eventData;
+    return eventData;
 }
 
 void EventTreeItem::setEvent(const Event &event)
 {
-    delete eventData;
-    eventData = new Event(event);
+    eventData = event;
 }
 
 EventTreeItem *EventTreeItem::parent()
@@ -24,10 +24,48 @@
 #define COMMHISTORY_EVENTTREEITEM_H
 
 #include <QList>
+#include "event.h"
 
 namespace CommHistory {
 
-class Event;
+/*!
+ * \class EventTreeItemArena
+ *
+ * Storage for the EventTreeItems of one model. Items are carved from
+ * slabs holding many items each and are put on a free list when destroyed,
+ * so that filling and clearing a model do not allocate and free every row
+ * separately. clear() releases all slabs at once, or keeps them for the
+ * next fill when retainSlabs is set.
+ */
+class EventTreeItemArena
+{
+public:
+    EventTreeItemArena();
+    ~EventTreeItemArena();
+
+    void *allocate();
+    void release(void *item);
+
+    /*!
+     * Release all storage. Every item allocated from the arena must have
+     * been destroyed.
+     */
+    void clear();
+
+    bool retainSlabs() const { return m_retainSlabs; }
+    void setRetainSlabs(bool retain);
+
+    int slabCount() const { return m_slabs.size(); }
+
+private:
+    Q_DISABLE_COPY(EventTreeItemArena)
+
+    QList<char *> m_slabs;
+    void *m_freeList;
+    int m_slab;
+    int m_used;
+    bool m_retainSlabs;
+};
 
 /*!
  * \class EventTreeItem
@@ -38,8 +76,17 @@ class EventTreeItem
 {
 public:
     EventTreeItem(const Event &event, EventTreeItem *parent = 0);
+    EventTreeItem(Event &&event, EventTreeItem *parent = 0);
     ~EventTreeItem();
 
+    /*!
+     * Create an item in arena storage. Such items, and any item which may
+     * have them as children, must be released with destroy().
+     */
+    static EventTreeItem *create(EventTreeItemArena *arena, const Event &event, EventTreeItem *parent = 0);
+    static EventTreeItem *create(EventTreeItemArena *arena, Event &&event, EventTreeItem *parent = 0);
+    static void destroy(EventTreeItem *item);
+
     void appendChild(EventTreeItem *child);
     void prependChild(EventTreeItem *child);
     void insertChildAt(int row, EventTreeItem *child);
@@ -55,8 +102,9 @@ public:
 
 private:
     QList<EventTreeItem *> children;
-    Event *eventData;
+    Event eventData;
     EventTreeItem *parentItem;
+    EventTreeItemArena *arena;
 };
 
 }
@@ -23,9 +23,11 @@
 
 #include <QtDBus/QtDBus>
 #include <QSqlQuery>
+#include <QTimer>
 
 #include "commonutils.h"
 #include "contactresolver.h"
+#include "conversationcache_p.h"
 #include "databaseio.h"
 #include "databaseio_p.h"
 #include "eventmodel.h"
@@ -48,6 +50,14 @@ bool initializeTypes()
 }
 
 const int defaultChunkSize = 50;
+const int defaultPrefetchChunkSize = 25;
+// Wait for the group list to settle before prefetching conversations
+const int prefetchSettleDelay = 500;
+
+inline bool groupObjectSort(CommHistory::GroupObject *a, CommHistory::GroupObject *b)
+{
+    return a->endTimeT() > b->endTimeT(); // descending order
+}
 
 }
 
@@ -75,19 +85,38 @@ public:
     void add(const Group &group);
     void addGroups(const QList<Group> &groups);
 
-    void modifyInModel(Group &group, bool query = true);
+    void modifyInModel(Group &group);
+    // Reads the groups again, in one query
+    void modifyInModel(const QList<int> &groupIds);
 
     void resolve(GroupObject &group);
 
     ContactResolver *resolver();
 
     bool canFetchMore() const;
+    bool isStreaming() const;
+    bool fetchChunk(int limit);
+    bool isBeyondLoaded(const Group &group) const;
 
     bool commitTransaction(const QList<int> &groupIds);
 
+    bool applyChanges();
+
+    void subscribe();
+    void unsubscribe();
+    void suspend();
+    bool resume();
+
     DatabaseIO* database();
 
+    QTimer *prefetchTimer();
+    void openConversationCache();
+
 public Q_SLOTS:
+    void schedulePrefetch();
+    void prefetchNext();
+    void prefetchFinished(int groupId);
+
     void eventsAddedSlot(const QList<CommHistory::Event> &events);
 
     void groupsAddedSlot(const QList<CommHistory::Group> &addedGroups);
@@ -109,8 +138,13 @@ public:
     int queryLimit;
     int queryOffset;
     bool isReady;
+    bool isSuspended;
     QHash<int,GroupObject*> groups;
 
+    // Change journal sequence the groups are known to be up to date with,
+    // or -1 before getGroups()
+    qint64 changeSequence;
+
     QString filterLocalUid;
     QString filterRemoteUid;
 
@@ -124,6 +158,20 @@ public:
     QList<Group> pendingResolve;
     QSet<int> pendingIds;
     QList<GroupObject *> pendingObjects;
+
+    // Position of the last streamed chunk
+    bool allLoaded;
+    quint32 fetchedEndTime;
+    int fetchedId;
+
+    int prefetchCount;
+    int prefetchChunkSize;
+    bool prefetchRecentPending;
+    QList<int> prefetchQueue;
+    QTimer *prefetchTimerObject;
+    // Group being read on bgThread
+    int prefetchingGroup;
+    QSharedPointer<ConversationCache> conversationCache;
 };
 
 }
@@ -138,49 +186,25 @@ GroupManagerPrivate::GroupManagerPrivate(GroupManager *manager)
         , queryLimit(0)
         , queryOffset(0)
         , isReady(true)
+        , isSuspended(false)
+        , changeSequence(-1)
         , filterLocalUid(QString())
         , filterRemoteUid(QString())
         , bgThread(0)
         , contactResolver(0)
         , resolveContacts(GroupManager::DoNotResolve)
+        , allLoaded(true)
+        , fetchedEndTime(0)
+        , fetchedId(-1)
+        , prefetchCount(0)
+        , prefetchChunkSize(defaultPrefetchChunkSize)
+        , prefetchRecentPending(false)
+        , prefetchTimerObject(0)
+        , prefetchingGroup(-1)
 {
     emitter = UpdatesEmitter::instance();
 
-    QDBusConnection::sessionBus().connect(
-        QString(),
-        QString(),
-        COMM_HISTORY_SERVICE_NAME,
-        EVENTS_ADDED_SIGNAL,
-        this,
-        SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(),
-        QString(),
-        COMM_HISTORY_SERVICE_NAME,
-        GROUPS_ADDED_SIGNAL,
-        this,
-        SLOT(groupsAddedSlot(const QList<CommHistory::Group> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(),
-        QString(),
-        COMM_HISTORY_SERVICE_NAME,
-        GROUPS_UPDATED_SIGNAL,
-        this,
-        SLOT(groupsUpdatedSlot(const QList<int> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(),
-        QString(),
-        COMM_HISTORY_SERVICE_NAME,
-        GROUPS_UPDATED_FULL_SIGNAL,
-        this,
-        SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(),
-        QString(),
-        COMM_HISTORY_SERVICE_NAME,
-        GROUPS_DELETED_SIGNAL,
-        this,
-        SLOT(groupsDeletedSlot(const QList<int> &)));
+    subscribe();
 }
 
 GroupManagerPrivate::~GroupManagerPrivate()
@@ -231,7 +255,7 @@ bool GroupManagerPrivate::commitTransaction(const QList<int> &groupIds)
     return success;
 }
 
-void GroupManagerPrivate::modifyInModel(Group &group, bool query)
+void GroupManagerPrivate::modifyInModel(Group &group)
 {
     Q_Q(GroupManager);
 
@@ -239,19 +263,47 @@ void GroupManagerPrivate::modifyInModel(Group &group, bool query)
     if (!go)
         return;
 
-    if (query) {
-        Group newGroup;
-        if (!database()->getGroup(group.id(), newGroup))
-            return;
-        go->set(newGroup);
-    } else {
-        go->copyValidProperties(group);
-    }
-
+    go->copyValidProperties(group);
     emit q->groupUpdated(go);
     DEBUG() << Q_FUNC_INFO << ": updated" << go->toString();
 }
 
+void GroupManagerPrivate::modifyInModel(const QList<int> &groupIds)
+{
+    Q_Q(GroupManager);
+
+    // Loaded groups are read again, others only when they may now sort
+    // before the last streamed chunk
+    QList<int> ids;
+    QSet<int> seen;
+    foreach (int id, groupIds) {
+        if (seen.contains(id))
+            continue;
+        seen.insert(id);
+        if (groups.contains(id) || (canFetchMore() && !pendingIds.contains(id)))
+            ids.append(id);
+    }
+    if (ids.isEmpty())
+        return;
+
+    QList<Group> results;
+    if (!database()->getGroupsByIds(ids, results))
+        return;
+
+    QList<Group> added;
+    foreach (const Group &group, results) {
+        GroupObject *go = groups.value(group.id());
+        if (go) {
+            go->set(group);
+            emit q->groupUpdated(go);
+            DEBUG() << Q_FUNC_INFO << ": updated" << go->toString();
+        } else if (groupMatchesFilter(group) && !isBeyondLoaded(group)) {
+            added.append(group);
+        }
+    }
+    addGroups(added);
+}
+
 void GroupManagerPrivate::resolve(GroupObject &group)
 {
     if (resolveContacts == GroupManager::ResolveOnDemand) {
@@ -275,6 +327,8 @@ void GroupManagerPrivate::eventsAddedSlot(const QList<Event> &events)
     Q_Q(GroupManager);
     DEBUG() << Q_FUNC_INFO << events.count();
 
+    QSet<int> loadedGroups;
+    QList<int> unloadedGroups;
     foreach (const Event &event, events) {
         // statusmessages are not shown in group model
         if (event.type() == Event::StatusMessageEvent
@@ -282,9 +336,19 @@ void GroupManagerPrivate::eventsAddedSlot(const QList<Event> &events)
             continue;
         }
 
+        // Already up to date when read from the database below
+        if (loadedGroups.contains(event.groupId()))
+            continue;
+
         GroupObject *go = groups.value(event.groupId());
-        if (!go)
+        if (!go) {
+            // The group may now sort before the last streamed chunk
+            if (canFetchMore()) {
+                unloadedGroups.append(event.groupId());
+                loadedGroups.insert(event.groupId());
+            }
             continue;
+        }
 
         if (event.endTimeT() >= go->endTimeT()) {
             DEBUG() << Q_FUNC_INFO << ": updating group" << go->id();
@@ -308,6 +372,8 @@ void GroupManagerPrivate::eventsAddedSlot(const QList<Event> &events)
             go->setUnreadMessages(go->unreadMessages() + 1);
         emit q->groupUpdated(go);
     }
+
+    modifyInModel(unloadedGroups);
 }
 
 void GroupManagerPrivate::groupsAddedSlot(const QList<CommHistory::Group> &addedGroups)
@@ -331,21 +397,22 @@ void GroupManagerPrivate::groupsUpdatedSlot(const QList<int> &groupIds)
 {
     DEBUG() << Q_FUNC_INFO << groupIds.count();
 
-    foreach (int id, groupIds) {
-        Group g;
-        g.setId(id);
-
-        modifyInModel(g);
-    }
+    modifyInModel(groupIds);
 }
 
 void GroupManagerPrivate::groupsUpdatedFullSlot(const QList<CommHistory::Group> &groups)
 {
     DEBUG() << Q_FUNC_INFO << groups.count();
 
+    // Groups not loaded may now sort before the last streamed chunk
+    QList<int> unloadedGroups;
     foreach (Group g, groups) {
-        modifyInModel(g, false);
+        if (this->groups.contains(g.id()))
+            modifyInModel(g);
+        else
+            unloadedGroups.append(g.id());
     }
+    modifyInModel(unloadedGroups);
 }
 
 void GroupManagerPrivate::groupsDeletedSlot(const QList<int> &groupIds)
@@ -368,7 +435,155 @@ void GroupManagerPrivate::groupsDeletedSlot(const QList<int> &groupIds)
 
 bool GroupManagerPrivate::canFetchMore() const
 {
-    return false;
+    return isStreaming() && !allLoaded;
+}
+
+bool GroupManagerPrivate::isStreaming() const
+{
+    return queryMode == EventModel::StreamedAsyncQuery && chunkSize > 0;
+}
+
+bool GroupManagerPrivate::fetchChunk(int limit)
+{
+    QList<Group> results;
+    if (!database()->getGroupsChunk(filterLocalUid, filterRemoteUid, results, limit,
+                                    fetchedEndTime, fetchedId)) {
+        return false;
+    }
+
+    DEBUG() << Q_FUNC_INFO << "fetched" << results.size() << "groups";
+
+    if (results.size() < limit)
+        allLoaded = true;
+    if (!results.isEmpty()) {
+        fetchedEndTime = results.last().endTimeT();
+        fetchedId = results.last().id();
+    }
+
+    addGroups(results);
+    return true;
+}
+
+bool GroupManagerPrivate::isBeyondLoaded(const Group &group) const
+{
+    // Groups sorting after the last streamed chunk are left for fetchMore()
+    if (allLoaded || fetchedId < 0)
+        return false;
+
+    return group.endTimeT() < fetchedEndTime
+            || (group.endTimeT() == fetchedEndTime && group.id() < fetchedId);
+}
+
+void GroupManagerPrivate::subscribe()
+{
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+        this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_ADDED_SIGNAL,
+        this, SLOT(groupsAddedSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_SIGNAL,
+        this, SLOT(groupsUpdatedSlot(const QList<int> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+        this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+        this, SLOT(groupsDeletedSlot(const QList<int> &)));
+}
+
+void GroupManagerPrivate::unsubscribe()
+{
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, EVENTS_ADDED_SIGNAL,
+        this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_ADDED_SIGNAL,
+        this, SLOT(groupsAddedSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_SIGNAL,
+        this, SLOT(groupsUpdatedSlot(const QList<int> &)));
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_UPDATED_FULL_SIGNAL,
+        this, SLOT(groupsUpdatedFullSlot(const QList<CommHistory::Group> &)));
+    QDBusConnection::sessionBus().disconnect(
+        QString(), QString(), COMM_HISTORY_SERVICE_NAME, GROUPS_DELETED_SIGNAL,
+        this, SLOT(groupsDeletedSlot(const QList<int> &)));
+}
+
+void GroupManagerPrivate::suspend()
+{
+    if (isSuspended)
+        return;
+
+    DEBUG() << Q_FUNC_INFO;
+    isSuspended = true;
+    unsubscribe();
+}
+
+bool GroupManagerPrivate::resume()
+{
+    Q_Q(GroupManager);
+
+    if (!isSuspended)
+        return true;
+
+    DEBUG() << Q_FUNC_INFO;
+    isSuspended = false;
+    subscribe();
+
+    if (changeSequence < 0 || applyChanges())
+        return true;
+
+    DEBUG() << Q_FUNC_INFO << "reloading";
+    return q->getGroups(filterLocalUid, filterRemoteUid);
+}
+
+bool GroupManagerPrivate::applyChanges()
+{
+    if (changeSequence < 0)
+        return false;
+
+    QList<DatabaseIO::Change> changes;
+    qint64 lastSequence;
+    bool expired;
+    if (!database()->changesSince(changeSequence, changes, lastSequence, &expired)) {
+        // Reloaded by the caller
+        if (expired)
+            DEBUG() << Q_FUNC_INFO << "missed changes are no longer journaled";
+        return false;
+    }
+
+    // Any change to an event can change its group's summary
+    QSet<int> changed, deleted;
+    foreach (const DatabaseIO::Change &change, changes) {
+        if (change.target == DatabaseIO::Change::GroupTarget && change.operation == DatabaseIO::Change::Deleted)
+            deleted.insert(change.id);
+        else if (change.groupId > 0)
+            changed.insert(change.groupId);
+    }
+    changed.subtract(deleted);
+
+    DEBUG() << Q_FUNC_INFO << changes.size() << "changes," << changed.size() << "groups";
+
+    groupsDeletedSlot(deleted.toList());
+
+    QList<Group> changedGroups;
+    if (!database()->getGroupsByIds(changed.toList(), changedGroups))
+        return false;
+
+    QList<Group> added;
+    foreach (Group group, changedGroups) {
+        if (groups.contains(group.id()))
+            modifyInModel(group);
+        else if (!group.recipients().isEmpty() && groupMatchesFilter(group) && !isBeyondLoaded(group))
+            added.append(group);
+    }
+    addGroups(added);
+
+    changeSequence = lastSequence;
+    return true;
 }
 
 DatabaseIO* GroupManagerPrivate::database()
@@ -376,6 +591,87 @@ DatabaseIO* GroupManagerPrivate::database()
     return DatabaseIO::instance();
 }
 
+QTimer *GroupManagerPrivate::prefetchTimer()
+{
+    if (!prefetchTimerObject) {
+        prefetchTimerObject = new QTimer(this);
+        prefetchTimerObject->setSingleShot(true);
+        connect(prefetchTimerObject, SIGNAL(timeout()), SLOT(prefetchNext()));
+    }
+    return prefetchTimerObject;
+}
+
+void GroupManagerPrivate::openConversationCache()
+{
+    if (conversationCache)
+        return;
+
+    conversationCache = ConversationCache::instance();
+    connect(conversationCache.data(), SIGNAL(fetchFinished(int)), SLOT(prefetchFinished(int)));
+}
+
+void GroupManagerPrivate::schedulePrefetch()
+{
+    if (prefetchCount <= 0 || !isReady)
+        return;
+
+    // Restarted on every change, so that prefetching happens after bursts
+    prefetchRecentPending = true;
+    prefetchTimer()->start(prefetchSettleDelay);
+}
+
+void GroupManagerPrivate::prefetchNext()
+{
+    if (!conversationCache || prefetchChunkSize <= 0)
+        return;
+
+    // Continued from prefetchFinished()
+    if (prefetchingGroup >= 0)
+        return;
+
+    if (prefetchRecentPending) {
+        prefetchRecentPending = false;
+
+        QList<GroupObject*> recent = groups.values();
+        std::sort(recent.begin(), recent.end(), groupObjectSort);
+        for (int i = 0; i < recent.size() && i < prefetchCount; i++) {
+            if (!prefetchQueue.contains(recent[i]->id()))
+                prefetchQueue.append(recent[i]->id());
+        }
+    }
+
+    // Read at most one conversation per pass to stay out of the way of
+    // other queries and events
+    while (!prefetchQueue.isEmpty()) {
+        int groupId = prefetchQueue.takeFirst();
+        if (!groups.contains(groupId) || conversationCache->contains(groupId, prefetchChunkSize)
+            || conversationCache->isFetching(groupId))
+            continue;
+
+        DEBUG() << Q_FUNC_INFO << "prefetching group" << groupId;
+        if (bgThread) {
+            prefetchingGroup = groupId;
+            conversationCache->fetchInBackground(groupId, prefetchChunkSize, bgThread);
+            return;
+        }
+        conversationCache->fetch(groupId, prefetchChunkSize);
+        break;
+    }
+
+    if (!prefetchQueue.isEmpty())
+        prefetchTimer()->start(0);
+}
+
+void GroupManagerPrivate::prefetchFinished(int groupId)
+{
+    if (groupId != prefetchingGroup)
+        return;
+
+    prefetchingGroup = -1;
+    if ((!prefetchQueue.isEmpty() || prefetchRecentPending) && !prefetchTimer()->isActive())
+        prefetchTimer()->start(0);
+}
+
 void GroupManagerPrivate::slotContactInfoChanged(const RecipientList &recipients)
 {
     Q_Q(GroupManager);
@@ -555,22 +851,35 @@ bool GroupManager::getGroups(const QString &localUid,
         qDeleteAll(d->groups);
         d->groups.clear();
     }
+    d->prefetchQueue.clear();
 
-    QString queryOrder;
-    if (d->queryLimit > 0)
-        queryOrder += QString::fromLatin1("LIMIT %1 ").arg(d->queryLimit);
-    if (d->queryOffset > 0)
-        queryOrder += QString::fromLatin1("OFFSET %1 ").arg(d->queryOffset);
+    d->allLoaded = true;
+    d->fetchedEndTime = 0;
+    d->fetchedId = -1;
+    d->changeSequence = d->database()->changeSequence();
 
-    QList<Group> results;
-    if (!d->database()->getGroups(localUid, remoteUid, results, queryOrder))
-        return false;
+    if (d->isStreaming()) {
+        d->allLoaded = false;
+        if (!d->fetchChunk(d->firstChunkSize > 0 ? d->firstChunkSize : d->chunkSize))
+            return false;
+    } else {
+        QString queryOrder;
+        if (d->queryLimit > 0)
+            queryOrder += QString::fromLatin1("LIMIT %1 ").arg(d->queryLimit);
+        if (d->queryOffset > 0)
+            queryOrder += QString::fromLatin1("OFFSET %1 ").arg(d->queryOffset);
+
+        QList<Group> results;
+        if (!d->database()->getGroups(localUid, remoteUid, results, queryOrder))
+            return false;
 
-    d->addGroups(results);
+        d->addGroups(results);
+    }
 
     if (!d->isReady && d->pendingResolve.isEmpty()) {
         d->isReady = true;
         emit modelReady(true);
+        d->schedulePrefetch();
     }
 
     return true;
@@ -608,6 +917,7 @@ void GroupManagerPrivate::contactResolveFinished()
     if (!isReady) {
         isReady = true;
         emit q->modelReady(true);
+        schedulePrefetch();
     }
 }
 
@@ -692,6 +1002,66 @@ bool GroupManager::canFetchMore() const
 
 void GroupManager::fetchMore()
 {
+    if (!d->canFetchMore())
+        return;
+
+    d->fetchChunk(d->chunkSize);
+}
+
+int GroupManager::prefetchCount() const
+{
+    return d->prefetchCount;
+}
+
+void GroupManager::setPrefetchCount(int count)
+{
+    if (d->prefetchCount == count)
+        return;
+
+    d->prefetchCount = count;
+
+    if (count > 0) {
+        d->openConversationCache();
+        connect(this, SIGNAL(groupAdded(GroupObject*)), d, SLOT(schedulePrefetch()), Qt::UniqueConnection);
+        connect(this, SIGNAL(groupUpdated(GroupObject*)), d, SLOT(schedulePrefetch()), Qt::UniqueConnection);
+        d->schedulePrefetch();
+    } else {
+        disconnect(this, SIGNAL(groupAdded(GroupObject*)), d, SLOT(schedulePrefetch()));
+        disconnect(this, SIGNAL(groupUpdated(GroupObject*)), d, SLOT(schedulePrefetch()));
+        d->prefetchRecentPending = false;
+        if (d->prefetchQueue.isEmpty() && d->prefetchTimerObject)
+            d->prefetchTimerObject->stop();
+    }
+}
+
+int GroupManager::prefetchChunkSize() const
+{
+    return d->prefetchChunkSize;
+}
+
+void GroupManager::setPrefetchChunkSize(int size)
+{
+    d->prefetchChunkSize = size;
+}
+
+void GroupManager::prefetchConversation(int groupId)
+{
+    if (d->prefetchChunkSize <= 0)
+        return;
+
+    d->openConversationCache();
+
+    d->prefetchQueue.removeOne(groupId);
+    d->prefetchQueue.prepend(groupId);
+
+    QTimer *timer = d->prefetchTimer();
+    if (!timer->isActive())
+        timer->start(0);
+}
+
+bool GroupManager::isConversationPrefetched(int groupId) const
+{
+    return d->conversationCache && d->conversationCache->contains(groupId, d->prefetchChunkSize);
 }
 
 QList<GroupObject*> GroupManager::groups() const
@@ -699,6 +1069,21 @@ QList<GroupObject*> GroupManager::groups() const
     return d->groups.values();
 }
 
+void GroupManager::suspend()
+{
+    d->suspend();
+}
+
+bool GroupManager::resume()
+{
+    return d->resume();
+}
+
+bool GroupManager::isSuspended() const
+{
+    return d->isSuspended;
+}
+
 bool GroupManager::isReady() const
 {
     return d->isReady;
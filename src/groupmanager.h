@@ -44,6 +44,11 @@ class DatabaseIO;
  *
  * Use groupAdded, groupUpdated, and groupRemoved signals to monitor
  * changes, or the indiviual change signals for a GroupObject.
+ *
+ * In StreamedAsyncQuery mode, groups are loaded in chunks ordered by last
+ * activity: getGroups() loads the first chunk and fetchMore() the following
+ * ones. Only loaded groups have a GroupObject; a group that becomes active
+ * is loaded as soon as it sorts before the last loaded chunk.
  */
 class LIBCOMMHISTORY_EXPORT GroupManager : public QObject
 {
@@ -54,6 +59,8 @@ class LIBCOMMHISTORY_EXPORT GroupManager : public QObject
     Q_PROPERTY(int limit READ limit WRITE setLimit)
     Q_PROPERTY(int offset READ offset WRITE setOffset)
     Q_PROPERTY(bool isReady READ isReady NOTIFY modelReady)
+    Q_PROPERTY(int prefetchCount READ prefetchCount WRITE setPrefetchCount)
+    Q_PROPERTY(int prefetchChunkSize READ prefetchChunkSize WRITE setPrefetchChunkSize)
 
 public:
     enum ContactResolveType {
@@ -203,6 +210,24 @@ public:
      */
     bool isReady() const;
 
+    /*!
+     * Stop following changes to the database, for example while the groups
+     * are not shown. The loaded groups are kept, but the manager drops its
+     * subscriptions to change signals until resume() is called.
+     */
+    void suspend();
+
+    /*!
+     * Follow changes to the database again after suspend(). Groups changed
+     * while suspended are read again and updated, added or deleted, or all
+     * groups are reloaded if the changes are no longer journaled.
+     *
+     * \return true if successful
+     */
+    bool resume();
+
+    bool isSuspended() const;
+
     /*!
      * Provide background thread for running database queries and blocking operations.
      * It allows to avoid blocking when the model used in the main GUI thread.
@@ -241,6 +266,39 @@ public:
 
     void resolve(GroupObject &group);
 
+    /*!
+     * Number of most recent groups whose newest events are read in advance,
+     * once the group list has settled. Prefetched events are kept in a small
+     * shared cache and adopted by a ConversationModel opening one of those
+     * groups with a matching first chunk. Zero (the default) disables it.
+     * With a background thread set, the events are read on that thread.
+     */
+    int prefetchCount() const;
+    void setPrefetchCount(int count);
+
+    /*!
+     * Number of events prefetched per group. This should match the first
+     * chunk size of the conversation models, see EventModel::setFirstChunkSize().
+     */
+    int prefetchChunkSize() const;
+    void setPrefetchChunkSize(int size);
+
+    /*!
+     * Request prefetching of a group, for example when it becomes visible.
+     * Explicit requests are handled before the most recent groups.
+     *
+     * \param groupId group ID
+     */
+    Q_INVOKABLE void prefetchConversation(int groupId);
+
+    /*!
+     * Whether the newest events of a group are in the prefetch cache. Writes
+     * to the group drop them again.
+     *
+     * \param groupId group ID
+     */
+    bool isConversationPrefetched(int groupId) const;
+
 Q_SIGNALS:
     /*!
      * Emitted when an async query is finished and the model has been filled.
@@ -245,6 +245,19 @@ void GroupModel::setOffset(int offset)
     d->manager->setOffset(offset);
 }
 
+void GroupModel::setPrefetchCount(int count)
+{
+    d->ensureManager();
+    d->manager->setPrefetchCount(count);
+}
+
+void GroupModel::prefetch(int row)
+{
+    GroupObject *group = d->groups.value(row);
+    if (group && d->manager)
+        d->manager->prefetchConversation(group->id());
+}
+
 int GroupModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid())
@@ -270,7 +283,7 @@ QVariant GroupModel::data(const QModelIndex &index, int role) const
     case ContactIdsRole:
         return QVariant::fromValue<QList<int> >(group->recipients().contactIds());
     case TimeSectionRole:
-        return group->endTime().toLocalTime().date();
+        return group->endTimeT() ? localDate(group->endTimeT()) : QDate();
     case GroupIdRole:
         return QVariant::fromValue(group->id());
     case LocalUidRole:
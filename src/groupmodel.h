@@ -133,6 +133,22 @@ public:
      */
     virtual void setOffset(int offset);
 
+    /*!
+     * Set number of most recent conversations to prefetch.
+     * See GroupManager::setPrefetchCount().
+     *
+     * \param count Number of groups, 0 to disable.
+     */
+    void setPrefetchCount(int count);
+
+    /*!
+     * Request prefetching of the conversation at row, typically when its
+     * delegate becomes visible. See GroupManager::prefetchConversation().
+     *
+     * \param row Model row.
+     */
+    Q_INVOKABLE void prefetch(int row);
+
     /*!
      * Convenience method for getting the group data without QVariant casts.
      *
@@ -0,0 +1,207 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "historyquery_p.h"
+#include "databaseio_p.h"
+
+#include <QtDebug>
+#include <QSqlQuery>
+#include <QSqlError>
+
+namespace CommHistory {
+
+HistoryQuery::HistoryQuery(const Filter &filter)
+    : m_filter(filter)
+    , m_startSecs(filter.startTime.isValid() ? filter.startTime.toMSecsSinceEpoch() / 1000 : 0)
+    , m_endSecs((filter.endTime.isValid() ? filter.endTime : QDateTime::currentDateTimeUtc()).toMSecsSinceEpoch() / 1000)
+{
+}
+
+bool HistoryQuery::isValid() const
+{
+    if (m_filter.startTime.isValid() && m_filter.endTime.isValid() && m_filter.endTime <= m_filter.startTime) {
+        qWarning() << "Error: end time" << m_filter.endTime.toString()
+                   << "is not after start time" << m_filter.startTime.toString();
+        return false;
+    }
+    return true;
+}
+
+QByteArray HistoryQuery::statement(Interval interval, bool perEvent, QVariantList &values) const
+{
+    QByteArray q;
+    if (perEvent)
+        q = "SELECT startTime, endTime, remoteUid FROM Events";
+    else
+        q = "SELECT startTime, COUNT(*) FROM Events";
+
+    q += " WHERE startTime >= ? AND startTime <= ?";
+    values << m_startSecs << m_endSecs;
+
+    if (m_filter.eventType != Event::UnknownType) {
+        q += " AND type = ?";
+        values << int(m_filter.eventType);
+    }
+
+    switch (m_filter.callType) {
+    case CallEvent::UnknownCallType:
+        break;
+    case CallEvent::ReceivedCallType:
+        q += " AND direction = ? AND isMissedCall = 0";
+        values << int(Event::Inbound);
+        break;
+    case CallEvent::MissedCallType:
+        q += " AND direction = ? AND isMissedCall = 1";
+        values << int(Event::Inbound);
+        break;
+    case CallEvent::DialedCallType:
+        q += " AND direction = ?";
+        values << int(Event::Outbound);
+        break;
+    }
+
+    if (!perEvent) {
+        switch (interval) {
+        case NoInterval:
+            break;
+        case Yearly:
+            q += " GROUP BY strftime('%Y', datetime(startTime, 'unixepoch'))";
+            break;
+        case Monthly:
+            q += " GROUP BY strftime('%Y-%m', datetime(startTime, 'unixepoch'))";
+            break;
+        case Weekly:
+            q += " GROUP BY strftime('%Y-%W', datetime(startTime, 'unixepoch'))";
+            break;
+        case Daily:
+            q += " GROUP BY strftime('%Y-%m-%d', datetime(startTime, 'unixepoch'))";
+            break;
+        }
+    }
+
+    return q;
+}
+
+QSqlQuery HistoryQuery::prepare(Interval interval, bool perEvent) const
+{
+    QVariantList values;
+    QSqlQuery query = DatabaseIOPrivate::prepareQuery(QString::fromLatin1(statement(interval, perEvent, values)));
+    foreach (const QVariant &value, values)
+        query.addBindValue(value);
+    return query;
+}
+
+bool HistoryQuery::read(Interval interval, bool perEvent, QVector<Row> &rows) const
+{
+    rows.clear();
+
+    QSqlQuery query = prepare(interval, perEvent);
+
+    DatabaseIOPrivate *d = DatabaseIOPrivate::instance();
+    const QString key = d->queryCacheKey(query);
+    QVariant cached;
+    if (d->findCachedResult(key, cached)) {
+        rows = cached.value<QVector<Row> >();
+        return true;
+    }
+
+    if (!query.exec()) {
+        qWarning() << "Failed to execute query:" << query.lastQuery();
+        qWarning() << "Error was:" << query.lastError();
+        return false;
+    }
+
+    while (query.next()) {
+        Row row;
+        row.startTime = query.value(0).toLongLong();
+        if (perEvent) {
+            row.endTime = query.value(1).toLongLong();
+            row.remoteUid = query.value(2).toString();
+            row.count = 1;
+        } else {
+            row.count = query.value(1).toInt();
+        }
+        rows.append(row);
+    }
+    query.finish();
+
+    d->cacheResult(key, QVariant::fromValue(rows), rows.size());
+    return true;
+}
+
+bool HistoryQuery::events(QVector<Row> &rows) const
+{
+    return read(NoInterval, true, rows);
+}
+
+bool HistoryQuery::counts(Interval interval, QVector<Row> &rows) const
+{
+    return read(interval, false, rows);
+}
+
+QVector<qint64> HistoryQuery::bucketStarts(Interval interval) const
+{
+    static const qint64 secsPerDay = 24 * 60 * 60;
+
+    QVector<qint64> starts;
+    starts.append(m_startSecs);
+    if (interval == NoInterval)
+        return starts;
+
+    // Days since the epoch, rounded down also before it
+    qint64 day = m_startSecs / secsPerDay;
+    if (m_startSecs % secsPerDay < 0)
+        day--;
+    QDate date = QDate(1970, 1, 1).addDays(day);
+
+    forever {
+        QDate next;
+        switch (interval) {
+        case NoInterval:
+            return starts;
+        case Yearly:
+            next = QDate(date.year() + 1, 1, 1);
+            break;
+        case Monthly:
+            next = QDate(date.year(), date.month(), 1).addMonths(1);
+            break;
+        case Weekly:
+            next = date.addDays(Qt::Sunday - date.dayOfWeek() + 1);
+            if (next.year() != date.year())
+                next = QDate(next.year(), 1, 1);
+            break;
+        case Daily:
+            next = date.addDays(1);
+            break;
+        }
+
+        const qint64 start = QDate(1970, 1, 1).daysTo(next) * secsPerDay;
+        if (start > m_endSecs)
+            break;
+        starts.append(start);
+        date = next;
+    }
+
+    return starts;
+}
+
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_HISTORYQUERY_P_H
+#define COMMHISTORY_HISTORYQUERY_P_H
+
+#include <QDateTime>
+#include <QVariantList>
+#include <QVector>
+#include <QMetaType>
+
+#include "event.h"
+#include "callevent.h"
+
+class QSqlQuery;
+
+namespace CommHistory {
+
+/*!
+ * \class HistoryQuery
+ *
+ * Query engine shared by CallStatistics, CallHistory and SMSHistory.
+ * Filters are bound as parameters and read results go through the
+ * DatabaseIO query cache. The statements match what each class ran
+ * before, so results are unchanged.
+ */
+class HistoryQuery
+{
+public:
+    // In the same order as CallStatistics::TimeInterval
+    enum Interval {
+        NoInterval,
+        Yearly,
+        Monthly,
+        Weekly,
+        Daily
+    };
+
+    struct Filter {
+        Filter() : eventType(Event::UnknownType), callType(CallEvent::UnknownCallType) {}
+
+        // Events starting within [startTime, endTime] match, an invalid
+        // start is the epoch and an invalid end is the current time
+        QDateTime startTime;
+        QDateTime endTime;
+        Event::EventType eventType;
+        CallEvent::CallType callType;
+    };
+
+    // An event, or a group of events with the start time of one of them
+    struct Row {
+        Row() : startTime(0), endTime(0), count(0) {}
+
+        qint64 startTime;
+        qint64 endTime;
+        QString remoteUid;
+        int count;
+    };
+
+    explicit HistoryQuery(const Filter &filter);
+
+    // Warns and returns false for an empty time range
+    bool isValid() const;
+
+    // Matching events, read through the query cache
+    bool events(QVector<Row> &rows) const;
+    // Number of matching events per UTC year/month/week/day, weeks as
+    // split by SQLite's %W, or one row for all of them
+    bool counts(Interval interval, QVector<Row> &rows) const;
+
+    // Start of each period counted by counts() up to the end time, in
+    // seconds since the epoch. The first period starts at the start time,
+    // the following ones at the start of their UTC year/month/week/day.
+    // Weeks also start on January 1st, as with %W.
+    QVector<qint64> bucketStarts(Interval interval) const;
+
+private:
+    QByteArray statement(Interval interval, bool perEvent, QVariantList &values) const;
+    QSqlQuery prepare(Interval interval, bool perEvent) const;
+    bool read(Interval interval, bool perEvent, QVector<Row> &rows) const;
+
+    Filter m_filter;
+    qint64 m_startSecs;
+    qint64 m_endSecs;
+};
+
+}
+
+Q_DECLARE_METATYPE(QVector<CommHistory::HistoryQuery::Row>)
+
+#endif
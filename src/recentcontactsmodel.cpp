@@ -99,7 +99,7 @@ bool RecentContactsModelPrivate::fillModel(int start, int end, QList<Event> even
 
     // This model doesn't fetchMore, so fill is only called once. We can use the prepend logic to get
     // the right contact behaviors.
-    prependEvents(events, resolved);
+    prependEvents(std::move(events), resolved);
     return true;
 }
 
@@ -300,7 +300,7 @@ void RecentContactsModelPrivate::prependEvents(QList<Event> events, bool resolve
         q->beginInsertRows(QModelIndex(), start, resolvedEvents.count() - 1);
         QList<Event>::const_iterator it = resolvedEvents.constBegin(), end = resolvedEvents.constEnd();
         for ( ; it != end; ++it) {
-            eventRootItem->insertChildAt(start++, new EventTreeItem(*it, eventRootItem));
+            eventRootItem->insertChildAt(start++, newItem(*it, eventRootItem));
         }
         q->endInsertRows();
 
@@ -22,6 +22,7 @@
 
 #include "recipient.h"
 #include "commonutils.h"
+#include "contactbackend.h"
 #include <QSet>
 #include <QHash>
 #include <QDebug>
@@ -414,12 +415,12 @@ RecipientList RecipientList::fromUids(const QString &localUid, const QStringList
 
 RecipientList RecipientList::fromContact(int contactId)
 {
-    return fromCacheItem(SeasideCache::itemById(contactId, false));
+    return fromCacheItem(ContactBackend::instance()->itemById(contactId));
 }
 
 RecipientList RecipientList::fromContact(const QContactId &contactId)
 {
-    return fromCacheItem(SeasideCache::itemById(contactId, false));
+    return fromContact(static_cast<int>(SeasideCache::internalId(contactId)));
 }
 
 RecipientList RecipientList::fromCacheItem(const SeasideCache::CacheItem *item)
@@ -26,11 +26,27 @@
 #include "databaseio_p.h"
 #include "eventmodel_p.h"
 #include "recipienteventmodel_p.h"
+#include "debug.h"
 
+#include <QSet>
 #include <QSqlQuery>
 
+#include <algorithm>
+
 namespace CommHistory {
 
+namespace {
+
+// Model order: most recent first, newest id first for equal times
+bool eventSortsBefore(const Event &a, const Event &b)
+{
+    if (a.endTimeT() != b.endTimeT())
+        return a.endTimeT() > b.endTimeT();
+    return a.id() > b.id();
+}
+
+}
+
 RecipientEventModelPrivate::RecipientEventModelPrivate(RecipientEventModel *model)
     : EventModelPrivate(model)
 {
@@ -51,30 +67,93 @@ bool RecipientEventModelPrivate::acceptsEvent(const Event &event) const
 bool RecipientEventModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> events, bool resolved)
 {
     if (m_contactId > 0 || m_recipients.count()) {
-        // Filter out any events that do not match our recipients
+        // Filter out any events that do not match our recipients, and those
+        // returned by more than one of the queries resolved together
+        QSet<int> ids;
         QList<CommHistory::Event>::iterator it = events.begin();
         while (it != events.end()) {
             const Event &event(*it);
-            if (acceptsEvent(event)) {
+            if (acceptsEvent(event) && !ids.contains(event.id())) {
+                ids.insert(event.id());
                 ++it;
             } else {
                 it = events.erase(it);
             }
         }
-        return EventModelPrivate::fillModel(start, start + events.size(), events, resolved);
+
+        // Results of the query for the contact's other addresses are
+        // merged into the rows already loaded
+        if (eventRootItem->childCount() > 0) {
+            mergeEvents(std::move(events));
+            modelUpdatedSlot(true);
+            return true;
+        }
+
+        // Resolved results of both queries can arrive together
+        if (!std::is_sorted(events.constBegin(), events.constEnd(), eventSortsBefore))
+            std::sort(events.begin(), events.end(), eventSortsBefore);
+
+        const int filteredEnd = start + events.size();
+        return EventModelPrivate::fillModel(start, filteredEnd, std::move(events), resolved);
+    }
+
+    return EventModelPrivate::fillModel(start, end, std::move(events), resolved);
+}
+
+void RecipientEventModelPrivate::mergeEvents(QList<CommHistory::Event> events)
+{
+    Q_Q(RecipientEventModel);
+
+    std::sort(events.begin(), events.end(), eventSortsBefore);
+
+    // Walk both lists once, inserting each run of new events in front of
+    // the first loaded row that sorts after them
+    int row = 0;
+    int i = 0;
+    while (i < events.size()) {
+        if (findEvent(events.at(i).id()).isValid()) {
+            i++;
+            continue;
+        }
+
+        while (row < eventRootItem->childCount() && eventSortsBefore(eventRootItem->eventAt(row), events.at(i)))
+            row++;
+
+        QList<Event> run;
+        run.append(events.at(i++));
+        while (i < events.size()
+               && (row == eventRootItem->childCount() || eventSortsBefore(events.at(i), eventRootItem->eventAt(row)))) {
+            if (!findEvent(events.at(i).id()).isValid())
+                run.append(events.at(i));
+            i++;
+        }
+
+        q->beginInsertRows(QModelIndex(), row, row + run.size() - 1);
+        for (int j = 0; j < run.size(); j++)
+            eventRootItem->insertChildAt(row + j, newItem(std::move(run[j]), eventRootItem));
+        q->endInsertRows();
+        row += run.size();
     }
+}
 
-    return EventModelPrivate::fillModel(start, end, events, resolved);
+void RecipientEventModelPrivate::modelUpdatedSlot(bool successful)
+{
+    // Ready once the contact's addresses have been queried too, and all
+    // results have been resolved and inserted
+    if (successful && (m_contactPending || !pendingReceived.isEmpty()))
+        return;
+
+    EventModelPrivate::modelUpdatedSlot(successful);
 }
 
-void RecipientEventModelPrivate::fetchEvents()
+void RecipientEventModelPrivate::fetchEvents(const RecipientList &recipients)
 {
-    if (!m_recipients.isEmpty()) {
+    if (!recipients.isEmpty()) {
         // Get the events that match these addresses
         QStringList clauses;
         QVariantList values;
-        for (RecipientList::const_iterator it = m_recipients.constBegin();
-            it != m_recipients.constEnd(); ++it) {
+        for (RecipientList::const_iterator it = recipients.constBegin();
+            it != recipients.constEnd(); ++it) {
             if (CommHistory::localUidComparesPhoneNumbers(it->localUid())) {
                 clauses.append(QString("(remoteUid LIKE ? AND localUid LIKE '%1%%')").arg(RING_ACCOUNT));
                 values.append(QString("%%%1%%").arg(minimizePhoneNumber(it->remoteUid())));
@@ -83,6 +162,7 @@ void RecipientEventModelPrivate::fetchEvents()
                 values.append(it->remoteUid());
                 values.append(it->localUid());
             }
+            m_queried.append(*it);
         }
 
         QString where("WHERE ( ");
@@ -102,6 +182,8 @@ void RecipientEventModelPrivate::fetchEvents()
 
 void RecipientEventModelPrivate::fetcherFinished()
 {
+    m_contactPending = false;
+
     // Our contact is now loaded in the cache
     if (m_contactId > 0) {
         m_recipients = RecipientList::fromContact(m_contactId);
@@ -127,7 +209,20 @@ void RecipientEventModelPrivate::fetcherFinished()
         }
     }
 
-    fetchEvents();
+    if (m_queried.isEmpty()) {
+        fetchEvents(m_recipients);
+        return;
+    }
+
+    // Only the addresses that were not known before need to be queried
+    RecipientList added;
+    for (const Recipient &recipient : m_recipients) {
+        if (!m_queried.containsMatch(recipient))
+            added.append(recipient);
+    }
+
+    DEBUG() << Q_FUNC_INFO << "querying" << added.count() << "more addresses";
+    fetchEvents(added);
 }
 
 
@@ -177,19 +272,28 @@ bool RecipientEventModel::getEvents()
     d->isReady = false;
     endResetModel();
 
+    d->m_queried = RecipientList();
+
+    // Addresses known before the contact is loaded are queried right away,
+    // unless the query is limited; limited results could not be merged
+    RecipientList known;
     if (d->m_contactId > 0) {
+        known = RecipientList::fromContact(d->m_contactId);
         d->m_fetcher.add(d->m_contactId);
-        return true;
-
     } else if (!d->m_recipients.isEmpty()) {
+        known = d->m_recipients;
         for (const Recipient &recipient : d->m_recipients) {
             d->m_fetcher.add(recipient);
         }
-
-        return true;
+    } else {
+        return false;
     }
 
-    return false;
+    d->m_contactPending = true;
+    if (!known.isEmpty() && d->queryLimit <= 0 && d->queryOffset <= 0)
+        d->fetchEvents(known);
+
+    return true;
 }
 
 } // namespace CommHistory
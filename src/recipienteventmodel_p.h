@@ -41,14 +41,20 @@ public:
 
     bool acceptsEvent(const Event &event) const override;
     bool fillModel(int start, int end, QList<CommHistory::Event> events, bool resolved) override;
-    void fetchEvents();
+    void mergeEvents(QList<CommHistory::Event> events);
+    void fetchEvents(const RecipientList &recipients);
 
     ContactFetcher m_fetcher;
     RecipientList m_recipients;
     int m_contactId = 0;
 
+    // Addresses whose events have been queried since getEvents()
+    RecipientList m_queried;
+    bool m_contactPending = false;
+
 public slots:
     void fetcherFinished();
+    void modelUpdatedSlot(bool successful) override;
 };
 
 }
@@ -24,11 +24,14 @@
 #include <QDebug>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QTimer>
+#include <QWeakPointer>
 
 #include "databaseio_p.h"
 #include "commhistorydatabase.h"
 #include "eventmodel_p.h"
 #include "group.h"
+#include "debug.h"
 
 #include "singleeventmodel.h"
 
@@ -36,6 +39,41 @@ namespace CommHistory {
 
 using namespace CommHistory;
 
+class SingleEventModelPrivate;
+
+/*
+ * Collects the fetchEventById() requests of all models made during one pass
+ * of the event loop and serves them with a single query. Models requesting
+ * the same id share the result.
+ */
+class SingleEventBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QSharedPointer<SingleEventBatch> instance();
+
+    void request(int eventId, SingleEventModelPrivate *model);
+    void cancel(SingleEventModelPrivate *model);
+
+private slots:
+    void flush();
+
+private:
+    SingleEventBatch();
+
+    typedef QHash<int, QList<SingleEventModelPrivate *> > Requests;
+
+    static QWeakPointer<SingleEventBatch> m_Instance;
+    Requests pending;
+    // Requests of the flushes in progress, which may be nested if a model
+    // runs the event loop when it receives its event
+    QList<Requests *> delivering;
+    bool flushQueued;
+};
+
+QWeakPointer<SingleEventBatch> SingleEventBatch::m_Instance;
+
 class SingleEventModelPrivate : public EventModelPrivate {
 public:
     Q_DECLARE_PUBLIC(SingleEventModel)
@@ -47,6 +85,22 @@ public:
         clearTokens();
     }
 
+    ~SingleEventModelPrivate() {
+        cancelBatch();
+    }
+
+    void cancelBatch() {
+        if (batch) {
+            batch->cancel(this);
+            batch.clear();
+        }
+    }
+
+    void batchReceived(const QList<Event> &events) {
+        batch.clear();
+        eventsReceivedSlot(0, events.size(), events);
+    }
+
     bool acceptsEvent(const Event &event) const {
 
         // If the urls match, we'll accept
@@ -74,8 +128,97 @@ public:
     QString m_token;
     QString m_mmsId;
     int m_groupId;
+    QSharedPointer<SingleEventBatch> batch;
 };
 
+SingleEventBatch::SingleEventBatch()
+    : flushQueued(false)
+{
+}
+
+QSharedPointer<SingleEventBatch> SingleEventBatch::instance()
+{
+    QSharedPointer<SingleEventBatch> batch = m_Instance;
+    if (!batch) {
+        batch = QSharedPointer<SingleEventBatch>(new SingleEventBatch);
+        m_Instance = batch;
+    }
+    return batch;
+}
+
+void SingleEventBatch::request(int eventId, SingleEventModelPrivate *model)
+{
+    pending[eventId].append(model);
+
+    if (!flushQueued) {
+        flushQueued = true;
+        QTimer::singleShot(0, this, SLOT(flush()));
+    }
+}
+
+static void removeRequests(QHash<int, QList<SingleEventModelPrivate *> > &requests,
+                           SingleEventModelPrivate *model)
+{
+    QMutableHashIterator<int, QList<SingleEventModelPrivate *> > it(requests);
+    while (it.hasNext()) {
+        it.next();
+        it.value().removeAll(model);
+        if (it.value().isEmpty())
+            it.remove();
+    }
+}
+
+void SingleEventBatch::cancel(SingleEventModelPrivate *model)
+{
+    removeRequests(pending, model);
+
+    // Models can also be deleted by the receivers of another model
+    foreach (Requests *requests, delivering)
+        removeRequests(*requests, model);
+}
+
+void SingleEventBatch::flush()
+{
+    flushQueued = false;
+
+    // Models may request again while receiving; those go to the next batch
+    Requests requests;
+    requests.swap(pending);
+    if (requests.isEmpty())
+        return;
+
+    QList<Event> events;
+    if (!DatabaseIO::instance()->getEventsByIds(requests.keys(), events))
+        events.clear();
+
+    DEBUG() << Q_FUNC_INFO << "fetched" << events.size() << "of" << requests.size() << "events";
+
+    QHash<int, Event> eventsById;
+    foreach (const Event &event, events)
+        eventsById.insert(event.id(), event);
+
+    // Keep the batch alive while the last models let go of it
+    QSharedPointer<SingleEventBatch> self = m_Instance;
+
+    // Deliver one model at a time, cancelled models are removed from the
+    // requests. Missing events still complete the request, with an empty
+    // model.
+    delivering.append(&requests);
+    while (!requests.isEmpty()) {
+        Requests::iterator it = requests.begin();
+        const int eventId = it.key();
+        SingleEventModelPrivate *model = it.value().takeFirst();
+        if (it.value().isEmpty())
+            requests.erase(it);
+
+        QList<Event> result;
+        if (eventsById.contains(eventId))
+            result << eventsById.value(eventId);
+        model->batchReceived(result);
+    }
+    delivering.removeOne(&requests);
+}
+
 SingleEventModel::SingleEventModel(QObject *parent)
     : EventModel(*new SingleEventModelPrivate(this), parent)
 {
@@ -89,6 +232,8 @@ bool SingleEventModel::getEventById(int eventId)
 {
     Q_D(SingleEventModel);
 
+    d->cancelBatch();
+
     beginResetModel();
     d->clearEvents();
     d->clearTokens();
@@ -96,18 +241,38 @@ bool SingleEventModel::getEventById(int eventId)
 
     d->m_eventId = eventId;
 
-    const QString where = QString::fromLatin1(" WHERE id = %1").arg(eventId);
-    QSqlQuery query = d->prepareQuery(DatabaseIOPrivate::eventQueryBase() + where);
+    QSqlQuery query = d->prepareQuery(DatabaseIOPrivate::eventQueryBase() + "WHERE Events.id = :eventId ");
+    query.bindValue(":eventId", eventId);
 
     return d->executeQuery(query);
 }
 
+void SingleEventModel::fetchEventById(int eventId)
+{
+    Q_D(SingleEventModel);
+
+    d->cancelBatch();
+
+    beginResetModel();
+    d->clearEvents();
+    d->clearTokens();
+    endResetModel();
+
+    d->m_eventId = eventId;
+    d->isReady = false;
+
+    d->batch = SingleEventBatch::instance();
+    d->batch->request(eventId, d);
+}
+
 bool SingleEventModel::getEventByTokens(const QString &token,
                                         const QString &mmsId,
                                         int groupId)
 {
     Q_D(SingleEventModel);
 
+    d->cancelBatch();
+
     beginResetModel();
     d->clearEvents();
     d->m_eventId = -1;
@@ -120,8 +285,8 @@ bool SingleEventModel::getEventByTokens(const QString &token,
     QString q = DatabaseIOPrivate::eventQueryBase();
     q += "WHERE ";
 
-    if (groupId > -1) { 
-        q += QString::fromLatin1("groupId = %1 ").arg(groupId);
+    if (groupId > -1) {
+        q += "groupId = :groupId ";
 
         if (!token.isEmpty() || !mmsId.isEmpty())
             q += "AND ";
@@ -134,17 +299,21 @@ bool SingleEventModel::getEventByTokens(const QString &token,
     }
 
     if (!mmsId.isEmpty())
-        q += QString::fromLatin1("( mmsId = :mmsId AND direction = %1 ) ").arg(Event::Outbound);
+        q += "( mmsId = :mmsId AND direction = :direction ) ";
 
     if (!token.isEmpty())
         q += " ) ";
 
     QSqlQuery query = d->prepareQuery(q);
 
+    if (groupId > -1)
+        query.bindValue(":groupId", groupId);
     if (!token.isEmpty())
         query.bindValue(":messageToken", token);
-    if (!mmsId.isEmpty())
+    if (!mmsId.isEmpty()) {
         query.bindValue(":mmsId", mmsId);
+        query.bindValue(":direction", Event::Outbound);
+    }
 
     return d->executeQuery(query);
 }
@@ -156,3 +325,5 @@ Event SingleEventModel::event() const
 
 
 } // namespace CommHistory
+
+#include "singleeventmodel.moc"
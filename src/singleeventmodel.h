@@ -62,6 +62,15 @@ public:
      */
     bool getEventById(int eventId);
 
+    /*!
+     * Populate model with existing event, asynchronously. Requests made by
+     * all models during one pass of the event loop are fetched with a single
+     * query, and modelReady() is emitted once the event has been fetched.
+     *
+     * \param id, event id to be fetched from database
+     */
+    void fetchEventById(int eventId);
+
     /*!
      * Populate model with existing event identified by message token or mms id.
      *
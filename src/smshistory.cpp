@@ -20,54 +20,7 @@
 ******************************************************************************/
 
 #include "smshistory_p.h"
-#include "databaseio_p.h"
-#include "event.h"
-
-#include <QtDebug>
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QSqlDatabase>
-
-namespace {
-
-const QDateTime epoch(QDate(1970, 1, 1), QTime(0, 0), Qt::UTC);
-
-QString buildEventsQuery(const QDateTime &startTime,
-                         const QDateTime &endTime)
-{
-    qint64 startTimeSecs = (startTime.isValid() ? startTime : epoch).toMSecsSinceEpoch() / 1000;
-    qint64 endTimeSecs = (endTime.isValid() ? endTime : QDateTime::currentDateTimeUtc()).toMSecsSinceEpoch() / 1000;
-
-    QStringList conditions;
-
-    conditions.append(QString::fromLatin1("startTime >= %1").arg(startTimeSecs));
-    conditions.append(QString::fromLatin1("startTime <= %1").arg(endTimeSecs));
-    conditions.append(QString::fromLatin1("type=%1").arg(CommHistory::Event::EventType::SMSEvent));
-
-    QString group;
-    static const QString groupTemplate = QStringLiteral(" GROUP BY strftime('%1', datetime(startTime, 'unixepoch'))");
-
-    QString q = "SELECT startTime, remoteUid from Events";
-    if (!conditions.isEmpty()) {
-        q += " WHERE " + conditions.join(" AND ");
-    }
-
-    return q + group;
-}
-
-QList<CommHistory::SMSHistory::Result> readQueryResult(QSqlQuery *query)
-{
-    QList<CommHistory::SMSHistory::Result> results;
-    while (query->next()) {
-        CommHistory::SMSHistory::Result result;
-        result.when = QDateTime::fromMSecsSinceEpoch(query->value(0).toLongLong() * 1000).toUTC();
-        result.phoneNumber = query->value(1).toString();
-        results.append(result);
-    }
-    return results;
-}
-
-}
+#include "historyquery_p.h"
 
 namespace CommHistory {
 
@@ -118,22 +71,23 @@ bool SMSHistory::reload()
 {
     d->results.clear();
 
-    if (d->startTime.isValid() && d->endTime.isValid() && d->endTime <= d->startTime) {
-        qWarning() << "Error: end time" << d->endTime.toString()
-                   << "is not after start time" << d->startTime.toString();
-        return false;
-    }
-
-    QString queryString = buildEventsQuery(d->startTime, d->endTime);
+    HistoryQuery::Filter filter;
+    filter.startTime = d->startTime;
+    filter.endTime = d->endTime;
+    filter.eventType = Event::SMSEvent;
 
-    QSqlQuery query = DatabaseIOPrivate::prepareQuery(queryString);
-    if (!query.exec()) {
-        qWarning() << "Failed to execute query:" << query.lastQuery();
-        qWarning() << "Error was:" << query.lastError();
+    HistoryQuery history(filter);
+    QVector<HistoryQuery::Row> rows;
+    if (!history.isValid() || !history.events(rows))
         return false;
-    }
 
-    d->results = readQueryResult(&query);
+    d->results.reserve(rows.size());
+    foreach (const HistoryQuery::Row &row, rows) {
+        Result result;
+        result.when = QDateTime::fromMSecsSinceEpoch(row.startTime * 1000, Qt::UTC);
+        result.phoneNumber = row.remoteUid;
+        d->results.append(result);
+    }
     return true;
 }
 
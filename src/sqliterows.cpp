@@ -0,0 +1,183 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "sqliterows_p.h"
+
+#include <QtDebug>
+#include <QSqlQuery>
+#include <QSqlResult>
+#include <QVariant>
+
+#ifdef COMMHISTORY_NATIVE_SQLITE
+#include <QAtomicInt>
+#include <QSqlDriver>
+#include <sqlite3.h>
+#include <string.h>
+#endif
+
+namespace CommHistory {
+
+#ifdef COMMHISTORY_NATIVE_SQLITE
+namespace {
+
+// The statements of the driver can only be stepped with the sqlite library
+// it uses, which is then also the one linked here
+bool driverUsesLinkedSqlite(const QSqlDriver *driver)
+{
+    static QAtomicInt usesLinked(-1);
+
+    int uses = usesLinked.load();
+    if (uses < 0) {
+        QSqlQuery query(driver->createResult());
+        if (query.exec(QStringLiteral("SELECT sqlite_source_id()")) && query.next()) {
+            const QString driverSource = query.value(0).toString();
+            uses = driverSource == QLatin1String(sqlite3_sourceid()) ? 1 : 0;
+            if (!uses) {
+                qWarning() << "QSQLITE uses sqlite" << driverSource << "instead of"
+                           << sqlite3_sourceid() << "- not reading rows natively";
+            }
+        } else {
+            uses = 0;
+        }
+        usesLinked.store(uses);
+    }
+    return uses > 0;
+}
+
+}
+#endif
+
+SqliteRows::SqliteRows(QSqlQuery &query)
+    : m_stmt(0)
+    , m_pending(false)
+    , m_done(false)
+    , m_error(false)
+{
+#ifdef COMMHISTORY_NATIVE_SQLITE
+    if (!query.isActive() || !query.isSelect() || !query.isForwardOnly()
+            || qEnvironmentVariableIsSet("COMMHISTORY_NO_NATIVE_DECODE"))
+        return;
+
+    const QVariant handle = query.result()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3_stmt*") != 0
+            || !driverUsesLinkedSqlite(query.driver()))
+        return;
+    sqlite3_stmt *stmt = *static_cast<sqlite3_stmt * const *>(handle.constData());
+    if (!stmt)
+        return;
+
+    // QSQLITE steps once in exec() to find the columns, and keeps that row
+    // current in the statement. An empty result has been reset already.
+    if (sqlite3_data_count(stmt) > 0)
+        m_pending = true;
+    else if (query.at() == QSql::AfterLastRow)
+        m_done = true;
+    else
+        return;
+
+    m_stmt = stmt;
+    const int columns = sqlite3_column_count(stmt);
+    m_lastStrings.resize(columns);
+#else
+    Q_UNUSED(query);
+#endif
+}
+
+bool SqliteRows::next()
+{
+#ifdef COMMHISTORY_NATIVE_SQLITE
+    if (m_pending) {
+        m_pending = false;
+        return true;
+    }
+    if (m_done || !m_stmt)
+        return false;
+
+    int re = sqlite3_step(m_stmt);
+    if (re == SQLITE_ROW)
+        return true;
+
+    if (re != SQLITE_DONE) {
+        qWarning() << "Failed to read query results:" << sqlite3_errmsg(sqlite3_db_handle(m_stmt));
+        m_error = true;
+    }
+    m_done = true;
+#endif
+    return false;
+}
+
+#ifdef COMMHISTORY_NATIVE_SQLITE
+
+bool SqliteRows::isNull(int column) const
+{
+    return sqlite3_column_type(m_stmt, column) == SQLITE_NULL;
+}
+
+int SqliteRows::intValue(int column) const
+{
+    return sqlite3_column_int(m_stmt, column);
+}
+
+quint32 SqliteRows::uintValue(int column) const
+{
+    return quint32(sqlite3_column_int64(m_stmt, column));
+}
+
+bool SqliteRows::boolValue(int column) const
+{
+    return sqlite3_column_int64(m_stmt, column) != 0;
+}
+
+QString SqliteRows::stringValue(int column) const
+{
+    // The database is UTF-16, read the text as stored
+    const void *text = sqlite3_column_text16(m_stmt, column);
+    if (!text)
+        return QString();
+    return QString(reinterpret_cast<const QChar *>(text), sqlite3_column_bytes16(m_stmt, column) / 2);
+}
+
+QString SqliteRows::sharedStringValue(int column)
+{
+    const void *text = sqlite3_column_text16(m_stmt, column);
+    if (!text)
+        return QString();
+
+    const int size = sqlite3_column_bytes16(m_stmt, column);
+    QString &last = m_lastStrings[column];
+    if (last.isNull() || last.size() * 2 != size || memcmp(last.constData(), text, size) != 0)
+        last = QString(reinterpret_cast<const QChar *>(text), size / 2);
+    return last;
+}
+
+#else
+
+bool SqliteRows::isNull(int) const { return true; }
+int SqliteRows::intValue(int) const { return 0; }
+quint32 SqliteRows::uintValue(int) const { return 0; }
+bool SqliteRows::boolValue(int) const { return false; }
+QString SqliteRows::stringValue(int) const { return QString(); }
+QString SqliteRows::sharedStringValue(int) { return QString(); }
+
+#endif
+
+}
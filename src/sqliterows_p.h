@@ -0,0 +1,76 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_SQLITEROWS_P_H
+#define COMMHISTORY_SQLITEROWS_P_H
+
+#include <QString>
+#include <QVector>
+
+class QSqlQuery;
+struct sqlite3_stmt;
+
+namespace CommHistory {
+
+/*!
+ * \class SqliteRows
+ *
+ * Reads the rows of an executed QSQLITE query straight from its sqlite3
+ * statement, without converting every column through QVariant.
+ *
+ * Construct it right after QSqlQuery::exec(), before next() has been
+ * called. When isValid() is false the native path is not available (not
+ * built in with CONFIG+=native_sqlite, another driver or sqlite library
+ * than the one linked, or COMMHISTORY_NO_NATIVE_DECODE is set in the
+ * environment) and the query must be read as usual. Call
+ * QSqlQuery::finish() when done.
+ */
+class SqliteRows
+{
+public:
+    explicit SqliteRows(QSqlQuery &query);
+
+    bool isValid() const { return m_stmt != 0; }
+    bool hasError() const { return m_error; }
+
+    bool next();
+
+    bool isNull(int column) const;
+    int intValue(int column) const;
+    quint32 uintValue(int column) const;
+    bool boolValue(int column) const;
+    QString stringValue(int column) const;
+    // For columns that repeat between rows: an unchanged value returns the
+    // same shared QString
+    QString sharedStringValue(int column);
+
+private:
+    sqlite3_stmt *m_stmt;
+    bool m_pending;
+    bool m_done;
+    bool m_error;
+    QVector<QString> m_lastStrings;
+};
+
+}
+
+#endif
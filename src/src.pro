@@ -46,6 +46,16 @@ PKGCONFIG += qtcontacts-sqlite-qt5-extensions contactcache-qt5
 LIBS += -lphonenumber
 
 DEFINES += LIBCOMMHISTORY_SHARED
+
+# Read event and group rows with the sqlite3 API instead of through QVariant,
+# enabled with CONFIG+=native_sqlite. Only use it when the QSQLITE driver is
+# built against the system sqlite library; rows are still read through
+# QSqlQuery if the driver reports another sqlite at runtime.
+native_sqlite {
+    PKGCONFIG += sqlite3
+    DEFINES += COMMHISTORY_NATIVE_SQLITE
+}
+
 CONFIG += hide_symbols
 
 # -----------------------------------------------------------------------------
@@ -57,8 +67,10 @@ QT_LIKE_HEADERS += \
                    headers/CallStatistics \
                    headers/SmsHistory \
                    headers/CallHistory \
+                   headers/ContactStatistics \
                    headers/ContactListener \
                    headers/ContactResolver \
+                   headers/ContactBackend \
                    headers/ConversationModel \
                    headers/Event \
                    headers/EventModel \
@@ -76,6 +88,7 @@ HEADERS += commonutils.h \
            eventmodel.h \
            eventmodel_p.h \
            event.h \
+           event_p.h \
            messagepart.h \
            callevent.h \
            eventtreeitem.h \
@@ -86,12 +99,17 @@ HEADERS += commonutils.h \
            smshistory_p.h \
            callhistory.h \
            callhistory_p.h \
+           contactstatistics.h \
+           contactstatistics_p.h \
+           historyquery_p.h \
+           sqliterows_p.h \
            callmodel.h \
            groupmodel.h \
            groupmodel_p.h \
            group.h \
            adaptor.h \
            conversationmodel_p.h \
+           conversationcache_p.h \
            contactlistener.h \
            libcommhistoryexport.h \
            singleeventmodel.h \
@@ -113,6 +131,7 @@ HEADERS += commonutils.h \
            debug.h \
            contactfetcher.h \
            contactresolver.h \
+           contactbackend.h \
            draftsmodel.h \
            draftsmodel_p.h \
            recipient.h
@@ -122,8 +141,12 @@ SOURCES += commonutils.cpp \
            eventmodel_p.cpp \
            eventtreeitem.cpp \
            conversationmodel.cpp \
+           conversationcache.cpp \
            callstatistics.cpp \
            callhistory.cpp \
+           contactstatistics.cpp \
+           historyquery.cpp \
+           sqliterows.cpp \
            callmodel.cpp \
            groupmodel.cpp \
            group.cpp \
@@ -145,6 +168,7 @@ SOURCES += commonutils.cpp \
            commhistorydatabase.cpp \
            contactfetcher.cpp \
            contactresolver.cpp \
+           contactbackend.cpp \
            draftsmodel.cpp \
            recipient.cpp
 
@@ -45,6 +45,75 @@ UpdatesEmitter::~UpdatesEmitter()
     QDBusConnection::sessionBus().unregisterObject(COMM_HISTORY_OBJECT_PATH);
 }
 
+QString UpdatesEmitter::groupEventsPath(int groupId)
+{
+    return COMM_HISTORY_GROUP_EVENTS_PATH + QString::number(groupId);
+}
+
+QString UpdatesEmitter::typeEventsPath(int type)
+{
+    return COMM_HISTORY_TYPE_EVENTS_PATH + QString::number(type);
+}
+
+void UpdatesEmitter::routeEventsAdded(const QList<Event> &events)
+{
+    routeEvents(EVENTS_ADDED_SIGNAL, events);
+}
+
+void UpdatesEmitter::routeEventsUpdated(const QList<Event> &events)
+{
+    routeEvents(EVENTS_UPDATED_SIGNAL, events);
+}
+
+void UpdatesEmitter::routeEventDeleted(const Event &event)
+{
+    if (event.groupId() >= 0)
+        sendSignal(groupEventsPath(event.groupId()), EVENT_DELETED_SIGNAL, event.id());
+    sendSignal(typeEventsPath(event.type()), EVENT_DELETED_SIGNAL, event.id());
+}
+
+void UpdatesEmitter::routeEvents(const QString &signal, const QList<Event> &events)
+{
+    // Insertion order of the groups and types is kept, as is the order of
+    // the events in each
+    QList<int> groupIds, types;
+    QHash<int, QList<Event> > byGroup, byType;
+    foreach (const Event &event, events) {
+        if (event.groupId() >= 0) {
+            if (!byGroup.contains(event.groupId()))
+                groupIds.append(event.groupId());
+            byGroup[event.groupId()].append(event);
+        }
+        if (!byType.contains(event.type()))
+            types.append(event.type());
+        byType[event.type()].append(event);
+    }
+
+    foreach (int groupId, groupIds)
+        sendSignal(groupEventsPath(groupId), signal, QVariant::fromValue(byGroup.value(groupId)));
+    foreach (int type, types)
+        sendSignal(typeEventsPath(type), signal, QVariant::fromValue(byType.value(type)));
+}
+
+void UpdatesEmitter::routeEventsMovedOut(const QList<Event> &events, const QHash<int, int> &oldGroupIds)
+{
+    // Receivers of the old group's path see the event leave it
+    foreach (const Event &event, events) {
+        const int oldGroupId = oldGroupIds.value(event.id(), -1);
+        if (oldGroupId >= 0 && oldGroupId != event.groupId())
+            sendSignal(groupEventsPath(oldGroupId), EVENT_DELETED_SIGNAL, event.id());
+    }
+}
+
+void UpdatesEmitter::sendSignal(const QString &path, const QString &signal, const QVariant &argument)
+{
+    QDBusMessage message = QDBusMessage::createSignal(path, COMM_HISTORY_EVENTS_INTERFACE, signal);
+    if (argument.isValid())
+        message << argument;
+    if (!QDBusConnection::sessionBus().send(message))
+        qWarning() << Q_FUNC_INFO << ": error sending" << signal << "on" << path;
+}
+
 QSharedPointer<UpdatesEmitter> UpdatesEmitter::instance()
 {
     QSharedPointer<UpdatesEmitter> result;
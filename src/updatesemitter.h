@@ -24,6 +24,7 @@
 #define UPDATESEMITTER_H
 
 #include <QObject>
+#include <QHash>
 #include <QSharedPointer>
 #include <QWeakPointer>
 
@@ -39,6 +40,21 @@ public:
     static QSharedPointer<UpdatesEmitter> instance();
     ~UpdatesEmitter();
 
+    // Paths on which event signals are emitted for only the events of a
+    // group or of a type, so that receivers can match just those
+    static QString groupEventsPath(int groupId);
+    static QString typeEventsPath(int type);
+
+    void routeEventDeleted(const Event &event);
+
+    // Deletion of events modified into another group, on the paths of the
+    // groups they were in before, keyed by event id
+    void routeEventsMovedOut(const QList<Event> &events, const QHash<int, int> &oldGroupIds);
+
+public Q_SLOTS:
+    void routeEventsAdded(const QList<CommHistory::Event> &events);
+    void routeEventsUpdated(const QList<CommHistory::Event> &events);
+
 Q_SIGNALS:
 #ifndef Q_MOC_RUN
 public:
@@ -50,10 +66,14 @@ public:
     void groupsUpdated(const QList<int> &groupIds);
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
     void groupsDeleted(const QList<int> &groupIds);
+    void upgradeProgress(int percent);
 
 private:
     UpdatesEmitter();
 
+    void routeEvents(const QString &signal, const QList<Event> &events);
+    void sendSignal(const QString &path, const QString &signal, const QVariant &argument);
+
     static QWeakPointer<UpdatesEmitter> m_Instance;
 };
 
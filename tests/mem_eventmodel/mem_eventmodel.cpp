@@ -234,6 +234,80 @@ void MemEventModelTest::callSetFilter()
     MALLINFO_DUMP("don");
 }
 
+void MemEventModelTest::fillAndReset_data()
+{
+    QTest::addColumn<bool>("reuse");
+
+    QTest::newRow("fresh storage") << false;
+    QTest::newRow("reused storage") << true;
+}
+
+void MemEventModelTest::fillAndReset()
+{
+    QFETCH(bool, reuse);
+
+    const int eventCount = 5000;
+    const int rounds = 5;
+
+    static bool eventsAdded = false;
+    if (!eventsAdded) {
+        EventModel addModel;
+        QList<Event> events;
+        QDateTime startTime = QDateTime::fromString("2010-01-08T13:37:00Z", Qt::ISODate);
+        for (int i = 0; i < eventCount; i++) {
+            Event e;
+            e.setGroupId(group.id());
+            e.setType(Event::IMEvent);
+            e.setDirection(i & 1 ? Event::Inbound : Event::Outbound);
+            e.setStartTime(startTime.addSecs(i));
+            e.setEndTime(startTime.addSecs(i));
+            e.setLocalUid("/org/freedesktop/Telepathy/Account/gabble/jabber/dut_40localhost0");
+            e.setRecipients(Recipient(e.localUid(), "td@localhost"));
+            e.setFreeText(QString("fillAndReset %1").arg(i));
+            events.append(e);
+        }
+        QVERIFY(addModel.addEvents(events));
+        eventsAdded = true;
+    }
+
+    MALLINFO_DUMP("start");
+
+    EventModel *model = new EventModel();
+    model->setQueryMode(EventModel::SyncQuery);
+    model->setResolveContacts(EventModel::DoNotResolve);
+    model->setReuseRowStorage(reuse);
+    QCOMPARE(model->reuseRowStorage(), reuse);
+
+    qint64 fillTime = 0;
+    qint64 resetTime = 0;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < rounds; i++) {
+        timer.start();
+        QVERIFY(model->getEvents());
+        fillTime += timer.nsecsElapsed();
+        QVERIFY(model->rowCount() >= eventCount);
+        MALLINFO_DUMP("filled");
+
+        // Resetting the model releases all rows
+        timer.start();
+        model->setLimit(1);
+        QVERIFY(model->getEvents());
+        resetTime += timer.nsecsElapsed();
+        QCOMPARE(model->rowCount(), 1);
+        model->setLimit(0);
+        MALLINFO_DUMP("reset");
+    }
+
+    qDebug() << (reuse ? "reused storage:" : "fresh storage:")
+             << "fill" << fillTime / rounds / 1000 << "us,"
+             << "reset" << resetTime / rounds / 1000 << "us";
+
+    delete model;
+    waitWithDeletes(100);
+    MALLINFO_DUMP("done");
+}
+
 void MemEventModelTest::cleanupTestCase()
 {
     MALLINFO_DUMP("CLEANUP");
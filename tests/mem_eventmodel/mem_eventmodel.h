@@ -38,6 +38,8 @@ private slots:
     void deleteEvent();
 
     void callSetFilter();
+    void fillAndReset_data();
+    void fillAndReset();
 
     void cleanupTestCase();
 };
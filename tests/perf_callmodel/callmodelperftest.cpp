@@ -26,6 +26,7 @@
 #include <cstdlib>
 #include "callmodelperftest.h"
 #include "callmodel.h"
+#include "databaseio_p.h"
 #include "common.h"
 
 using namespace CommHistory;
@@ -220,6 +221,120 @@ void CallModelPerfTest::getEvents()
     summarizeResults(metaObject()->className(), times, logFile, startTime.secsTo(QDateTime::currentDateTime()));
 }
 
+void CallModelPerfTest::groupKeys_data()
+{
+    QTest::addColumn<bool>("useKey");
+    QTest::addColumn<int>("events");
+    QTest::addColumn<int>("contacts");
+
+    QTest::newRow("uri, 1000 events, 30 contacts") << false << 1000 << 30;
+    QTest::newRow("key, 1000 events, 30 contacts") << true << 1000 << 30;
+    QTest::newRow("uri, 1000 events, 1000 contacts") << false << 1000 << 1000;
+    QTest::newRow("key, 1000 events, 1000 contacts") << true << 1000 << 1000;
+}
+
+void CallModelPerfTest::groupKeys()
+{
+    QFETCH(bool, useKey);
+    QFETCH(int, events);
+    QFETCH(int, contacts);
+
+    QList<Event> eventList;
+    for (int i = 0; i < events; i++) {
+        Event e;
+        e.setType(Event::CallEvent);
+        e.setDirection(i % 2 ? Event::Inbound : Event::Outbound);
+        e.setLocalUid(RING_ACCOUNT);
+        e.setRecipients(Recipient(RING_ACCOUNT, QString("+35840%1").arg(i % contacts, 7, 10, QChar('0'))));
+        e.setIsVideoCall(i % 7 == 0);
+        eventList << e;
+    }
+
+    // The grouping path of CallModel: collect the groups of updated events,
+    // then match every row against them
+    if (useKey) {
+        QBENCHMARK {
+            QSet<CallGroupKey> groups;
+            foreach (const Event &e, eventList)
+                groups.insert(CallGroupKey(e));
+            int matches = 0;
+            foreach (const Event &e, eventList)
+                matches += groups.contains(CallGroupKey(e));
+            QCOMPARE(matches, events);
+        }
+    } else {
+        QBENCHMARK {
+            QSet<QString> groups;
+            foreach (const Event &e, eventList)
+                groups.insert(CallGroupKey::uri(e));
+            int matches = 0;
+            foreach (const Event &e, eventList)
+                matches += groups.contains(CallGroupKey::uri(e));
+            QCOMPARE(matches, events);
+        }
+    }
+}
+
+void CallModelPerfTest::decodeRows_data()
+{
+    QTest::addColumn<bool>("native");
+    QTest::addColumn<int>("events");
+
+    QTest::newRow("QVariant, 1000 events") << false << 1000;
+    QTest::newRow("native, 1000 events") << true << 1000;
+    QTest::newRow("QVariant, 5000 events") << false << 5000;
+    QTest::newRow("native, 5000 events") << true << 5000;
+}
+
+void CallModelPerfTest::decodeRows()
+{
+    QFETCH(bool, native);
+    QFETCH(int, events);
+
+    cleanupTestGroups();
+    cleanupTestEvents();
+
+    EventModel addModel;
+    QDateTime when = QDateTime::currentDateTime();
+    QList<Event> eventList;
+    for (int i = 0; i < events; i++) {
+        Event e;
+        e.setType(Event::CallEvent);
+        e.setDirection(i % 2 ? Event::Inbound : Event::Outbound);
+        e.setGroupId(-1);
+        e.setStartTime(when.addSecs(i));
+        e.setEndTime(when.addSecs(i + 60));
+        e.setLocalUid(RING_ACCOUNT);
+        e.setRecipients(Recipient(RING_ACCOUNT, QString("+35840%1").arg(i % 50, 7, 10, QChar('0'))));
+        e.setIsMissedCall(i % 3 == 0);
+        eventList << e;
+    }
+    QVERIFY(addModel.addEvents(eventList, false));
+
+    // Rows are read through QVariant when the native path is disabled
+    if (native)
+        qunsetenv("COMMHISTORY_NO_NATIVE_DECODE");
+    else
+        qputenv("COMMHISTORY_NO_NATIVE_DECODE", "1");
+
+    qint64 rows = 0;
+    QElapsedTimer time;
+    time.start();
+    QBENCHMARK {
+        CallModel fetchModel;
+        fetchModel.setQueryMode(EventModel::SyncQuery);
+        fetchModel.setResolveContacts(EventModel::DoNotResolve);
+        fetchModel.setTreeMode(false);
+        QVERIFY(fetchModel.setFilter(CallModel::SortByTime));
+        QVERIFY(fetchModel.getEvents());
+        QCOMPARE(fetchModel.rowCount(), events);
+        rows += events;
+    }
+    qDebug("%lld rows per second", rows * 1000 / qMax<qint64>(time.elapsed(), 1));
+
+    qunsetenv("COMMHISTORY_NO_NATIVE_DECODE");
+}
+
 void CallModelPerfTest::cleanupTestCase()
 {
     if(logFile) {
@@ -36,6 +36,10 @@ private slots:
     void init();
     void getEvents_data();
     void getEvents();
+    void groupKeys_data();
+    void groupKeys();
+    void decodeRows_data();
+    void decodeRows();
     void cleanupTestCase();
 
 private:
@@ -27,6 +27,9 @@
 #include "conversationmodelperftest.h"
 #include "conversationmodel.h"
 #include "groupmodel.h"
+#include "databaseio.h"
+#include "contactresolver.h"
+#include "stubcontactbackend.h"
 #include "common.h"
 
 using namespace CommHistory;
@@ -246,6 +249,193 @@ void ConversationModelPerfTest::getEvents()
     summarizeResults(metaObject()->className(), times, logFile, startTime.secsTo(QDateTime::currentDateTime()));
 }
 
+void ConversationModelPerfTest::resolveStub_data()
+{
+    // Number of recipients to resolve, every other one matching a contact
+    QTest::addColumn<int>("recipients");
+
+    // Latency of the stub backend in milliseconds
+    QTest::addColumn<int>("latency");
+
+    QTest::newRow("10000 recipients") << 10000 << 0;
+    QTest::newRow("100000 recipients") << 100000 << 0;
+    QTest::newRow("100000 recipients, 10 ms latency") << 100000 << 10;
+}
+
+void ConversationModelPerfTest::resolveStub()
+{
+    QFETCH(int, recipients);
+    QFETCH(int, latency);
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    // Resolution without the contacts database, to measure only the
+    // library's own work
+    StubContactBackend backend;
+    backend.setLatency(latency);
+    ContactBackend::setInstance(&backend);
+
+    qDebug() << Q_FUNC_INFO << "- Creating" << recipients << "recipients";
+
+    RecipientList recipientList;
+    for (int i = 0; i < recipients; i++) {
+        Recipient recipient(RING_ACCOUNT, QString("+3584%1").arg(1000000 + i));
+        recipientList << recipient;
+        if (i % 2 == 0)
+            backend.addContact(QString("Stub Contact %1").arg(i), RecipientList(recipient));
+    }
+
+    int iterations = 10;
+    QList<int> times;
+
+    #ifdef PERF_ITERATIONS
+    iterations = PERF_ITERATIONS;
+    #endif
+
+    char *iterVar = getenv("PERF_ITERATIONS");
+    if (iterVar) {
+        int iters = QString::fromLatin1(iterVar).toInt();
+        if (iters > 0) {
+            iterations = iters;
+        }
+    }
+
+    qDebug() << Q_FUNC_INFO << "- Resolving." << iterations << "iterations";
+    for (int i = 0; i < iterations; i++) {
+        foreach (const Recipient &recipient, recipientList)
+            recipient.setUnresolved();
+
+        ContactResolver resolver(0);
+
+        QElapsedTimer time;
+        time.start();
+        resolver.add(recipientList);
+        waitForSignal(&resolver, SIGNAL(finished()));
+
+        int elapsed = time.elapsed();
+        times << elapsed;
+        qDebug("Time elapsed: %d ms", elapsed);
+
+        int matched = 0;
+        foreach (const Recipient &recipient, recipientList) {
+            QVERIFY(recipient.isContactResolved());
+            if (recipient.contactId())
+                matched++;
+        }
+        QCOMPARE(matched, (recipients + 1) / 2);
+    }
+
+    ContactBackend::setInstance(0);
+
+    summarizeResults(metaObject()->className(), times, logFile, startTime.secsTo(QDateTime::currentDateTime()));
+}
+
+void ConversationModelPerfTest::upsertByToken_data()
+{
+    // Number of messages received
+    QTest::addColumn<int>("messages");
+
+    // Percentage of messages received again
+    QTest::addColumn<int>("retransmitted");
+
+    // Upsert by token, or look up the token and then add or modify
+    QTest::addColumn<bool>("upsert");
+
+    QTest::newRow("1000 messages, lookup") << 1000 << 0 << false;
+    QTest::newRow("1000 messages, upsert") << 1000 << 0 << true;
+    QTest::newRow("1000 messages, 50% retransmitted, lookup") << 1000 << 50 << false;
+    QTest::newRow("1000 messages, 50% retransmitted, upsert") << 1000 << 50 << true;
+    QTest::newRow("1000 messages, 90% retransmitted, lookup") << 1000 << 90 << false;
+    QTest::newRow("1000 messages, 90% retransmitted, upsert") << 1000 << 90 << true;
+}
+
+void ConversationModelPerfTest::upsertByToken()
+{
+    QFETCH(int, messages);
+    QFETCH(int, retransmitted);
+    QFETCH(bool, upsert);
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    Group group;
+    addTestGroup(group, RING_ACCOUNT, "+3584100200300");
+
+    // Retransmissions repeat the token of an earlier message
+    QList<int> tokens;
+    for (int i = 0; i < messages; i++) {
+        if (i > 0 && qrand() % 100 < retransmitted)
+            tokens << tokens.at(qrand() % i);
+        else
+            tokens << i;
+    }
+    const int distinct = tokens.toSet().count();
+
+    int iterations = 10;
+    QList<int> times;
+
+    #ifdef PERF_ITERATIONS
+    iterations = PERF_ITERATIONS;
+    #endif
+
+    char *iterVar = getenv("PERF_ITERATIONS");
+    if (iterVar) {
+        int iters = QString::fromLatin1(iterVar).toInt();
+        if (iters > 0) {
+            iterations = iters;
+        }
+    }
+
+    EventModel model;
+    DatabaseIO &database = model.databaseIO();
+    QDateTime when = QDateTime::currentDateTime();
+
+    qDebug() << Q_FUNC_INFO << "- Receiving" << messages << "messages," << distinct
+             << "distinct." << iterations << "iterations";
+    for (int i = 0; i < iterations; i++) {
+        int added = 0;
+
+        QElapsedTimer time;
+        time.start();
+        for (int m = 0; m < messages; m++) {
+            Event e;
+            e.setType(Event::SMSEvent);
+            e.setDirection(Event::Inbound);
+            e.setGroupId(group.id());
+            e.setStartTime(when.addSecs(m));
+            e.setEndTime(when.addSecs(m));
+            e.setLocalUid(RING_ACCOUNT);
+            e.setRecipients(Recipient(RING_ACCOUNT, "+3584100200300"));
+            e.setFreeText(QString("Message %1").arg(tokens.at(m)));
+            e.setStatus(Event::ReceivedStatus);
+            e.setMessageToken(QString("upsert-%1-%2").arg(i).arg(tokens.at(m)));
+
+            if (upsert) {
+                bool inserted = false;
+                QVERIFY(model.upsertEventByToken(e, DatabaseIO::MergeModified, &inserted));
+                if (inserted)
+                    added++;
+            } else {
+                Event existing;
+                if (database.getEventByMessageToken(e.messageToken(), existing)) {
+                    existing.setStatus(e.status());
+                    QVERIFY(model.modifyEvent(existing));
+                } else {
+                    QVERIFY(model.addEvent(e));
+                    added++;
+                }
+            }
+        }
+
+        int elapsed = time.elapsed();
+        times << elapsed;
+        qDebug("Time elapsed: %d ms", elapsed);
+
+        QCOMPARE(added, distinct);
+    }
+
+    summarizeResults(metaObject()->className(), times, logFile, startTime.secsTo(QDateTime::currentDateTime()));
+}
+
 void ConversationModelPerfTest::cleanupTestCase()
 {
     if(logFile) {
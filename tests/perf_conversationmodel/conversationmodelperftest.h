@@ -36,6 +36,10 @@ private slots:
     void init();
     void getEvents_data();
     void getEvents();
+    void resolveStub_data();
+    void resolveStub();
+    void upsertByToken_data();
+    void upsertByToken();
     void cleanupTestCase();
 
 private:
@@ -26,5 +26,5 @@ include( ../performance_tests.pri )
 
 TARGET = perf_conversationmodel
 QT -= gui
-SOURCES += conversationmodelperftest.cpp
-HEADERS += conversationmodelperftest.h
+SOURCES += conversationmodelperftest.cpp ../stubcontactbackend.cpp
+HEADERS += conversationmodelperftest.h ../stubcontactbackend.h
@@ -0,0 +1,498 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "replayer.h"
+#include "common.h"
+#include "groupmodel.h"
+#include "groupmanager.h"
+#include "callmodel.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QTimer>
+#include <QRegExp>
+#include <QDateTime>
+#include <QDebug>
+
+#include <algorithm>
+
+using namespace CommHistory;
+
+namespace {
+
+// Interval of the main thread heartbeat, and the gap between two beats
+// beyond which the thread is considered stalled (one 60Hz frame)
+const int TICK_INTERVAL = 5;
+const int STALL_THRESHOLD = 16;
+
+const int SETUP_BATCH_SIZE = 100;
+
+bool operationOrder(const ReplayOp &a, const ReplayOp &b)
+{
+    return a.offset < b.offset;
+}
+
+}
+
+Replayer::Replayer(const QString &process, const QList<ReplayOp> &ops, QObject *parent)
+    : QObject(parent),
+      m_process(process),
+      m_next(0),
+      m_startTime(0),
+      m_failed(false),
+      m_observing(false),
+      m_stallTime(0),
+      m_stallCount(0),
+      m_longestStall(0),
+      m_groupModel(0),
+      m_groupManager(new GroupManager(this)),
+      m_writeModel(new EventModel(this))
+{
+    foreach (const ReplayOp &op, ops) {
+        if (op.process == process)
+            m_ops.append(op);
+    }
+    std::stable_sort(m_ops.begin(), m_ops.end(), operationOrder);
+
+    m_runTimer = new QTimer(this);
+    m_runTimer->setSingleShot(true);
+    m_runTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_runTimer, SIGNAL(timeout()), SLOT(runNext()));
+
+    m_tickTimer = new QTimer(this);
+    m_tickTimer->setInterval(TICK_INTERVAL);
+    m_tickTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_tickTimer, SIGNAL(timeout()), SLOT(tick()));
+}
+
+Replayer::~Replayer()
+{
+}
+
+bool Replayer::parseTrace(const QString &fileName, QList<ReplayOp> &ops)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Unable to open trace" << fileName;
+        return false;
+    }
+
+    QRegExp offsetExp("(\\d+)(?:\\+(\\d+)x(\\d+))?");
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        lineNumber++;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(QRegExp("\\s+"));
+        if (fields.size() < 3 || !offsetExp.exactMatch(fields.at(0))) {
+            qWarning() << "Invalid trace line" << fileName << lineNumber << line;
+            return false;
+        }
+
+        ReplayOp op;
+        op.offset = offsetExp.cap(1).toLongLong();
+        op.process = fields.at(1);
+        op.command = fields.at(2);
+        op.arguments = fields.mid(3);
+
+        int interval = offsetExp.cap(2).toInt();
+        int count = offsetExp.cap(3).isEmpty() ? 1 : offsetExp.cap(3).toInt();
+        for (int i = 0; i < count; i++) {
+            ops.append(op);
+            op.offset += interval;
+        }
+    }
+
+    return true;
+}
+
+QStringList Replayer::processes(const QList<ReplayOp> &ops)
+{
+    QStringList result;
+    foreach (const ReplayOp &op, ops) {
+        if (op.process != QLatin1String("setup") && !result.contains(op.process))
+            result.append(op.process);
+    }
+    return result;
+}
+
+QString Replayer::generatedRemoteUid(int index)
+{
+    return QString("+3585%1").arg(index, 8, 10, QChar('0'));
+}
+
+bool Replayer::runSetup(const QList<ReplayOp> &ops)
+{
+    foreach (const ReplayOp &op, ops) {
+        if (op.process != QLatin1String("setup"))
+            continue;
+
+        if (op.command == QLatin1String("generate") && op.arguments.size() == 2) {
+            int groups = op.arguments.at(0).toInt();
+            int events = op.arguments.at(1).toInt();
+            qDebug() << Q_FUNC_INFO << "- Generating" << groups << "groups with" << events << "events";
+
+            GroupManager manager;
+            QList<Group> groupList;
+            for (int i = 0; i < groups; i++) {
+                Group group;
+                group.setLocalUid(RING_ACCOUNT);
+                group.setRecipients(RecipientList::fromUids(RING_ACCOUNT, QStringList() << generatedRemoteUid(i)));
+                groupList.append(group);
+            }
+            if (!manager.addGroups(groupList))
+                return false;
+
+            EventModel model;
+            QList<Event> eventList;
+            QDateTime when = QDateTime::currentDateTime().addSecs(-60 * groups * events);
+            for (int i = 0; i < groups * events; i++) {
+                const Group &group = groupList.at(qrand() % groups);
+                Event e;
+                if (i % 5 == 0) {
+                    e.setType(Event::CallEvent);
+                    e.setGroupId(-1);
+                    e.setIsMissedCall(qrand() % 3 == 0);
+                } else {
+                    e.setType(Event::SMSEvent);
+                    e.setGroupId(group.id());
+                    e.setFreeText(randomMessage(qrand() % 20 + 1));
+                }
+                e.setDirection(qrand() % 2 ? Event::Inbound : Event::Outbound);
+                e.setStartTime(when.addSecs(60 * i));
+                e.setEndTime(e.startTime());
+                e.setLocalUid(RING_ACCOUNT);
+                e.setRecipients(Recipient(RING_ACCOUNT, group.recipients().value(0).remoteUid()));
+                e.setIsRead(true);
+                eventList.append(e);
+
+                if (eventList.size() == SETUP_BATCH_SIZE) {
+                    if (!model.addEvents(eventList, false))
+                        return false;
+                    eventList.clear();
+                }
+            }
+            if (!eventList.isEmpty() && !model.addEvents(eventList, false))
+                return false;
+        } else if (op.command == QLatin1String("contacts") && op.arguments.size() == 1) {
+            int contacts = op.arguments.at(0).toInt();
+            qDebug() << Q_FUNC_INFO << "- Creating" << contacts << "contacts";
+
+            QList<QPair<QString, QPair<QString, QString> > > details;
+            for (int i = 0; i < contacts; i++)
+                details.append(qMakePair(QString("Replay Contact %1").arg(i), qMakePair(generatedRemoteUid(i), QString())));
+            if (addTestContacts(details).size() != contacts)
+                return false;
+        } else {
+            qWarning() << "Invalid setup step" << op.command << op.arguments;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Replayer::start(qint64 startTime)
+{
+    m_startTime = startTime;
+    m_sinceTick.start();
+    m_tickTimer->start();
+    runNext();
+}
+
+void Replayer::runNext()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch() - m_startTime;
+    while (m_next < m_ops.size() && m_ops.at(m_next).offset <= now) {
+        const ReplayOp &op = m_ops.at(m_next++);
+        if (!execute(op)) {
+            qWarning() << m_process << "failed to replay" << op.offset << op.command << op.arguments;
+            m_failed = true;
+        }
+        now = QDateTime::currentMSecsSinceEpoch() - m_startTime;
+    }
+
+    if (isFinished()) {
+        m_tickTimer->stop();
+        emit finished();
+    } else {
+        m_runTimer->start(qMax<qint64>(0, m_ops.at(m_next).offset - now));
+    }
+}
+
+void Replayer::tick()
+{
+    qint64 elapsed = m_sinceTick.restart();
+    if (elapsed > STALL_THRESHOLD) {
+        m_stallTime += elapsed - STALL_THRESHOLD;
+        m_stallCount++;
+        m_longestStall = qMax(m_longestStall, elapsed);
+    }
+}
+
+bool Replayer::execute(const ReplayOp &op)
+{
+    if (op.command == QLatin1String("open"))
+        return open(op.arguments);
+    else if (op.command == QLatin1String("scroll"))
+        return scroll(op.arguments);
+    else if (op.command == QLatin1String("sms"))
+        return addMessages(op.arguments);
+    else if (op.command == QLatin1String("call"))
+        return addCall(op.arguments);
+    else if (op.command == QLatin1String("read"))
+        return markRead(op.arguments);
+    else if (op.command == QLatin1String("contact"))
+        return addContact(op.arguments);
+
+    qWarning() << "Unknown replay command" << op.command;
+    return false;
+}
+
+bool Replayer::open(const QStringList &arguments)
+{
+    QString name = arguments.value(0);
+
+    if (name == QLatin1String("groups")) {
+        delete m_groupModel;
+        m_groupModel = new GroupModel(this);
+        connect(m_groupModel, SIGNAL(rowsInserted(QModelIndex,int,int)),
+                SLOT(groupRowsInserted(QModelIndex,int,int)));
+        connect(m_groupModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+                SLOT(groupDataChanged(QModelIndex,QModelIndex)));
+        connect(m_groupModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                SLOT(groupRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+        return m_groupModel->getGroups();
+    }
+
+    EventModel *model = 0;
+    bool ok = false;
+    if (name == QLatin1String("calls")) {
+        CallModel *calls = new CallModel(this);
+        calls->setFilter(CallModel::SortByContact);
+        model = calls;
+        ok = calls->getEvents();
+    } else if (name == QLatin1String("conversation")) {
+        int id = groupId(arguments.value(1), false);
+        if (id < 0)
+            return false;
+        ConversationModel *conversation = new ConversationModel(this);
+        model = conversation;
+        ok = conversation->getEvents(id);
+    } else {
+        return false;
+    }
+
+    delete m_eventModels.take(name);
+    m_eventModels.insert(name, model);
+    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
+            SLOT(eventRowsInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+            SLOT(eventDataChanged(QModelIndex,QModelIndex)));
+    return ok;
+}
+
+QAbstractItemModel *Replayer::model(const QString &name) const
+{
+    if (name == QLatin1String("groups"))
+        return m_groupModel;
+    return m_eventModels.value(name);
+}
+
+bool Replayer::scroll(const QStringList &arguments)
+{
+    QAbstractItemModel *model = this->model(arguments.value(0));
+    if (!model)
+        return false;
+
+    // Read every role of the rows, as a view creating delegates would
+    int rows = qMin(arguments.value(1).toInt(), model->rowCount());
+    QList<int> roles = model->roleNames().keys();
+    for (int i = 0; i < rows; i++) {
+        QModelIndex index = model->index(i, 0);
+        foreach (int role, roles)
+            model->data(index, role);
+    }
+
+    return true;
+}
+
+bool Replayer::addMessages(const QStringList &arguments)
+{
+    QString remoteUid = arguments.value(0);
+    int count = arguments.size() > 1 ? arguments.at(1).toInt() : 1;
+    int id = groupId(remoteUid, true);
+    if (id < 0)
+        return false;
+
+    QList<Event> events;
+    QDateTime when = QDateTime::currentDateTime();
+    for (int i = 0; i < count; i++) {
+        Event e;
+        e.setType(Event::SMSEvent);
+        e.setDirection(Event::Inbound);
+        e.setGroupId(id);
+        e.setStartTime(when);
+        e.setEndTime(when);
+        e.setLocalUid(RING_ACCOUNT);
+        e.setRecipients(Recipient(RING_ACCOUNT, remoteUid));
+        e.setFreeText(randomMessage(qrand() % 20 + 1));
+        events.append(e);
+    }
+
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    if (!m_writeModel->addEvents(events, false))
+        return false;
+
+    foreach (const Event &e, events)
+        m_writes.append(ReplayRecord(QString("e%1").arg(e.id()), time));
+    m_writes.append(ReplayRecord(QString("g%1").arg(id), time));
+    return true;
+}
+
+bool Replayer::addCall(const QStringList &arguments)
+{
+    Event e;
+    e.setType(Event::CallEvent);
+    e.setDirection(Event::Inbound);
+    e.setGroupId(-1);
+    e.setStartTime(QDateTime::currentDateTime());
+    e.setEndTime(e.startTime());
+    e.setLocalUid(RING_ACCOUNT);
+    e.setRecipients(Recipient(RING_ACCOUNT, arguments.value(0)));
+    e.setIsMissedCall(arguments.value(1) == QLatin1String("missed"));
+
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    if (!m_writeModel->addEvent(e))
+        return false;
+
+    m_writes.append(ReplayRecord(QString("e%1").arg(e.id()), time));
+    return true;
+}
+
+bool Replayer::markRead(const QStringList &arguments)
+{
+    int id = groupId(arguments.value(0), false);
+    if (id < 0)
+        return false;
+
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    if (!m_groupManager->markAsReadGroup(id))
+        return false;
+
+    m_writes.append(ReplayRecord(QString("g%1").arg(id), time));
+    return true;
+}
+
+bool Replayer::addContact(const QStringList &arguments)
+{
+    QString name = arguments.mid(1).join(QLatin1Char(' '));
+    return addTestContact(name, arguments.value(0)) >= 0;
+}
+
+int Replayer::groupId(const QString &remoteUid, bool create)
+{
+    QHash<QString, int>::const_iterator it = m_groupIds.constFind(remoteUid);
+    if (it != m_groupIds.constEnd())
+        return *it;
+
+    QList<Group> groups;
+    if (!DatabaseIO::instance()->getGroups(RING_ACCOUNT, remoteUid, groups))
+        return -1;
+
+    int id = -1;
+    if (!groups.isEmpty()) {
+        id = groups.first().id();
+    } else if (create) {
+        Group group;
+        group.setLocalUid(RING_ACCOUNT);
+        group.setRecipients(RecipientList::fromUids(RING_ACCOUNT, QStringList() << remoteUid));
+        if (m_groupManager->addGroup(group))
+            id = group.id();
+    }
+
+    if (id >= 0)
+        m_groupIds.insert(remoteUid, id);
+    return id;
+}
+
+void Replayer::observeEvents(EventModel *model, int first, int last)
+{
+    if (!m_observing)
+        return;
+
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    for (int i = first; i <= last; i++)
+        m_observations.append(ReplayRecord(QString("e%1").arg(model->event(model->index(i, 0)).id()), time));
+}
+
+void Replayer::observeGroups(int first, int last)
+{
+    if (!m_observing)
+        return;
+
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    for (int i = first; i <= last; i++) {
+        int id = m_groupModel->index(i, 0).data(GroupModel::GroupIdRole).toInt();
+        m_observations.append(ReplayRecord(QString("g%1").arg(id), time));
+    }
+}
+
+void Replayer::eventRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (!parent.isValid())
+        observeEvents(qobject_cast<EventModel *>(sender()), first, last);
+}
+
+void Replayer::eventDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!topLeft.parent().isValid())
+        observeEvents(qobject_cast<EventModel *>(sender()), topLeft.row(), bottomRight.row());
+}
+
+void Replayer::groupRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    observeGroups(first, last);
+}
+
+void Replayer::groupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    observeGroups(topLeft.row(), bottomRight.row());
+}
+
+void Replayer::groupRowsMoved(const QModelIndex &parent, int start, int end,
+                              const QModelIndex &destination, int row)
+{
+    Q_UNUSED(parent);
+    Q_UNUSED(destination);
+
+    // Rows moved up land at row, rows moved down end just before it
+    int count = end - start + 1;
+    int first = row < start ? row : row - count;
+    observeGroups(first, first + count - 1);
+}
@@ -0,0 +1,167 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+
+class QTimer;
+class QModelIndex;
+class QAbstractItemModel;
+
+namespace CommHistory {
+    class EventModel;
+    class GroupModel;
+    class GroupManager;
+}
+
+/*!
+ * One step of a workload trace.
+ *
+ * Traces are plain text, one step per line:
+ *
+ *   <offset>[+<interval>x<count>] <process> <command> [arguments...]
+ *
+ * The offset is in milliseconds from the start of the replay. The optional
+ * repeat suffix expands the line into count steps, interval milliseconds
+ * apart. Steps of the "setup" process are run once against an empty database
+ * before the replay starts; all other process names are replayed in a process
+ * of their own, except "main", which is the process being measured.
+ *
+ * Setup commands:
+ *   generate <groups> <events per group>
+ *   contacts <count>
+ *
+ * Replay commands:
+ *   open groups|calls|conversation [remoteUid]
+ *   scroll groups|calls|conversation <rows>
+ *   sms <remoteUid> [count]
+ *   call <remoteUid> [missed]
+ *   read <remoteUid>
+ *   contact <remoteUid> <name>
+ *
+ * Lines starting with '#' are comments.
+ */
+struct ReplayOp
+{
+    qint64 offset;
+    QString process;
+    QString command;
+    QStringList arguments;
+};
+
+typedef QPair<QString, qint64> ReplayRecord;
+
+class Replayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    Replayer(const QString &process, const QList<ReplayOp> &ops, QObject *parent = 0);
+    ~Replayer();
+
+    static bool parseTrace(const QString &fileName, QList<ReplayOp> &ops);
+    static QStringList processes(const QList<ReplayOp> &ops);
+    static bool runSetup(const QList<ReplayOp> &ops);
+    static QString generatedRemoteUid(int index);
+
+    /*!
+     * Start replaying at startTime, in milliseconds since the epoch. All
+     * processes of a replay share the same start time.
+     */
+    void start(qint64 startTime);
+    bool isFinished() const { return m_next >= m_ops.size(); }
+    bool hasFailed() const { return m_failed; }
+
+    /*!
+     * Record when model updates are seen, so that they can be matched
+     * against the writes of all processes.
+     */
+    void setObserving(bool observing) { m_observing = observing; }
+
+    /*!
+     * Writes done by this process; the key identifies the event ("e<id>") or
+     * group ("g<id>") and the time is taken just before the API call.
+     */
+    QList<ReplayRecord> writes() const { return m_writes; }
+    QList<ReplayRecord> observations() const { return m_observations; }
+
+    qint64 stallTime() const { return m_stallTime; }
+    int stallCount() const { return m_stallCount; }
+    qint64 longestStall() const { return m_longestStall; }
+
+signals:
+    void finished();
+
+private slots:
+    void runNext();
+    void tick();
+    void eventRowsInserted(const QModelIndex &parent, int first, int last);
+    void eventDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void groupRowsInserted(const QModelIndex &parent, int first, int last);
+    void groupDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void groupRowsMoved(const QModelIndex &parent, int start, int end,
+                        const QModelIndex &destination, int row);
+
+private:
+    bool execute(const ReplayOp &op);
+    bool open(const QStringList &arguments);
+    bool scroll(const QStringList &arguments);
+    bool addMessages(const QStringList &arguments);
+    bool addCall(const QStringList &arguments);
+    bool markRead(const QStringList &arguments);
+    bool addContact(const QStringList &arguments);
+    int groupId(const QString &remoteUid, bool create);
+    QAbstractItemModel *model(const QString &name) const;
+    void observeEvents(CommHistory::EventModel *model, int first, int last);
+    void observeGroups(int first, int last);
+
+    QString m_process;
+    QList<ReplayOp> m_ops;
+    int m_next;
+    qint64 m_startTime;
+    bool m_failed;
+    bool m_observing;
+
+    QTimer *m_runTimer;
+    QTimer *m_tickTimer;
+    QElapsedTimer m_sinceTick;
+    qint64 m_stallTime;
+    int m_stallCount;
+    qint64 m_longestStall;
+
+    QHash<QString, CommHistory::EventModel *> m_eventModels;
+    CommHistory::GroupModel *m_groupModel;
+    CommHistory::GroupManager *m_groupManager;
+    CommHistory::EventModel *m_writeModel;
+    QHash<QString, int> m_groupIds;
+
+    QList<ReplayRecord> m_writes;
+    QList<ReplayRecord> m_observations;
+};
+
+#endif
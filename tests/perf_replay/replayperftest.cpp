@@ -0,0 +1,236 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QDateTime>
+#include <QProcess>
+#include <unistd.h>
+#include "replayperftest.h"
+#include "replayer.h"
+#include "commhistorydatabasepath.h"
+#include "common.h"
+#include "databaseio.h"
+
+using namespace CommHistory;
+
+namespace {
+
+// Time for the replay processes to start up before the first step
+const int REPLAY_STARTUP_DELAY = 2000;
+// Time to wait for late model updates after the last step
+const int REPLAY_SETTLE_TIME = 2000;
+
+int percentile(const QList<int> &sorted, int percent)
+{
+    return sorted.at(qMin(sorted.size() - 1, sorted.size() * percent / 100));
+}
+
+}
+
+void ReplayPerfTest::initTestCase()
+{
+    initTestDatabase();
+
+    logFile = new QFile("libcommhistory-performance-test.log");
+    if(!logFile->open(QIODevice::Append)) {
+        qDebug() << "!!!! Failed to open log file !!!!";
+        logFile = 0;
+    }
+
+    qsrand( QDateTime::currentDateTime().toTime_t() );
+}
+
+void ReplayPerfTest::replay_data()
+{
+    QTest::addColumn<QString>("trace");
+
+    // A single trace can be replayed with REPLAY_TRACE=file
+    QString trace = QString::fromLocal8Bit(qgetenv("REPLAY_TRACE"));
+    if (!trace.isEmpty()) {
+        QTest::newRow(qPrintable(QFileInfo(trace).baseName())) << trace;
+        return;
+    }
+
+    QDir traces(QFINDTESTDATA("traces"));
+    foreach (const QFileInfo &info, traces.entryInfoList(QStringList() << "*.trace", QDir::Files, QDir::Name))
+        QTest::newRow(qPrintable(info.baseName())) << info.absoluteFilePath();
+}
+
+void ReplayPerfTest::replay()
+{
+    QFETCH(QString, trace);
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    QList<ReplayOp> ops;
+    QVERIFY(Replayer::parseTrace(trace, ops));
+
+    cleanupTestGroups();
+    cleanupTestEvents();
+    QVERIFY(Replayer::runSetup(ops));
+
+    qint64 replayStart = QDateTime::currentMSecsSinceEpoch() + REPLAY_STARTUP_DELAY;
+
+    QList<QProcess *> processes;
+    foreach (const QString &name, Replayer::processes(ops)) {
+        if (name == QLatin1String("main"))
+            continue;
+
+        QProcess *process = new QProcess(this);
+        process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process->start(QCoreApplication::applicationFilePath(),
+                       QStringList() << "-replay" << name << trace << QString::number(replayStart));
+        QVERIFY(process->waitForStarted());
+        processes.append(process);
+    }
+
+    qDebug() << Q_FUNC_INFO << "- Replaying" << trace << "with" << processes.size() << "other processes";
+
+    Replayer replayer(QLatin1String("main"), ops);
+    replayer.setObserving(true);
+    replayer.start(replayStart);
+
+    bool running = true;
+    while (running) {
+        QTest::qWait(10);
+        running = !replayer.isFinished();
+        foreach (QProcess *process, processes) {
+            if (process->state() != QProcess::NotRunning)
+                running = true;
+        }
+    }
+    QTest::qWait(REPLAY_SETTLE_TIME);
+
+    QVERIFY(!replayer.hasFailed());
+
+    QList<ReplayRecord> writes = replayer.writes();
+    foreach (QProcess *process, processes) {
+        QCOMPARE(process->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(process->exitCode(), 0);
+
+        foreach (const QByteArray &line, process->readAllStandardOutput().split('\n')) {
+            QList<QByteArray> fields = line.split(' ');
+            if (fields.size() == 3 && fields.at(0) == "W")
+                writes.append(ReplayRecord(QString::fromLatin1(fields.at(1)), fields.at(2).toLongLong()));
+        }
+        delete process;
+    }
+
+    // Latency of a write is the time until the first model update for the
+    // same event or group that was seen after it
+    QHash<QString, QList<qint64> > observed;
+    foreach (const ReplayRecord &record, replayer.observations())
+        observed[record.first].append(record.second);
+
+    QList<int> latencies;
+    int unseen = 0;
+    foreach (const ReplayRecord &write, writes) {
+        bool seen = false;
+        foreach (qint64 time, observed.value(write.first)) {
+            if (time >= write.second) {
+                latencies << int(time - write.second);
+                seen = true;
+                break;
+            }
+        }
+        if (!seen)
+            unseen++;
+    }
+
+    QVERIFY(!latencies.isEmpty());
+
+    summarizeResults(metaObject()->className(), latencies, logFile, startTime.secsTo(QDateTime::currentDateTime()));
+
+    QString summary = QString("Updates: %1 seen, %2 unseen; p50 %3 ms, p95 %4 ms, p99 %5 ms. "
+                              "Main thread stalled %6 ms in %7 stalls, longest %8 ms")
+                      .arg(latencies.size()).arg(unseen)
+                      .arg(percentile(latencies, 50)).arg(percentile(latencies, 95)).arg(percentile(latencies, 99))
+                      .arg(replayer.stallTime()).arg(replayer.stallCount()).arg(replayer.longestStall());
+
+    int cacheHits, cacheMisses;
+    DatabaseIO::instance()->queryCacheStatistics(cacheHits, cacheMisses);
+    summary += QString(". Query cache: %1 hits, %2 misses").arg(cacheHits).arg(cacheMisses);
+    qDebug("##### %s", qPrintable(summary));
+    if (logFile)
+        QTextStream(logFile) << summary << "\n";
+}
+
+void ReplayPerfTest::cleanupTestCase()
+{
+    if(logFile) {
+        logFile->close();
+        delete logFile;
+        logFile = 0;
+    }
+
+    deleteAll();
+}
+
+int runReplayProcess(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (argc != 5)
+        return 1;
+
+    CommHistoryDatabasePath::setRootDir(TEST_DATABASE_DIR);
+    qsrand(QDateTime::currentDateTime().toTime_t() ^ app.applicationPid());
+
+    QList<ReplayOp> ops;
+    if (!Replayer::parseTrace(QString::fromLocal8Bit(argv[3]), ops))
+        return 1;
+
+    Replayer replayer(QString::fromLocal8Bit(argv[2]), ops);
+    QObject::connect(&replayer, SIGNAL(finished()), &app, SLOT(quit()), Qt::QueuedConnection);
+    replayer.start(QByteArray(argv[4]).toLongLong());
+    if (!replayer.isFinished())
+        app.exec();
+
+    QTextStream out(stdout);
+    foreach (const ReplayRecord &record, replayer.writes())
+        out << "W " << record.first << ' ' << record.second << '\n';
+
+    return replayer.hasFailed() ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !qstrcmp(argv[1], "-replay"))
+        return runReplayProcess(argc, argv);
+
+    // Replay on a private session bus, so that the processes only see each
+    // other's notifications
+    if (qgetenv("COMMHISTORY_REPLAY_BUS").isEmpty()) {
+        qputenv("COMMHISTORY_REPLAY_BUS", "1");
+
+        QVector<char *> args;
+        args << const_cast<char *>("dbus-run-session") << const_cast<char *>("--");
+        for (int i = 0; i < argc; i++)
+            args << argv[i];
+        args << 0;
+        execvp(args.at(0), args.data());
+        qWarning() << "Unable to start a private session bus, replaying on the session bus";
+    }
+
+    QCoreApplication app(argc, argv);
+    ReplayPerfTest test;
+    return QTest::qExec(&test, argc, argv);
+}
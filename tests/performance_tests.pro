@@ -29,6 +29,7 @@ SUBDIRS = \
     perf_conversationmodel \
     perf_groupmodel \
     perf_recentcontactsmodel \
+    perf_replay \
     profile_callmodel \
     profile_conversationmodel \
     profile_groupmodel \
@@ -0,0 +1,199 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jollamobile.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "stubcontactbackend.h"
+
+#include <QSet>
+#include <QTimer>
+
+#include <qtcontacts-extensions.h>
+
+#include <QContactOnlineAccount>
+#include <QContactPhoneNumber>
+
+#include "debug.h"
+
+namespace CommHistory {
+
+class StubContactBackendPrivate
+{
+public:
+    StubContactBackendPrivate()
+        : latency(0), resolveCount(0), nextId(0)
+    {
+        timer.setSingleShot(true);
+    }
+
+    ~StubContactBackendPrivate()
+    {
+        qDeleteAll(items);
+        qDeleteAll(removedItems);
+    }
+
+    void resolveNow(const Recipient &recipient)
+    {
+        const int id = contacts.value(recipient, 0);
+        recipient.setResolved(id ? items.value(id) : 0);
+        resolveCount++;
+    }
+
+    int latency;
+    int resolveCount;
+    int nextId;
+    QTimer timer;
+    QHash<int, SeasideCache::CacheItem *> items;
+    // Recipients may still refer to removed contacts
+    QList<SeasideCache::CacheItem *> removedItems;
+    // Recipient instances are shared by address, so this also matches
+    // equivalent phone numbers
+    QHash<Recipient, int> contacts;
+    QList<Recipient> pending;
+    QSet<Recipient> pendingSet;
+};
+
+}
+
+using namespace CommHistory;
+
+StubContactBackend::StubContactBackend(QObject *parent)
+    : ContactBackend(parent), d_ptr(new StubContactBackendPrivate)
+{
+    Q_D(StubContactBackend);
+    connect(&d->timer, SIGNAL(timeout()), SLOT(resolvePending()));
+}
+
+StubContactBackend::~StubContactBackend()
+{
+    delete d_ptr;
+}
+
+int StubContactBackend::latency() const
+{
+    Q_D(const StubContactBackend);
+    return d->latency;
+}
+
+void StubContactBackend::setLatency(int msecs)
+{
+    Q_D(StubContactBackend);
+    d->latency = qMax(0, msecs);
+}
+
+int StubContactBackend::resolveCount() const
+{
+    Q_D(const StubContactBackend);
+    return d->resolveCount;
+}
+
+int StubContactBackend::addContact(const QString &name, const RecipientList &addresses)
+{
+    Q_D(StubContactBackend);
+
+    QContact contact;
+    contact.setCollectionId(SeasideCache::aggregateCollectionId());
+    foreach (const Recipient &address, addresses) {
+        if (address.isPhoneNumber()) {
+            QContactPhoneNumber phoneNumber;
+            phoneNumber.setNumber(address.remoteUid());
+            contact.saveDetail(&phoneNumber);
+        } else {
+            QContactOnlineAccount account;
+            account.setAccountUri(address.remoteUid());
+            account.setValue(QContactOnlineAccount__FieldAccountPath, address.localUid());
+            contact.saveDetail(&account);
+        }
+    }
+
+    SeasideCache::CacheItem *item = new SeasideCache::CacheItem;
+    item->contact = contact;
+    item->iid = ++d->nextId;
+    item->displayLabel = name;
+    item->contactState = SeasideCache::ContactComplete;
+    d->items.insert(item->iid, item);
+
+    foreach (const Recipient &address, addresses)
+        d->contacts.insert(address, item->iid);
+
+    emit contactUpdated(item);
+    return item->iid;
+}
+
+void StubContactBackend::removeContact(int contactId)
+{
+    Q_D(StubContactBackend);
+
+    SeasideCache::CacheItem *item = d->items.value(contactId);
+    if (!item)
+        return;
+
+    emit contactAboutToBeRemoved(item);
+
+    d->items.remove(contactId);
+    for (QHash<Recipient, int>::iterator it = d->contacts.begin(); it != d->contacts.end(); ) {
+        if (it.value() == contactId)
+            it = d->contacts.erase(it);
+        else
+            ++it;
+    }
+    d->removedItems.append(item);
+}
+
+bool StubContactBackend::resolve(const Recipient &recipient)
+{
+    Q_D(StubContactBackend);
+
+    if (d->latency == 0) {
+        d->resolveNow(recipient);
+        return true;
+    }
+
+    // Requests during the interval are answered together when it ends
+    if (!d->pendingSet.contains(recipient)) {
+        d->pendingSet.insert(recipient);
+        d->pending.append(recipient);
+    }
+    if (!d->timer.isActive())
+        d->timer.start(d->latency);
+    return false;
+}
+
+SeasideCache::CacheItem *StubContactBackend::itemById(int contactId)
+{
+    Q_D(StubContactBackend);
+    return d->items.value(contactId);
+}
+
+void StubContactBackend::resolvePending()
+{
+    Q_D(StubContactBackend);
+
+    QList<Recipient> recipients;
+    recipients.swap(d->pending);
+    d->pendingSet.clear();
+
+    DEBUG() << Q_FUNC_INFO << recipients.size();
+
+    foreach (const Recipient &recipient, recipients)
+        d->resolveNow(recipient);
+
+    emit resolved(recipients);
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jollamobile.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_STUBCONTACTBACKEND_H
+#define COMMHISTORY_STUBCONTACTBACKEND_H
+
+#include "contactbackend.h"
+
+namespace CommHistory {
+
+class StubContactBackendPrivate;
+
+/* StubContactBackend resolves recipients against contacts kept in memory,
+ * without SeasideCache or a contacts database.
+ *
+ * Results are deterministic: with no latency, recipients are resolved within
+ * ContactResolver::add(). Otherwise, all recipients requested during the
+ * latency interval are resolved together when it ends, as with a cache that
+ * has to fetch contacts first. This is for tests and benchmarks measuring
+ * the library's own resolution work, and is not part of the library.
+ */
+class StubContactBackend : public ContactBackend
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(StubContactBackend)
+
+public:
+    explicit StubContactBackend(QObject *parent = 0);
+    ~StubContactBackend();
+
+    /* Delay in milliseconds before requested recipients are resolved */
+    int latency() const;
+    void setLatency(int msecs);
+
+    /* Add a contact matching the addresses and return its id. Recipients
+     * that were resolved to no contact are updated through ContactListener. */
+    int addContact(const QString &name, const RecipientList &addresses);
+
+    /* Remove a contact. Its recipients are resolved again. */
+    void removeContact(int contactId);
+
+    /* Number of recipients resolved so far */
+    int resolveCount() const;
+
+    bool resolve(const Recipient &recipient);
+    SeasideCache::CacheItem *itemById(int contactId);
+
+private slots:
+    void resolvePending();
+
+private:
+    StubContactBackendPrivate *d_ptr;
+};
+
+}
+
+#endif
@@ -31,5 +31,10 @@ SUBDIRS = \
     ut_groupmodel \
     ut_recentcontactsmodel \
     ut_singleeventmodel \
-    ut_recipienteventmodel
+    ut_commonutils \
+    ut_contactstatistics \
+    ut_callstatistics \
+    ut_contactbackend \
+    ut_recipienteventmodel \
+    ut_databaseio
 
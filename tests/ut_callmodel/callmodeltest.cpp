@@ -27,6 +27,7 @@
 #include "common.h"
 #include "modelwatcher.h"
 #include "databaseio.h"
+#include "event_p.h"
 
 using namespace CommHistory;
 
@@ -1189,6 +1190,102 @@ void CallModelTest::testContactGrouping()
     QCOMPARE(postModel.rowCount(), 3);
 }
 
+void CallModelTest::testLoadCopies_data()
+{
+    QTest::addColumn<bool>("treeMode");
+    QTest::addColumn<int>("sorting");
+
+    QTest::newRow("flat") << false << int(CallModel::SortByTime);
+    QTest::newRow("tree, by time") << true << int(CallModel::SortByTime);
+    QTest::newRow("tree, by contact") << true << int(CallModel::SortByContact);
+}
+
+void CallModelTest::testLoadCopies()
+{
+    QFETCH(bool, treeMode);
+    QFETCH(int, sorting);
+
+    deleteAll(false);
+
+    CallModel addModel;
+    watcher.setModel(&addModel);
+
+    QDateTime when = QDateTime::currentDateTime();
+    for (int i = 0; i < 3; i++)
+        addTestEvent(addModel, Event::CallEvent, Event::Inbound, ACCOUNT1, -1, "", false, true, when.addSecs(i), REMOTEUID1);
+    for (int i = 3; i < 5; i++)
+        addTestEvent(addModel, Event::CallEvent, Event::Outbound, ACCOUNT1, -1, "", false, false, when.addSecs(i), REMOTEUID2);
+    QVERIFY(watcher.waitForAdded(5));
+
+    CallModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    model.setResolveContacts(EventModel::DoNotResolve);
+    model.setTreeMode(treeMode);
+    QVERIFY(model.setFilter(static_cast<CallModel::Sorting>(sorting)));
+
+    // Loading should move the events read from the database into the
+    // model. Only the top level items of a tree, which carry their own
+    // event count, may detach from the grouped events.
+    setEventDataCopyCounting(true);
+    int copies = eventDataCopyCount();
+    QVERIFY(model.getEvents());
+    copies = eventDataCopyCount() - copies;
+    setEventDataCopyCounting(false);
+
+    if (treeMode) {
+        QCOMPARE(model.rowCount(), 2);
+        QCOMPARE(copies, model.rowCount());
+    } else {
+        QCOMPARE(model.rowCount(), 5);
+        QCOMPARE(copies, 0);
+    }
+}
+
+void CallModelTest::testSharedModels()
+{
+    deleteAll(false);
+
+    CallModel addModel;
+    watcher.setModel(&addModel);
+
+    QDateTime when = QDateTime::currentDateTime();
+    for (int i = 0; i < 2; i++)
+        addTestEvent(addModel, Event::CallEvent, Event::Inbound, ACCOUNT1, -1, "", false, true, when.addSecs(i), REMOTEUID1);
+    addTestEvent(addModel, Event::CallEvent, Event::Outbound, ACCOUNT1, -1, "", false, false, when.addSecs(2), REMOTEUID2);
+    QVERIFY(watcher.waitForAdded(3));
+
+    CallModel first;
+    first.setQueryMode(EventModel::SyncQuery);
+    first.setResolveContacts(EventModel::DoNotResolve);
+    QVERIFY(first.setFilter(CallModel::SortByContact));
+    QVERIFY(first.getEvents());
+    QCOMPARE(first.rowCount(), 2);
+
+    // The second model adopts the grouped rows and the ready state
+    CallModel second;
+    second.setQueryMode(EventModel::SyncQuery);
+    second.setResolveContacts(EventModel::DoNotResolve);
+    QVERIFY(second.setFilter(CallModel::SortByContact));
+    QSignalSpy modelReady(&second, &CallModel::modelReady);
+    QVERIFY(second.getEvents());
+    QCOMPARE(modelReady.count(), 1);
+    QVERIFY(second.isReady());
+    QCOMPARE(second.rowCount(), first.rowCount());
+
+    // Regrouping after a change is the same in both models
+    addTestEvent(addModel, Event::CallEvent, Event::Inbound, ACCOUNT1, -1, "", false, true, when.addSecs(3), REMOTEUID1);
+    QVERIFY(watcher.waitForAdded());
+    QTRY_COMPARE(first.event(first.index(0, 0)).eventCount(), 3);
+    QTRY_COMPARE(second.event(second.index(0, 0)).eventCount(), 3);
+    QCOMPARE(second.rowCount(), first.rowCount());
+    for (int row = 0; row < first.rowCount(); row++) {
+        QCOMPARE(second.event(second.index(row, 0)).id(),
+                 first.event(first.index(row, 0)).id());
+        QCOMPARE(second.event(second.index(row, 0)).eventCount(),
+                 first.event(first.index(row, 0)).eventCount());
+    }
+}
+
 void CallModelTest::cleanupTestCase()
 {
     deleteAll();
@@ -52,6 +52,9 @@ private slots:
     void testMinimizedPhone();
     void testMinimizedEmpty();
     void testContactGrouping();
+    void testLoadCopies_data();
+    void testLoadCopies();
+    void testSharedModels();
     void cleanupTestCase();
 
 private:
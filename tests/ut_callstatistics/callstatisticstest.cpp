@@ -0,0 +1,274 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "callstatisticstest.h"
+#include "callstatistics.h"
+#include "callhistory.h"
+#include "smshistory.h"
+#include "eventmodel.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+Group group1, group2;
+
+QDateTime utc(int month, int day, int hour = 0)
+{
+    return QDateTime(QDate(2020, month, day), QTime(hour, 0), Qt::UTC);
+}
+
+// Calls within the tested range
+const QDateTime receivedTime = utc(6, 3, 15);
+const QDateTime dialedTime = utc(6, 4, 9);
+const QDateTime missedTime = utc(6, 10, 9);
+const QDateTime lateReceivedTime = utc(6, 16, 9);
+
+// Starts within the first day, so the first result is dated at it
+const QDateTime rangeStart = utc(6, 3, 12);
+const QDateTime rangeEnd = utc(6, 20);
+
+const QDateTime smsTime = utc(7, 5, 9);
+
+// Calls in the week from Monday 2019-12-30, which %W splits at the new year
+const QDateTime yearEndTime(QDate(2019, 12, 31), QTime(9, 0), Qt::UTC);
+const QDateTime newYearTime(QDate(2020, 1, 2), QTime(9, 0), Qt::UTC);
+
+}
+
+void CallStatisticsTest::initTestCase()
+{
+    initTestDatabase();
+    addTestGroups(group1, group2);
+
+    EventModel model;
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "before", false, false, utc(6, 2, 9), "+15550001") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "received", false, false, receivedTime, "+15550001") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                         "dialed", false, false, dialedTime, "+15550002") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "missed", false, true, missedTime, "+15550003") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "received", false, false, lateReceivedTime, "+15550001") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                         "after", false, false, utc(7, 1, 9), "+15550002") != -1);
+    QVERIFY(addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group2.id(),
+                         "message", false, false, smsTime, "+15550004") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "year end", false, false, yearEndTime, "+15550001") != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "new year", false, false, newYearTime, "+15550001") != -1);
+}
+
+void CallStatisticsTest::statistics_data()
+{
+    QTest::addColumn<int>("timeInterval");
+    QTest::addColumn<int>("callType");
+    QTest::addColumn<QDateTime>("start");
+    QTest::addColumn<QDateTime>("end");
+    QTest::addColumn<QList<QDateTime> >("whens");
+    QTest::addColumn<QList<int> >("counts");
+
+    // Each day of the range, the first one dated at the start time
+    QList<QDateTime> days;
+    QList<int> dayCounts;
+    days << rangeStart;
+    for (QDateTime day = utc(6, 4); day <= rangeEnd; day = day.addDays(1))
+        days << day;
+    for (int i = 0; i < days.size(); i++)
+        dayCounts << 0;
+    dayCounts[0] = 1;
+    dayCounts[1] = 1;
+    dayCounts[7] = 1;
+    dayCounts[13] = 1;
+
+    QTest::newRow("daily") << int(CallStatistics::Daily) << int(CallEvent::UnknownCallType)
+        << rangeStart << rangeEnd << days << dayCounts;
+
+    // Weeks start on Monday, the first one at the start time
+    QTest::newRow("weekly") << int(CallStatistics::Weekly) << int(CallEvent::UnknownCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart << utc(6, 8) << utc(6, 15))
+        << (QList<int>() << 2 << 1 << 1);
+
+    // A week across the new year is counted in two parts
+    const QDateTime weekStart(QDate(2019, 12, 30), QTime(12, 0), Qt::UTC);
+    QTest::newRow("weekly, new year") << int(CallStatistics::Weekly) << int(CallEvent::UnknownCallType)
+        << weekStart << QDateTime(QDate(2020, 1, 7), QTime(0, 0), Qt::UTC)
+        << (QList<QDateTime>() << weekStart
+                               << QDateTime(QDate(2020, 1, 1), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2020, 1, 6), QTime(0, 0), Qt::UTC))
+        << (QList<int>() << 1 << 1 << 0);
+
+    QTest::newRow("monthly") << int(CallStatistics::Monthly) << int(CallEvent::UnknownCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart)
+        << (QList<int>() << 4);
+
+    QTest::newRow("monthly, two months") << int(CallStatistics::Monthly) << int(CallEvent::UnknownCallType)
+        << rangeStart << utc(7, 2)
+        << (QList<QDateTime>() << rangeStart << utc(7, 1))
+        << (QList<int>() << 4 << 1);
+
+    QTest::newRow("yearly") << int(CallStatistics::Yearly) << int(CallEvent::UnknownCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart)
+        << (QList<int>() << 4);
+
+    QTest::newRow("received") << int(CallStatistics::Monthly) << int(CallEvent::ReceivedCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart)
+        << (QList<int>() << 2);
+
+    QTest::newRow("missed") << int(CallStatistics::Monthly) << int(CallEvent::MissedCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart)
+        << (QList<int>() << 1);
+
+    QTest::newRow("dialed") << int(CallStatistics::Monthly) << int(CallEvent::DialedCallType)
+        << rangeStart << rangeEnd
+        << (QList<QDateTime>() << rangeStart)
+        << (QList<int>() << 1);
+
+    // Intervals are only filled in between a start and an end time
+    QTest::newRow("open end") << int(CallStatistics::Daily) << int(CallEvent::UnknownCallType)
+        << rangeStart << QDateTime()
+        << QList<QDateTime>() << QList<int>();
+}
+
+void CallStatisticsTest::statistics()
+{
+    QFETCH(int, timeInterval);
+    QFETCH(int, callType);
+    QFETCH(QDateTime, start);
+    QFETCH(QDateTime, end);
+    QFETCH(QList<QDateTime>, whens);
+    QFETCH(QList<int>, counts);
+
+    CallStatistics statistics;
+    statistics.setTimeInterval(static_cast<CallStatistics::TimeInterval>(timeInterval));
+    statistics.setCallType(static_cast<CallEvent::CallType>(callType));
+    statistics.setStartTime(start);
+    statistics.setEndTime(end);
+    QVERIFY(statistics.reload());
+
+    const QList<CallStatistics::Result> results = statistics.results();
+    QCOMPARE(results.size(), whens.size());
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].when, whens[i]);
+        QCOMPARE(results[i].callCount, counts[i]);
+    }
+}
+
+void CallStatisticsTest::noInterval()
+{
+    CallStatistics statistics;
+    statistics.setStartTime(rangeStart);
+    statistics.setEndTime(rangeEnd);
+    QVERIFY(statistics.reload());
+
+    // A single result, dated at one of the counted events
+    QList<CallStatistics::Result> results = statistics.results();
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].callCount, 4);
+    QVERIFY((QList<QDateTime>() << receivedTime << dialedTime << missedTime << lateReceivedTime)
+            .contains(results[0].when));
+
+    // Without events, at the epoch
+    statistics.setStartTime(utc(5, 1));
+    statistics.setEndTime(utc(5, 2));
+    QVERIFY(statistics.reload());
+    results = statistics.results();
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].callCount, 0);
+    QCOMPARE(results[0].when, QDateTime::fromMSecsSinceEpoch(0, Qt::UTC));
+
+    // The end must be after the start
+    statistics.setEndTime(utc(5, 1));
+    QVERIFY(!statistics.reload());
+}
+
+void CallStatisticsTest::callHistory()
+{
+    CallHistory history;
+    history.setStartTime(rangeStart);
+    history.setEndTime(rangeEnd);
+    QVERIFY(history.reload());
+
+    QList<CallHistory::Result> results = history.results();
+    QCOMPARE(results.size(), 4);
+    QCOMPARE(results[0].when, receivedTime);
+    QCOMPARE(results[0].finish, receivedTime.addSecs(TESTCALL_SECS));
+    QCOMPARE(results[0].phoneNumber, QString("+15550001"));
+    QCOMPARE(results[1].when, dialedTime);
+    QCOMPARE(results[1].phoneNumber, QString("+15550002"));
+    QCOMPARE(results[2].when, missedTime);
+    QCOMPARE(results[2].phoneNumber, QString("+15550003"));
+    QCOMPARE(results[3].when, lateReceivedTime);
+
+    history.setCallType(CallEvent::MissedCallType);
+    QVERIFY(history.reload());
+    results = history.results();
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].when, missedTime);
+
+    // Messages are not calls
+    history.setCallType(CallEvent::UnknownCallType);
+    history.setStartTime(utc(7, 2));
+    history.setEndTime(utc(7, 31));
+    QVERIFY(history.reload());
+    QVERIFY(history.results().isEmpty());
+
+    // Without an end time, up to now
+    history.setStartTime(utc(6, 16));
+    history.setEndTime(QDateTime());
+    QVERIFY(history.reload());
+    results = history.results();
+    QCOMPARE(results.size(), 2);
+    QCOMPARE(results[0].when, lateReceivedTime);
+    QCOMPARE(results[1].when, utc(7, 1, 9));
+}
+
+void CallStatisticsTest::smsHistory()
+{
+    SMSHistory history;
+    history.setStartTime(rangeStart);
+    history.setEndTime(utc(7, 31));
+    QVERIFY(history.reload());
+
+    const QList<SMSHistory::Result> results = history.results();
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].when, smsTime);
+    QCOMPARE(results[0].phoneNumber, QString("+15550004"));
+}
+
+void CallStatisticsTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+QTEST_MAIN(CallStatisticsTest)
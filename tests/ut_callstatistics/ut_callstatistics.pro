@@ -0,0 +1,8 @@
+include( ../../common-project-config.pri )
+include( ../../common-vars.pri )
+include( ../tests.pri )
+
+TARGET = ut_callstatistics
+QT -= gui
+SOURCES += callstatisticstest.cpp
+HEADERS += callstatisticstest.h
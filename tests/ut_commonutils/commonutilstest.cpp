@@ -0,0 +1,199 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <time.h>
+
+#include "commonutilstest.h"
+#include "commonutils.h"
+
+#include <qtcontacts-extensions.h>
+#include <qtcontacts-extensions_impl.h>
+
+using namespace CommHistory;
+
+namespace {
+
+const QString PHONE_ACCOUNT = RING_ACCOUNT + QLatin1String("/account0");
+
+QString referenceMinimize(const QString &number)
+{
+    return QtContactsSqliteExtensions::minimizePhoneNumber(number, QtContactsSqliteExtensions::DefaultMaximumPhoneNumberCharacters);
+}
+
+// remoteAddressMatch() for minimized comparisons, as it was before the
+// fast path
+bool referenceMatch(const QString &uid, const QString &match)
+{
+    QString phone = referenceMinimize(uid);
+    QString phoneMatch = referenceMinimize(match);
+    if (phone.isEmpty())
+        phone = uid;
+    if (phoneMatch.isEmpty())
+        phoneMatch = match;
+    return phoneMatch.compare(phone, Qt::CaseInsensitive) == 0;
+}
+
+// Every string of up to maxLength characters from alphabet
+QStringList allStrings(const QString &alphabet, int maxLength)
+{
+    QStringList result;
+    result << QString();
+    QStringList previous = result;
+    for (int length = 1; length <= maxLength; length++) {
+        QStringList next;
+        foreach (const QString &prefix, previous) {
+            foreach (const QChar &c, alphabet)
+                next << prefix + c;
+        }
+        result << next;
+        previous = next;
+    }
+    return result;
+}
+
+}
+
+void CommonUtilsTest::minimizeDigits()
+{
+    // Plain numbers of every length, across the SIMD block sizes, with and
+    // without a leading '+'
+    QString digits;
+    for (int length = 0; length <= 70; length++) {
+        QString number = digits;
+        QCOMPARE(minimizePhoneNumber(number), referenceMinimize(number));
+        QCOMPARE(minimizePhoneNumber('+' + number), referenceMinimize('+' + number));
+
+        // A single unusual character anywhere takes the normal path
+        for (int i = 0; i < number.size(); i++) {
+            foreach (const QChar &c, QString::fromUtf8(" -+#*pxa/:\xd9\xa3\xef\xbc\x91")) {
+                QString changed = number;
+                changed[i] = c;
+                QCOMPARE(minimizePhoneNumber(changed), referenceMinimize(changed));
+            }
+        }
+
+        digits += QChar('0' + (length * 7) % 10);
+    }
+}
+
+void CommonUtilsTest::minimizeExhaustive()
+{
+    foreach (const QString &number, allStrings(QLatin1String("09+ #a"), 6))
+        QCOMPARE(minimizePhoneNumber(number), referenceMinimize(number));
+
+    foreach (const QString &number, allStrings(QLatin1String("19+"), 10))
+        QCOMPARE(minimizePhoneNumber(number), referenceMinimize(number));
+}
+
+void CommonUtilsTest::matchExhaustive()
+{
+    QStringList numbers = allStrings(QLatin1String("01+-"), 4);
+    numbers << "0401234567" << "+358401234567" << "+358 40 1234567" << "0401234568"
+            << "+3584012345678" << "40123456" << "+4012345" << "4012345" << "user@example.com";
+
+    foreach (const QString &uid, numbers) {
+        foreach (const QString &match, numbers) {
+            QCOMPARE(remoteAddressMatch(PHONE_ACCOUNT, uid, match, true), referenceMatch(uid, match));
+        }
+    }
+}
+
+void CommonUtilsTest::minimizeBenchmark_data()
+{
+    QTest::addColumn<bool>("reference");
+    QTest::addColumn<QString>("number");
+
+    QTest::newRow("reference, local") << true << "0401234567";
+    QTest::newRow("fast, local") << false << "0401234567";
+    QTest::newRow("reference, international") << true << "+358401234567";
+    QTest::newRow("fast, international") << false << "+358401234567";
+    QTest::newRow("reference, formatted") << true << "+358 (40) 123-4567";
+    QTest::newRow("fast, formatted") << false << "+358 (40) 123-4567";
+}
+
+void CommonUtilsTest::minimizeBenchmark()
+{
+    QFETCH(bool, reference);
+    QFETCH(QString, number);
+
+    QString other = number;
+    other[other.size() - 1] = QChar('8');
+
+    if (reference) {
+        QBENCHMARK {
+            referenceMinimize(number);
+            referenceMatch(number, other);
+        }
+    } else {
+        QBENCHMARK {
+            minimizePhoneNumber(number);
+            remoteAddressMatch(PHONE_ACCOUNT, number, other, true);
+        }
+    }
+}
+
+void CommonUtilsTest::localDateHours_data()
+{
+    QTest::addColumn<QByteArray>("zone");
+    QTest::addColumn<QDateTime>("from");
+    QTest::addColumn<int>("days");
+
+    // Finnish time, with DST changes at 03:00 and 04:00 local time
+    const QByteArray eet("EET-2EEST,M3.5.0/3,M10.5.0/4");
+    // DST changes at midnight, as in Brazil until 2019: there is no midnight
+    // on the day summer time starts, and two on the day it ends
+    const QByteArray midnight("<-03>3<-02>,M10.3.0/0,M2.3.0/0");
+
+    // Rows are in different years, so that days cached for another zone
+    // are never looked up
+    QTest::newRow("eet, year") << eet << QDateTime(QDate(2019, 1, 1), QTime(0, 0), Qt::UTC) << 365;
+    QTest::newRow("eet, summer time") << eet << QDateTime(QDate(2020, 3, 27), QTime(0, 0), Qt::UTC) << 4;
+    QTest::newRow("eet, winter time") << eet << QDateTime(QDate(2020, 10, 23), QTime(0, 0), Qt::UTC) << 4;
+    QTest::newRow("midnight, summer time") << midnight << QDateTime(QDate(2021, 10, 15), QTime(0, 0), Qt::UTC) << 4;
+    QTest::newRow("midnight, winter time") << midnight << QDateTime(QDate(2022, 2, 18), QTime(0, 0), Qt::UTC) << 4;
+}
+
+void CommonUtilsTest::localDateHours()
+{
+    QFETCH(QByteArray, zone);
+    QFETCH(QDateTime, from);
+    QFETCH(int, days);
+
+    qputenv("TZ", zone);
+    tzset();
+
+    // Steps forwards and backwards cross every day boundary and DST change
+    // from both sides of the cached days, in quarter hours around the
+    // changes
+    const quint32 start = from.toTime_t();
+    const quint32 end = start + days * 24 * 3600;
+    const quint32 step = days > 7 ? 3600 : 900;
+
+    for (quint32 t = start; t < end; t += step)
+        QCOMPARE(localDate(t), QDateTime::fromTime_t(t).date());
+    for (quint32 t = end; t > start; t -= step - 1)
+        QCOMPARE(localDate(t), QDateTime::fromTime_t(t).date());
+}
+
+QTEST_MAIN(CommonUtilsTest)
@@ -0,0 +1,8 @@
+include( ../../common-project-config.pri )
+include( ../../common-vars.pri )
+include( ../tests.pri )
+
+TARGET = ut_commonutils
+QT -= gui
+SOURCES += commonutilstest.cpp
+HEADERS += commonutilstest.h
@@ -0,0 +1,145 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "contactbackendtest.h"
+#include "stubcontactbackend.h"
+#include "contactresolver.h"
+#include "contactlistener.h"
+#include "commonutils.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+void ContactBackendTest::initTestCase()
+{
+    // Resolvers and the listener use the backend installed when they are
+    // created, so it has to be installed before anything is resolved
+    backend = new StubContactBackend(this);
+    ContactBackend::setInstance(backend);
+    QCOMPARE(ContactBackend::instance(), static_cast<ContactBackend *>(backend));
+
+    listener = ContactListener::instance();
+}
+
+void ContactBackendTest::resolveImmediately()
+{
+    Recipient known(RING_ACCOUNT, QStringLiteral("+358401000001"));
+    Recipient unknown(RING_ACCOUNT, QStringLiteral("+358401000002"));
+    const int contactId = backend->addContact(QStringLiteral("Known"), RecipientList(known));
+    QVERIFY(contactId > 0);
+
+    const int resolveCount = backend->resolveCount();
+    ContactResolver resolver(0);
+    QSignalSpy finished(&resolver, SIGNAL(finished()));
+    resolver.add(RecipientList() << known << unknown);
+
+    // Without latency, the stub resolves within add()
+    QCOMPARE(backend->resolveCount(), resolveCount + 2);
+
+    QVERIFY(known.isContactResolved());
+    QCOMPARE(known.contactId(), contactId);
+    QCOMPARE(known.contactName(), QStringLiteral("Known"));
+
+    QVERIFY(unknown.isContactResolved());
+    QCOMPARE(unknown.contactId(), 0);
+    QTRY_COMPARE(finished.count(), 1);
+
+    // Recipients of the same address share the resolved contact
+    Recipient same(RING_ACCOUNT, QStringLiteral("+358401000001"));
+    QVERIFY(same.isContactResolved());
+    QCOMPARE(same.contactId(), contactId);
+}
+
+void ContactBackendTest::resolveWithLatency()
+{
+    backend->setLatency(50);
+
+    Recipient first(RING_ACCOUNT, QStringLiteral("+358401000011"));
+    Recipient second(RING_ACCOUNT, QStringLiteral("+358401000012"));
+    const int contactId = backend->addContact(QStringLiteral("Delayed"), RecipientList(first));
+
+    ContactResolver resolver(0);
+    QSignalSpy finished(&resolver, SIGNAL(finished()));
+    resolver.add(RecipientList() << first << second);
+
+    // Resolved together when the latency interval ends
+    QVERIFY(resolver.isResolving());
+    QVERIFY(!first.isContactResolved());
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(!resolver.isResolving());
+
+    QVERIFY(first.isContactResolved());
+    QCOMPARE(first.contactId(), contactId);
+    QCOMPARE(first.contactName(), QStringLiteral("Delayed"));
+    QVERIFY(second.isContactResolved());
+    QCOMPARE(second.contactId(), 0);
+
+    backend->setLatency(0);
+}
+
+void ContactBackendTest::fromContact()
+{
+    Recipient phone(RING_ACCOUNT, QStringLiteral("+358401000021"));
+    Recipient im(ACCOUNT1, QStringLiteral("stub@localhost"));
+    const int contactId = backend->addContact(QStringLiteral("Addresses"),
+                                              RecipientList() << phone << im);
+
+    // The addresses of a contact are read from the backend's item
+    RecipientList addresses = RecipientList::fromContact(contactId);
+    QCOMPARE(addresses.size(), 2);
+    QVERIFY(addresses.contains(phone));
+    QVERIFY(addresses.contains(im));
+
+    QVERIFY(RecipientList::fromContact(contactId + 1000).isEmpty());
+}
+
+void ContactBackendTest::contactChanges()
+{
+    Recipient recipient(RING_ACCOUNT, QStringLiteral("+358401000031"));
+    ContactResolver resolver(0);
+    resolver.add(recipient);
+    QVERIFY(recipient.isContactResolved());
+    QCOMPARE(recipient.contactId(), 0);
+
+    // Adding a matching contact updates recipients that had none
+    QSignalSpy contactChanged(listener.data(), SIGNAL(contactChanged(RecipientList)));
+    const int contactId = backend->addContact(QStringLiteral("Added"), RecipientList(recipient));
+    QTRY_VERIFY(contactChanged.count() > 0);
+    QCOMPARE(recipient.contactId(), contactId);
+    QCOMPARE(recipient.contactName(), QStringLiteral("Added"));
+
+    // Removing it leaves them without a contact again
+    contactChanged.clear();
+    backend->removeContact(contactId);
+    QTRY_VERIFY(contactChanged.count() > 0);
+    QCOMPARE(recipient.contactId(), 0);
+    QVERIFY(!backend->itemById(contactId));
+}
+
+void ContactBackendTest::cleanupTestCase()
+{
+    listener.clear();
+}
+
+QTEST_MAIN(ContactBackendTest)
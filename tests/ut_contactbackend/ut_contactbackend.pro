@@ -0,0 +1,8 @@
+include( ../../common-project-config.pri )
+include( ../../common-vars.pri )
+include( ../tests.pri )
+
+TARGET = ut_contactbackend
+QT -= gui
+SOURCES += contactbackendtest.cpp ../stubcontactbackend.cpp
+HEADERS += contactbackendtest.h ../stubcontactbackend.h
@@ -0,0 +1,516 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include <time.h>
+
+#include "contactstatisticstest.h"
+#include "contactstatistics.h"
+#include "commhistorydatabase.h"
+#include "databaseio.h"
+#include "eventmodel.h"
+#include "commonutils.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+Group group1, group2;
+
+// Noon UTC of the first test day
+const QDateTime testDay(QDate(2020, 3, 1), QTime(12, 0), Qt::UTC);
+
+// Years of the events for the interval, top-K and recipient tests, apart
+// from the events of the other tests
+const QDateTime intervalYear(QDate(2022, 1, 1), QTime(0, 0), Qt::UTC);
+const QDateTime topYear(QDate(2023, 1, 1), QTime(0, 0), Qt::UTC);
+const QDateTime recipientYear(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+
+// What the ContactActivity rollup should contain, from the events
+const QString eventActivity = QString::fromLatin1(
+    "SELECT IFNULL(localUid, ''), IFNULL(remoteUid, ''), IFNULL(startTime, 0) / 86400, type, direction, "
+    "  COUNT(*), SUM(IFNULL(isMissedCall, 0) != 0), "
+    "  SUM(CASE WHEN type = %1 THEN MAX(IFNULL(endTime, 0) - IFNULL(startTime, 0), 0) ELSE 0 END) "
+    "FROM Events WHERE IFNULL(isDraft, 0) = 0 GROUP BY 1, 2, 3, 4, 5").arg(Event::CallEvent);
+
+const QString rollupActivity = QString::fromLatin1(
+    "SELECT localUid, remoteUid, day, type, direction, eventCount, missedCount, duration "
+    "FROM ContactActivity");
+
+int missingRows(const QSqlDatabase &database, const QString &rows, const QString &from)
+{
+    QSqlQuery query(database);
+    const QString q = QString::fromLatin1("SELECT COUNT(*) FROM (SELECT * FROM (%1) EXCEPT SELECT * FROM (%2))")
+            .arg(rows, from);
+    if (!query.exec(q) || !query.next()) {
+        qWarning() << query.lastError();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+bool execute(QSqlDatabase &database, const char *statement)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QLatin1String(statement))) {
+        qWarning() << query.lastError() << statement;
+        return false;
+    }
+    return true;
+}
+
+// The statistics of ContactStatistics, computed from the events alone
+QList<ContactStatistics::Result> scanResults(const QSqlDatabase &database, const QDateTime &start,
+                                             const QDateTime &end)
+{
+    QString q = QString::fromLatin1(
+            "SELECT IFNULL(localUid, ''), IFNULL(remoteUid, ''), COUNT(*), "
+            "  SUM(type IN (%1, %2, %3, %4)), SUM(type = %5), "
+            "  SUM(type = %5 AND IFNULL(isMissedCall, 0) != 0), "
+            "  SUM(CASE WHEN type = %5 THEN MAX(IFNULL(endTime, 0) - IFNULL(startTime, 0), 0) ELSE 0 END) "
+            "FROM Events WHERE IFNULL(isDraft, 0) = 0")
+            .arg(Event::IMEvent).arg(Event::SMSEvent).arg(Event::MMSEvent).arg(Event::ClassZeroSMSEvent)
+            .arg(Event::CallEvent);
+    if (start.isValid())
+        q += QLatin1String(" AND startTime >= ?");
+    if (end.isValid())
+        q += QLatin1String(" AND startTime < ?");
+    q += QLatin1String(" GROUP BY 1, 2 ORDER BY 1, 2");
+
+    QSqlQuery query(database);
+    query.prepare(q);
+    if (start.isValid())
+        query.addBindValue(start.toMSecsSinceEpoch() / 1000);
+    if (end.isValid())
+        query.addBindValue(end.toMSecsSinceEpoch() / 1000);
+
+    QList<ContactStatistics::Result> results;
+    if (!query.exec()) {
+        qWarning() << query.lastError();
+        return results;
+    }
+    while (query.next()) {
+        ContactStatistics::Result result;
+        result.localUid = query.value(0).toString();
+        result.remoteUid = query.value(1).toString();
+        result.eventCount = query.value(2).toInt();
+        result.messageCount = query.value(3).toInt();
+        result.callCount = query.value(4).toInt();
+        result.missedCallCount = query.value(5).toInt();
+        result.callDuration = query.value(6).toLongLong();
+        results.append(result);
+    }
+    return results;
+}
+
+int addCall(EventModel &model, const QString &remoteUid, const QDateTime &when, int duration)
+{
+    int id = addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                          "call", false, false, when, remoteUid);
+    Event call;
+    if (id == -1 || !DatabaseIO::instance()->getEvent(id, call))
+        return -1;
+    call.setEndTime(when.addSecs(duration));
+    return model.modifyEvent(call) ? id : -1;
+}
+
+QStringList remoteUids(const QList<ContactStatistics::Result> &results)
+{
+    QStringList uids;
+    foreach (const ContactStatistics::Result &result, results)
+        uids << result.remoteUid;
+    return uids;
+}
+
+}
+
+void ContactStatisticsTest::initTestCase()
+{
+    // Local midnights must not fall on UTC day boundaries
+    qputenv("TZ", "IST-5:30");
+    tzset();
+
+    initTestDatabase();
+    addTestGroups(group1, group2);
+
+    database = CommHistoryDatabase::open(QLatin1String("ut_contactstatistics"));
+    QVERIFY(database.isOpen());
+
+    EventModel model;
+
+    // Two days of one week, the next week and a day of the next month
+    const QList<QDateTime> days = QList<QDateTime>()
+            << QDateTime(QDate(2022, 1, 3), QTime(10, 0), Qt::UTC)
+            << QDateTime(QDate(2022, 1, 4), QTime(10, 0), Qt::UTC)
+            << QDateTime(QDate(2022, 1, 10), QTime(23, 30), Qt::UTC)
+            << QDateTime(QDate(2022, 2, 1), QTime(0, 30), Qt::UTC);
+    foreach (const QDateTime &day, days) {
+        QVERIFY(addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                             "interval", false, false, day, "interval@localhost") != -1);
+    }
+
+    // Contacts with the most events and the longest calls differ
+    const QDateTime top = topYear.addMonths(5);
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                             "top", false, false, top.addSecs(i), "a@localhost") != -1);
+    }
+    QVERIFY(addCall(model, "b@localhost", top, 100) != -1);
+    QVERIFY(addCall(model, "b@localhost", top.addDays(1), 200) != -1);
+    QVERIFY(addCall(model, "c@localhost", top, 600) != -1);
+    QVERIFY(addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "top", false, false, top, "d@localhost") != -1);
+
+    // Numbers that match loosely, and ones that only share digits
+    const QDateTime numbers = recipientYear.addMonths(5);
+    const QStringList remoteUids = QStringList() << "+358401234567" << "0401234567"
+                                                 << "+3584012345678" << "0401234568";
+    foreach (const QString &remoteUid, remoteUids) {
+        QVERIFY(addTestEvent(model, Event::SMSEvent, Event::Inbound, RING_ACCOUNT, group1.id(),
+                             "number", false, false, numbers, remoteUid) != -1);
+    }
+}
+
+bool ContactStatisticsTest::rollupMatchesEvents()
+{
+    const int missing = missingRows(database, eventActivity, rollupActivity);
+    const int extra = missingRows(database, rollupActivity, eventActivity);
+    if (missing || extra) {
+        qWarning() << "ContactActivity is missing" << missing << "rows and has" << extra << "extra rows";
+        return false;
+    }
+    return true;
+}
+
+void ContactStatisticsTest::rollupTriggers()
+{
+    EventModel model;
+
+    int callId = addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                              "call", false, false, testDay, "td@localhost");
+    QVERIFY(callId != -1);
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                         "missed", false, true, testDay.addSecs(60), "td@localhost") != -1);
+    QVERIFY(addTestEvent(model, Event::IMEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                         "message", false, false, testDay.addDays(1), "td@localhost") != -1);
+    int draftId = addTestEvent(model, Event::IMEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                               "draft", true, false, testDay.addDays(1), "td@localhost");
+    QVERIFY(draftId != -1);
+    QVERIFY(rollupMatchesEvents());
+
+    // Properties not in the rollup
+    Event partial;
+    partial.setId(callId);
+    partial.setIsRead(true);
+    QVERIFY(model.modifyEvent(partial));
+    QVERIFY(rollupMatchesEvents());
+
+    // Another day and duration
+    Event call;
+    QVERIFY(DatabaseIO::instance()->getEvent(callId, call));
+    call.setStartTime(testDay.addDays(2));
+    call.setEndTime(testDay.addDays(2).addSecs(30));
+    QVERIFY(model.modifyEvent(call));
+    QVERIFY(rollupMatchesEvents());
+
+    call.setIsMissedCall(true);
+    QVERIFY(model.modifyEvent(call));
+    QVERIFY(rollupMatchesEvents());
+
+    Event draft;
+    QVERIFY(DatabaseIO::instance()->getEvent(draftId, draft));
+    draft.setIsDraft(false);
+    QVERIFY(model.modifyEvent(draft));
+    QVERIFY(rollupMatchesEvents());
+
+    QVERIFY(model.moveEvent(draft, group2.id()));
+    QVERIFY(rollupMatchesEvents());
+
+    QVERIFY(model.deleteEvent(callId));
+    QVERIFY(rollupMatchesEvents());
+}
+
+void ContactStatisticsTest::ranges_data()
+{
+    QTest::addColumn<QDateTime>("start");
+    QTest::addColumn<QDateTime>("end");
+
+    const QDateTime localMidnight(testDay.date(), QTime(0, 0), Qt::LocalTime);
+    const QDateTime utcMidnight(testDay.date(), QTime(0, 0), Qt::UTC);
+
+    QTest::newRow("all") << QDateTime() << QDateTime();
+    QTest::newRow("utc days") << utcMidnight << utcMidnight.addDays(3);
+    QTest::newRow("local days") << localMidnight << localMidnight.addDays(3);
+    QTest::newRow("from local day") << localMidnight.addDays(1) << QDateTime();
+    QTest::newRow("until local day") << QDateTime() << localMidnight.addDays(2);
+    QTest::newRow("within a day") << testDay.addSecs(-3600) << testDay.addSecs(3600);
+}
+
+void ContactStatisticsTest::ranges()
+{
+    QFETCH(QDateTime, start);
+    QFETCH(QDateTime, end);
+
+    // Events close to the UTC and local midnights of each day
+    EventModel model;
+    for (int day = -1; day < 4; day++) {
+        const QDateTime utcMidnight = testDay.addDays(day).addSecs(-12 * 3600);
+        const QDateTime localMidnight(testDay.date().addDays(day), QTime(0, 0), Qt::LocalTime);
+        QVERIFY(addTestEvent(model, Event::CallEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                             "call", false, false, utcMidnight.addSecs(60), "td@localhost") != -1);
+        QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                             "missed", false, true, localMidnight.addSecs(-60), "td@localhost") != -1);
+        QVERIFY(addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group2.id(),
+                             "message", false, false, localMidnight.addSecs(60), "td2@localhost") != -1);
+    }
+
+    ContactStatistics statistics;
+    statistics.setStartTime(start);
+    statistics.setEndTime(end);
+    QVERIFY(statistics.reload());
+
+    const QList<ContactStatistics::Result> results = statistics.results();
+    const QList<ContactStatistics::Result> expected = scanResults(database, start, end);
+    QVERIFY(!expected.isEmpty());
+    QCOMPARE(results.size(), expected.size());
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].localUid, expected[i].localUid);
+        QCOMPARE(results[i].remoteUid, expected[i].remoteUid);
+        QCOMPARE(results[i].eventCount, expected[i].eventCount);
+        QCOMPARE(results[i].messageCount, expected[i].messageCount);
+        QCOMPARE(results[i].callCount, expected[i].callCount);
+        QCOMPARE(results[i].missedCallCount, expected[i].missedCallCount);
+        QCOMPARE(results[i].callDuration, expected[i].callDuration);
+    }
+}
+
+void ContactStatisticsTest::backfill()
+{
+    EventModel model;
+    int oldId = addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                             "old", false, false, testDay, "td@localhost");
+    QVERIFY(oldId != -1);
+
+    // As after db_upgrade_5, existing events are left to the backfill
+    QVERIFY(execute(database, "BEGIN"));
+    QVERIFY(execute(database, "DELETE FROM ContactActivity"));
+    QVERIFY(execute(database, "UPDATE Migrations SET watermark = 0, "
+                              "target = (SELECT IFNULL(MAX(id), 0) FROM Events), finished = 0 "
+                              "WHERE name = 'contact_activity'"));
+    QVERIFY(execute(database, "COMMIT"));
+
+    // Changes to events not yet backfilled are ignored by the triggers,
+    // newer events are counted as usual
+    Event old;
+    QVERIFY(DatabaseIO::instance()->getEvent(oldId, old));
+    old.setStartTime(testDay.addDays(1));
+    QVERIFY(model.modifyEvent(old));
+    QVERIFY(addTestEvent(model, Event::CallEvent, Event::Outbound, ACCOUNT1, group1.id(),
+                         "new", false, false, testDay.addDays(1), "td@localhost") != -1);
+
+    bool finished = false;
+    for (int batches = 0; !finished && batches < 1000; batches++)
+        QVERIFY(CommHistoryDatabase::runMigrationBatch(database, 3, &finished));
+    QVERIFY(finished);
+    QVERIFY(rollupMatchesEvents());
+}
+
+void ContactStatisticsTest::intervals_data()
+{
+    QTest::addColumn<int>("timeInterval");
+    QTest::addColumn<QList<QDateTime> >("buckets");
+    QTest::addColumn<QList<int> >("counts");
+
+    QTest::newRow("daily") << int(ContactStatistics::Daily)
+        << (QList<QDateTime>() << QDateTime(QDate(2022, 1, 3), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 1, 4), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 1, 10), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 2, 1), QTime(0, 0), Qt::UTC))
+        << (QList<int>() << 1 << 1 << 1 << 1);
+    // Weeks start on the Monday, 2022-02-01 is a Tuesday
+    QTest::newRow("weekly") << int(ContactStatistics::Weekly)
+        << (QList<QDateTime>() << QDateTime(QDate(2022, 1, 3), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 1, 10), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 1, 31), QTime(0, 0), Qt::UTC))
+        << (QList<int>() << 2 << 1 << 1);
+    QTest::newRow("monthly") << int(ContactStatistics::Monthly)
+        << (QList<QDateTime>() << QDateTime(QDate(2022, 1, 1), QTime(0, 0), Qt::UTC)
+                               << QDateTime(QDate(2022, 2, 1), QTime(0, 0), Qt::UTC))
+        << (QList<int>() << 3 << 1);
+    QTest::newRow("yearly") << int(ContactStatistics::Yearly)
+        << (QList<QDateTime>() << intervalYear)
+        << (QList<int>() << 4);
+    QTest::newRow("none") << int(ContactStatistics::NoTimeInterval)
+        << (QList<QDateTime>() << intervalYear)
+        << (QList<int>() << 4);
+}
+
+void ContactStatisticsTest::intervals()
+{
+    QFETCH(int, timeInterval);
+    QFETCH(QList<QDateTime>, buckets);
+    QFETCH(QList<int>, counts);
+
+    ContactStatistics statistics;
+    statistics.setStartTime(intervalYear);
+    statistics.setEndTime(intervalYear.addYears(1));
+    statistics.setTimeInterval(static_cast<ContactStatistics::TimeInterval>(timeInterval));
+    QVERIFY(statistics.reload());
+
+    const QList<ContactStatistics::Result> results = statistics.results();
+    QCOMPARE(results.size(), buckets.size());
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].remoteUid, QString("interval@localhost"));
+        QCOMPARE(results[i].when, buckets[i]);
+        QCOMPARE(results[i].eventCount, counts[i]);
+        QCOMPARE(results[i].messageCount, counts[i]);
+    }
+}
+
+void ContactStatisticsTest::topK_data()
+{
+    QTest::addColumn<int>("sortOrder");
+    QTest::addColumn<int>("limit");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("count, top 2") << int(ContactStatistics::SortByEventCount) << 2
+        << (QStringList() << "a@localhost" << "b@localhost");
+    QTest::newRow("count, all") << int(ContactStatistics::SortByEventCount) << 0
+        << (QStringList() << "a@localhost" << "b@localhost" << "c@localhost" << "d@localhost");
+    QTest::newRow("duration, top 2") << int(ContactStatistics::SortByCallDuration) << 2
+        << (QStringList() << "c@localhost" << "b@localhost");
+    // Without calls, by event count
+    QTest::newRow("duration, all") << int(ContactStatistics::SortByCallDuration) << 0
+        << (QStringList() << "c@localhost" << "b@localhost" << "a@localhost" << "d@localhost");
+    QTest::newRow("recipient, top 3") << int(ContactStatistics::SortByRecipient) << 3
+        << (QStringList() << "a@localhost" << "b@localhost" << "c@localhost");
+}
+
+void ContactStatisticsTest::topK()
+{
+    QFETCH(int, sortOrder);
+    QFETCH(int, limit);
+    QFETCH(QStringList, expected);
+
+    ContactStatistics statistics;
+    statistics.setStartTime(topYear);
+    statistics.setEndTime(topYear.addYears(1));
+    statistics.setSortOrder(static_cast<ContactStatistics::SortOrder>(sortOrder));
+    statistics.setLimit(limit);
+    QVERIFY(statistics.reload());
+
+    const QList<ContactStatistics::Result> results = statistics.results();
+    QCOMPARE(remoteUids(results), expected);
+    foreach (const ContactStatistics::Result &result, results) {
+        if (result.remoteUid == "a@localhost") {
+            QCOMPARE(result.eventCount, 3);
+            QCOMPARE(result.messageCount, 3);
+        } else if (result.remoteUid == "b@localhost") {
+            QCOMPARE(result.callCount, 2);
+            QCOMPARE(result.callDuration, qint64(300));
+        } else if (result.remoteUid == "c@localhost") {
+            QCOMPARE(result.callCount, 1);
+            QCOMPARE(result.callDuration, qint64(600));
+        }
+    }
+}
+
+void ContactStatisticsTest::recipient()
+{
+    ContactStatistics statistics;
+    statistics.setStartTime(recipientYear);
+    statistics.setEndTime(recipientYear.addYears(1));
+    QVERIFY(statistics.reload());
+    QCOMPARE(statistics.results().size(), 4);
+
+    // Numbers containing the minimized number are only candidates
+    statistics.setRecipient(Recipient(RING_ACCOUNT, "+358401234567"));
+    QVERIFY(statistics.reload());
+    QCOMPARE(remoteUids(statistics.results()), QStringList() << "+358401234567" << "0401234567");
+
+    statistics.setRecipient(Recipient(RING_ACCOUNT, "0401234567"));
+    QVERIFY(statistics.reload());
+    QCOMPARE(remoteUids(statistics.results()), QStringList() << "+358401234567" << "0401234567");
+
+    // The limit counts matching rows only
+    statistics.setLimit(1);
+    QVERIFY(statistics.reload());
+    QCOMPARE(remoteUids(statistics.results()), QStringList() << "+358401234567");
+
+    // Other addresses are compared as they are
+    statistics.setLimit(0);
+    statistics.setStartTime(topYear);
+    statistics.setEndTime(topYear.addYears(1));
+    statistics.setRecipient(Recipient(ACCOUNT1, "b@localhost"));
+    QVERIFY(statistics.reload());
+    QCOMPARE(remoteUids(statistics.results()), QStringList() << "b@localhost");
+}
+
+void ContactStatisticsTest::streaming()
+{
+    ContactStatistics statistics;
+    statistics.setStartTime(topYear);
+    statistics.setEndTime(topYear.addYears(1));
+    statistics.setSortOrder(ContactStatistics::SortByEventCount);
+    QVERIFY(statistics.reload());
+    const QList<ContactStatistics::Result> expected = statistics.results();
+    QCOMPARE(expected.size(), 4);
+
+    // Rows one at a time, as reload() reads them
+    QVERIFY(statistics.open());
+    ContactStatistics::Result result;
+    for (int i = 0; i < expected.size(); i++) {
+        QVERIFY(statistics.next(result));
+        QCOMPARE(result.remoteUid, expected[i].remoteUid);
+        QCOMPARE(result.eventCount, expected[i].eventCount);
+        QCOMPARE(result.callDuration, expected[i].callDuration);
+    }
+    QVERIFY(!statistics.next(result));
+    QVERIFY(!statistics.next(result));
+
+    statistics.setLimit(2);
+    QVERIFY(statistics.open());
+    QVERIFY(statistics.next(result));
+    QVERIFY(statistics.next(result));
+    QCOMPARE(result.remoteUid, expected[1].remoteUid);
+    QVERIFY(!statistics.next(result));
+
+    // Reading can stop before the last row
+    statistics.setLimit(0);
+    QVERIFY(statistics.open());
+    QVERIFY(statistics.next(result));
+    QCOMPARE(result.remoteUid, expected[0].remoteUid);
+    statistics.close();
+    QVERIFY(!statistics.next(result));
+}
+
+void ContactStatisticsTest::cleanupTestCase()
+{
+    database.close();
+    deleteAll();
+}
+
+QTEST_MAIN(ContactStatisticsTest)
@@ -0,0 +1,13 @@
+include( ../../common-project-config.pri )
+include( ../../common-vars.pri )
+include( ../tests.pri )
+
+TARGET = ut_contactstatistics
+QT -= gui
+SOURCES += contactstatisticstest.cpp
+HEADERS += contactstatisticstest.h
+
+# Runs the migrations on a connection of its own
+QT += sql
+SOURCES += ../../src/commhistorydatabase.cpp
+HEADERS += ../../src/commhistorydatabase.h
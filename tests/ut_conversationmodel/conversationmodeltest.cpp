@@ -24,6 +24,7 @@
 #include <QDBusConnection>
 #include "conversationmodeltest.h"
 #include "groupmodel.h"
+#include "groupmanager.h"
 #include "conversationmodel.h"
 #include "adaptor.h"
 #include "event.h"
@@ -389,6 +390,133 @@ void ConversationModelTest::sorting()
     QCOMPARE(conv.event(conv.index(4, 0)).freeText(), QLatin1String("I"));
 }
 
+void ConversationModelTest::prefetch_data()
+{
+    QTest::addColumn<bool>("useThread");
+
+    QTest::newRow("Without thread") << false;
+    QTest::newRow("Use thread") << true;
+}
+
+void ConversationModelTest::prefetch()
+{
+    QFETCH(bool, useThread);
+
+    QThread prefetchThread;
+
+    GroupManager manager;
+    manager.setPrefetchChunkSize(5);
+    if (useThread) {
+        prefetchThread.start();
+        manager.setBackgroundThread(&prefetchThread);
+    }
+    QVERIFY(manager.getGroups());
+    QTRY_VERIFY(manager.isReady());
+
+    manager.prefetchConversation(group1.id());
+    QTRY_VERIFY(manager.isConversationPrefetched(group1.id()));
+
+    // The first chunk comes from the prefetched events
+    ConversationModel conv;
+    conv.setQueryMode(EventModel::StreamedAsyncQuery);
+    conv.setFirstChunkSize(5);
+    QVERIFY(conv.getEvents(group1.id()));
+    QCOMPARE(conv.rowCount(), 5);
+
+    // A larger first chunk is not covered by the cache
+    ConversationModel largeConv;
+    largeConv.setQueryMode(EventModel::StreamedAsyncQuery);
+    largeConv.setFirstChunkSize(10);
+    QVERIFY(largeConv.getEvents(group1.id()));
+    QTRY_VERIFY(largeConv.rowCount() > 0);
+    QCOMPARE(largeConv.event(largeConv.index(0, 0)).id(), conv.event(conv.index(0, 0)).id());
+
+    // Writes through a model invalidate the prefetched events at once,
+    // before the change notification comes back
+    EventModel model;
+    watcher.setModel(&model);
+    QDateTime later = QDateTime::currentDateTime().addSecs(60);
+    int added = addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1,
+                             group1.id(), "notified", false, false, later);
+    QVERIFY(added != -1);
+    QVERIFY(!manager.isConversationPrefetched(group1.id()));
+
+    ConversationModel updatedConv;
+    updatedConv.setQueryMode(EventModel::StreamedAsyncQuery);
+    updatedConv.setFirstChunkSize(5);
+    QVERIFY(updatedConv.getEvents(group1.id()));
+    QTRY_VERIFY(updatedConv.rowCount() > 0);
+    QCOMPARE(updatedConv.event(updatedConv.index(0, 0)).id(), added);
+    QVERIFY(watcher.waitForAdded(1));
+
+    // Prefetching again reads the new event
+    manager.prefetchConversation(group1.id());
+    QTRY_VERIFY(manager.isConversationPrefetched(group1.id()));
+    ConversationModel prefetchedConv;
+    prefetchedConv.setQueryMode(EventModel::StreamedAsyncQuery);
+    prefetchedConv.setFirstChunkSize(5);
+    QVERIFY(prefetchedConv.getEvents(group1.id()));
+    QCOMPARE(prefetchedConv.rowCount(), 5);
+    QCOMPARE(prefetchedConv.event(prefetchedConv.index(0, 0)).id(), added);
+
+    QVERIFY(model.deleteEvent(added));
+    QVERIFY(!manager.isConversationPrefetched(group1.id()));
+
+    if (useThread) {
+        prefetchThread.quit();
+        prefetchThread.wait(3000);
+    }
+}
+
+void ConversationModelTest::setGroups()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    // Interleave the events of both groups, newer than any other event
+    QDateTime future = QDateTime::currentDateTime().addSecs(600);
+    QList<int> ids;
+    QStringList texts = QStringList() << "a" << "b" << "c" << "d" << "e" << "f";
+    for (int i = 0; i < texts.size(); i++) {
+        ids << addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1,
+                            i % 2 ? group2.id() : group1.id(), texts[i], false, false,
+                            future.addSecs(i));
+    }
+    QVERIFY(watcher.waitForAdded(texts.size()));
+
+    ConversationModel conv;
+    conv.setQueryMode(EventModel::StreamedAsyncQuery);
+    conv.setFirstChunkSize(3);
+    conv.setChunkSize(3);
+    QVERIFY(conv.getEvents(group1.id()));
+    QTRY_COMPARE(conv.rowCount(), 3);
+    QCOMPARE(conv.event(conv.index(2, 0)).freeText(), QLatin1String("a"));
+
+    QSignalSpy modelReset(&conv, SIGNAL(modelReset()));
+    QSignalSpy rowsInserted(&conv, SIGNAL(rowsInserted(const QModelIndex &, int, int)));
+    QSignalSpy rowsRemoved(&conv, SIGNAL(rowsRemoved(const QModelIndex &, int, int)));
+
+    // Only the events of group2 within the loaded rows are merged in
+    QVERIFY(conv.setGroups(QList<int>() << group1.id() << group2.id()));
+    QTRY_COMPARE(conv.rowCount(), 6);
+    QCOMPARE(modelReset.count(), 0);
+    QCOMPARE(rowsInserted.count(), 3);
+    for (int i = 0; i < texts.size(); i++)
+        QCOMPARE(conv.event(conv.index(i, 0)).freeText(), texts[texts.size() - 1 - i]);
+
+    // Removing a group removes only its rows
+    QVERIFY(conv.setGroups(QList<int>() << group2.id()));
+    QCOMPARE(modelReset.count(), 0);
+    QCOMPARE(rowsRemoved.count(), 3);
+    QCOMPARE(conv.rowCount(), 3);
+    QCOMPARE(conv.event(conv.index(0, 0)).freeText(), QLatin1String("f"));
+    QCOMPARE(conv.event(conv.index(1, 0)).freeText(), QLatin1String("d"));
+    QCOMPARE(conv.event(conv.index(2, 0)).freeText(), QLatin1String("b"));
+
+    foreach (int id, ids)
+        QVERIFY(model.deleteEvent(id));
+}
+
 void ConversationModelTest::contacts_data()
 {
     QTest::addColumn<QString>("localId");
@@ -455,6 +583,173 @@ void ConversationModelTest::contacts()
     deleteTestContact(contactId, &contactChangeListener);
 }
 
+void ConversationModelTest::suspendResume()
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group1.id()));
+    const int rows = model.rowCount();
+
+    model.suspend();
+    QVERIFY(model.isSuspended());
+
+    // Changes made by another model are not followed while suspended
+    EventModel writer;
+    watcher.setModel(&writer);
+    int id = addTestEvent(writer, Event::IMEvent, Event::Inbound, ACCOUNT1,
+                          group1.id(), "added while suspended");
+    QVERIFY(id != -1);
+    QVERIFY(watcher.waitForAdded());
+    QCOMPARE(model.rowCount(), rows);
+
+    QVERIFY(model.resume());
+    QVERIFY(!model.isSuspended());
+    QCOMPARE(model.rowCount(), rows + 1);
+    QCOMPARE(model.event(model.index(0, 0)).id(), id);
+
+    model.suspend();
+    QVERIFY(writer.deleteEvent(id));
+    QVERIFY(watcher.waitForDeleted());
+    QCOMPARE(model.rowCount(), rows + 1);
+
+    QVERIFY(model.resume());
+    QCOMPARE(model.rowCount(), rows);
+}
+
+void ConversationModelTest::sharedModels()
+{
+    ConversationModel first;
+    first.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(first.getEvents(group1.id()));
+    QVERIFY(first.rowCount() > 0);
+
+    // The second model copies the rows of the first one
+    ConversationModel second;
+    second.setQueryMode(EventModel::SyncQuery);
+    QSignalSpy modelReady(&second, &ConversationModel::modelReady);
+    QVERIFY(second.getEvents(group1.id()));
+    QCOMPARE(modelReady.count(), 1);
+    QCOMPARE(second.rowCount(), first.rowCount());
+    for (int row = 0; row < first.rowCount(); row++) {
+        QCOMPARE(second.event(second.index(row, 0)).id(),
+                 first.event(first.index(row, 0)).id());
+    }
+
+    // Changes reach both models
+    EventModel writer;
+    watcher.setModel(&writer);
+    int id = addTestEvent(writer, Event::IMEvent, Event::Inbound, ACCOUNT1,
+                          group1.id(), "shared");
+    QVERIFY(id != -1);
+    QVERIFY(watcher.waitForAdded());
+    QTRY_COMPARE(first.event(first.index(0, 0)).id(), id);
+    QTRY_COMPARE(second.event(second.index(0, 0)).id(), id);
+
+    // The second model follows changes on its own once the first is gone
+    const int rows = second.rowCount();
+    first.getEvents(group2.id());
+    QVERIFY(writer.deleteEvent(id));
+    QVERIFY(watcher.waitForDeleted());
+    QTRY_COMPARE(second.rowCount(), rows - 1);
+
+    // A partially fetched model is adopted as such, not as ready
+    ConversationModel streamed;
+    streamed.setQueryMode(EventModel::StreamedAsyncQuery);
+    streamed.setFirstChunkSize(3);
+    streamed.setChunkSize(3);
+    QVERIFY(streamed.getEvents(group1.id()));
+    QTRY_COMPARE(streamed.rowCount(), 3);
+    QVERIFY(!streamed.isReady());
+
+    ConversationModel adopted;
+    adopted.setQueryMode(EventModel::StreamedAsyncQuery);
+    adopted.setFirstChunkSize(3);
+    adopted.setChunkSize(3);
+    QSignalSpy adoptedReady(&adopted, &ConversationModel::modelReady);
+    QVERIFY(adopted.getEvents(group1.id()));
+    QCOMPARE(adopted.rowCount(), 3);
+    QVERIFY(!adopted.isReady());
+    QVERIFY(adopted.canFetchMore(QModelIndex()));
+    QCOMPARE(adoptedReady.count(), 0);
+}
+
+void ConversationModelTest::groupSignals()
+{
+    // Each model only follows the changes of its own group
+    ConversationModel first, second;
+    first.setQueryMode(EventModel::SyncQuery);
+    second.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(first.getEvents(group1.id()));
+    QVERIFY(second.getEvents(group2.id()));
+    const int firstRows = first.rowCount();
+    const int secondRows = second.rowCount();
+    QSignalSpy firstInserted(&first, SIGNAL(rowsInserted(QModelIndex,int,int)));
+
+    EventModel writer;
+    watcher.setModel(&writer);
+    int id = addTestEvent(writer, Event::SMSEvent, Event::Inbound, ACCOUNT1,
+                          group2.id(), "routed");
+    QVERIFY(id != -1);
+    QVERIFY(watcher.waitForAdded());
+    QTRY_COMPARE(second.rowCount(), secondRows + 1);
+    QCOMPARE(first.rowCount(), firstRows);
+    QCOMPARE(firstInserted.count(), 0);
+
+    // Moving the event is seen by both groups
+    Event event = second.event(second.index(0, 0));
+    QCOMPARE(event.id(), id);
+    QVERIFY(writer.moveEvent(event, group1.id()));
+    QTRY_COMPARE(first.rowCount(), firstRows + 1);
+    QTRY_COMPARE(second.rowCount(), secondRows);
+    QCOMPARE(first.event(first.index(0, 0)).id(), id);
+    watcher.reset();
+
+    QVERIFY(writer.deleteEvent(id));
+    QVERIFY(watcher.waitForDeleted());
+    QTRY_COMPARE(first.rowCount(), firstRows);
+}
+
+void ConversationModelTest::partialSignals()
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group1.id()));
+
+    EventModel writer;
+    watcher.setModel(&writer);
+    int id = addTestEvent(writer, Event::SMSEvent, Event::Inbound, ACCOUNT1,
+                          group1.id(), "partial");
+    QVERIFY(id != -1);
+    QVERIFY(watcher.waitForAdded());
+    QTRY_VERIFY(model.findEvent(id).isValid());
+    QVERIFY(!model.event(model.findEvent(id)).isRead());
+
+    // The group and type of a partial event are read for routing
+    Event partial;
+    partial.setId(id);
+    partial.setIsRead(true);
+    QVERIFY(writer.modifyEvent(partial));
+    QCOMPARE(partial.groupId(), group1.id());
+    QCOMPARE(partial.type(), Event::SMSEvent);
+    QTRY_VERIFY(model.event(model.findEvent(id)).isRead());
+
+    // Modifying the event into another group removes it from the old one
+    ConversationModel other;
+    other.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(other.getEvents(group2.id()));
+    Event moved;
+    moved.setId(id);
+    moved.setGroupId(group2.id());
+    QVERIFY(writer.modifyEvent(moved));
+    QTRY_VERIFY(!model.findEvent(id).isValid());
+    QTRY_VERIFY(other.findEvent(id).isValid());
+
+    watcher.reset();
+    QVERIFY(writer.deleteEvent(id));
+    QVERIFY(watcher.waitForDeleted());
+    QTRY_VERIFY(!other.findEvent(id).isValid());
+}
+
 void ConversationModelTest::reset()
 {
     ConversationModel conv, allConv;
@@ -43,8 +43,15 @@ private slots:
     void deleteEvent();
     void asyncMode();
     void sorting();
+    void prefetch_data();
+    void prefetch();
+    void setGroups();
     void contacts_data();
     void contacts();
+    void suspendResume();
+    void sharedModels();
+    void groupSignals();
+    void partialSignals();
     void reset();
     void cleanupTestCase();
 };
@@ -0,0 +1,173 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2014 Jolla Ltd.
+** Contact: John Brooks <john.brooks@jolla.com>
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include "databaseiotest.h"
+#include "databaseio.h"
+#include "commhistorydatabasepath.h"
+#include "eventmodel.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+Group group1, group2;
+int eventId = -1;
+
+// Group of the test, read through the query cache
+Group readGroup(int id)
+{
+    QList<Group> groups;
+    if (!DatabaseIO::instance()->getGroups(QString(), QString(), groups))
+        return Group();
+    foreach (const Group &group, groups) {
+        if (group.id() == id)
+            return group;
+    }
+    return Group();
+}
+
+// Event of the test, read through the query cache
+Event readEvent(int id)
+{
+    QList<Event> events;
+    if (!DatabaseIO::instance()->getEventsByIds(QList<int>() << id, events) || events.isEmpty())
+        return Event();
+    return events.first();
+}
+
+}
+
+void DatabaseIOTest::initTestCase()
+{
+    initTestDatabase();
+    addTestGroups(group1, group2);
+
+    EventModel model;
+    eventId = addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "cached");
+    QVERIFY(eventId != -1);
+}
+
+void DatabaseIOTest::cacheStatistics()
+{
+    int hits = 0, misses = 0;
+    DatabaseIO::instance()->queryCacheStatistics(hits, misses);
+
+    // The first read runs the query, the same read again is answered
+    // from the cache
+    QCOMPARE(readEvent(eventId).freeText(), QString("cached"));
+    int newHits = 0, newMisses = 0;
+    DatabaseIO::instance()->queryCacheStatistics(newHits, newMisses);
+    QCOMPARE(newMisses, misses + 1);
+    QCOMPARE(newHits, hits);
+
+    QCOMPARE(readEvent(eventId).freeText(), QString("cached"));
+    DatabaseIO::instance()->queryCacheStatistics(newHits, newMisses);
+    QCOMPARE(newMisses, misses + 1);
+    QCOMPARE(newHits, hits + 1);
+
+    QVERIFY(readGroup(group1.id()).isValid());
+    QVERIFY(readGroup(group1.id()).isValid());
+    DatabaseIO::instance()->queryCacheStatistics(newHits, newMisses);
+    QCOMPARE(newMisses, misses + 2);
+    QCOMPARE(newHits, hits + 2);
+}
+
+void DatabaseIOTest::localWrite()
+{
+    QCOMPARE(readEvent(eventId).freeText(), QString("cached"));
+    Group group = readGroup(group1.id());
+    QVERIFY(group.isValid());
+
+    // Writes through the library's connection drop the cached results
+    Event event;
+    event.setId(eventId);
+    event.setFreeText("local");
+    QVERIFY(DatabaseIO::instance()->modifyEvent(event));
+    QCOMPARE(readEvent(eventId).freeText(), QString("local"));
+
+    group.setChatName("local chat");
+    QVERIFY(DatabaseIO::instance()->modifyGroup(group));
+    QCOMPARE(readGroup(group1.id()).chatName(), QString("local chat"));
+}
+
+void DatabaseIOTest::otherConnection()
+{
+    QCOMPARE(readEvent(eventId).freeText(), QString("local"));
+    QCOMPARE(readGroup(group1.id()).chatName(), QString("local chat"));
+
+    // Commits of another connection, as of another process, drop them too
+    {
+        QSqlDatabase other = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"),
+                                                       QLatin1String("otherConnection"));
+        other.setDatabaseName(QDir(CommHistoryDatabasePath::databaseDir())
+                              .absoluteFilePath(CommHistoryDatabasePath::databaseFile()));
+        QVERIFY(other.open());
+
+        QSqlQuery query(other);
+        QVERIFY2(query.exec(QString("UPDATE Events SET freeText = 'other' WHERE id = %1").arg(eventId)),
+                 qPrintable(query.lastError().text()));
+        QVERIFY2(query.exec(QString("UPDATE Groups SET chatName = 'other chat' WHERE id = %1").arg(group1.id())),
+                 qPrintable(query.lastError().text()));
+        query.finish();
+        other.close();
+    }
+    QSqlDatabase::removeDatabase(QLatin1String("otherConnection"));
+
+    QCOMPARE(readEvent(eventId).freeText(), QString("other"));
+    QCOMPARE(readGroup(group1.id()).chatName(), QString("other chat"));
+}
+
+void DatabaseIOTest::rolledBack()
+{
+    DatabaseIO *database = DatabaseIO::instance();
+    QCOMPARE(readEvent(eventId).freeText(), QString("other"));
+
+    // Results read inside a transaction are not kept once it is rolled
+    // back, although the change counters do not go back
+    QVERIFY(database->transaction());
+    Event event;
+    event.setId(eventId);
+    event.setFreeText("rolled back");
+    QVERIFY(database->modifyEvent(event));
+    QCOMPARE(readEvent(eventId).freeText(), QString("rolled back"));
+    Group group = readGroup(group1.id());
+    group.setChatName("rolled back chat");
+    QVERIFY(database->modifyGroup(group));
+    QCOMPARE(readGroup(group1.id()).chatName(), QString("rolled back chat"));
+    QVERIFY(database->rollback());
+
+    QCOMPARE(readEvent(eventId).freeText(), QString("other"));
+    QCOMPARE(readGroup(group1.id()).chatName(), QString("other chat"));
+}
+
+void DatabaseIOTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+QTEST_MAIN(DatabaseIOTest)
@@ -0,0 +1,9 @@
+include( ../../common-project-config.pri )
+include( ../../common-vars.pri )
+include( ../tests.pri )
+
+TARGET = ut_databaseio
+QT -= gui
+QT += sql
+SOURCES += databaseiotest.cpp
+HEADERS += databaseiotest.h
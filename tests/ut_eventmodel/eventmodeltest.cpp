@@ -98,6 +98,93 @@ void EventModelTest::testMessageToken()
     QVERIFY(compareEvents(event, sms));
 }
 
+void EventModelTest::testUpsertByToken()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    Event event;
+    event.setGroupId(group1.id());
+    event.setType(Event::SMSEvent);
+    event.setDirection(Event::Inbound);
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(event.startTime());
+    event.setLocalUid(RING_ACCOUNT);
+    event.setRecipients(Recipient(event.localUid(), "123456"));
+    event.setFreeText("upsert");
+    event.setStatus(Event::SendingStatus);
+
+    // A token is required
+    QVERIFY(!model.upsertEventByToken(event));
+    event.setMessageToken("upsertToken");
+
+    bool inserted = false;
+    QVERIFY(model.upsertEventByToken(event, DatabaseIO::MergeModified, &inserted));
+    QVERIFY(inserted);
+    QVERIFY(watcher.waitForAdded());
+    const int id = event.id();
+    QVERIFY(id != -1);
+
+    // Retransmission updates the same event
+    Event retransmitted;
+    retransmitted.setGroupId(group1.id());
+    retransmitted.setType(Event::SMSEvent);
+    retransmitted.setDirection(Event::Inbound);
+    retransmitted.setMessageToken("upsertToken");
+    retransmitted.setStatus(Event::DeliveredStatus);
+    QVERIFY(model.upsertEventByToken(retransmitted, DatabaseIO::MergeModified, &inserted));
+    QVERIFY(!inserted);
+    QCOMPARE(retransmitted.id(), id);
+    QVERIFY(watcher.waitForUpdated());
+
+    Event stored;
+    QVERIFY(model.databaseIO().getEvent(id, stored));
+    QCOMPARE(stored.status(), Event::DeliveredStatus);
+    QCOMPARE(stored.freeText(), QString("upsert"));
+
+    // Existing events can also be kept as they are
+    retransmitted.setFreeText("ignored");
+    QVERIFY(model.upsertEventByToken(retransmitted, DatabaseIO::KeepExisting, &inserted));
+    QVERIFY(!inserted);
+    QCOMPARE(retransmitted.id(), id);
+    QVERIFY(model.databaseIO().getEvent(id, stored));
+    QCOMPARE(stored.freeText(), QString("upsert"));
+
+    // Tokens are unique only within a group
+    Event other(event);
+    other.setId(-1);
+    other.setGroupId(group2.id());
+    QVERIFY(model.upsertEventByToken(other, DatabaseIO::MergeModified, &inserted));
+    QVERIFY(inserted);
+    QVERIFY(other.id() != id);
+    QVERIFY(watcher.waitForAdded());
+
+    // Other writers can still store a token more than once in a group
+    Event duplicate(event);
+    duplicate.setId(-1);
+    duplicate.setFreeText("duplicate");
+    QVERIFY(model.addEvent(duplicate));
+    QVERIFY(watcher.waitForAdded());
+    QVERIFY(duplicate.id() != id);
+
+    QVERIFY(model.moveEvent(other, group1.id()));
+    QVERIFY(watcher.waitForAdded());
+
+    // The most recent of them is updated
+    retransmitted.setId(-1);
+    retransmitted.setFreeText("newest");
+    QVERIFY(model.upsertEventByToken(retransmitted, DatabaseIO::MergeModified, &inserted));
+    QVERIFY(!inserted);
+    QCOMPARE(retransmitted.id(), duplicate.id());
+    QVERIFY(watcher.waitForUpdated());
+    QVERIFY(model.databaseIO().getEvent(duplicate.id(), stored));
+    QCOMPARE(stored.freeText(), QString("newest"));
+    QVERIFY(model.databaseIO().getEvent(id, stored));
+    QCOMPARE(stored.freeText(), QString("upsert"));
+    QVERIFY(model.databaseIO().getEvent(other.id(), stored));
+    QCOMPARE(stored.freeText(), QString("upsert"));
+}
+
 void EventModelTest::testAddEvent()
 {
     EventModel model;
@@ -1567,6 +1654,175 @@ void EventModelTest::testBufferInsertions()
     rowsInserted.clear();
 }
 
+void EventModelTest::testChangeJournal()
+{
+    EventModel model;
+    watcher.setModel(&model);
+    DatabaseIO &db = model.databaseIO();
+
+    const qint64 start = db.changeSequence();
+    QVERIFY(start >= 0);
+
+    QList<DatabaseIO::Change> changes;
+    qint64 last = -1;
+    QVERIFY(db.changesSince(start, changes, last));
+    QVERIFY(changes.isEmpty());
+    QCOMPARE(last, start);
+
+    const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/dut_40localhost0");
+    int id = addTestEvent(model, Event::IMEvent, Event::Inbound, account, group1.id(), "journal");
+    QVERIFY(id != -1);
+    QVERIFY(watcher.waitForAdded());
+
+    Event event;
+    QVERIFY(db.getEvent(id, event));
+    event.setIsRead(true);
+    QVERIFY(model.modifyEvent(event));
+    QVERIFY(watcher.waitForUpdated());
+
+    QVERIFY(model.deleteEvent(event));
+    QVERIFY(watcher.waitForDeleted());
+
+    QVERIFY(db.changesSince(start, changes, last));
+    QCOMPARE(last, db.changeSequence());
+
+    // Group changes from the activity triggers are interleaved
+    QList<DatabaseIO::Change::Operation> operations;
+    foreach (const DatabaseIO::Change &change, changes) {
+        QVERIFY(change.sequence > start && change.sequence <= last);
+        if (change.target == DatabaseIO::Change::EventTarget) {
+            QCOMPARE(change.id, id);
+            QCOMPARE(change.groupId, group1.id());
+            operations << change.operation;
+        }
+    }
+    QVERIFY(operations.size() >= 3);
+    QCOMPARE(operations.first(), DatabaseIO::Change::Inserted);
+    QVERIFY(operations.contains(DatabaseIO::Change::Updated));
+    QCOMPARE(operations.last(), DatabaseIO::Change::Deleted);
+
+    // Nothing after the last change
+    QVERIFY(db.changesSince(last, changes, last));
+    QVERIFY(changes.isEmpty());
+
+    // A sequence from a different database
+    QVERIFY(!db.changesSince(last + 1000000, changes, last));
+}
+
+void EventModelTest::testChangeJournalExpiry()
+{
+    EventModel model;
+    DatabaseIO &db = model.databaseIO();
+
+    const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/dut_40localhost0");
+    Group group;
+    addTestGroup(group, account, "journal@localhost");
+
+    // More unread events than the journal is sure to keep
+    const QDateTime when = QDateTime::currentDateTime();
+    int lastId = -1;
+    QVERIFY(db.transaction());
+    for (int i = 0; i < 11000; i++) {
+        Event event;
+        event.setType(Event::IMEvent);
+        event.setDirection(Event::Inbound);
+        event.setGroupId(group.id());
+        event.setStartTime(when);
+        event.setEndTime(when);
+        event.setLocalUid(account);
+        event.setRecipients(Recipient(account, "journal@localhost"));
+        event.setFreeText("expiry");
+        QVERIFY(db.addEvent(event));
+        lastId = event.id();
+    }
+    QVERIFY(db.commit());
+
+    const qint64 start = db.changeSequence();
+    QVERIFY(start >= 0);
+    QVERIFY(db.markAsReadGroup(group.id()));
+    const qint64 afterRead = db.changeSequence();
+    QVERIFY(afterRead > start);
+
+    // Updates leaving an event as it was are not journaled
+    Event unchanged;
+    QVERIFY(db.getEvent(lastId, unchanged));
+    unchanged.setIsRead(true);
+    QVERIFY(db.modifyEvent(unchanged));
+    QCOMPARE(db.changeSequence(), afterRead);
+
+    // Marking them all read pushed the earlier sequence out of the journal
+    QList<DatabaseIO::Change> changes;
+    qint64 last = -1;
+    bool expired = false;
+    QVERIFY(!db.changesSince(start, changes, last, &expired));
+    QVERIFY(expired);
+    QVERIFY(changes.isEmpty());
+
+    QVERIFY(db.changesSince(afterRead, changes, last, &expired));
+    QVERIFY(!expired);
+    QVERIFY(changes.isEmpty());
+
+    GroupModel groupModel;
+    QVERIFY(groupModel.deleteGroups(QList<int>() << group.id()));
+}
+
+void EventModelTest::testBatching()
+{
+    EventModel model;
+    model.setDefaultAccept(true);
+    QCOMPARE(model.batchInterval(), 0);
+
+    // Only the batch size applies changes within the test
+    model.setBatchInterval(60000);
+    model.setBatchSize(3);
+    QCOMPARE(model.batchInterval(), 60000);
+    QCOMPARE(model.batchSize(), 3);
+
+    QSignalSpy rowsInserted(&model, SIGNAL(rowsInserted(const QModelIndex &, int, int)));
+    QSignalSpy dataChanged(&model, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)));
+
+    EventModel writer;
+    watcher.setModel(&writer);
+    const QString account("/org/freedesktop/Telepathy/Account/gabble/jabber/dut_40localhost0");
+    QList<int> ids;
+    for (int i = 0; i < 3; i++) {
+        if (i == 2)
+            QCOMPARE(rowsInserted.count(), 0);
+        int id = addTestEvent(writer, Event::IMEvent, Event::Inbound, account, group1.id(), "batch");
+        QVERIFY(id != -1);
+        QVERIFY(watcher.waitForAdded());
+        ids.prepend(id);
+    }
+
+    // One insertion, the last event first
+    QTRY_COMPARE(rowsInserted.count(), 1);
+    QCOMPARE(rowsInserted.first().at(1).toInt(), 0);
+    QCOMPARE(rowsInserted.first().at(2).toInt(), 2);
+    for (int row = 0; row < ids.size(); row++)
+        QCOMPARE(model.event(model.index(row, 0)).id(), ids.at(row));
+
+    // Adjacent updates are reported as one range
+    model.setBatchSize(2);
+    dataChanged.clear();
+    for (int row = 0; row < 2; row++) {
+        Event event;
+        QVERIFY(writer.databaseIO().getEvent(ids.at(row), event));
+        event.setIsRead(true);
+        QVERIFY(writer.modifyEvent(event));
+        QVERIFY(watcher.waitForUpdated());
+    }
+    QTRY_COMPARE(dataChanged.count(), 1);
+    QCOMPARE(dataChanged.first().at(0).value<QModelIndex>().row(), 0);
+    QCOMPARE(dataChanged.first().at(1).value<QModelIndex>().row(), 1);
+    QVERIFY(model.event(model.index(1, 0)).isRead());
+
+    // Turning batching off applies what was collected
+    QVERIFY(writer.deleteEvent(ids.at(2)));
+    QVERIFY(watcher.waitForDeleted());
+    model.setBatchInterval(0);
+    QTRY_COMPARE(model.rowCount(), 2);
+}
+
 void EventModelTest::cleanupTestCase()
 {
     deleteAll();
@@ -42,6 +42,7 @@ private slots:
     void testDeleteEventMmsParts();
     void testDeleteEventGroupUpdated();
     void testMessageToken();
+    void testUpsertByToken();
     void testVCard();
     void testDeliveryStatus();
     void testFindEvent();
@@ -58,6 +59,9 @@ private slots:
     void testAddNonDigitRemoteId_data();
     void testAddNonDigitRemoteId();
     void testBufferInsertions();
+    void testChangeJournal();
+    void testChangeJournalExpiry();
+    void testBatching();
     void cleanupTestCase();
 
     void groupsUpdatedSlot(const QList<int> &groupIds);
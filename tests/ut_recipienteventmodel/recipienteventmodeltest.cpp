@@ -222,6 +222,10 @@ void RecipientEventModelTest::testGetContactEvents()
     QTRY_VERIFY(model.isReady());
     QCOMPARE(model.rowCount(), 2);
 
+    // Events of the address known up front and of the contact's other
+    // address are queried separately and merged in order
+    QCOMPARE(model.findEvent(eventId), model.index(0, 0));
+
     event = model.event(model.findEvent(eventId));
     QCOMPARE(event.id(), eventId);
     QCOMPARE(event.contactId(), contactId);
@@ -298,4 +302,43 @@ void RecipientEventModelTest::testLimitOffset()
     QCOMPARE(model.event(model.index(1, 0)).id(), eventIds.at(3));
 }
 
+void RecipientEventModelTest::testOverlappingAddresses()
+{
+    deleteAll(false);
+    ContactChangeListener contactChangeListener;
+    addTestGroups(group1, group2);
+
+    // The contact's short number is contained in its long number, so the
+    // queries for both addresses return the long number's event
+    const QString longNumber("+42382394");
+    const QString shortNumber("82394");
+
+    RecipientEventModel model;
+    QDateTime when(QDateTime::currentDateTime());
+    int longId = addTestEvent(model, Event::SMSEvent, Event::Inbound, RING_ACCOUNT, group1.id(),
+                              "long", false, false, when, longNumber, false);
+    QVERIFY(longId != -1);
+    int shortId = addTestEvent(model, Event::SMSEvent, Event::Inbound, RING_ACCOUNT, group1.id(),
+                               "short", false, false, when.addSecs(-1), shortNumber, false);
+    QVERIFY(shortId != -1);
+
+    int contactId = addTestContact("Overlapping", longNumber, RING_ACCOUNT, &contactChangeListener);
+    QVERIFY(addTestContactAddress(contactId, shortNumber, RING_ACCOUNT));
+
+    // Each event is in the model once
+    model.setRecipients(Recipient(RING_ACCOUNT, longNumber));
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(model.event(model.index(0, 0)).id(), longId);
+    QCOMPARE(model.event(model.index(1, 0)).id(), shortId);
+
+    model.setRecipients(contactId);
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(model.event(model.index(0, 0)).id(), longId);
+    QCOMPARE(model.event(model.index(1, 0)).id(), shortId);
+}
+
 QTEST_MAIN(RecipientEventModelTest)
@@ -42,6 +42,8 @@ private slots:
 
     void testLimitOffset_data();
     void testLimitOffset();
+
+    void testOverlappingAddresses();
 };
 
 #endif
@@ -63,6 +63,86 @@ void SingleEventModelTest::getEventById()
     QVERIFY(compareEvents(event, modelEvent));
 }
 
+void SingleEventModelTest::fetchEventById()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    int id1 = addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "first");
+    int id2 = addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "second");
+    QVERIFY(watcher.waitForAdded(2));
+
+    // Requests made together are served by one query, shared by equal ids
+    SingleEventModel first, sameAsFirst, second, missing;
+    QSignalSpy firstReady(&first, &SingleEventModel::modelReady);
+    QSignalSpy sameReady(&sameAsFirst, &SingleEventModel::modelReady);
+    QSignalSpy secondReady(&second, &SingleEventModel::modelReady);
+    QSignalSpy missingReady(&missing, &SingleEventModel::modelReady);
+
+    first.fetchEventById(id1);
+    sameAsFirst.fetchEventById(id1);
+    second.fetchEventById(id2);
+    missing.fetchEventById(INT_MAX);
+    QCOMPARE(first.rowCount(), 0);
+
+    QTRY_COMPARE(firstReady.count(), 1);
+    QTRY_COMPARE(sameReady.count(), 1);
+    QTRY_COMPARE(secondReady.count(), 1);
+    QTRY_COMPARE(missingReady.count(), 1);
+
+    QCOMPARE(first.event().freeText(), QLatin1String("first"));
+    QCOMPARE(sameAsFirst.event().id(), id1);
+    QCOMPARE(second.event().freeText(), QLatin1String("second"));
+    QCOMPARE(missing.rowCount(), 0);
+
+    // A model destroyed before the batch runs is skipped
+    {
+        SingleEventModel gone;
+        gone.fetchEventById(id2);
+    }
+    SingleEventModel after;
+    QSignalSpy afterReady(&after, &SingleEventModel::modelReady);
+    after.fetchEventById(id2);
+    QTRY_COMPARE(afterReady.count(), 1);
+    QCOMPARE(after.event().id(), id2);
+}
+
+void SingleEventModelTest::fetchEventByIdDeleted()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    int id = addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "deleted");
+    QVERIFY(watcher.waitForAdded());
+
+    // Whichever model of the batch is ready first deletes the others
+    QList<SingleEventModel *> models;
+    for (int i = 0; i < 3; i++)
+        models.append(new SingleEventModel);
+
+    int ready = 0;
+    foreach (SingleEventModel *receiver, models) {
+        connect(receiver, &SingleEventModel::modelReady, [&ready, &models, receiver]() {
+            ready++;
+            foreach (SingleEventModel *other, models) {
+                if (other != receiver)
+                    delete other;
+            }
+            models = QList<SingleEventModel *>() << receiver;
+        });
+        receiver->fetchEventById(id);
+    }
+
+    QTRY_COMPARE(ready, 1);
+    QCOMPARE(models.size(), 1);
+    QCOMPARE(models.first()->event().id(), id);
+
+    // Nothing is delivered to the deleted models later
+    QTest::qWait(100);
+    QCOMPARE(ready, 1);
+    delete models.first();
+}
+
 void SingleEventModelTest::getEventByTokens()
 {
     SingleEventModel model;
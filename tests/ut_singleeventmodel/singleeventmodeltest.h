@@ -10,6 +10,8 @@ class SingleEventModelTest : public QObject
 private slots:
     void initTestCase();
     void getEventById();
+    void fetchEventById();
+    void fetchEventByIdDeleted();
     void getEventByTokens();
     void contactMatching_data();
     void contactMatching();
@@ -34,10 +34,21 @@
 #include "../src/callevent.h"
 #include "../src/group.h"
 #include "../src/databaseio.h"
+#include "../src/databaseio_p.h"
+#include "../src/contactfetcher.h"
+#include "../src/contactresolver.h"
+#include "../src/commhistorydatabasepath.h"
 
 #include "catcher.h"
 
 #include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include <algorithm>
 
 using namespace CommHistory;
 
@@ -128,7 +139,7 @@ void printUsage()
 {
     std::cout << "Usage:"                                                                                                                                  << std::endl;
     std::cout << "commhistory-tool listgroups"                                                                                                             << std::endl;
-    std::cout << "                 list [-t] [-p] [-group group-id] [local-uid] [remote-uid]"                                                              << std::endl;
+    std::cout << "                 list [-t] [-p] [-resolve] [-group group-id] [local-uid remote-uid]"                                                     << std::endl;
     std::cout << "                 listcalls [{bycontact|bytime} [resolve]]"                                                                               << std::endl;
     std::cout << "                 listcontact {contact-id|local-uid remote-uid}"                                                                          << std::endl;
     std::cout << "                 add [-newgroup] [-group group-id] [-startTime yyyyMMdd:hh:mm] [-endTime yyyyMMdd:hh:mm] [{-sms|-mms}] [{-in|-out}] [-n number-of-messages] [-async] [-text message-text] local-uid remote-uid" << std::endl;
@@ -149,6 +160,9 @@ void printUsage()
                         << std::endl;
     std::cout << "                 import-json [-relativeDate yyMMdd] filename"
                         << std::endl;
+    std::cout << "                 stats [--json]"                                                                                                        << std::endl;
+    std::cout << "Listing commands accept [-format {text|tsv|json}] and stream their output. Contacts are"                                                 << std::endl;
+    std::cout << "resolved in batches of [-batch n] events, 500 by default. The row rate is reported on stderr."                                             << std::endl;
     std::cout << "When adding new events, the default count is 1."                                                                                         << std::endl;
     std::cout << "When adding new events, the given local-ui is ignored, if -sms or -mms specified."                                                       << std::endl;
     std::cout << "New events are of IM type and have random contents."                                                                                     << std::endl;
@@ -510,6 +524,293 @@ int doAddClass0(const QStringList &arguments, const QVariantMap &options)
     return 0;
 }
 
+QString eventTypeName(int type)
+{
+    switch (type) {
+    case Event::IMEvent: return "im";
+    case Event::SMSEvent: return "sms";
+    case Event::CallEvent: return "call";
+    case Event::VoicemailEvent: return "voicemail";
+    case Event::StatusMessageEvent: return "status";
+    case Event::MMSEvent: return "mms";
+    case Event::ClassZeroSMSEvent: return "class0";
+    default: return QString::number(type);
+    }
+}
+
+enum OutputFormat {
+    TextOutput,
+    TsvOutput,
+    JsonOutput
+};
+
+bool parseOutputFormat(const QVariantMap &options, OutputFormat &format)
+{
+    QString name = options.value("-format", QString("text")).toString();
+    if (name == "text")
+        format = TextOutput;
+    else if (name == "tsv")
+        format = TsvOutput;
+    else if (name == "json")
+        format = JsonOutput;
+    else
+        return false;
+    return true;
+}
+
+QString tsvField(const QString &value)
+{
+    QString re(value);
+    re.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    re.replace(QLatin1Char('\t'), QLatin1String("\\t"));
+    re.replace(QLatin1Char('\n'), QLatin1String("\\n"));
+    re.replace(QLatin1Char('\r'), QLatin1String("\\r"));
+    return re;
+}
+
+QString joinedContactIds(const Event &event)
+{
+    QStringList ids;
+    foreach (int id, event.recipients().contactIds()) {
+        if (id > 0)
+            ids.append(QString::number(id));
+    }
+    return ids.join(QLatin1Char(','));
+}
+
+QJsonObject eventJson(const Event &event)
+{
+    QJsonObject o;
+    o.insert("id", event.id());
+    o.insert("type", eventTypeName(event.type()));
+    o.insert("direction", event.direction() == Event::Inbound ? QString("in")
+                          : event.direction() == Event::Outbound ? QString("out") : QString());
+    o.insert("groupId", event.groupId());
+    o.insert("startTime", qint64(event.startTimeT()));
+    o.insert("endTime", qint64(event.endTimeT()));
+    o.insert("localUid", event.localUid());
+    o.insert("remoteUid", event.recipients().value(0).remoteUid());
+    o.insert("isRead", event.isRead());
+    o.insert("isMissedCall", event.isMissedCall());
+    o.insert("status", int(event.status()));
+    o.insert("eventCount", event.eventCount());
+    if (event.isResolved())
+        o.insert("contactIds", joinedContactIds(event));
+    o.insert("freeText", event.freeText());
+    return o;
+}
+
+/*
+ * Writes streamed rows in the requested format and reports the row rate on
+ * stderr when done.
+ */
+class RowWriter
+{
+public:
+    RowWriter(OutputFormat format, const char *unit)
+        : m_format(format), m_unit(unit), m_rows(0)
+    {
+        m_timer.start();
+    }
+
+    ~RowWriter()
+    {
+        qint64 msecs = m_timer.elapsed();
+        std::cerr << m_rows << " " << m_unit << " in " << msecs << " ms ("
+                  << (msecs > 0 ? m_rows * 1000 / msecs : m_rows) << " " << m_unit << "/s)" << std::endl;
+    }
+
+    void writeEventHeader()
+    {
+        if (m_format == TsvOutput) {
+            std::cout << "id\ttype\tdirection\tgroupId\tstartTime\tendTime\tlocalUid\tremoteUid"
+                         "\tisRead\tisMissedCall\tstatus\teventCount\tcontactIds\tfreeText" << std::endl;
+        }
+    }
+
+    void writeEvent(const Event &event, bool showParts = false)
+    {
+        m_rows++;
+        if (m_format == TextOutput) {
+            printEvent(event, showParts);
+        } else if (m_format == JsonOutput) {
+            std::cout << QJsonDocument(eventJson(event)).toJson(QJsonDocument::Compact).constData() << '\n';
+        } else {
+            QStringList fields;
+            fields << QString::number(event.id())
+                   << eventTypeName(event.type())
+                   << (event.direction() == Event::Inbound ? "in" : event.direction() == Event::Outbound ? "out" : "")
+                   << QString::number(event.groupId())
+                   << QString::number(event.startTimeT())
+                   << QString::number(event.endTimeT())
+                   << tsvField(event.localUid())
+                   << tsvField(event.recipients().value(0).remoteUid())
+                   << QString::number(event.isRead())
+                   << QString::number(event.isMissedCall())
+                   << QString::number(event.status())
+                   << QString::number(event.eventCount())
+                   << (event.isResolved() ? joinedContactIds(event) : QString())
+                   << tsvField(event.freeText());
+            std::cout << fields.join(QLatin1Char('\t')).toUtf8().constData() << '\n';
+        }
+    }
+
+    void writeGroup(const Group &group, const Event &lastEvent)
+    {
+        m_rows++;
+        if (m_format == TextOutput) {
+            std::cout << qPrintable(group.toString()) << std::endl;
+            if (lastEvent.isValid())
+                printEvent(lastEvent);
+            std::cout << std::endl;
+        } else if (m_format == JsonOutput) {
+            QJsonObject o;
+            o.insert("id", group.id());
+            o.insert("localUid", group.localUid());
+            o.insert("remoteUids", QJsonArray::fromStringList(group.recipients().remoteUids()));
+            o.insert("chatName", group.chatName());
+            o.insert("unreadMessages", group.unreadMessages());
+            o.insert("endTime", qint64(group.endTimeT()));
+            if (lastEvent.isValid())
+                o.insert("lastEvent", eventJson(lastEvent));
+            std::cout << QJsonDocument(o).toJson(QJsonDocument::Compact).constData() << '\n';
+        } else {
+            QStringList fields;
+            fields << QString::number(group.id())
+                   << tsvField(group.localUid())
+                   << tsvField(group.recipients().remoteUids().join(QLatin1Char(',')))
+                   << tsvField(group.chatName())
+                   << QString::number(group.unreadMessages())
+                   << QString::number(group.endTimeT())
+                   << QString::number(group.lastEventId());
+            std::cout << fields.join(QLatin1Char('\t')).toUtf8().constData() << '\n';
+        }
+    }
+
+    void writeGroupHeader()
+    {
+        if (m_format == TsvOutput)
+            std::cout << "id\tlocalUid\tremoteUids\tchatName\tunreadMessages\tendTime\tlastEventId" << std::endl;
+    }
+
+private:
+    OutputFormat m_format;
+    const char *m_unit;
+    qint64 m_rows;
+    QElapsedTimer m_timer;
+};
+
+/*
+ * Resolves contacts for streamed events a bounded batch at a time, so that
+ * the first rows can be written before the whole result is resolved.
+ */
+class BatchResolver
+{
+public:
+    explicit BatchResolver(int batchSize)
+        : m_batchSize(qMax(batchSize, 1)), m_resolver(0)
+    {
+        QObject::connect(&m_resolver, &ContactResolver::finished, &m_loop, &QEventLoop::quit);
+    }
+
+    void add(const Event &event)
+    {
+        m_pending.append(event);
+    }
+
+    bool isFull() const
+    {
+        return m_pending.size() >= m_batchSize;
+    }
+
+    // Resolve the pending events and hand them over to the caller
+    QList<Event> take()
+    {
+        QList<Event> events;
+        events.swap(m_pending);
+
+        m_resolver.add(events);
+        if (m_resolver.isResolving())
+            m_loop.exec();
+
+        QList<Event>::iterator it = events.begin(), end = events.end();
+        for ( ; it != end; ++it) {
+            if (!it->isResolved() && it->recipients().allContactsResolved())
+                it->setIsResolved(true);
+        }
+        return events;
+    }
+
+private:
+    int m_batchSize;
+    QList<Event> m_pending;
+    QEventLoop m_loop;
+    ContactResolver m_resolver;
+};
+
+int batchSizeOption(const QVariantMap &options)
+{
+    return options.value("-batch", 500).toInt();
+}
+
+int doListTree(int groupId, bool showParts)
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    model.setTreeMode(true);
+    if (!model.getEvents(groupId)) {
+        qCritical() << "Error fetching events";
+        return -1;
+    }
+
+    for (int i = 0; i < model.rowCount(); i++) {
+        QModelIndex parent = model.index(i, 0);
+        if (model.hasChildren(parent)) {
+            QString header = "*** " + model.event(parent).freeText() + " ***";
+            std::cout << qPrintable(header) << std::endl;
+            for (int row = 0; row < model.rowCount(parent); row++) {
+                Event e = model.event(model.index(row, 0, parent));
+                printEvent(e, showParts);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int streamEvents(EventCursor &cursor, const QVariantMap &options, bool resolve, bool showParts = false)
+{
+    OutputFormat format;
+    if (!parseOutputFormat(options, format)) {
+        qCritical() << "Invalid output format";
+        return -1;
+    }
+
+    RowWriter writer(format, "events");
+    writer.writeEventHeader();
+
+    Event e;
+    if (!resolve) {
+        while (cursor.next(e))
+            writer.writeEvent(e, showParts);
+        return 0;
+    }
+
+    BatchResolver resolver(batchSizeOption(options));
+    bool more = true;
+    while (more) {
+        more = cursor.next(e);
+        if (more)
+            resolver.add(e);
+        if (resolver.isFull() || !more) {
+            foreach (const Event &event, resolver.take())
+                writer.writeEvent(event, showParts);
+        }
+    }
+
+    return 0;
+}
+
 int doList(const QStringList &arguments, const QVariantMap &options)
 {
     QString localUid;
@@ -525,11 +826,6 @@ int doList(const QStringList &arguments, const QVariantMap &options)
         }
     }
 
-    if (groupId == -1) {
-        qCritical() << "Not implemented, use list -group <id>";
-        return -1;
-    }
-
     bool tree = options.contains("-t");
     bool showParts = options.contains("-p");
 
@@ -540,34 +836,26 @@ int doList(const QStringList &arguments, const QVariantMap &options)
         remoteUid = arguments.at(3);
     }
 
-    ConversationModel model;
-    model.setQueryMode(EventModel::SyncQuery);
-    model.setTreeMode(tree);
-    if (!model.getEvents(groupId)) {
-        qCritical() << "Error fetching events";
-        return -1;
+    if (tree) {
+        // Tree mode groups the whole conversation and needs the model
+        if (groupId == -1) {
+            qCritical() << "Not implemented, use list -t -group <id>";
+            return -1;
+        }
+        return doListTree(groupId, showParts);
     }
 
-    if (!tree) {
-        for (int i = 0; i < model.rowCount(); i++) {
-            Event e = model.event(model.index(i, 0));
-            printEvent(e, showParts);
-        }
-    } else {
-        for (int i = 0; i < model.rowCount(); i++) {
-            QModelIndex parent = model.index(i, 0);
-            if (model.hasChildren(parent)) {
-                QString header = "*** " + model.event(parent).freeText() + " ***";
-                std::cout << qPrintable(header) << std::endl;
-                for (int row = 0; row < model.rowCount(parent); row++) {
-                    Event e = model.event(model.index(row, 0, parent));
-                    printEvent(e, showParts);
-                }
-            }
-        }
+    RecipientList recipients;
+    if (!localUid.isEmpty() && !remoteUid.isEmpty())
+        recipients.append(Recipient(localUid, remoteUid));
+
+    EventCursor cursor;
+    if (!DatabaseIO::instance()->openEvents(cursor, groupId, Event::UnknownType, recipients)) {
+        qCritical() << "Error fetching events";
+        return -1;
     }
 
-    return 0;
+    return streamEvents(cursor, options, options.contains("-resolve"), showParts);
 }
 
 int doListGroups(const QStringList &arguments, const QVariantMap &options)
@@ -586,73 +874,183 @@ int doListGroups(const QStringList &arguments, const QVariantMap &options)
         remoteUid = arguments.at(3);
     }
 
-    bool showParts = options.contains("-p");
-
-    GroupModel model;
-    model.setResolveContacts(GroupManager::DoNotResolve);
-    model.setQueryMode(EventModel::SyncQuery);
-    if (!model.getGroups(localUid, remoteUid)) {
-        qCritical() << "Error fetching groups";
+    OutputFormat format;
+    if (!parseOutputFormat(options, format)) {
+        qCritical() << "Invalid output format";
         return -1;
     }
 
-    Q_UNUSED(showParts);
-    EventModel eventModel;
-    for (int i = 0; i < model.rowCount(); i++) {
-        Group g = model.group(model.index(i, 0));
-        std::cout << qPrintable(g.toString()) << std::endl;
+    RowWriter writer(format, "groups");
+    writer.writeGroupHeader();
 
-        Event e;
-        if (eventModel.databaseIO().getEvent(g.lastEventId(), e)) {
-            printEvent(e, showParts);
-        } else {
-            qCritical() << "getEvent error ";
+    // Page through the groups instead of loading them all into a model
+    DatabaseIO *database = DatabaseIO::instance();
+    const int chunkSize = 100;
+    quint32 lastEndTime = 0;
+    int lastId = -1;
+    QList<Group> groups;
+    do {
+        if (!database->getGroupsChunk(localUid, remoteUid, groups, chunkSize, lastEndTime, lastId)) {
+            qCritical() << "Error fetching groups";
+            return -1;
         }
 
-        std::cout << std::endl;
-    }
+        foreach (const Group &g, groups) {
+            Event e;
+            if (g.lastEventId() > 0 && !database->getEvent(g.lastEventId(), e))
+                qCritical() << "getEvent error ";
+            writer.writeGroup(g, e);
+        }
+
+        if (!groups.isEmpty()) {
+            lastEndTime = groups.last().endTimeT();
+            lastId = groups.last().id();
+        }
+    } while (groups.size() == chunkSize);
 
     return 0;
 }
 
 int doListContact(const QStringList &arguments, const QVariantMap &options)
 {
-    Q_UNUSED( options );
-
-    RecipientEventModel model;
+    RecipientList recipients;
 
     if (arguments.count() > 3) {
-        model.setRecipients(Recipient(arguments.at(2), arguments.at(3)));
-        if (!model.getEvents()) {
-            qCritical() << "Error fetching events for local-uid:" << arguments.at(2) << "remote-uid:" << arguments.at(3);
-            return -1;
-        }
+        recipients.append(Recipient(arguments.at(2), arguments.at(3)));
     } else if (arguments.count() > 2) {
         int contactId = arguments.at(2).toInt();
-        model.setRecipients(contactId);
-        if (!model.getEvents()) {
-            qCritical() << "Error fetching events for contact-id:" << contactId;
+
+        // Load the contact to find its addresses
+        ContactFetcher fetcher;
+        QEventLoop loop;
+        QObject::connect(&fetcher, &ContactFetcher::finished, &loop, &QEventLoop::quit);
+        fetcher.add(contactId);
+        if (fetcher.isFetching())
+            loop.exec();
+
+        recipients = RecipientList::fromContact(contactId);
+        if (recipients.isEmpty()) {
+            qCritical() << "No addresses for contact-id:" << contactId;
             return -1;
         }
     }
-    if (!model.isReady()) {
-        waitForReadiness(model);
-    }
 
-    for (int i = 0; i < model.rowCount(); i++) {
-        Event e = model.event(model.index(i, 0));
-        printEvent(e);
+    EventCursor cursor;
+    if (!DatabaseIO::instance()->openEvents(cursor, -1, Event::UnknownType, recipients)) {
+        qCritical() << "Error fetching events for" << arguments.mid(2);
+        return -1;
     }
 
-    return 0;
+    return streamEvents(cursor, options, true);
 }
 
-int doListCalls( const QStringList &arguments, const QVariantMap &options )
+QString callGroupKey(const Event &event)
+{
+    QString ids;
+    if (event.isResolved())
+        ids = joinedContactIds(event);
+    if (ids.isEmpty())
+        return CallGroupKey(event).toString();
+    return QString(QLatin1String("contact:%1:%2")).arg(ids).arg(event.isVideoCall());
+}
+
+// Same grouping as CallModel::SortByTime
+bool sameTimeGroup(const Event &e1, const Event &e2)
 {
-    Q_UNUSED( options );
+    return e1.direction() == e2.direction()
+        && e1.isMissedCall() == e2.isMissedCall()
+        && callGroupKey(e1) == callGroupKey(e2);
+}
+
+/*
+ * Groups a stream of calls like CallModel does and writes the top level
+ * rows in order. By time only the current group is kept; by contact the
+ * groups whose missed call count may still change are kept, which is
+ * bounded by the number of contacts rather than the number of calls.
+ */
+class CallGrouper
+{
+public:
+    CallGrouper(CallModel::Sorting sorting, RowWriter &writer)
+        : m_sorting(sorting), m_writer(writer), m_count(0)
+    {
+    }
+
+    ~CallGrouper()
+    {
+        if (m_count > 0)
+            writeCurrent();
+        while (!m_queue.isEmpty())
+            writePending();
+    }
+
+    void add(const Event &event)
+    {
+        if (m_sorting == CallModel::SortByTime) {
+            if (m_count > 0 && sameTimeGroup(m_current, event)) {
+                m_count++;
+                return;
+            }
+            if (m_count > 0)
+                writeCurrent();
+            m_current = event;
+            m_count = 1;
+            return;
+        }
+
+        const QString key(callGroupKey(event));
+        if (m_done.contains(key))
+            return;
+
+        if (m_counts.contains(key)) {
+            // Missed calls are counted only while they are consecutive
+            if (event.isMissedCall()) {
+                m_counts[key]++;
+                return;
+            }
+        } else {
+            m_queue.enqueue(qMakePair(key, event));
+            m_counts.insert(key, event.isMissedCall() ? 1 : 0);
+            if (event.isMissedCall())
+                return;
+        }
+        m_done.insert(key);
+
+        while (!m_queue.isEmpty() && m_done.contains(m_queue.head().first))
+            writePending();
+    }
+
+private:
+    void writeCurrent()
+    {
+        m_current.setEventCount(m_count);
+        m_writer.writeEvent(m_current);
+        m_count = 0;
+    }
+
+    void writePending()
+    {
+        QPair<QString, Event> pending(m_queue.dequeue());
+        pending.second.setEventCount(m_counts.take(pending.first));
+        m_writer.writeEvent(pending.second);
+    }
+
+    CallModel::Sorting m_sorting;
+    RowWriter &m_writer;
+
+    Event m_current;
+    int m_count;
 
+    // Top level rows in order, with the missed call count of each group
+    QQueue<QPair<QString, Event> > m_queue;
+    QHash<QString, int> m_counts;
+    QSet<QString> m_done;
+};
+
+int doListCalls( const QStringList &arguments, const QVariantMap &options )
+{
     CallModel::Sorting sorting = CallModel::SortByContact;
-    CallModel::ContactResolveType resolve = CallModel::DoNotResolve;
+    bool resolve = false;
 
     if ( arguments.count() >= 3 )
     {
@@ -665,28 +1063,44 @@ int doListCalls( const QStringList &arguments, const QVariantMap &options )
         {
             if ( arguments.at( 3 ) == "resolve" )
             {
-                resolve = CallModel::ResolveImmediately;
+                resolve = true;
             }
         }
     }
 
-    CallModel model;
-    model.setFilter(sorting);
-    model.setResolveContacts(resolve);
-    model.setQueryMode(resolve == CallModel::ResolveImmediately ? EventModel::AsyncQuery : EventModel::SyncQuery);
-    if ( !model.getEvents() )
-    {
+    OutputFormat format;
+    if (!parseOutputFormat(options, format)) {
+        qCritical() << "Invalid output format";
+        return -1;
+    }
+
+    EventCursor cursor;
+    if (!DatabaseIO::instance()->openEvents(cursor, -1, Event::CallEvent)) {
         qCritical() << "Error fetching events";
         return -1;
     }
-    if ( !model.isReady() ) {
-        waitForReadiness(model);
+
+    RowWriter writer(format, "calls");
+    writer.writeEventHeader();
+    CallGrouper grouper(sorting, writer);
+
+    Event e;
+    if (!resolve) {
+        while (cursor.next(e))
+            grouper.add(e);
+        return 0;
     }
 
-    for ( int i = 0; i < model.rowCount(); i++ )
-    {
-        Event e = model.event(model.index(i, 0));
-        printEvent(e);
+    BatchResolver resolver(batchSizeOption(options));
+    bool more = true;
+    while (more) {
+        more = cursor.next(e);
+        if (more)
+            resolver.add(e);
+        if (resolver.isFull() || !more) {
+            foreach (const Event &event, resolver.take())
+                grouper.add(event);
+        }
     }
 
     return 0;
@@ -1329,6 +1743,365 @@ int doJsonImport(const QStringList &arguments, const QVariantMap &options)
 
 }
 
+bool execStatsQuery(QSqlQuery &query, const QString &statement)
+{
+    if (!query.exec(statement)) {
+        qWarning() << "Failed to execute query";
+        qWarning() << query.lastError();
+        qWarning() << statement;
+        return false;
+    }
+    return true;
+}
+
+QJsonValue statsScalar(QSqlDatabase &database, const QString &statement)
+{
+    QSqlQuery query(database);
+    if (!execStatsQuery(query, statement) || !query.next())
+        return QJsonValue();
+    return QJsonValue::fromVariant(query.value(0));
+}
+
+qint64 pathSize(const QString &path)
+{
+    QFileInfo info(path);
+    if (!info.isDir())
+        return info.size();
+
+    qint64 size = 0;
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        size += it.fileInfo().size();
+    }
+    return size;
+}
+
+// Default chunk size of GroupManager
+const int groupsChunkSize = 50;
+
+struct StatsQuery
+{
+    explicit StatsQuery(const QString &name) : name(name) {}
+
+    QString name;
+    QByteArray statement;
+    QVariantList values;
+};
+
+bool slowerQuery(const QPair<qint64, QJsonObject> &a, const QPair<qint64, QJsonObject> &b)
+{
+    return a.first > b.first;
+}
+
+QJsonObject collectStats(QSqlDatabase &database, const QString &databaseFile)
+{
+    QJsonObject stats;
+    QSqlQuery query(database);
+
+    // Row counts
+    QJsonObject rows;
+    if (execStatsQuery(query, "SELECT name FROM sqlite_master WHERE type = 'table' "
+                              "AND name NOT LIKE 'sqlite_%' ORDER BY name")) {
+        QStringList tables;
+        while (query.next())
+            tables << query.value(0).toString();
+        foreach (const QString &table, tables)
+            rows.insert(table, statsScalar(database, "SELECT COUNT(*) FROM " + table));
+    }
+    stats.insert("rows", rows);
+
+    QJsonObject types;
+    if (execStatsQuery(query, "SELECT type, COUNT(*) FROM Events GROUP BY type")) {
+        while (query.next())
+            types.insert(eventTypeName(query.value(0).toInt()), query.value(1).toLongLong());
+    }
+    stats.insert("eventTypes", types);
+
+    // Storage
+    QJsonObject storage;
+    qint64 pageSize = statsScalar(database, "PRAGMA page_size").toVariant().toLongLong();
+    qint64 pageCount = statsScalar(database, "PRAGMA page_count").toVariant().toLongLong();
+    qint64 freePages = statsScalar(database, "PRAGMA freelist_count").toVariant().toLongLong();
+    storage.insert("pageSize", pageSize);
+    storage.insert("pageCount", pageCount);
+    storage.insert("freePages", freePages);
+    storage.insert("freeRatio", pageCount > 0 ? double(freePages) / pageCount : 0.0);
+    storage.insert("fileSize", QFileInfo(databaseFile).size());
+    storage.insert("walSize", QFileInfo(databaseFile + "-wal").size());
+    storage.insert("schemaVersion", statsScalar(database, "PRAGMA user_version"));
+    stats.insert("storage", storage);
+
+    // Table and index sizes, if SQLite is built with the dbstat table
+    QJsonArray objects;
+    if (query.exec("SELECT dbstat.name, sqlite_master.type, SUM(dbstat.pgsize) AS size FROM dbstat "
+                   "LEFT JOIN sqlite_master ON (sqlite_master.name = dbstat.name) "
+                   "GROUP BY dbstat.name ORDER BY size DESC")) {
+        while (query.next()) {
+            QJsonObject object;
+            object.insert("name", query.value(0).toString());
+            object.insert("type", query.value(1).isNull() ? QString("internal") : query.value(1).toString());
+            object.insert("bytes", query.value(2).toLongLong());
+            objects.append(object);
+        }
+        stats.insert("objects", objects);
+    } else {
+        stats.insert("objects", QJsonValue());
+    }
+
+    // Groups with the most events
+    QJsonArray topGroups;
+    int largestGroup = -1;
+    if (execStatsQuery(query, "SELECT Events.groupId, COUNT(*) AS count, Groups.localUid, Groups.remoteUids "
+                              "FROM Events JOIN Groups ON (Groups.id = Events.groupId) "
+                              "GROUP BY Events.groupId ORDER BY count DESC LIMIT 10")) {
+        while (query.next()) {
+            QJsonObject group;
+            group.insert("id", query.value(0).toInt());
+            group.insert("events", query.value(1).toLongLong());
+            group.insert("localUid", query.value(2).toString());
+            group.insert("remoteUids", query.value(3).toString());
+            topGroups.append(group);
+            if (largestGroup < 0)
+                largestGroup = query.value(0).toInt();
+        }
+    }
+    stats.insert("topGroups", topGroups);
+
+    QString busiestRemote = statsScalar(database, "SELECT remoteUid FROM Events WHERE remoteUid IS NOT NULL "
+                                                  "GROUP BY remoteUid ORDER BY COUNT(*) DESC LIMIT 1").toString();
+    QString busiestLocal = statsScalar(database, QString("SELECT localUid FROM Events WHERE remoteUid = '%1' "
+                                                         "LIMIT 1").arg(QString(busiestRemote).replace('\'', "''"))).toString();
+    // Groups are sorted by the indexed activity once it has been backfilled
+    bool groupActivity = statsScalar(database, "SELECT finished FROM Migrations "
+                                               "WHERE name = 'groups_lastEventTime'").toVariant().toBool();
+
+    // Queries of the library as the models run them, slowest first
+    QList<StatsQuery> statsQueries;
+    StatsQuery conversation("conversation");
+    conversation.statement = DatabaseIOStatements::eventsQuery(largestGroup, Event::UnknownType, RecipientList(),
+                                                               conversation.values);
+    statsQueries << conversation;
+    StatsQuery calls("calls");
+    calls.statement = DatabaseIOStatements::eventsQuery(-1, Event::CallEvent, RecipientList(), calls.values);
+    statsQueries << calls;
+    StatsQuery recipient("recipient");
+    recipient.statement = DatabaseIOStatements::eventsQuery(-1, Event::UnknownType,
+                                                            RecipientList() << Recipient(busiestLocal, busiestRemote),
+                                                            recipient.values);
+    statsQueries << recipient;
+    StatsQuery messageToken("messageToken");
+    messageToken.statement = DatabaseIOStatements::eventByMessageTokenQuery();
+    messageToken.values << QString("commhistory-tool-stats");
+    statsQueries << messageToken;
+
+    // First chunk of GroupManager, and the one after it
+    StatsQuery groups("groups");
+    groups.statement = DatabaseIOStatements::groupsChunkQuery(groupActivity, QString(), QString(),
+                                                              groupsChunkSize, 0, -1, groups.values);
+    statsQueries << groups;
+    quint32 chunkEndTime = 0;
+    int chunkId = -1;
+    QSqlQuery chunk(database);
+    if (chunk.prepare(QString::fromLatin1(groups.statement))) {
+        foreach (const QVariant &value, groups.values)
+            chunk.addBindValue(value);
+        if (chunk.exec() && chunk.last()) {
+            chunkId = chunk.value(0).toInt();
+            chunkEndTime = chunk.value(7).toUInt();
+        }
+    }
+    chunk.finish();
+    if (chunkId >= 0) {
+        StatsQuery nextGroups("groupsNextChunk");
+        nextGroups.statement = DatabaseIOStatements::groupsChunkQuery(groupActivity, QString(), QString(),
+                                                                      groupsChunkSize, chunkEndTime, chunkId,
+                                                                      nextGroups.values);
+        statsQueries << nextGroups;
+    }
+
+    QList<QPair<qint64, QJsonObject> > timings;
+    for (int i = 0; i < statsQueries.size(); i++) {
+        const StatsQuery &statsQuery = statsQueries.at(i);
+        const QString statement = QString::fromLatin1(statsQuery.statement).simplified();
+        QJsonObject timing;
+        timing.insert("name", statsQuery.name);
+        timing.insert("query", statement);
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 rowCount = 0;
+        if (query.prepare(statement)) {
+            foreach (const QVariant &value, statsQuery.values)
+                query.addBindValue(value);
+        }
+        if (query.exec()) {
+            while (query.next())
+                rowCount++;
+        } else {
+            timing.insert("error", query.lastError().text());
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+        query.finish();
+
+        timing.insert("usec", elapsed / 1000);
+        timing.insert("rows", rowCount);
+
+        QStringList plan;
+        if (query.prepare("EXPLAIN QUERY PLAN " + statement)) {
+            foreach (const QVariant &value, statsQuery.values)
+                query.addBindValue(value);
+            if (query.exec()) {
+                while (query.next())
+                    plan << query.value(3).toString();
+            }
+        }
+        query.finish();
+        timing.insert("plan", QJsonArray::fromStringList(plan));
+        timings.append(qMakePair(elapsed, timing));
+    }
+    std::sort(timings.begin(), timings.end(), slowerQuery);
+    QJsonArray queries;
+    for (int i = 0; i < timings.size(); i++)
+        queries.append(timings[i].second);
+    stats.insert("queries", queries);
+
+    // Message parts left behind by deleted events, and their files
+    QJsonObject orphans;
+    qint64 orphanedParts = 0, orphanedBytes = 0;
+    if (execStatsQuery(query, "SELECT path FROM MessageParts WHERE eventId IS NULL "
+                              "OR eventId NOT IN (SELECT id FROM Events)")) {
+        while (query.next()) {
+            orphanedParts++;
+            QString path = query.value(0).toString();
+            if (!path.isEmpty())
+                orphanedBytes += QFileInfo(path).size();
+        }
+    }
+    orphans.insert("messageParts", orphanedParts);
+    orphans.insert("messagePartBytes", orphanedBytes);
+
+    // Per-event data directories without an event
+    qint64 orphanedDirs = 0, orphanedDirBytes = 0;
+    QDir dataDir(CommHistoryDatabasePath::dataDir());
+    QSqlQuery exists(database);
+    exists.prepare("SELECT 1 FROM Events WHERE id = :id");
+    foreach (const QString &entry, dataDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        bool ok = false;
+        int id = entry.toInt(&ok);
+        if (!ok)
+            continue;
+
+        exists.bindValue(":id", id);
+        if (exists.exec() && !exists.next()) {
+            orphanedDirs++;
+            orphanedDirBytes += pathSize(dataDir.absoluteFilePath(entry));
+        }
+        exists.finish();
+    }
+    orphans.insert("dataDirectories", orphanedDirs);
+    orphans.insert("dataDirectoryBytes", orphanedDirBytes);
+    stats.insert("orphans", orphans);
+
+    return stats;
+}
+
+void printStats(const QJsonObject &stats)
+{
+    std::cout << "Rows:" << std::endl;
+    QJsonObject rows = stats.value("rows").toObject();
+    foreach (const QString &table, rows.keys())
+        std::cout << "  " << qPrintable(table) << ": " << rows.value(table).toVariant().toLongLong() << std::endl;
+
+    std::cout << "Events by type:" << std::endl;
+    QJsonObject types = stats.value("eventTypes").toObject();
+    foreach (const QString &type, types.keys())
+        std::cout << "  " << qPrintable(type) << ": " << types.value(type).toVariant().toLongLong() << std::endl;
+
+    QJsonObject storage = stats.value("storage").toObject();
+    std::cout << "Storage:" << std::endl;
+    std::cout << "  schema version: " << storage.value("schemaVersion").toInt() << std::endl;
+    std::cout << "  pages: " << storage.value("pageCount").toVariant().toLongLong()
+              << " x " << storage.value("pageSize").toVariant().toLongLong() << " bytes" << std::endl;
+    std::cout << "  free pages: " << storage.value("freePages").toVariant().toLongLong()
+              << " (" << qPrintable(QString::number(storage.value("freeRatio").toDouble() * 100, 'f', 1)) << "%)" << std::endl;
+    std::cout << "  database file: " << storage.value("fileSize").toVariant().toLongLong() << " bytes" << std::endl;
+    std::cout << "  WAL file: " << storage.value("walSize").toVariant().toLongLong() << " bytes" << std::endl;
+
+    std::cout << "Tables and indexes:" << std::endl;
+    if (stats.value("objects").isNull()) {
+        std::cout << "  (dbstat is not available)" << std::endl;
+    } else {
+        foreach (const QJsonValue &value, stats.value("objects").toArray()) {
+            QJsonObject object = value.toObject();
+            std::cout << "  " << qPrintable(object.value("name").toString())
+                      << " (" << qPrintable(object.value("type").toString()) << "): "
+                      << object.value("bytes").toVariant().toLongLong() << " bytes" << std::endl;
+        }
+    }
+
+    std::cout << "Groups with most events:" << std::endl;
+    foreach (const QJsonValue &value, stats.value("topGroups").toArray()) {
+        QJsonObject group = value.toObject();
+        std::cout << "  " << group.value("id").toInt() << ": "
+                  << group.value("events").toVariant().toLongLong() << " events, "
+                  << qPrintable(group.value("localUid").toString()) << " "
+                  << qPrintable(group.value("remoteUids").toString()) << std::endl;
+    }
+
+    std::cout << "Queries, slowest first:" << std::endl;
+    foreach (const QJsonValue &value, stats.value("queries").toArray()) {
+        QJsonObject timing = value.toObject();
+        std::cout << "  " << qPrintable(timing.value("name").toString()) << ": "
+                  << timing.value("usec").toVariant().toLongLong() << " usec, "
+                  << timing.value("rows").toVariant().toLongLong() << " rows" << std::endl;
+        if (timing.contains("error"))
+            std::cout << "    error: " << qPrintable(timing.value("error").toString()) << std::endl;
+        foreach (const QJsonValue &step, timing.value("plan").toArray())
+            std::cout << "    " << qPrintable(step.toString()) << std::endl;
+    }
+
+    QJsonObject orphans = stats.value("orphans").toObject();
+    std::cout << "Orphans:" << std::endl;
+    std::cout << "  message parts: " << orphans.value("messageParts").toVariant().toLongLong()
+              << " (" << orphans.value("messagePartBytes").toVariant().toLongLong() << " bytes)" << std::endl;
+    std::cout << "  data directories: " << orphans.value("dataDirectories").toVariant().toLongLong()
+              << " (" << orphans.value("dataDirectoryBytes").toVariant().toLongLong() << " bytes)" << std::endl;
+}
+
+int doStats(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+
+    // The database is only read, it is neither created nor upgraded
+    QString databaseFile = QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::databaseFile());
+    if (!QFile::exists(databaseFile)) {
+        qCritical() << "No database at" << databaseFile;
+        return -1;
+    }
+
+    int result = 0;
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), QLatin1String("commhistory-tool-stats"));
+        database.setDatabaseName(databaseFile);
+        database.setConnectOptions(QLatin1String("QSQLITE_OPEN_READONLY"));
+        if (!database.open()) {
+            qCritical() << "Unable to open database" << databaseFile << database.lastError();
+            result = -1;
+        } else {
+            QJsonObject stats = collectStats(database, databaseFile);
+            if (options.contains("--json"))
+                std::cout << QJsonDocument(stats).toJson().constData();
+            else
+                printStats(stats);
+            database.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(QLatin1String("commhistory-tool-stats"));
+
+    return result;
+}
+
 int main(int argc, char **argv)
 {
 #ifndef QT_NO_EXCEPTIONS
@@ -1336,7 +2109,8 @@ int main(int argc, char **argv)
 #endif
         QCoreApplication app(argc, argv);
 
-        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text" << "-relativeDate";
+        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text" << "-relativeDate"
+                             << "-format" << "-batch";
 
         QStringList args = app.arguments();
         QVariantMap options = parseOptions(args);
@@ -1393,6 +2167,8 @@ int main(int argc, char **argv)
             return doImport(args, options);
         } else if (args.at(1) == "import-json" && args.count() >= 3) {
             return doJsonImport(args, options);
+        } else if (args.at(1) == "stats") {
+            return doStats(args, options);
         } else {
             printUsage();
         }
@@ -27,7 +27,7 @@ VERSION = $$PROJECT_VERSION
 TARGET = commhistory-tool
 
 QT -= gui
-QT += dbus contacts
+QT += dbus contacts sql
 CONFIG += debug \
     pkgconfig
 